@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgsched.h"
+#include "imgscale.h"
+#include "imgwarp.h"
+
+// defaults, all overridable from the command line
+#define BENCH_DEFAULT_SIZES "256,1024,4096"
+#define BENCH_DEFAULT_CONTENTS "random,flat,binary"
+#define BENCH_DEFAULT_REPS 5
+#define BENCH_DEFAULT_WARMUP 1
+#define BENCH_DEFAULT_MAX_SECONDS 1.0
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_MAX_REPS 1000
+
+
+/**
+ * @brief images a benchmark case works on
+ *
+ * @member src: the generated image, never modified
+ * @member work: copy of `src` that in place ops run on, restored before every repetition
+ * @member dest: output of out of place ops, same size as `src`
+ * @member readimg: what the read benchmarks read into
+ * @member path: file written from `src`, that the read and write benchmarks use
+ */
+struct _bench_ctx_type_struct {
+    IMAGE src;
+    IMAGE work;
+    IMAGE dest;
+    IMAGE readimg;
+    char path[256];
+};
+typedef struct _bench_ctx_type_struct BENCHCTX;
+
+/**
+ * @brief a single timed function
+ *
+ * @member op: name of the public function being timed
+ * @member params: how it's called (kernel, range, thresholds...)
+ * @member type: type of image it runs on
+ * @member reset: run before every repetition, not timed (can be NULL)
+ * @member run: the timed call
+ */
+struct _bench_case_type_struct {
+    char* op;
+    char* params;
+    IMGTYPE type;
+    void (*reset)(BENCHCTX* ctx);
+    void (*run)(BENCHCTX* ctx);
+};
+typedef struct _bench_case_type_struct BENCHCASE;
+
+
+static void _reset_work(BENCHCTX* ctx) {
+    copy_pxmat(ctx->work.mat, ctx->src.mat, ctx->src.width, ctx->src.height);
+}
+
+static void _reset_read(BENCHCTX* ctx) {
+    free_pxmat(ctx->readimg.mat, ctx->readimg.height);
+    ctx->readimg.mat = NULL;
+}
+
+static void _run_read_pgm(BENCHCTX* ctx) { read_pgm_image(ctx->path, &ctx->readimg); }
+static void _run_read_ppm(BENCHCTX* ctx) { read_ppm_image(ctx->path, &ctx->readimg); }
+static void _run_write_pgm(BENCHCTX* ctx) { write_pgm2pgm(ctx->path, &ctx->src); }
+static void _run_write_ppm(BENCHCTX* ctx) { write_ppm2ppm(ctx->path, &ctx->src); }
+
+static void _run_rgb2ycbcr(BENCHCTX* ctx) { convert_channel_img(&ctx->dest, &ctx->src, RGB2YCBCR); }
+static void _run_ycbcr2rgb(BENCHCTX* ctx) { convert_channel_img(&ctx->dest, &ctx->src, YCBCR2RGB); }
+static void _run_rgb2gray(BENCHCTX* ctx) { convert_channel_img(&ctx->dest, &ctx->src, RGB2GRAY); }
+static void _run_rgb2yuv(BENCHCTX* ctx) { convert_channel_img(&ctx->dest, &ctx->src, RGB2YUV); }
+
+static void _run_blur_gcross(BENCHCTX* ctx) { apply_blur2img(&blur_gpx_cross, &ctx->dest, &ctx->src, 1); }
+static void _run_blur_gsquare(BENCHCTX* ctx) { apply_blur2img(&blur_gpx_square, &ctx->dest, &ctx->src, 1); }
+static void _run_blur_gsquare3(BENCHCTX* ctx) { apply_blur2img(&blur_gpx_square, &ctx->dest, &ctx->src, 3); }
+static void _run_blur_rgbcross(BENCHCTX* ctx) { apply_blur2img(&blur_rgbpx_cross, &ctx->dest, &ctx->src, 1); }
+static void _run_blur_rgbsquare(BENCHCTX* ctx) { apply_blur2img(&blur_rgbpx_square, &ctx->dest, &ctx->src, 1); }
+
+static void _run_erode(BENCHCTX* ctx) { erode_img(&ctx->dest, &ctx->src, 1); }
+static void _run_dilate(BENCHCTX* ctx) { dilate_img(&ctx->dest, &ctx->src, 1); }
+static void _run_erode3(BENCHCTX* ctx) { erode_img(&ctx->dest, &ctx->src, 3); }
+static void _run_grad(BENCHCTX* ctx) { grad_gimg(&ctx->dest, &ctx->src); }
+
+static void _run_bin_gthresh(BENCHCTX* ctx) { bin_gthresh_img(&ctx->work, 128, 0, 255); }
+static void _run_bin_rgbthresh(BENCHCTX* ctx) { bin_rgbthresh_img(&ctx->work, 128, 128, 128, 0, 255); }
+static void _run_tri_gthresh(BENCHCTX* ctx) { tri_gthresh_img(&ctx->work, 85, 170); }
+static void _run_hysteresis(BENCHCTX* ctx) { hysteresis_gthresh_img(&ctx->work, 60, 180); }
+static void _run_invert(BENCHCTX* ctx) { invert_gimg(&ctx->work); }
+static void _run_add(BENCHCTX* ctx) { add_gimg(&ctx->work, 20); }
+
+static void _run_histogram_g(BENCHCTX* ctx) {
+    int hist[256];
+    histogram_gimg(&ctx->src, hist);
+}
+
+static void _run_histogram_rgb(BENCHCTX* ctx) {
+    int hist[256][3];
+    histogram_rgbimg(&ctx->src, hist);
+}
+
+static void _run_profile(BENCHCTX* ctx) {
+    int profile[256];
+    profile_gimg(&ctx->src, 0, ctx->src.width/2, profile);
+}
+
+// the resizes write to the top left corner of `dest`
+static void _run_downscale(BENCHCTX* ctx, int factor) {
+    IMAGE small = ctx->dest;
+    small.width = downscaled_size(ctx->src.width, factor);
+    small.height = downscaled_size(ctx->src.height, factor);
+    downscale_img(&small, &ctx->src, factor);
+}
+
+static void _run_resample(BENCHCTX* ctx, RESAMPLETYPE filter) {
+    IMAGE small = ctx->dest;
+    small.width = ctx->src.width*2/3;
+    small.height = ctx->src.height*2/3;
+    resample_img(&small, &ctx->src, filter);
+}
+
+static void _run_downscale2(BENCHCTX* ctx) { _run_downscale(ctx, 2); }
+static void _run_downscale4(BENCHCTX* ctx) { _run_downscale(ctx, 4); }
+static void _run_bilinear(BENCHCTX* ctx) { _run_resample(ctx, BILINEAR); }
+static void _run_lanczos3(BENCHCTX* ctx) { _run_resample(ctx, LANCZOS3); }
+
+static void _run_pyramid(BENCHCTX* ctx) {
+    PYRAMID pyr;
+    if (pyramid_build(&pyr, &ctx->src, 5) == 0) {
+        free_pyramid(&pyr);
+    }
+}
+
+static void _run_warp(BENCHCTX* ctx) {
+    // 10 degrees around the center, scaled by 0.9
+    double a = 0.9*0.98481, b = 0.9*0.17365;
+    double cx = ctx->src.width/2.0, cy = ctx->src.height/2.0;
+    double m[9] = {a, -b, cx - a*cx + b*cy, b, a, cy - b*cx - a*cy, 0, 0, 1};
+    PIXEL border = {0};
+    warp_img(&ctx->dest, &ctx->src, m, BORDER_CONSTANT, border);
+}
+
+static BENCHCASE _cases[] = {
+    {"read_pgm_image",        "",                    PGM, _reset_read, _run_read_pgm},
+    {"read_ppm_image",        "",                    PPM, _reset_read, _run_read_ppm},
+    {"write_pgm2pgm",         "",                    PGM, NULL,        _run_write_pgm},
+    {"write_ppm2ppm",         "",                    PPM, NULL,        _run_write_ppm},
+    {"convert_channel_img",   "RGB2YCBCR",           PPM, NULL,        _run_rgb2ycbcr},
+    {"convert_channel_img",   "YCBCR2RGB",           PPM, NULL,        _run_ycbcr2rgb},
+    {"convert_channel_img",   "RGB2GRAY",            PPM, NULL,        _run_rgb2gray},
+    {"convert_channel_img",   "RGB2YUV",             PPM, NULL,        _run_rgb2yuv},
+    {"apply_blur2img",        "blur_gpx_cross,1",    PGM, NULL,        _run_blur_gcross},
+    {"apply_blur2img",        "blur_gpx_square,1",   PGM, NULL,        _run_blur_gsquare},
+    {"apply_blur2img",        "blur_gpx_square,3",   PGM, NULL,        _run_blur_gsquare3},
+    {"apply_blur2img",        "blur_rgbpx_cross,1",  PPM, NULL,        _run_blur_rgbcross},
+    {"apply_blur2img",        "blur_rgbpx_square,1", PPM, NULL,        _run_blur_rgbsquare},
+    {"erode_img",             "1",                   PGM, NULL,        _run_erode},
+    {"erode_img",             "3",                   PGM, NULL,        _run_erode3},
+    {"dilate_img",            "1",                   PGM, NULL,        _run_dilate},
+    {"grad_gimg",             "",                    PGM, NULL,        _run_grad},
+    {"bin_gthresh_img",       "128",                 PGM, _reset_work, _run_bin_gthresh},
+    {"bin_rgbthresh_img",     "128,128,128",         PPM, _reset_work, _run_bin_rgbthresh},
+    {"tri_gthresh_img",       "85,170",              PGM, _reset_work, _run_tri_gthresh},
+    {"hysteresis_gthresh_img","60,180",              PGM, _reset_work, _run_hysteresis},
+    {"invert_gimg",           "",                    PGM, _reset_work, _run_invert},
+    {"add_gimg",              "20",                  PGM, _reset_work, _run_add},
+    {"histogram_gimg",        "",                    PGM, NULL,        _run_histogram_g},
+    {"histogram_rgbimg",      "",                    PPM, NULL,        _run_histogram_rgb},
+    {"profile_gimg",          "column",              PGM, NULL,        _run_profile},
+    {"downscale_img",         "2",                   PGM, NULL,        _run_downscale2},
+    {"downscale_img",         "4",                   PPM, NULL,        _run_downscale4},
+    {"resample_img",          "BILINEAR,2/3",        PPM, NULL,        _run_bilinear},
+    {"resample_img",          "LANCZOS3,2/3",        PPM, NULL,        _run_lanczos3},
+    {"pyramid_build",         "5",                   PGM, NULL,        _run_pyramid},
+    {"warp_img",              "rotate 10,0.9",       PGM, NULL,        _run_warp},
+    {"warp_img",              "rotate 10,0.9",       PPM, NULL,        _run_warp},
+};
+
+
+/**
+ * @brief fills an image with synthetic content, the same for a given seed
+ *
+ * @param content "random" (uniform noise), "flat" (a single value) or "binary" (noise of 0s and 255s)
+ * @return int `0` if success, `-1` if the content is unknown
+ */
+int fill_image(IMAGE* img, char* content, unsigned int seed) {
+
+    int kind;
+    if (strcmp(content, "random") == 0) kind = 0;
+    else if (strcmp(content, "flat") == 0) kind = 1;
+    else if (strcmp(content, "binary") == 0) kind = 2;
+    else return -1;
+
+    // xorshift32, rand() would be both slower and different between libcs
+    unsigned int x = seed ? seed : 1;
+
+    for (int r = 0; r < img->height; r++) {
+        BYTE* row = &img->mat[r][0].cpx.r;
+        for (int i = 0; i < img->width*3; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+
+            if (kind == 0) row[i] = x >> 24;
+            else if (kind == 1) row[i] = 128;
+            else row[i] = (x >> 31) ? 255 : 0;
+        }
+    }
+
+    return 0;
+}
+
+long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+int cmp_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief percentile of sorted samples, linearly interpolated between the closest ranks
+ */
+double percentile(long long* sorted, int n, double p) {
+
+    double rank = p/100.0 * (n-1);
+    int lo = (int)rank;
+    int hi = (lo+1 < n) ? lo+1 : lo;
+    double frac = rank - lo;
+
+    return sorted[lo] + (sorted[hi] - sorted[lo])*frac;
+}
+
+/**
+ * @brief splits a comma separated list in place
+ *
+ * @return int amount of items
+ */
+int split_list(char* list, char** items, int maxitems) {
+
+    int n = 0;
+    for (char* tok = strtok(list, ","); tok != NULL && n < maxitems; tok = strtok(NULL, ",")) {
+        items[n++] = tok;
+    }
+    return n;
+}
+
+/**
+ * @brief allocates `img` as a `size`x`size` image of type `type`
+ *
+ * @return int `0` if success, `-1` if allocation failed
+ */
+int alloc_image(IMAGE* img, int size, IMGTYPE type) {
+
+    img->width = size;
+    img->height = size;
+    img->img_type = type;
+    img->mat = pxrealloc(img->mat, size, size);
+
+    return img->mat == NULL ? -1 : 0;
+}
+
+void print_usage(char* name) {
+    printf("Expected usage: %s [options]\n", name);
+    printf("  --sizes <n,n,...>      side of the square images (default %s, up to 16384)\n", BENCH_DEFAULT_SIZES);
+    printf("  --contents <c,c,...>   random, flat and/or binary (default %s)\n", BENCH_DEFAULT_CONTENTS);
+    printf("  --reps <n>             timed repetitions of each case (default %d)\n", BENCH_DEFAULT_REPS);
+    printf("  --warmup <n>           untimed repetitions before those (default %d)\n", BENCH_DEFAULT_WARMUP);
+    printf("  --max-seconds <s>      stop repeating a case once its timed repetitions took this long (default %.1f)\n", BENCH_DEFAULT_MAX_SECONDS);
+    printf("  --filter <text>        only run the functions whose name contains <text>\n");
+    printf("  --out <file.json>      where to write the results (default: stdout)\n");
+    printf("  --tmpdir <dir>         where the read/write benchmarks put their files (default /tmp)\n");
+}
+
+
+int main(int argc, char* argv[]) {
+
+    char sizes_arg[256] = BENCH_DEFAULT_SIZES;
+    char contents_arg[256] = BENCH_DEFAULT_CONTENTS;
+    int reps = BENCH_DEFAULT_REPS;
+    int warmup = BENCH_DEFAULT_WARMUP;
+    double max_seconds = BENCH_DEFAULT_MAX_SECONDS;
+    char* filter = NULL;
+    char* outpath = NULL;
+    char* tmpdir = "/tmp";
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = (i+1 < argc);
+
+        if (strcmp(argv[i], "--sizes") == 0 && has_value) {
+            snprintf(sizes_arg, sizeof(sizes_arg), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--contents") == 0 && has_value) {
+            snprintf(contents_arg, sizeof(contents_arg), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && has_value) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-seconds") == 0 && has_value) {
+            max_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            outpath = argv[++i];
+        } else if (strcmp(argv[i], "--tmpdir") == 0 && has_value) {
+            tmpdir = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (reps < 1 || reps > BENCH_MAX_REPS || warmup < 0) {
+        printf("Expected 1 to %d repetitions and a positive warmup\n", BENCH_MAX_REPS);
+        exit(EXIT_FAILURE);
+    }
+
+    char* sizes_list[BENCH_MAX_SIZES];
+    char* contents[BENCH_MAX_SIZES];
+    int nsizes = split_list(sizes_arg, sizes_list, BENCH_MAX_SIZES);
+    int ncontents = split_list(contents_arg, contents, BENCH_MAX_SIZES);
+
+    FILE* out = stdout;
+    if (outpath != NULL) {
+        out = fopen(outpath, "w");
+        if (out == NULL) {
+            printf("Error opening %s for writing\n", outpath);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    SCHEDULER* sched = sched_default();
+    BENCHCTX ctx = {0};
+    long long samples[BENCH_MAX_REPS];
+    int first = 1;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"threads\": %d,\n", sched != NULL ? sched->nthreads : 1);
+    fprintf(out, "  \"reps\": %d,\n", reps);
+    fprintf(out, "  \"warmup\": %d,\n", warmup);
+    fprintf(out, "  \"max_seconds\": %.2f,\n", max_seconds);
+    fprintf(out, "  \"results\": [");
+
+    for (int s = 0; s < nsizes; s++) {
+        int size = atoi(sizes_list[s]);
+        if (size <= 0) continue;
+
+        for (int ci = 0; ci < ncontents; ci++) {
+            for (IMGTYPE type = PGM; type <= PPM; type++) {
+
+                if (alloc_image(&ctx.src, size, type) != 0
+                    || alloc_image(&ctx.work, size, type) != 0
+                    || alloc_image(&ctx.dest, size, type) != 0) {
+                    fprintf(stderr, "skipping %dx%d P%d: not enough memory\n", size, size, type);
+                    continue;
+                }
+                if (fill_image(&ctx.src, contents[ci], size) != 0) {
+                    fprintf(stderr, "unknown content %s\n", contents[ci]);
+                    break;
+                }
+                copy_pxmat(ctx.work.mat, ctx.src.mat, size, size);
+
+                // the read benchmarks read back what the write benchmarks write
+                snprintf(ctx.path, sizeof(ctx.path), "%s/bench_%d.p%cm", tmpdir, (int)getpid(), type == PGM ? 'g' : 'p');
+                if (save_pnm_image(ctx.path, &ctx.src, type) != 0) {
+                    fprintf(stderr, "Error writing %s\n", ctx.path);
+                    exit(EXIT_FAILURE);
+                }
+
+                for (int i = 0; i < sizeof(_cases)/sizeof(BENCHCASE); i++) {
+                    BENCHCASE* bc = &_cases[i];
+                    if (bc->type != type) continue;
+                    if (filter != NULL && strstr(bc->op, filter) == NULL) continue;
+
+                    fprintf(stderr, "%s(%s) %dx%d %s\n", bc->op, bc->params, size, size, contents[ci]);
+
+                    // big images of slow ops get fewer repetitions, so the whole run stays bounded
+                    int nsamples = 0;
+                    long long total = 0;
+                    for (int rep = 0; rep < warmup + reps; rep++) {
+                        if (bc->reset != NULL) bc->reset(&ctx);
+
+                        long long t0 = now_ns();
+                        bc->run(&ctx);
+                        long long t1 = now_ns();
+
+                        if (rep < warmup) continue;
+                        samples[nsamples++] = t1 - t0;
+                        total += t1 - t0;
+                        if (total > max_seconds*1e9) break;
+                    }
+                    _reset_read(&ctx);
+
+                    qsort(samples, nsamples, sizeof(long long), cmp_ll);
+                    double median = percentile(samples, nsamples, 50);
+
+                    fprintf(out, "%s\n    {", first ? "" : ",");
+                    fprintf(out, "\"op\": \"%s\", \"params\": \"%s\", ", bc->op, bc->params);
+                    fprintf(out, "\"type\": \"P%d\", \"size\": %d, \"content\": \"%s\", \"reps\": %d, ", type, size, contents[ci], nsamples);
+                    fprintf(out, "\"median_ns\": %.0f, \"p10_ns\": %.0f, \"p90_ns\": %.0f, ",
+                        median, percentile(samples, nsamples, 10), percentile(samples, nsamples, 90));
+                    fprintf(out, "\"min_ns\": %lld, \"max_ns\": %lld, ", samples[0], samples[nsamples-1]);
+                    fprintf(out, "\"mpx_per_s\": %.2f}", median > 0 ? (double)size*size / median * 1000.0 : 0.0);
+                    first = 0;
+                }
+
+                remove(ctx.path);
+            }
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout) fclose(out);
+
+    free_pxmat(ctx.src.mat, ctx.src.height);
+    free_pxmat(ctx.work.mat, ctx.work.height);
+    free_pxmat(ctx.dest.mat, ctx.dest.height);
+
+    return 0;
+}
@@ -9,49 +9,43 @@ int main(int argc, char* argv[]) {
 
     if (argc != 5) {
         printf("Expected usage: %s <Y_image.pgm> <Cb_image.pgm> <Cr_image.pgm> <out_filepath>\n", argv[0]);
+        printf("Cb and Cr can be full size, or subsampled 4:2:2 or 4:2:0 (see sepYCrCb)\n");
         exit(1);
     }
 
-    IMAGE outimg;
-
-    IMAGE Yimg;
-    IMAGE Cbimg;
-    IMAGE Crimg;
-    printf("Reading images... \n");
-    read_pgm_image(argv[1], &Yimg);
-    read_pgm_image(argv[2], &Cbimg);
-    read_pgm_image(argv[3], &Crimg);
-
-    outimg = Yimg;
-    outimg.img_type = PPM;
-    outimg.mat = pxalloc(outimg.width, outimg.height);
-    if (outimg.mat == NULL) {
-        printf("Error allocating memory for output image\n");
+    ROWREADER readers[3];
+    for (int i = 0; i < 3; i++) {
+        if (open_row_reader(argv[1 + i], &readers[i], PGM) != 0) {
+            printf("Error opening %s\n", argv[1 + i]);
+            exit(1);
+        }
+    }
+
+    ROWWRITER writer;
+    if (open_row_writer(argv[4], &writer, readers[0].width, readers[0].height, PPM) != 0) {
+        printf("Error creating %s\n", argv[4]);
         exit(1);
     }
 
+    // the 3 files are read row by row together, and each row converted and written right away
     printf("Merging all 3 components... ");
-    for (int r = 0; r < outimg.height; r++) {
-        for (int c = 0; c < outimg.width; c++) {
-            RGBPIXEL* px = get_rgbpixel(r, c, &outimg);
-            px->r = get_gpixel(r, c, &Yimg)->v;
-            px->g = get_gpixel(r, c, &Cbimg)->v;
-            px->b = get_gpixel(r, c, &Crimg)->v;
-        }
+    int res = stream_merge_ycbcr(&readers[0], &readers[1], &readers[2], &writer);
+    for (int i = 0; i < 3; i++) {
+        close_row_reader(&readers[i]);
+    }
+    if (close_row_writer(&writer) != 0 && res == 0) {
+        res = -2;
     }
-    convert_channel_img(&outimg, &outimg, YCBCR2RGB);
-    printf("DONE\n");
-
 
-    printf("Writing image... ");
-    write_ppm2ppm(argv[4], &outimg);
+    if (res == -1) {
+        printf("\nCb and Cr must be of the same size, the size of Y or a subsampled one\n");
+        exit(1);
+    } else if (res != 0) {
+        printf("\nError merging the images (%d)\n", res);
+        exit(1);
+    }
     printf("DONE\n");
 
-    free_img_pxmat(&outimg);
-    free_img_pxmat(&Yimg);
-    free_img_pxmat(&Cbimg);
-    free_img_pxmat(&Crimg);
-
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+#include <stdatomic.h>
+#include "imgio.h"
+#include "imgsched.h"
+#include "imgtools.h"
+
+
+// everything the runners share
+struct _batch_type_struct {
+    TOOL* tool;
+    char** args;
+    char* outpattern;
+
+    char** inputs;
+    char** outpaths;
+    int n_inputs;
+
+    atomic_int next;
+    atomic_int n_failed;
+};
+typedef struct _batch_type_struct BATCH;
+
+
+/**
+ * @brief builds the output path of an input by replacing the first `%s` of `pattern` with the input's file name
+ * @brief (without its directory nor extension). `pattern` must hold a `%s`
+ */
+char* make_outpath(char* pattern, char* inpath) {
+
+    char* name = strrchr(inpath, '/');
+    name = (name == NULL) ? inpath : name+1;
+
+    int namelen = strlen(name);
+    char* ext = strrchr(name, '.');
+    if (ext != NULL && ext != name) {
+        namelen = ext - name;
+    }
+
+    char* outpath = (char*)malloc(strlen(pattern) + namelen + 1);
+    if (outpath == NULL) {
+        return NULL;
+    }
+
+    char* subst = strstr(pattern, "%s");
+    int prefixlen = subst - pattern;
+    memcpy(outpath, pattern, prefixlen);
+    memcpy(outpath + prefixlen, name, namelen);
+    strcpy(outpath + prefixlen + namelen, subst + 2);
+
+    return outpath;
+}
+
+static int _cmp_outpaths(const void* a, const void* b) {
+    return strcmp(**(char***)a, **(char***)b);
+}
+
+/**
+ * @brief builds the output path of every input, and makes sure no two inputs get the same one
+ * @brief (inputs with the same file name in different directories would overwrite each other's output)
+ *
+ * @return int `0` if success, `-1` otherwise (the error has already been printed)
+ */
+int make_outpaths(BATCH* batch) {
+
+    if (batch->n_inputs == 0) {
+        return 0;
+    }
+
+    batch->outpaths = (char**)calloc(batch->n_inputs, sizeof(char*));
+    char*** sorted = (char***)malloc(sizeof(char**)*batch->n_inputs);
+    if (batch->outpaths == NULL || sorted == NULL) {
+        printf("Error allocating output paths\n");
+        free(sorted);
+        return -1;
+    }
+
+    for (int i = 0; i < batch->n_inputs; i++) {
+        batch->outpaths[i] = make_outpath(batch->outpattern, batch->inputs[i]);
+        if (batch->outpaths[i] == NULL) {
+            printf("Error allocating output path for %s\n", batch->inputs[i]);
+            free(sorted);
+            return -1;
+        }
+        sorted[i] = &batch->outpaths[i];
+    }
+
+    // duplicates end up next to each other, and their place in `outpaths` gives back their inputs
+    qsort(sorted, batch->n_inputs, sizeof(char**), _cmp_outpaths);
+    int res = 0;
+    for (int i = 1; i < batch->n_inputs && res == 0; i++) {
+        if (strcmp(*sorted[i-1], *sorted[i]) == 0) {
+            printf("Error: %s and %s would both be written to %s\n",
+                   batch->inputs[sorted[i-1] - batch->outpaths], batch->inputs[sorted[i] - batch->outpaths], *sorted[i]);
+            res = -1;
+        }
+    }
+
+    free(sorted);
+
+    return res;
+}
+
+/**
+ * @brief reads a manifest file (one input path per line) into a list of paths
+ *
+ * @return int amount of paths read | -1 if the manifest couldn't be read
+ */
+int read_manifest(char* filename, char*** paths) {
+
+    FILE* fd = fopen(filename, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+
+    int n = 0;
+    int capacity = 0;
+    *paths = NULL;
+
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &linecap, fd)) != -1) {
+
+        // strip the line ending (\n or \r\n)
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+        if (len == 0) continue;
+
+        if (n == capacity) {
+            capacity = capacity > 0 ? capacity*2 : 1024;
+            char** newpaths = (char**)realloc(*paths, sizeof(char*)*capacity);
+            if (newpaths == NULL) {
+                n = -1;
+                break;
+            }
+            *paths = newpaths;
+        }
+
+        (*paths)[n++] = strdup(line);
+    }
+
+    free(line);
+    fclose(fd);
+
+    return n;
+}
+
+/**
+ * @brief processes a single input with the buffers of the runner calling it. Output images are handed to the runner's
+ * @brief writer, so they get written while the next input is read and processed
+ *
+ * @return int `0` if success, `-1` otherwise (the error has already been printed)
+ */
+int process_one(BATCH* batch, int i, ASYNCWRITER* writer) {
+
+    char* inpath = batch->inputs[i];
+    TOOL* tool = batch->tool;
+
+    IMAGE* inimg = async_acquire(writer);
+    int res = load_pnm_image(inpath, inimg, tool->intype);
+    if (res != 0) {
+        if (res == -2 && inimg->img_type != tool->intype) {
+            printf("Error: %s is a P%d, %s expects a P%d\n", inpath, inimg->img_type, tool->name, tool->intype);
+        } else {
+            printf("Error reading %s (%d)\n", inpath, res);
+        }
+        async_release(writer, inimg);
+        return -1;
+    }
+
+    char* outpath = batch->outpaths[i];
+
+    int ok = 0;
+    if (tool->report != NULL) {
+
+        FILE* out = fopen(outpath, "w");
+        if (out == NULL) {
+            printf("Error opening %s for writing\n", outpath);
+        } else {
+            ok = (run_tool(tool, NULL, inimg, batch->args, out) != NULL);
+            if (fclose(out) != 0) ok = 0;
+            if (!ok) printf("Error running %s on %s\n", tool->name, inpath);
+        }
+        async_release(writer, inimg);
+
+    } else {
+
+        IMAGE* outimg = async_acquire(writer);
+        IMAGE* resimg = run_tool(tool, outimg, inimg, batch->args, NULL);
+        if (resimg == NULL) {
+            printf("Error running %s on %s\n", tool->name, inpath);
+        } else if (async_write(writer, resimg, outpath, tool->outtype) != 0) {
+            printf("Error writing %s\n", outpath);
+            // it never got to the writer thread, so nobody else will put it back in the pool
+            async_release(writer, resimg);
+        } else {
+            ok = 1;
+        }
+
+        // whichever of the two buffers isn't being written is free again
+        if (resimg != inimg) async_release(writer, inimg);
+        if (resimg != outimg) async_release(writer, outimg);
+    }
+
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief task run by every thread: takes the next input until there are none left.
+ * @brief The input/output buffers come from a pool of the runner's writer, and are kept from one image to the next
+ * @brief so they only get reallocated for bigger images.
+ */
+void batch_runner(void* arg) {
+
+    BATCH* batch = arg;
+
+    // the input and output of the image being processed, plus the output of the previous one being written
+    ASYNCWRITER writer;
+    if (async_writer_init(&writer, ASYNC_WRITER_BUFFERS + 1) != 0) {
+        printf("Error starting an image writer\n");
+        return;
+    }
+
+    int i;
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->n_inputs) {
+        if (process_one(batch, i, &writer) != 0) {
+            atomic_fetch_add(&batch->n_failed, 1);
+        }
+    }
+
+    if (async_writer_close(&writer) != 0) {
+        printf("Error writing %d output images\n", writer.failed);
+        atomic_fetch_add(&batch->n_failed, writer.failed);
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 4) {
+        printf("Expected usage: %s <tool> <in_glob|@manifest> <out_pattern> [tool args...]\n", argv[0]);
+        printf("The first %%s of <out_pattern> is replaced by each input's file name without extension, ex: out/%%s_blur.pgm\n");
+        printf("Available tools:\n");
+        print_tools(stdout);
+        exit(EXIT_FAILURE);
+    }
+
+    BATCH batch = {0};
+    batch.tool = get_tool(argv[1]);
+    if (batch.tool == NULL) {
+        printf("Unknown tool %s. Available tools:\n", argv[1]);
+        print_tools(stdout);
+        exit(EXIT_FAILURE);
+    }
+    if (argc - 4 != batch.tool->nargs) {
+        printf("Expected usage: %s %s <in_glob|@manifest> <out_pattern> %s\n", argv[0], batch.tool->name, batch.tool->args_usage);
+        exit(EXIT_FAILURE);
+    }
+    batch.args = &argv[4];
+    batch.outpattern = argv[3];
+    // without a `%s`, every input would be written to the same file
+    if (strstr(batch.outpattern, "%s") == NULL) {
+        printf("Error: %s has no %%s to put each input's file name in\n", batch.outpattern);
+        exit(EXIT_FAILURE);
+    }
+
+    glob_t globbuf = {0};
+    if (argv[2][0] == '@') {
+        batch.n_inputs = read_manifest(&argv[2][1], &batch.inputs);
+        if (batch.n_inputs < 0) {
+            printf("Error reading manifest %s\n", &argv[2][1]);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        if (glob(argv[2], 0, NULL, &globbuf) != 0) {
+            printf("No file matches %s\n", argv[2]);
+            exit(EXIT_FAILURE);
+        }
+        batch.inputs = globbuf.gl_pathv;
+        batch.n_inputs = globbuf.gl_pathc;
+    }
+
+    // nothing gets written when two inputs would overwrite each other
+    if (make_outpaths(&batch) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_init(&batch.next, 0);
+    atomic_init(&batch.n_failed, 0);
+
+    // one runner per thread. Images are handed out one at a time, so small ones run one per thread,
+    // and once there aren't any left, idle threads steal the tiles of the big ones still running
+    SCHEDULER* sched = sched_default();
+    if (sched == NULL) {
+        batch_runner(&batch);
+    } else {
+        TASKGROUP group;
+        sched_group_init(&group);
+        for (int t = 0; t < sched->nthreads; t++) {
+            sched_submit(sched, &group, batch_runner, &batch);
+        }
+        sched_wait(sched, &group);
+    }
+
+    // inputs no runner got to (none of them could start its writer) count as failed
+    int next = atomic_load(&batch.next);
+    if (next < batch.n_inputs) {
+        atomic_fetch_add(&batch.n_failed, batch.n_inputs - next);
+    }
+
+    int n_failed = atomic_load(&batch.n_failed);
+    printf("Processed %d/%d images with %s\n", batch.n_inputs - n_failed, batch.n_inputs, batch.tool->name);
+
+    if (batch.outpaths != NULL) {
+        for (int i = 0; i < batch.n_inputs; i++) free(batch.outpaths[i]);
+        free(batch.outpaths);
+    }
+
+    if (argv[2][0] == '@') {
+        for (int i = 0; i < batch.n_inputs; i++) free(batch.inputs[i]);
+        free(batch.inputs);
+    } else {
+        globfree(&globbuf);
+    }
+
+    return n_failed > 0 ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imggraph.h"
+
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 6) {
+        printf("Expected usage: %s <in_image.pgm> <out_image.pgm> <blur_range> <threshvalue> <close_radius>\n", argv[0]);
+        exit(1);
+    }
+
+    unsigned int range = 0, radius = 0;
+    int thresh = 0;
+    sscanf(argv[3], "%u", &range);
+    sscanf(argv[4], "%d", &thresh);
+    sscanf(argv[5], "%u", &radius);
+
+    IMAGE srcimg;
+    read_pgm_image(argv[1], &srcimg);
+
+    // blur -> gradient -> threshold -> closing, evaluated tile by tile so none of the steps is ever held whole
+    GRAPH graph;
+    graph_init(&graph);
+
+    GRAPHNODE* node = graph_source(&graph, &srcimg);
+    if (node != NULL) node = graph_blur(&graph, node, blur_gpx_square, range);
+    if (node != NULL) node = graph_gradient(&graph, node);
+    if (node != NULL) node = graph_thresh(&graph, node, thresh);
+    if (node != NULL) node = graph_dilate(&graph, node, radius);
+    if (node != NULL) node = graph_erode(&graph, node, radius);
+
+    IMAGE destimg = srcimg;
+    destimg.mat = pxalloc(destimg.width, destimg.height);
+
+    if (node == NULL || destimg.mat == NULL) {
+        printf("Error allocating memory for the op graph !\n");
+        free_graph(&graph);
+        free_img_pxmat(&srcimg);
+        exit(1);
+    }
+
+    if (graph_eval(&graph, node, &destimg) != 0) {
+        printf("Error evaluating the op graph !\n");
+        free_graph(&graph);
+        free_img_pxmat(&destimg);
+        free_img_pxmat(&srcimg);
+        exit(1);
+    }
+
+    write_pgm2pgm(argv[2], &destimg);
+
+    free_graph(&graph);
+    free_img_pxmat(&destimg);
+    free_img_pxmat(&srcimg);
+
+    return 0;
+}
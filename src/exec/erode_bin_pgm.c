@@ -19,11 +19,7 @@ int main(int argc, char* argv[]) {
     IMAGE destimg;
     copy_img(&destimg, &srcimg);
 
-    for (int r = 0; r < srcimg.height; r++) {
-        for (int c = 0; c < srcimg.width; c++) {
-            erode_px(r, c, &destimg, &srcimg, 1);
-        }
-    }
+    erode_img(&destimg, &srcimg, 1);
 
     free_pxmat(srcimg.mat, srcimg.height);
 
@@ -24,49 +24,8 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
 
-    int blur_range = 1;
-
-    for (int r = 0; r < inimg.height; r++) {
-        for (int c = 0; c < inimg.width; c++) {
-            int n = 0;
-            int sum = 0;
-
-            // usedfor getting the 4 surrounding pixels in a + cross
-
-            // get horizontal of cross
-            for (int cc = c-blur_range; cc <= c+blur_range; cc++) {
-                GPIXEL* px = get_gpixel(r, cc, &inimg);
-                if (px != NULL) {
-                    n++;
-                    sum += px->v;
-                }
-            }
-            // get vertical of cross
-            for (int rr = r-blur_range; rr <= r+blur_range; rr++) {
-                GPIXEL* px = get_gpixel(rr, c, &inimg);
-                if (px != NULL) {
-                    n++;
-                    sum += px->v;
-                }
-            }
-
-            // place the average of the surrounding pixels in the resulting image
-            GPIXEL* destpx = get_gpixel(r, c, &outimg);
-            // it's unlikely to be 0 if the image's sizes haven't been modified
-            if (n != 0) {
-                set_gpixel(
-                    destpx,
-                    sum/n
-                );
-            } else {
-                set_gpixel(
-                    destpx,
-                    get_gpixel(r, c, &inimg)->v
-                );
-            }
-
-        }
-    }
+    // average of the + cross of radius 1 around each pixel
+    apply_blur2img(&blur_gpx_cross, &outimg, &inimg, 1);
 
     free_img_pxmat(&inimg);
 
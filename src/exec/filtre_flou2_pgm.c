@@ -16,8 +16,8 @@ int main(int argc, char* argv[]) {
 
     char* outnamebase = argv[2];
     int outname_len = strlen(outnamebase);
-    // this assumes we won't do more than 999 reps
-    char* outname = (char*)malloc(sizeof(char)*(outname_len+9));
+    // `_`, up to 11 characters for the rep number, `.pgm` and the ending `\0`
+    char* outname = (char*)malloc(sizeof(char)*(outname_len+17));
     outname[0] = '\0';
     strcat(outname, outnamebase);
     strcat(outname, "_");
@@ -29,67 +29,48 @@ int main(int argc, char* argv[]) {
 
     read_pgm_image(argv[1], &inimg);
 
-    IMAGE outimg = inimg;
-    outimg.mat = pxalloc(outimg.width, outimg.height);
-    if (outimg.mat == NULL) {
-        printf("Error allocating memory for output image\n");
+    // each blurred image is written by a background thread while the next one is computed from it
+    ASYNCWRITER writer;
+    if (async_writer_init(&writer, ASYNC_WRITER_BUFFERS) != 0) {
+        printf("Error starting the image writer\n");
         free_img_pxmat(&inimg);
         exit(1);
     }
 
-    int blur_range = 1;
-
+    IMAGE* srcimg = &inimg;
     for (int i = 1; i <= n_reps; i++) {
         printf("Floutage: %d...", i);
 
-        for (int r = 0; r < inimg.height; r++) {
-            for (int c = 0; c < inimg.width; c++) {
-                int n = 0;
-                int sum = 0;
-                // gets all surrounding pixels and sums their values
-                for (int rr = r-blur_range; rr <= r+blur_range; rr++) {
-                    for (int cc = c-blur_range; cc <= c+blur_range; cc++) {
-                        GPIXEL* px = get_gpixel(rr, cc, &inimg);
-                        if (px != NULL) {
-                            n++;
-                            sum += px->v;
-                        }
-                    }
-                }
-
-                // place the average of the surrounding pixels in the resulting image
-                GPIXEL* destpx = get_gpixel(r, c, &outimg);
-                // it's unlikely to be 0 if the image's sizes haven't been modified
-                if (n != 0) {
-                    set_gpixel(
-                        destpx,
-                        sum/n
-                    );
-                } else {
-                    set_gpixel(
-                        destpx,
-                        get_gpixel(r, c, &inimg)->v
-                    );
-                }
-
-            }
+        // the buffer written the longest ago, so `srcimg` (written last) is left alone
+        IMAGE* outimg = async_acquire(&writer);
+        outimg->mat = pxrealloc(outimg->mat, inimg.width, inimg.height);
+        if (outimg->mat == NULL) {
+            printf("Error allocating memory for output image\n");
+            exit(1);
         }
+        outimg->width = inimg.width;
+        outimg->height = inimg.height;
+        outimg->img_type = PGM;
+
+        // average of the 3x3 square around each pixel
+        apply_blur2img(&blur_gpx_square, outimg, srcimg, 1);
 
-        char numbuff[4] = "";
-        itoa(i, numbuff, 10);
+        char numbuff[12] = "";
+        // itoa isn't part of the C standard (not available on glibc)
+        snprintf(numbuff, sizeof(numbuff), "%d", i);
         // set end of string to just after the _
         outname[outname_len+1] = '\0';
 
         strcat(outname, numbuff);
         strcat(outname, ".pgm");
-        
-        write_pgm2pgm(outname, &outimg);
-        
-        PIXEL** temp = outimg.mat;
-
-        // switch the matrixes so that the previously blured one is now the source
-        inimg.mat = outimg.mat;
-        outimg.mat = temp;
+
+        if (async_write(&writer, outimg, outname, PGM) != 0) {
+            printf("Error handing %s over to the image writer\n", outname);
+            exit(1);
+        }
+
+        // the previously blured one is now the source
+        srcimg = outimg;
         printf(" DONE!\n");
 
     }
@@ -97,9 +78,10 @@ int main(int argc, char* argv[]) {
 
     free_img_pxmat(&inimg);
 
-    // write_pgm2pgm(argv[2], &outimg);
-
-    free_img_pxmat(&outimg);
+    if (async_writer_close(&writer) != 0) {
+        printf("Error writing %d of the blurred images\n", writer.failed);
+        exit(1);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+
+
+int main(int argc, char* argv[]) {
+
+    char* names[] = {"transpose", "rot90", "rot180", "rot270", "fliph", "flipv"};
+
+    if (argc != 4) {
+        printf("Expected usage: %s <in_filepath> <out_filepath> <transpose|rot90|rot180|rot270|fliph|flipv>\n", argv[0]);
+        printf("  works on PGM and PPM images, rotations are clockwise\n");
+        return 1;
+    }
+
+    GEOMTYPE geom = _GEOMEND;
+    for (int i = 0; i < _GEOMEND; i++) {
+        if (strcmp(argv[3], names[i]) == 0) {
+            geom = i;
+        }
+    }
+    if (geom == _GEOMEND) {
+        printf("Unknown transform %s\n", argv[3]);
+        return 1;
+    }
+
+    IMAGE img = {0};
+    if (load_pnm_image(argv[1], &img, 0) != 0) {
+        printf("Error reading %s\n", argv[1]);
+        return 1;
+    }
+
+    // square images and the ops keeping the shape are done in place
+    IMAGE out = img;
+    int swapped = (geom == TRANSPOSE || geom == ROT90 || geom == ROT270);
+    if (swapped && img.width != img.height) {
+        out.width = img.height;
+        out.height = img.width;
+        out.mat = pxalloc(out.width, out.height);
+        if (out.mat == NULL) {
+            printf("Error allocating a %ux%u image\n", out.width, out.height);
+            free_img_pxmat(&img);
+            return 1;
+        }
+    }
+
+    geom_img(&out, &img, geom);
+
+    int res = save_pnm_image(argv[2], &out, out.img_type);
+    if (out.mat != img.mat) {
+        free_img_pxmat(&out);
+    }
+    free_img_pxmat(&img);
+
+    if (res != 0) {
+        printf("Error writing %s\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
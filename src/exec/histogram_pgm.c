@@ -16,12 +16,7 @@ int main(int argc, char* argv[]) {
 
     read_pgm_image(argv[1], &img);
 
-    for (int r = 0; r < img.height; r++) {
-        for (int c = 0; c < img.width; c++) {
-            GPIXEL* px = get_gpixel(r,c,&img);
-            hist[px->v]++;
-        }
-    }
+    histogram_gimg(&img, hist);
     
     free_pxmat(img.mat, img.height);
 
@@ -35,48 +35,7 @@ int main(int argc, char* argv[]) {
 
     free_img_pxmat(&srcimg);
 
-    // first threshold go over
-    for (int r = 0; r < destimg.height; r++) {
-        for (int c = 0; c < destimg.width; c++) {
-            GPIXEL* gradpx = get_gpixel(r, c, &destimg);
-            if (gradpx->v <= minthresh) {
-                gradpx->v = 0;
-            } else if (maxthresh <= gradpx->v) {
-                gradpx->v = 255;
-            }
-        }
-    }
-    // write_pgm2pgm(argv[2], &destimg);
-
-    // second threshold go over
-    for (int r = 0; r < destimg.height; r++) {
-        for (int c = 0; c < destimg.width; c++) {
-            GPIXEL* gradpx = get_gpixel(r, c, &destimg);
-
-            int cond1 = (minthresh < gradpx->v && gradpx->v < maxthresh);
-            int cond2 = 0;
-
-            // look for at least one 255 in 8 neighbors
-            for (int rr = r-1; rr <= r+1; rr++) {
-                for (int cc = c-1; cc <= c+1; cc++) {
-                    GPIXEL* npx = get_gpixel(r,c, &destimg);
-                    if (npx != NULL && r != rr && c != cc && npx->v == 255) {
-                        cond2++;
-                    }
-                }
-            }
-
-            if (cond1) {
-                if (cond2) {
-                    gradpx->v = 255;
-                } else {
-                    gradpx->v = 0;
-                }
-            }
-            // gradpx->v = (cond1 && cond2 > 0) ? 255 : 0;
-
-        }
-    }
+    hysteresis_gthresh_img(&destimg, minthresh, maxthresh);
 
     write_pgm2pgm(argv[2], &destimg);
 
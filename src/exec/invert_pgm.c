@@ -15,13 +15,8 @@ int main(int argc, char* argv[]) {
 
     read_pgm_image(argv[1], &img);
 
-    for (int r = 0; r < img.height; r++) {
-        for (int c = 0; c < img.width; c++) {
-            GPIXEL* px = get_gpixel(r, c, &img);
-            set_gpixel(px, 255 - px->v);
-        }
-    }
-    
+    invert_gimg(&img);
+
     write_pgm2pgm(argv[2], &img);
 
     free_pxmat(img.mat, img.height);
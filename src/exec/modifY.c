@@ -24,15 +24,8 @@ int main(int argc, char* argv[]) {
     IMAGE img;
     read_pgm_image(argv[1], &img);
 
-    for (int r = 0; r < img.height; r++) {
-        for (int c = 0; c < img.width; c++) {
-            GPIXEL* px = get_gpixel(r, c, &img);
-            int v = px->v + k;
-            // we clamp the updated exposure so that there are no overflows before putting it back on the image
-            clampg(&v);
-            px->v = v;
-        }
-    }
+    // the updated exposure is clamped so that there are no overflows
+    add_gimg(&img, k);
 
     write_pgm2pgm(argv[2], &img);
 
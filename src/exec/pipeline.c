@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgpipe.h"
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 2) {
+        printf("Expected usage: %s \"read <in_path> | <step> | ... | write <out_path>\"\n", argv[0]);
+        printf("ex: %s \"read a.ppm | rgb2ycbcr | y+=20 | ycbcr2rgb | write b.ppm\"\n", argv[0]);
+        printf("Available steps:\n");
+        print_pipeline_steps(stdout);
+        exit(EXIT_FAILURE);
+    }
+
+    // the spec can be given as a single argument or spread over several
+    int speclen = 0;
+    for (int i = 1; i < argc; i++) speclen += strlen(argv[i]) + 1;
+
+    char* spec = (char*)malloc(speclen + 1);
+    if (spec == NULL) {
+        fprintf(stderr, "Error allocating memory for the pipeline spec\n");
+        exit(EXIT_FAILURE);
+    }
+    spec[0] = '\0';
+    for (int i = 1; i < argc; i++) {
+        strcat(spec, argv[i]);
+        strcat(spec, " ");
+    }
+
+    PIPELINE pipe;
+    int res = parse_pipeline(spec, &pipe);
+    free(spec);
+    if (res != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    res = run_pipeline(&pipe);
+    free_pipeline(&pipe);
+
+    return res == 0 ? 0 : EXIT_FAILURE;
+}
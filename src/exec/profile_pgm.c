@@ -16,31 +16,30 @@ int main(int argc, char* argv[]) {
     sscanf(argv[3], "%d", &index);
     int is_row = argv[2][0] == 'r';
 
-    read_pgm_image(argv[1], &img);
-
-    int minr,minc,maxr,maxc;
-
-    if (is_row) {
-        minr = index;
-        maxr = minr+1;
-        minc = 0;
-        maxc = img.width;
-    } else {
-        minr = 0;
-        maxr = img.height;
-        minc = index;
-        maxc = minc+1;
+    // only the row or column is read, from a mapping as a column touches a single byte per row
+    PNMFILE file;
+    if (open_pnm_file(argv[1], &file, PGM, 1) != 0) {
+        printf("Error reading PGM image %s\n", argv[1]);
+        return 1;
     }
 
+    int inbounds = index >= 0 && index < (is_row ? file.height : file.width);
+    if (inbounds) {
+        int res = is_row ? read_pnm_roi(&file, &img, index, 0, file.width, 1) : read_pnm_roi(&file, &img, 0, index, 1, file.height);
+        if (res != 0) {
+            printf("Error reading PGM image %s\n", argv[1]);
+            close_pnm_file(&file);
+            return 1;
+        }
+    }
+    close_pnm_file(&file);
 
     int profile[256] = {0};
 
-
-    for (int r = minr; r < maxr; r++) {
-        for (int c = minc; c < maxc; c++) {
-            GPIXEL* px = get_gpixel(r, c, &img);
-            profile[px->v]++;
-        }
+    if (!inbounds || profile_gimg(&img, is_row, 0, profile) != 0) {
+        printf("Index %d is out of bounds of the image !\n", index);
+        free_pxmat(img.mat, img.height);
+        return 1;
     }
     
     free_pxmat(img.mat, img.height);
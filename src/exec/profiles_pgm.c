@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+
+
+// parses "all", "none" or a list such as "3,10-20,42" into `indices`, returns their amount (PROFILE_ALL for "all"), -2 if invalid
+static int parse_indices(char* arg, int** indices) {
+
+    *indices = NULL;
+    if (strcmp(arg, "all") == 0) return PROFILE_ALL;
+    if (strcmp(arg, "none") == 0) return 0;
+
+    int n = 0, cap = 0;
+    char* p = arg;
+    while (*p != '\0') {
+        char* end;
+        int a = (int)strtol(p, &end, 10);
+        int b = a;
+        if (end == p) return -2;
+        if (*end == '-') {
+            p = end + 1;
+            b = (int)strtol(p, &end, 10);
+            if (end == p || b < a) return -2;
+        }
+
+        for (int i = a; i <= b; i++) {
+            if (n == cap) {
+                cap = cap ? 2*cap : 64;
+                *indices = (int*)realloc(*indices, sizeof(int)*cap);
+                if (*indices == NULL) return -2;
+            }
+            (*indices)[n++] = i;
+        }
+
+        if (*end == ',') end++;
+        else if (*end != '\0') return -2;
+        p = end;
+    }
+
+    return n;
+}
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 4) {
+        printf("Exprected usage: %s <in_filepath> <rows> <cols>\n", argv[0]);
+        printf("  <rows> and <cols> are \"all\", \"none\" or a list of indices and ranges such as 3,10-20,42\n");
+        printf("Output: one line per gray value, then one column of counts per row profile (r<index>) and per column profile (c<index>)\n");
+        return 1;
+    }
+
+    int* rows;
+    int* cols;
+    int nrows = parse_indices(argv[2], &rows);
+    int ncols = parse_indices(argv[3], &cols);
+    if (nrows == -2 || ncols == -2) {
+        printf("Couldn't parse the rows or columns to profile\n");
+        return 1;
+    }
+
+    IMAGE img = {0};
+    read_pgm_image(argv[1], &img);
+
+    // every profile comes out of a single read of the image
+    PROFILESET set;
+    int res = profile_set_init(&set, &img, rows, nrows, cols, ncols);
+    free(rows);
+    free(cols);
+    if (res != 0) {
+        printf(res == -1 ? "An index is out of bounds of the image !\n" : "Error allocating the profiles\n");
+        free_pxmat(img.mat, img.height);
+        return 1;
+    }
+
+    profiles_gimg(&img, &set);
+    free_pxmat(img.mat, img.height);
+
+    printf("value");
+    for (int i = 0; i < set.nrows; i++) printf("\tr%d", set.rows[i]);
+    for (int j = 0; j < set.ncols; j++) printf("\tc%d", set.cols[j]);
+    printf("\n");
+
+    for (int v = 0; v < 256; v++) {
+        printf("%d", v);
+        for (int i = 0; i < set.nrows; i++) printf("\t%d", set.row_profiles[256*i + v]);
+        for (int j = 0; j < set.ncols; j++) printf("\t%d", set.col_profiles[256*j + v]);
+        printf("\n");
+    }
+
+    free_profile_set(&set);
+
+    return 0;
+}
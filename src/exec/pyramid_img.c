@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "imgio.h"
+#include "imgscale.h"
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 4) {
+        printf("Expected usage: %s <in_filepath> <out_prefix> <nlevels>\n", argv[0]);
+        printf("  writes <out_prefix>_<level>.pgm (or .ppm), level 1 being half the size of the input\n");
+        return 1;
+    }
+
+    int nlevels = atoi(argv[3]);
+
+    ROWREADER reader;
+    if (open_row_reader(argv[1], &reader, 0) != 0) {
+        printf("Error reading %s\n", argv[1]);
+        return 1;
+    }
+
+    // the input is streamed through, only the levels are held
+    PYRAMID pyr;
+    int res = stream_pyramid(&reader, &pyr, nlevels);
+    close_row_reader(&reader);
+    if (res != 0) {
+        printf(res == -1 ? "The amount of levels must be between 0 and %d\n" : "Error building the pyramid\n", PYRAMID_MAX_LEVELS);
+        return 1;
+    }
+
+    char path[4096];
+    for (int i = 0; i < pyr.nlevels && res == 0; i++) {
+        snprintf(path, sizeof(path), "%s_%d.%s", argv[2], i + 1, (pyr.levels[i].img_type == PGM) ? "pgm" : "ppm");
+        res = save_pnm_image(path, &pyr.levels[i], pyr.levels[i].img_type);
+        if (res != 0) {
+            printf("Error writing %s\n", path);
+        }
+    }
+
+    free_pyramid(&pyr);
+
+    return (res == 0) ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgscale.h"
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 4 && argc != 5) {
+        printf("Expected usage: %s <in_filepath> <out_filepath> <factor|WIDTHxHEIGHT> [bilinear|lanczos3]\n", argv[0]);
+        printf("  an integer factor averages blocks of factor x factor pixels, a size resamples (lanczos3 by default)\n");
+        return 1;
+    }
+
+    int factor = 0, width = 0, height = 0;
+    char end;
+    if (sscanf(argv[3], "%dx%d%c", &width, &height, &end) != 2 && sscanf(argv[3], "%d%c", &factor, &end) != 1) {
+        printf("Couldn't parse the size %s\n", argv[3]);
+        return 1;
+    }
+    if (factor < 0 || (factor == 0 && (width < 1 || height < 1))) {
+        printf("The factor and sizes must be 1 or more\n");
+        return 1;
+    }
+
+    RESAMPLETYPE filter = LANCZOS3;
+    if (argc == 5) {
+        if (strcmp(argv[4], "bilinear") == 0) filter = BILINEAR;
+        else if (strcmp(argv[4], "lanczos3") != 0) {
+            printf("Unknown filter %s\n", argv[4]);
+            return 1;
+        }
+    }
+
+    IMAGE img = {0};
+
+    // integer factors are averaged while the file is read, the full size image is never held
+    if (factor != 0) {
+        int res = load_pnm_scaled(argv[1], &img, 0, factor);
+        if (res == 0) {
+            res = save_pnm_image(argv[2], &img, img.img_type);
+        } else {
+            printf("Error reading %s\n", argv[1]);
+        }
+        free_img_pxmat(&img);
+        return (res == 0) ? 0 : 1;
+    }
+
+    if (load_pnm_image(argv[1], &img, 0) != 0) {
+        printf("Error reading %s\n", argv[1]);
+        return 1;
+    }
+
+    IMAGE out = img;
+    out.width = width;
+    out.height = height;
+    out.mat = pxalloc(out.width, out.height);
+    if (out.mat == NULL) {
+        printf("Error allocating a %dx%d image\n", out.width, out.height);
+        free_img_pxmat(&img);
+        return 1;
+    }
+
+    int res = resample_img(&out, &img, filter);
+    if (res == 0) {
+        res = save_pnm_image(argv[2], &out, out.img_type);
+    } else {
+        printf("Error resizing the image (%d)\n", res);
+    }
+
+    free_img_pxmat(&out);
+    free_img_pxmat(&img);
+
+    return (res == 0) ? 0 : 1;
+}
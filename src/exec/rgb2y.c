@@ -15,15 +15,8 @@ int main(int argc, char* argv[]) {
 
     read_ppm_image(argv[1], &img);
 
-    for (int r = 0; r < img.height; r++) {
-        for (int c = 0; c < img.width; c++) {
-            RGBPIXEL* px = get_rgbpixel(r,c,&img);
-            BYTE yval = 0.299*(px->r) + 0.587*(px->g) + 0.114*(px->b);
-
-            set_rgbpixel(px, yval, yval, yval);
-
-        }
-    }
+    // places Y on all 3 channels, so the gray value of each pixel is Y
+    convert_channel_img(&img, &img, RGB2GRAY);
 
     write_pgm2pgm(argv[2], &img);
 
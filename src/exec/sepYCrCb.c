@@ -8,73 +8,69 @@
 
 int main(int argc, char* argv[]) {
     
-    if (argc != 3) {
-        printf("Expected usage: %s inimg.ppm outname\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        printf("Expected usage: %s inimg.ppm outname [444|422|420]\n", argv[0]);
         printf("Output: {outname}_Y.pgm {outname}_Cb.pgm {outname}_Cr.pgm\n");
+        printf("Cb and Cr are halved horizontally with 422, and both ways with 420 (default 444, full size)\n");
         exit(EXIT_FAILURE);
     }
 
-
-    IMAGE inImg = {0};
-    read_ppm_image(argv[1], &inImg);
-
-    for (int r = 0; r < inImg.height; r++) {
-        for (int c = 0; c < inImg.width; c++) {
-            // get pixel at this pos
-            RGBPIXEL* pxpt = get_rgbpixel(r,c,&inImg);
-
-            // creates copy
-            RGBPIXEL px = *pxpt;
-
-            // calculates Y
-            pxpt->r = 0.299*px.r + 0.587*px.g + 0.114*px.b;
-            // calculates Cb
-            pxpt->g = -0.1687*px.r - 0.3313*px.g + 0.5*px.b + 128;
-            // calculates Cr
-            pxpt->b = 0.5*px.r - 0.4187*px.g - 0.0813*px.b + 128;
-                        
+    CHROMATYPE chroma = CHROMA_444;
+    if (argc == 4) {
+        if (strcmp(argv[3], "444") == 0) chroma = CHROMA_444;
+        else if (strcmp(argv[3], "422") == 0) chroma = CHROMA_422;
+        else if (strcmp(argv[3], "420") == 0) chroma = CHROMA_420;
+        else {
+            printf("Unknown chroma subsampling: %s\n", argv[3]);
+            exit(EXIT_FAILURE);
         }
     }
 
-    // + 7 for "_XX.pgm"
-    char* filepath = (char*)malloc(sizeof(char)*(strlen(argv[2]) + 1 + 7));
-
-    // write Y.pgm file
-    printf("Writing Y file...");
-    filepath[0] = '\0';
-    strcat(filepath, argv[2]);
-    strcat(filepath, "_Y.pgm");
-
-    write_pgm2pgm(filepath, &inImg);
-    printf(" DONE\n");
-
-
-    // write Cb.pgm file
-    printf("Writing Cb file...");
-    // moves green channel to the position of red, which is same position as grayscale value
-    extr_gchan_img(&inImg, &inImg);
-
-    filepath[0] = '\0';
-    strcat(filepath, argv[2]);
-    strcat(filepath, "_Cb.pgm");
-
-    write_pgm2pgm(filepath, &inImg);
-    printf(" DONE\n");
+    ROWREADER reader;
+    if (open_row_reader(argv[1], &reader, PPM) != 0) {
+        printf("Error opening %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
 
+    int cwidth, cheight;
+    chroma_size(chroma, reader.width, reader.height, &cwidth, &cheight);
 
-    // write Cr.pgm file
-    printf("Writing Cr file...");
-    extr_bchan_img(&inImg, &inImg);
+    // + 7 for "_XX.pgm"
+    char* filepath = (char*)malloc(sizeof(char)*(strlen(argv[2]) + 1 + 7));
+    const char* suffixes[3] = {"_Y.pgm", "_Cb.pgm", "_Cr.pgm"};
+    ROWWRITER writers[3];
+
+    for (int i = 0; i < 3; i++) {
+        filepath[0] = '\0';
+        strcat(filepath, argv[2]);
+        strcat(filepath, suffixes[i]);
+
+        int res = (i == 0)
+            ? open_row_writer(filepath, &writers[i], reader.width, reader.height, PGM)
+            : open_row_writer(filepath, &writers[i], cwidth, cheight, PGM);
+        if (res != 0) {
+            printf("Error creating %s\n", filepath);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    filepath[0] = '\0';
-    strcat(filepath, argv[2]);
-    strcat(filepath, "_Cr.pgm");
+    // every row is converted once and goes to all 3 files right away
+    printf("Writing Y, Cb and Cr files...");
+    int res = stream_split_ycbcr(&reader, &writers[0], &writers[1], &writers[2], chroma);
+    close_row_reader(&reader);
+    for (int i = 0; i < 3; i++) {
+        if (close_row_writer(&writers[i]) != 0 && res == 0) {
+            res = -2;
+        }
+    }
 
-    write_pgm2pgm(filepath, &inImg);
+    if (res != 0) {
+        printf("\nError splitting the image (%d)\n", res);
+        exit(EXIT_FAILURE);
+    }
     printf(" DONE\n");
 
-    free_pxmat(inImg.mat, inImg.height);
     free(filepath);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 4 && argc != 5) {
+        printf("Expected usage: %s <blur|blur_cross|gradient|erode|dilate> <in_image.pgm> <out_image.pgm> [range]\n", argv[0]);
+        printf("The image is streamed a few rows at a time, so it never has to fit in memory\n");
+        printf("Every frame of a stream of concatenated PGMs goes through the op, \"-\" reads stdin and writes stdout\n");
+        exit(1);
+    }
+
+    unsigned int range = 1;
+    if (argc == 5) sscanf(argv[4], "%u", &range);
+
+    char* ops[] = {"blur", "blur_cross", "gradient", "erode", "dilate"};
+    int op = -1;
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(argv[1], ops[i]) == 0) op = i;
+    }
+    if (op < 0) {
+        fprintf(stderr, "Unknown op %s\n", argv[1]);
+        exit(1);
+    }
+
+    // the input can hold several frames one after the other (a video piped in), each one is streamed through the op in turn
+    ROWREADER reader;
+    if (open_frame_reader(argv[2], &reader) != 0) {
+        fprintf(stderr, "Error opening PGM file %s\n", argv[2]);
+        exit(1);
+    }
+
+    ROWWRITER writer;
+    if (open_frame_writer(argv[3], &writer) != 0) {
+        fprintf(stderr, "Error opening %s for writing\n", argv[3]);
+        close_row_reader(&reader);
+        exit(1);
+    }
+
+    int nframes = 0;
+    int res = 0;
+    // reading a frame's header stops the loop with `hres`, anything else with `res`
+    int hres;
+    while ((hres = read_frame_header(&reader, PGM)) == 0) {
+        res = write_frame_header(&writer, reader.width, reader.height, PGM);
+        if (res != 0) break;
+
+        switch (op) {
+            case 0: res = stream_blur(&blur_gpx_square, &reader, &writer, range); break;
+            case 1: res = stream_blur(&blur_gpx_cross, &reader, &writer, range); break;
+            case 2: res = stream_grad(&reader, &writer); break;
+            case 3: res = stream_erode(&reader, &writer, range); break;
+            case 4: res = stream_dilate(&reader, &writer, range); break;
+        }
+        if (res != 0) break;
+        nframes++;
+    }
+
+    // the end of the input is where it stops, once there was at least a frame
+    if (res == 0) {
+        if (hres == 1 && nframes == 0) {
+            fprintf(stderr, "Error: no image in %s\n", argv[2]);
+            res = 1;
+        } else if (hres == -2 && reader.img_type != PGM) {
+            fprintf(stderr, "Incorrect file type! Tried opening PGM, P%d type recieved!\n", reader.img_type);
+            res = 1;
+        } else if (hres == -2) {
+            fprintf(stderr, "Error: malformed header for frame %d of %s\n", nframes + 1, argv[2]);
+            res = 1;
+        } else if (hres != 1) {
+            res = hres;
+        }
+    }
+
+    close_row_reader(&reader);
+    if (close_row_writer(&writer) != 0 && res == 0) {
+        res = -2;
+    }
+
+    if (res == -2) {
+        fprintf(stderr, "Error writing %s\n", argv[3]);
+    } else if (res == -3) {
+        fprintf(stderr, "Error allocating the row buffers !\n");
+    } else if (res == -4) {
+        fprintf(stderr, "Error: unexpectedly reached end of file in %s !\n", argv[2]);
+    }
+
+    return res == 0 ? 0 : 1;
+}
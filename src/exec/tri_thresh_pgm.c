@@ -20,19 +20,7 @@ int main(int argc, char* argv[]) {
     sscanf(argv[3], "%d", &thresh1);
     sscanf(argv[4], "%d", &thresh2);
 
-    for (int r = 0; r < img.height; r++) {
-        for (int c = 0; c < img.width; c++) {
-            GPIXEL* px = get_gpixel(r,c,&img);
-
-            if (px->v < thresh1) {
-                px->v = 0;
-            } else if (px->v >= thresh2) {
-                px->v = 255;
-            } else {
-                px->v = 128;
-            }
-        }
-    }
+    tri_gthresh_img(&img, thresh1, thresh2);
 
     write_pgm2pgm(argv[2], &img);
 
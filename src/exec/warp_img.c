@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "imgio.h"
+#include "imgwarp.h"
+
+
+int main(int argc, char* argv[]) {
+
+    char* modes[] = {"excluded", "replicate", "reflect", "constant"};
+
+    if (argc < 6) {
+        printf("Expected usage: %s <in_filepath> <out_filepath> <excluded|replicate|reflect|constant> <transform>\n", argv[0]);
+        printf("  <transform> is one of:\n");
+        printf("    rotate <degrees>        clockwise, around the center (to deskew a scan, rotate by minus its skew)\n");
+        printf("    affine <a> <b> <c> <d> <e> <f>    source (x, y) = (a*c + b*r + c, d*c + e*r + f) of each destination pixel (c, r)\n");
+        printf("    homography <h0> ... <h8>          same with the 3x3 matrix h, divided by (h6*c + h7*r + h8)\n");
+        printf("  constant fills what comes from outside of the image with white\n");
+        return 1;
+    }
+
+    BORDERMODE mode = 4;
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(argv[3], modes[i]) == 0) {
+            mode = i;
+        }
+    }
+
+    IMAGE img = {0};
+    if (mode == 4 || load_pnm_image(argv[1], &img, 0) != 0) {
+        printf(mode == 4 ? "Unknown border mode %s\n" : "Error reading %s\n", mode == 4 ? argv[3] : argv[1]);
+        return 1;
+    }
+
+    // the matrix maps each destination pixel to where it is read in the source
+    double m[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    int nvalues = (strcmp(argv[4], "affine") == 0) ? 6 : ((strcmp(argv[4], "homography") == 0) ? 9 : 0);
+    if (strcmp(argv[4], "rotate") == 0 && argc == 6) {
+        double a = atof(argv[5])*M_PI/180.0;
+        double cx = (img.width - 1)/2.0, cy = (img.height - 1)/2.0;
+        m[0] = cos(a); m[1] = sin(a); m[2] = cx - cos(a)*cx - sin(a)*cy;
+        m[3] = -sin(a); m[4] = cos(a); m[5] = cy + sin(a)*cx - cos(a)*cy;
+    } else if (nvalues != 0 && argc == 5 + nvalues) {
+        for (int i = 0; i < nvalues; i++) {
+            m[i] = atof(argv[5 + i]);
+        }
+    } else {
+        printf("Couldn't parse the transform\n");
+        free_img_pxmat(&img);
+        return 1;
+    }
+
+    IMAGE out = img;
+    out.mat = pxalloc(img.width, img.height);
+    if (out.mat == NULL) {
+        printf("Error allocating the output\n");
+        free_img_pxmat(&img);
+        return 1;
+    }
+    // excluded pixels keep the input's
+    copy_pxmat(out.mat, img.mat, img.width, img.height);
+
+    PIXEL white;
+    memset(&white, 255, sizeof(PIXEL));
+    int res = warp_img(&out, &img, m, mode, white);
+    if (res == 0) {
+        res = save_pnm_image(argv[2], &out, out.img_type);
+    } else {
+        printf("Error warping the image (%d)\n", res);
+    }
+
+    free_img_pxmat(&out);
+    free_img_pxmat(&img);
+
+    return (res == 0) ? 0 : 1;
+}
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgpipe.h"
+#include "imgsched.h"
+#include "imgmem.h"
+#include "imggraph.h"
+
+
+static int _node_blur(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node) {
+    return apply_blur2img(node->blur_func, destimg, srcimgs[0], node->range);
+}
+
+static int _node_gradient(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node) {
+    return grad_gimg(destimg, srcimgs[0]);
+}
+
+static int _node_erode(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node) {
+    erode_img(destimg, srcimgs[0], node->range);
+    return 0;
+}
+
+static int _node_dilate(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node) {
+    dilate_img(destimg, srcimgs[0], node->range);
+    return 0;
+}
+
+static int _node_difference(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node) {
+
+    for (int r = 0; r < destimg->height; r++) {
+        PIXEL* row1 = srcimgs[0]->mat[r];
+        PIXEL* row2 = srcimgs[1]->mat[r];
+        PIXEL* destrow = destimg->mat[r];
+
+        for (int c = 0; c < destimg->width; c++) {
+            destrow[c].gpx.v = (row1[c].gpx.v == row2[c].gpx.v) ? 255 : 0;
+        }
+    }
+    return 0;
+}
+
+static int _region_empty(GRAPHREGION* reg) {
+    return reg->r1 >= reg->r2 || reg->c1 >= reg->c2;
+}
+
+// grows `reg` so it also holds `other`
+static void _region_union(GRAPHREGION* reg, GRAPHREGION* other) {
+
+    if (_region_empty(reg)) {
+        *reg = *other;
+        return;
+    }
+
+    if (other->r1 < reg->r1) reg->r1 = other->r1;
+    if (other->c1 < reg->c1) reg->c1 = other->c1;
+    if (other->r2 > reg->r2) reg->r2 = other->r2;
+    if (other->c2 > reg->c2) reg->c2 = other->c2;
+}
+
+
+void graph_init(GRAPH* graph) {
+    memset(graph, 0, sizeof(GRAPH));
+}
+
+void free_graph(GRAPH* graph) {
+
+    for (int i = 0; i < graph->nnodes; i++) {
+        free(graph->nodes[i]->ops);
+        free(graph->nodes[i]);
+    }
+    free(graph->nodes);
+    memset(graph, 0, sizeof(GRAPH));
+}
+
+GRAPHNODE* graph_source(GRAPH* graph, IMAGE* img) {
+
+    GRAPHNODE* node = _graph_add_node(graph, NODE_SOURCE, NULL, 0);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->srcimg = img;
+    node->width = img->width;
+    node->height = img->height;
+    node->img_type = img->img_type;
+
+    return node;
+}
+
+GRAPHNODE* graph_point(GRAPH* graph, GRAPHNODE* in, POINTOP* ops, int nops, IMGTYPE outtype) {
+
+    POINTOP* opscopy = (POINTOP*)malloc(sizeof(POINTOP)*nops);
+    if (opscopy == NULL) {
+        return NULL;
+    }
+    memcpy(opscopy, ops, sizeof(POINTOP)*nops);
+
+    GRAPHNODE* node = _graph_add_node(graph, NODE_POINT, &in, 1);
+    if (node == NULL) {
+        free(opscopy);
+        return NULL;
+    }
+
+    node->ops = opscopy;
+    node->nops = nops;
+    if (outtype != 0) node->img_type = outtype;
+
+    return node;
+}
+
+GRAPHNODE* graph_thresh(GRAPH* graph, GRAPHNODE* in, int thresh) {
+
+    // same as `bin_gthresh_img(img, thresh, 0, 255)`
+    POINTOP op = {.kind = POINT_LUT, .nchan = 1};
+    for (int v = 0; v < 256; v++) {
+        op.lut[0][v] = (thresh < v) ? 255 : 0;
+    }
+
+    return graph_point(graph, in, &op, 1, 0);
+}
+
+GRAPHNODE* graph_op(GRAPH* graph, NODEFUNC apply, int halo, IMGTYPE outtype, GRAPHNODE** inputs, int ninputs) {
+
+    if (ninputs < 1) {
+        return NULL;
+    }
+
+    GRAPHNODE* node = _graph_add_node(graph, NODE_OP, inputs, ninputs);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->apply = apply;
+    node->halo = halo;
+    if (outtype != 0) node->img_type = outtype;
+
+    return node;
+}
+
+GRAPHNODE* graph_blur(GRAPH* graph, GRAPHNODE* in, int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int), unsigned int range) {
+
+    GRAPHNODE* node = graph_op(graph, _node_blur, range, 0, &in, 1);
+    if (node != NULL) {
+        node->blur_func = blur_func;
+        node->range = range;
+    }
+    return node;
+}
+
+GRAPHNODE* graph_gradient(GRAPH* graph, GRAPHNODE* in) {
+    // reads the next row and the next column
+    return graph_op(graph, _node_gradient, 1, PGM, &in, 1);
+}
+
+GRAPHNODE* graph_erode(GRAPH* graph, GRAPHNODE* in, unsigned int radius) {
+
+    GRAPHNODE* node = graph_op(graph, _node_erode, radius, 0, &in, 1);
+    if (node != NULL) node->range = radius;
+    return node;
+}
+
+GRAPHNODE* graph_dilate(GRAPH* graph, GRAPHNODE* in, unsigned int radius) {
+
+    GRAPHNODE* node = graph_op(graph, _node_dilate, radius, 0, &in, 1);
+    if (node != NULL) node->range = radius;
+    return node;
+}
+
+GRAPHNODE* graph_difference(GRAPH* graph, GRAPHNODE* in1, GRAPHNODE* in2) {
+
+    GRAPHNODE* inputs[2] = {in1, in2};
+    return graph_op(graph, _node_difference, 0, PGM, inputs, 2);
+}
+
+int graph_tile_size(GRAPH* graph) {
+
+    if (graph->tile_size > 0) {
+        return graph->tile_size;
+    }
+
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 <= 0) l2 = GRAPH_DEFAULT_L2;
+
+    // every node but the sources holds a tile (plus the halos of the nodes after it),
+    // half of L2 is left for the lookup tables, the stack and whatever the other core sharing it does
+    int nbufs = 0, halos = 0;
+    for (int i = 0; i < graph->nnodes; i++) {
+        if (graph->nodes[i]->kind != NODE_SOURCE) nbufs++;
+        halos += graph->nodes[i]->halo;
+    }
+    if (nbufs == 0) nbufs = 1;
+
+    int size = (int)sqrt((double)(l2/2) / (nbufs*sizeof(PIXEL))) - 2*halos;
+
+    // tiles bigger than this would get split again by the ops running on them
+    int max_size = (int)sqrt(SCHED_MIN_TILE_PX - 1);
+    if (size > max_size) size = max_size;
+    if (size < GRAPH_MIN_TILE) size = GRAPH_MIN_TILE;
+
+    return size;
+}
+
+int graph_eval(GRAPH* graph, GRAPHNODE* out, IMAGE* destimg) {
+
+    if (destimg->width != out->width || destimg->height != out->height) {
+        return -1;
+    }
+
+    GRAPHTILE args = {.graph = graph, .out = out, .destimg = destimg, .tile_size = graph_tile_size(graph)};
+    atomic_init(&args.failed, 0);
+
+    sched_parallel_rows(sched_default(), out->width, out->height, _graph_band_tile, &args);
+
+    destimg->img_type = out->img_type;
+
+    return atomic_load(&args.failed);
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+GRAPHNODE* _graph_add_node(GRAPH* graph, NODEKIND kind, GRAPHNODE** inputs, int ninputs) {
+
+    if (ninputs > GRAPH_MAX_INPUTS) {
+        return NULL;
+    }
+    for (int i = 1; i < ninputs; i++) {
+        if (inputs[i]->width != inputs[0]->width || inputs[i]->height != inputs[0]->height) {
+            return NULL;
+        }
+    }
+
+    if (graph->nnodes == graph->capacity) {
+        int capacity = graph->capacity > 0 ? graph->capacity*2 : 8;
+        GRAPHNODE** nodes = (GRAPHNODE**)realloc(graph->nodes, sizeof(GRAPHNODE*)*capacity);
+        if (nodes == NULL) {
+            return NULL;
+        }
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+
+    GRAPHNODE* node = (GRAPHNODE*)calloc(1, sizeof(GRAPHNODE));
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->kind = kind;
+    node->index = graph->nnodes;
+    node->ninputs = ninputs;
+    for (int i = 0; i < ninputs; i++) {
+        node->inputs[i] = inputs[i];
+        inputs[i]->nconsumers++;
+    }
+    if (ninputs > 0) {
+        node->width = inputs[0]->width;
+        node->height = inputs[0]->height;
+        node->img_type = inputs[0]->img_type;
+    }
+
+    graph->nodes[graph->nnodes++] = node;
+
+    return node;
+}
+
+void _region_view(IMAGE* view, PIXEL** rows, IMAGE* buf, GRAPHREGION* bufreg, GRAPHREGION* reg) {
+
+    for (int r = 0; r < reg->r2 - reg->r1; r++) {
+        rows[r] = buf->mat[reg->r1 - bufreg->r1 + r] + (reg->c1 - bufreg->c1);
+    }
+
+    view->width = reg->c2 - reg->c1;
+    view->height = reg->r2 - reg->r1;
+    view->mat = rows;
+    view->img_type = buf->img_type;
+}
+
+int _graph_eval_tile(GRAPH* graph, GRAPHNODE* out, GRAPHSTATE* states, GRAPHREGION* tile, IMAGE* destimg) {
+
+    int n = out->index + 1;
+
+    for (int i = 0; i < n; i++) {
+        memset(&states[i].need, 0, sizeof(GRAPHREGION));
+    }
+    states[out->index].need = *tile;
+
+    // from the output back to the sources: every node needs whatever its consumers read,
+    // and reads its inputs over that plus its halo (clipped to the image, like the ops do)
+    for (int i = n-1; i >= 0; i--) {
+        GRAPHNODE* node = graph->nodes[i];
+        GRAPHSTATE* st = &states[i];
+        if (_region_empty(&st->need)) continue;
+
+        st->bufreg.r1 = (st->need.r1 - node->halo < 0) ? 0 : st->need.r1 - node->halo;
+        st->bufreg.c1 = (st->need.c1 - node->halo < 0) ? 0 : st->need.c1 - node->halo;
+        st->bufreg.r2 = (st->need.r2 + node->halo > node->height) ? node->height : st->need.r2 + node->halo;
+        st->bufreg.c2 = (st->need.c2 + node->halo > node->width) ? node->width : st->need.c2 + node->halo;
+
+        for (int k = 0; k < node->ninputs; k++) {
+            _region_union(&states[node->inputs[k]->index].need, &st->bufreg);
+        }
+    }
+
+    // from the sources to the output: compute every node over its region
+    for (int i = 0; i < n; i++) {
+        GRAPHNODE* node = graph->nodes[i];
+        GRAPHSTATE* st = &states[i];
+        if (_region_empty(&st->need)) continue;
+
+        int width = st->bufreg.c2 - st->bufreg.c1;
+        int height = st->bufreg.r2 - st->bufreg.r1;
+
+        if (node->kind == NODE_SOURCE) {
+            GRAPHREGION whole = {0, 0, node->height, node->width};
+            _region_view(&st->buf, st->rows, node->srcimg, &whole, &st->bufreg);
+            continue;
+        }
+
+        GRAPHSTATE* inst = &states[node->inputs[0]->index];
+
+        if (node->kind == NODE_POINT && node->inputs[0]->kind != NODE_SOURCE && node->inputs[0]->nconsumers == 1) {
+            // nobody else reads the tile of the input, run the ops right on it while it's still in cache
+            _region_view(&st->buf, st->rows, &inst->buf, &inst->bufreg, &st->bufreg);
+        } else {
+            st->own = pxrealloc(st->own, width, height);
+            if (st->own == NULL) {
+                return -2;
+            }
+            st->buf.width = width;
+            st->buf.height = height;
+            st->buf.mat = st->own;
+        }
+        st->buf.img_type = node->img_type;
+
+        if (node->kind == NODE_POINT) {
+            if (st->buf.mat == st->own) {
+                _region_view(&st->views[0], st->viewrows[0], &inst->buf, &inst->bufreg, &st->bufreg);
+                for (int r = 0; r < height; r++) {
+                    memcpy(st->buf.mat[r], st->views[0].mat[r], sizeof(PIXEL)*width);
+                }
+            }
+            for (int r = 0; r < height; r++) {
+                apply_point_ops(node->ops, node->nops, st->buf.mat[r], width);
+            }
+            continue;
+        }
+
+        IMAGE* srcimgs[GRAPH_MAX_INPUTS];
+        for (int k = 0; k < node->ninputs; k++) {
+            GRAPHSTATE* kst = &states[node->inputs[k]->index];
+            _region_view(&st->views[k], st->viewrows[k], &kst->buf, &kst->bufreg, &st->bufreg);
+            srcimgs[k] = &st->views[k];
+        }
+
+        if (node->apply(&st->buf, srcimgs, node) != 0) {
+            return -1;
+        }
+    }
+
+    // only the tile itself is right, the rest of the output buffer is halo
+    GRAPHSTATE* outst = &states[out->index];
+    for (int r = tile->r1; r < tile->r2; r++) {
+        memcpy(
+            destimg->mat[r] + tile->c1,
+            outst->buf.mat[r - outst->bufreg.r1] + (tile->c1 - outst->bufreg.c1),
+            sizeof(PIXEL)*(tile->c2 - tile->c1)
+        );
+    }
+
+    return 0;
+}
+
+void _graph_band_tile(void* arg, int r1, int r2) {
+
+    GRAPHTILE* args = arg;
+    GRAPH* graph = args->graph;
+    GRAPHNODE* out = args->out;
+    int n = out->index + 1;
+    int res = 0;
+
+    // bands run on the threads of the scheduler, so each charges its own buffers to the graph
+    MEMOP memop;
+    mem_op_begin(&memop, "graph_eval");
+
+    // every band has its own buffers: a band may wait on the tiles of an op, and run another band meanwhile
+    GRAPHSTATE* states = (GRAPHSTATE*)calloc(n, sizeof(GRAPHSTATE));
+    if (states == NULL) {
+        mem_op_end(&memop);
+        atomic_store(&args->failed, -2);
+        return;
+    }
+
+    for (int i = 0; i < n && res == 0; i++) {
+        GRAPHNODE* node = graph->nodes[i];
+        states[i].rows = (PIXEL**)malloc(sizeof(PIXEL*)*node->height);
+        if (states[i].rows == NULL) res = -2;
+
+        for (int k = 0; k < node->ninputs; k++) {
+            states[i].viewrows[k] = (PIXEL**)malloc(sizeof(PIXEL*)*node->height);
+            if (states[i].viewrows[k] == NULL) res = -2;
+        }
+    }
+
+    int size = args->tile_size;
+    for (int r = r1; r < r2 && res == 0; r += size) {
+        for (int c = 0; c < out->width && res == 0; c += size) {
+
+            GRAPHREGION tile = {r, c, r + size, c + size};
+            if (tile.r2 > r2) tile.r2 = r2;
+            if (tile.c2 > out->width) tile.c2 = out->width;
+
+            res = _graph_eval_tile(graph, out, states, &tile, args->destimg);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        free_pxmat(states[i].own, 0);
+        free(states[i].rows);
+        for (int k = 0; k < GRAPH_MAX_INPUTS; k++) {
+            free(states[i].viewrows[k]);
+        }
+    }
+    free(states);
+
+    mem_op_end(&memop);
+
+    if (res != 0) {
+        atomic_store(&args->failed, res);
+    }
+}
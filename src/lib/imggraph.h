@@ -0,0 +1,263 @@
+#ifndef IMAGE_GRAPH_H
+#define IMAGE_GRAPH_H
+
+#include <stdatomic.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgpipe.h"
+
+// max amount of inputs of a single node
+#define GRAPH_MAX_INPUTS 2
+
+// L2 size used to pick the tile size when the system doesn't tell us
+#define GRAPH_DEFAULT_L2 (256 * 1024)
+
+// tiles never get smaller than this (in pixels per side), whatever the cache size
+#define GRAPH_MIN_TILE 16
+
+enum _graph_node_kind_enum {
+    // an image already in memory
+    NODE_SOURCE = 0,
+    // point ops, run in place on the tile of their input whenever nobody else reads it
+    NODE_POINT,
+    // any op needing its input(s) over a halo around each output pixel (blur, gradient, morphology, ...)
+    NODE_OP
+};
+typedef enum _graph_node_kind_enum NODEKIND;
+
+typedef struct _graph_node_type_struct GRAPHNODE;
+
+/**
+ * @brief function computing an op node over a whole tile. `srcimgs` are the tiles of the node's inputs
+ * @brief (all the same size as `destimg`, and already allocated). Returns `0` if success.
+ */
+typedef int (*NODEFUNC)(IMAGE* destimg, IMAGE** srcimgs, GRAPHNODE* node);
+
+/**
+ * @brief a node of an op graph. Nodes are only ever added after their inputs, so the node list of a graph is
+ * @brief always in topological order
+ *
+ * @member index: position of the node in its graph
+ * @member img_type: type of image the node produces
+ * @member nconsumers: amount of nodes reading this one
+ * @member halo: how far around each output pixel the node reads its inputs
+ * @member srcimg: for NODE_SOURCE, the image
+ * @member ops: for NODE_POINT, the point ops applied in order
+ * @member apply: for NODE_OP, computes the node over a tile
+ * @member range: for NODE_OP, range of the blur or radius of the morphology
+ * @member blur_func: for blur nodes, the blur applied to each pixel
+ */
+struct _graph_node_type_struct {
+    NODEKIND kind;
+    int index;
+    unsigned int width;
+    unsigned int height;
+    IMGTYPE img_type;
+
+    GRAPHNODE* inputs[GRAPH_MAX_INPUTS];
+    int ninputs;
+    int nconsumers;
+    int halo;
+
+    IMAGE* srcimg;
+
+    POINTOP* ops;
+    int nops;
+
+    NODEFUNC apply;
+    unsigned int range;
+    int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int);
+};
+
+/**
+ * @brief a DAG of image ops, evaluated lazily one output tile at a time by `graph_eval()`
+ *
+ * @member tile_size: size (in pixels per side) of the output tiles, 0 to pick it from the L2 size
+ */
+struct _graph_type_struct {
+    GRAPHNODE** nodes;
+    int nnodes;
+    int capacity;
+    int tile_size;
+};
+typedef struct _graph_type_struct GRAPH;
+
+/**
+ * @brief a rectangle of an image, rows [r1, r2[ and columns [c1, c2[
+ */
+struct _graph_region_type_struct {
+    int r1;
+    int c1;
+    int r2;
+    int c2;
+};
+typedef struct _graph_region_type_struct GRAPHREGION;
+
+/**
+ * @brief what a node holds while evaluating a single tile
+ *
+ * @member need: part of the node's output its consumers read
+ * @member bufreg: part of the node's output held by `buf` (contains `need`, plus the halo when the node is an op)
+ * @member buf: the node's output over `bufreg`. Its rows are either `own` or `rows`
+ * @member own: matrix owned by the node, reused from one tile to the next
+ * @member rows: row pointers of views into another matrix (source image, or the tile of the input of an in place node)
+ * @member views: views of the input tiles over `bufreg`
+ */
+struct _graph_node_state_type_struct {
+    GRAPHREGION need;
+    GRAPHREGION bufreg;
+    IMAGE buf;
+    PIXEL** own;
+    PIXEL** rows;
+    IMAGE views[GRAPH_MAX_INPUTS];
+    PIXEL** viewrows[GRAPH_MAX_INPUTS];
+};
+typedef struct _graph_node_state_type_struct GRAPHSTATE;
+
+/**
+ * @brief what the bands of rows of `graph_eval()` work on
+ */
+struct _graph_tile_type_struct {
+    GRAPH* graph;
+    GRAPHNODE* out;
+    IMAGE* destimg;
+    int tile_size;
+    atomic_int failed;
+};
+typedef struct _graph_tile_type_struct GRAPHTILE;
+
+
+/**
+ * @brief initializes an empty graph
+ *
+ * @param graph the graph to initialize
+ */
+void graph_init(GRAPH* graph);
+
+/**
+ * @brief frees every node of a graph (source images are NOT freed)
+ *
+ * @param graph the graph to free
+ */
+void free_graph(GRAPH* graph);
+
+/**
+ * @brief adds an image already in memory to a graph
+ *
+ * @param graph the graph to add to
+ * @param img the image, it must outlive the graph and is never modified
+ * @return GRAPHNODE* | NULL if allocation failed
+ */
+GRAPHNODE* graph_source(GRAPH* graph, IMAGE* img);
+
+/**
+ * @brief adds a node running point ops (see `parse_point_op()`) on its input
+ *
+ * @param graph the graph to add to
+ * @param in input of the node
+ * @param ops point ops to run, in order (copied)
+ * @param nops amount of point ops
+ * @param outtype type of image the ops produce (0 if they keep the input type)
+ * @return GRAPHNODE* | NULL if allocation failed
+ */
+GRAPHNODE* graph_point(GRAPH* graph, GRAPHNODE* in, POINTOP* ops, int nops, IMGTYPE outtype);
+
+/**
+ * @brief adds a node binary thresholding its (gray) input to 0/255
+ *
+ * @param graph the graph to add to
+ * @param in input of the node
+ * @param thresh pixels under this value become 0, others become 255
+ * @return GRAPHNODE* | NULL if allocation failed
+ */
+GRAPHNODE* graph_thresh(GRAPH* graph, GRAPHNODE* in, int thresh);
+
+/**
+ * @brief adds a generic op node. Every input must be the same size.
+ *
+ * @param graph the graph to add to
+ * @param apply computes the node over a tile
+ * @param halo how far around each output pixel `apply` reads its inputs
+ * @param outtype type of image the node produces (0 if it keeps the type of its first input)
+ * @param inputs inputs of the node
+ * @param ninputs amount of inputs (at most GRAPH_MAX_INPUTS)
+ * @return GRAPHNODE* | NULL if allocation failed or the inputs don't match
+ */
+GRAPHNODE* graph_op(GRAPH* graph, NODEFUNC apply, int halo, IMGTYPE outtype, GRAPHNODE** inputs, int ninputs);
+
+/**
+ * @brief adds a node blurring its input with `apply_blur2img()`
+ *
+ * @param blur_func one of the blur_*px_* functions
+ * @param range range of the blur
+ */
+GRAPHNODE* graph_blur(GRAPH* graph, GRAPHNODE* in, int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int), unsigned int range);
+
+/**
+ * @brief adds a node computing the norm of the gradient of its input with `grad_gimg()`
+ */
+GRAPHNODE* graph_gradient(GRAPH* graph, GRAPHNODE* in);
+
+/**
+ * @brief adds a node eroding its input with `erode_img()`
+ */
+GRAPHNODE* graph_erode(GRAPH* graph, GRAPHNODE* in, unsigned int radius);
+
+/**
+ * @brief adds a node dilating its input with `dilate_img()`
+ */
+GRAPHNODE* graph_dilate(GRAPH* graph, GRAPHNODE* in, unsigned int radius);
+
+/**
+ * @brief adds a node whose pixels are 255 where both (gray) inputs are equal, 0 elsewhere (same as difference_pgm)
+ */
+GRAPHNODE* graph_difference(GRAPH* graph, GRAPHNODE* in1, GRAPHNODE* in2);
+
+/**
+ * @brief picks the size of the output tiles so the tiles of every node of the graph fit in half of the L2 cache
+ *
+ * @param graph the graph to evaluate
+ * @return int size of the tiles, in pixels per side
+ */
+int graph_tile_size(GRAPH* graph);
+
+/**
+ * @brief evaluates a node of a graph one output tile at a time. For each tile, every node only computes the region
+ * @brief its consumers read (plus its halo), so intermediate images are never materialized whole.
+ * @brief Bands of tiles are spread over the default scheduler.
+ *
+ * @param graph the graph holding the node
+ * @param out the node to evaluate
+ * @param destimg where to write the result, must already be allocated to the size of `out`
+ * @return int `0` if success. `-1` if `destimg` isn't the size of `out` or an op failed. `-2` if allocation failed
+ */
+int graph_eval(GRAPH* graph, GRAPHNODE* out, IMAGE* destimg);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief allocates a node and appends it to the graph
+ */
+GRAPHNODE* _graph_add_node(GRAPH* graph, NODEKIND kind, GRAPHNODE** inputs, int ninputs);
+
+/**
+ * @brief points `view` at region `reg` of `buf` (which holds region `bufreg`), using `rows` for the row pointers
+ */
+void _region_view(IMAGE* view, PIXEL** rows, IMAGE* buf, GRAPHREGION* bufreg, GRAPHREGION* reg);
+
+/**
+ * @brief evaluates a single output tile, with the node states of the band running it
+ *
+ * @return int `0` if success. `-1` if an op failed. `-2` if allocation failed
+ */
+int _graph_eval_tile(GRAPH* graph, GRAPHNODE* out, GRAPHSTATE* states, GRAPHREGION* tile, IMAGE* destimg);
+
+/**
+ * @brief tile function evaluating every output tile of rows [r1, r2[ (`arg` is a GRAPHTILE)
+ */
+void _graph_band_tile(void* arg, int r1, int r2);
+
+#endif
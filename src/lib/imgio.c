@@ -2,211 +2,773 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "imgio.h"
+#include "imgtrace.h"
+#include "imgmem.h"
+
+// PPM rows are read and written straight into pixel rows, which relies on this
+_Static_assert(sizeof(PIXEL) == 3, "PIXEL must be exactly the size of an RGBPIXEL");
 
 
 PIXEL** pxalloc(int width, int height) {
-    // allocate all row pointers
-    PIXEL** mat = (PIXEL**)malloc(sizeof(PIXEL*)*height);
-    if (mat == NULL) {
+
+    // the whole matrix lives in a single block: [header][row pointers][pixels]
+    // this way it can be reused for another image of a smaller or equal size (see `pxrealloc()`)
+    size_t npx = (size_t)width*height;
+    size_t size = pxmat_bytes(width, height);
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "pxalloc");
+    scope.bytes = size;
+
+    PXMATHEADER* header = (PXMATHEADER*)mem_alloc(size);
+    if (header == NULL) {
         // propagate the MALLOC error, as it's essencially just that
+        trace_end(&scope);
         return NULL;
     }
 
-    for (int r = 0; r < height; r++) {
-        // allocate all columns of a row
-        mat[r] = (PIXEL*)malloc(sizeof(PIXEL)*width);
+    header->px_capacity = npx;
+    header->row_capacity = height;
+
+    PIXEL** mat = (PIXEL**)(header + 1);
+    _layout_pxmat(mat, width, height);
+
+    trace_end(&scope);
+
+    return mat;
+
+}
+
+size_t pxmat_bytes(int width, int height) {
+    // plus a spare pixel, so reading whole pixels through a channel view (see `channel_view_img()`)
+    // never goes past the end of the block on its last row
+    return sizeof(PXMATHEADER) + sizeof(PIXEL*)*height + sizeof(PIXEL)*((size_t)width*height + 1);
+}
 
+PIXEL** pxrealloc(PIXEL** mat, int width, int height) {
 
-        if (mat[r] == NULL) {
-            printf("Error allocating memory for row %d !\n", r);
-            // de-allocate all memory of the matrix allocated up until this point
-            for (int rr = 0; rr < r; rr++) free(mat[rr]);
-            free(mat);
+    if (mat != NULL) {
+        PXMATHEADER* header = _pxmat_header(mat);
 
-            // propagate the MALLOC error
-            return NULL;
+        // big enough, we just need to point the rows to their new place
+        if (header->px_capacity >= (size_t)width*height && header->row_capacity >= height) {
+            _layout_pxmat(mat, width, height);
+            return mat;
         }
+
+        free_pxmat(mat, height);
     }
 
-    return mat;
+    return pxalloc(width, height);
+}
+
+
+int view_img(IMAGE* view, IMAGE* src, int r, int c, int width, int height) {
+
+    if (r < 0 || c < 0 || width < 0 || height < 0 || r + height > src->height || c + width > src->width) {
+        return -1;
+    }
+
+    PIXEL** mat = _view_alloc(height);
+    if (mat == NULL) {
+        return -3;
+    }
+
+    for (int i = 0; i < height; i++) {
+        mat[i] = src->mat[r + i] + c;
+    }
 
+    view->width = width;
+    view->height = height;
+    view->img_type = src->img_type;
+    view->mat = mat;
+
+    return 0;
 }
 
+int channel_view_img(IMAGE* view, IMAGE* src, int chan) {
 
-void read_ppm_image(char* filename, IMAGE* img) {
+    if (chan < 0 || chan > 2) {
+        return -1;
+    }
 
-    FILE* imgfd = fopen(filename, "rb");
+    PIXEL** mat = _view_alloc(src->height);
+    if (mat == NULL) {
+        return -3;
+    }
+
+    // rows are shifted by `chan` bytes, which puts that channel where the gray value of a PIXEL is
+    for (int r = 0; r < src->height; r++) {
+        mat[r] = (PIXEL*)((BYTE*)src->mat[r] + chan);
+    }
+
+    view->width = src->width;
+    view->height = src->height;
+    view->img_type = PGM;
+    view->mat = mat;
+
+    return 0;
+}
+
+int is_view_pxmat(PIXEL** mat) {
+    return mat != NULL && _pxmat_header(mat)->px_capacity == 0;
+}
+
+
+int load_pnm_image(char* filename, IMAGE* img, IMGTYPE type) {
+
+    TRACESCOPE scope, step;
+    trace_begin(&scope, "imgio", "load_pnm_image");
+    trace_begin(&step, "imgio", "read_header");
+
+    FILE* imgfd = _open_stream(filename, "rb");
 
     // check that file exists
     if (imgfd == NULL) {
-        printf("Error opening PPM file %s\n", filename);
-        exit(EXIT_FAILURE);
+        trace_end(&step);
+        trace_end(&scope);
+        return -1;
     }
 
-    // make sure the file being read is in PPM format
+    // make sure the file being read is of the expected type
     IMGTYPE it = _read_pnm_type(imgfd);
-    if (it != PPM) {
-        printf("Incorrect file type! Tried opening PPM, P%d type recieved!\n", it);
-        fclose(imgfd);
-        exit(EXIT_FAILURE);
+    img->img_type = it;
+    if ((type != 0 && it != type) || (it != PGM && it != PPM)) {
+        _close_stream(imgfd);
+        trace_end(&step);
+        trace_end(&scope);
+        return -2;
     }
 
-    img->img_type = PPM;
-
-    _skip_comments(imgfd);
-
     unsigned int width, height;
-    _read_image_dimensions(imgfd, &width, &height);
+    int res = _skip_comments(imgfd);
+    if (res == 0) {
+        res = _read_image_dimensions(imgfd, &width, &height);
+    }
+    trace_end(&step);
+    if (res != 0) {
+        _close_stream(imgfd);
+        trace_end(&scope);
+        return res;
+    }
 
-    img->mat = pxalloc(width, height);
+    MEMOP memop;
+    mem_op_begin(&memop, "load_pnm_image");
+    img->mat = pxrealloc(img->mat, width, height);
+    mem_op_end(&memop);
     if (img->mat == NULL) {
-        printf("Error allocating pixel matrix memory for read PPM file %s\n", filename);
-        fclose(imgfd);
+        _close_stream(imgfd);
+        trace_end(&scope);
+        return -3;
     }
 
-    // go over every pixel in the image file and add it to the matrix
-    for (int r = 0; r < height; r++) {
-        for (int c = 0; c < width; c++) {
+    img->width = width;
+    img->height = height;
 
-            int res = fread(
-                (void*)&img->mat[r][c],
-                sizeof(BYTE)*3, // RGBPIXEL works too, but I think 3*BYTE is safer
-                1,
-                imgfd
-            );
-
-            if (res < 1) {
-                if (feof(imgfd)) {
-                    printf("Error: unexpectedly reached end of file in %s !\n", filename);
-                } else {
-                    printf("Error: something went wrong while reading from %s !\n", filename);
-                }
-            }
+    // fread of the pixels, and spreading them over the PIXELs for PGMs
+    long long nbytes = (long long)width*height*(it == PPM ? 3 : 1);
+    trace_begin(&step, "imgio", "read_pixels");
+    step.bytes = nbytes;
+    step.pixels = (long long)width*height;
+
+    res = _read_pixel_rows(imgfd, img, 0, height);
+    _close_stream(imgfd);
+
+    trace_end(&step);
+    trace_count("bytes_read", nbytes);
+
+    scope.bytes = nbytes;
+    scope.pixels = step.pixels;
+    trace_end(&scope);
+
+    return res;
+}
+
+int save_pnm_image(char* destname, IMAGE* img, IMGTYPE type) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "save_pnm_image");
+    scope.pixels = (long long)img->width*img->height;
+    scope.bytes = scope.pixels*(type == PPM ? 3 : 1);
+
+    FILE* imgfd = _open_stream(destname, "wb");
+    if (imgfd == NULL) {
+        trace_end(&scope);
+        return -1;
+    }
+
+    // write the image file headers
+    fprintf(imgfd, "P%d\r", type);
+    fprintf(imgfd, "%u %u\r255\r", img->width, img->height);
+
+    int res = _write_pixel_rows(imgfd, img, type, 0, img->height);
+
+    // buffered data is only really written on close, so that can fail too
+    if (_close_stream(imgfd) != 0) {
+        res = -2;
+    }
+
+    trace_end(&scope);
+    trace_count("bytes_written", scope.bytes);
+
+    return res;
+}
+
+int open_row_reader(char* filename, ROWREADER* reader, IMGTYPE type) {
+
+    int res = open_frame_reader(filename, reader);
+    if (res != 0) {
+        return res;
+    }
+
+    // a single image, so an empty file isn't a PNM either
+    res = read_frame_header(reader, type);
+    if (res != 0) {
+        close_row_reader(reader);
+        return (res == 1) ? -2 : res;
+    }
+
+    return 0;
+}
+
+int read_rows(ROWREADER* reader, PIXEL** rows, int nrows) {
+
+    if (reader->next_row + nrows > reader->height) {
+        return -4;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "read_rows");
+    scope.pixels = (long long)reader->width*nrows;
+    scope.bytes = scope.pixels*(reader->img_type == PPM ? 3 : 1);
+
+    // the rows are seen as a small image of their own
+    IMAGE img = {.width = reader->width, .height = nrows, .mat = rows, .img_type = reader->img_type};
+    int res = _read_pixel_rows(reader->fd, &img, 0, nrows);
+
+    if (res == 0) {
+        reader->next_row += nrows;
+    }
+
+    trace_end(&scope);
+    trace_count("bytes_read", scope.bytes);
+
+    return res;
+}
+
+void close_row_reader(ROWREADER* reader) {
+
+    if (reader->fd != NULL) {
+        _close_stream(reader->fd);
+        reader->fd = NULL;
+    }
+}
+
+int open_frame_reader(char* filename, ROWREADER* reader) {
+
+    memset(reader, 0, sizeof(ROWREADER));
+
+    reader->fd = _open_stream(filename, "rb");
+    return (reader->fd == NULL) ? -1 : 0;
+}
 
+int read_frame_header(ROWREADER* reader, IMGTYPE type) {
+
+    // rows of the previous frame nobody read still have to go, streams can't be seeked over
+    long long left = (long long)(reader->height - reader->next_row)*reader->width*(reader->img_type == PPM ? 3 : 1);
+    BYTE skipped[4096];
+    while (left > 0) {
+        size_t n = (left < (long long)sizeof(skipped)) ? (size_t)left : sizeof(skipped);
+        if (fread(skipped, 1, n, reader->fd) < n) {
+            return -4;
         }
+        left -= n;
     }
-    fclose(imgfd);
+    reader->width = 0;
+    reader->height = 0;
+    reader->next_row = 0;
+
+    // nothing but whitespace left, that was the last frame
+    _skip_whitespace(reader->fd);
+    int c = fgetc(reader->fd);
+    if (c == EOF) {
+        return 1;
+    }
+    ungetc(c, reader->fd);
 
-    img->width = width;
-    img->height = height;
+    IMGTYPE it = _read_pnm_type(reader->fd);
+    reader->img_type = it;
+    if ((type != 0 && it != type) || (it != PGM && it != PPM)) {
+        return -2;
+    }
+
+    int res = _skip_comments(reader->fd);
+    if (res == 0) {
+        res = _read_image_dimensions(reader->fd, &reader->width, &reader->height);
+    }
+    if (res != 0) {
+        // nothing of this frame can be read
+        reader->width = 0;
+        reader->height = 0;
+    }
+
+    return res;
 }
 
-void read_pgm_image(char* filename, IMAGE* img) {
+int read_frame(ROWREADER* reader, IMAGE* img, IMGTYPE type) {
 
-    FILE* imgfd = fopen(filename, "rb");
+    int res = read_frame_header(reader, type);
+    img->img_type = reader->img_type;
+    if (res != 0) {
+        return res;
+    }
 
-    // check that file exists
+    MEMOP memop;
+    mem_op_begin(&memop, "read_frame");
+    img->mat = pxrealloc(img->mat, reader->width, reader->height);
+    mem_op_end(&memop);
+    if (img->mat == NULL) {
+        return -3;
+    }
+
+    img->width = reader->width;
+    img->height = reader->height;
+
+    return read_rows(reader, img->mat, img->height);
+}
+
+int open_pnm_file(char* filename, PNMFILE* file, IMGTYPE type, int use_mmap) {
+
+    memset(file, 0, sizeof(PNMFILE));
+    file->fd = -1;
+
+    // the header goes through the same parsing as every other read, only the raster is read differently
+    FILE* imgfd = fopen(filename, "rb");
     if (imgfd == NULL) {
-        printf("Error opening PGM file %s\n", filename);
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
-    // make sure the file being read is a PGM type
     IMGTYPE it = _read_pnm_type(imgfd);
-    if (it != PGM) {
-        printf("Incorrect file type! Tried opening PGM, P%d type recieved!\n", it);
+    file->img_type = it;
+    if ((type != 0 && it != type) || (it != PGM && it != PPM)) {
         fclose(imgfd);
-        exit(EXIT_FAILURE);
+        return -2;
     }
 
-    img->img_type = PGM;
+    int res = _skip_comments(imgfd);
+    if (res == 0) {
+        res = _read_image_dimensions(imgfd, &file->width, &file->height);
+    }
+    if (res != 0) {
+        fclose(imgfd);
+        return res;
+    }
+    file->offset = ftell(imgfd);
 
-    _skip_comments(imgfd);
+    // a descriptor of our own, as the FILE's buffering is of no use for scattered reads
+    file->fd = dup(fileno(imgfd));
+    fclose(imgfd);
+    if (file->fd < 0) {
+        return -1;
+    }
 
-    unsigned int width, height;
-    _read_image_dimensions(imgfd, &width, &height);
+    struct stat st;
+    size_t raster = (size_t)file->width*file->height*(it == PPM ? 3 : 1);
+    if (fstat(file->fd, &st) != 0 || (size_t)st.st_size < file->offset + raster) {
+        close_pnm_file(file);
+        return -4;
+    }
 
-    img->mat = pxalloc(width, height);
-    if (img->mat == NULL) {
-        printf("Error allocating pixel matrix memory for read PGM file %s\n", filename);
-        fclose(imgfd);
+    if (use_mmap && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+        if (map == MAP_FAILED) {
+            close_pnm_file(file);
+            return -1;
+        }
+        file->map = map;
+        file->map_size = st.st_size;
     }
 
-    // go over every pixel in the image file and add it to the matrix
-    for (int r = 0; r < height; r++) {
-        for (int c = 0; c < width; c++) {
+    return 0;
+}
+
+int read_pnm_roi(PNMFILE* file, IMAGE* img, int r, int c, int width, int height) {
+
+    if (r < 0 || c < 0 || width < 0 || height < 0 || r + height > file->height || c + width > file->width) {
+        return -1;
+    }
+
+    int bpp = (file->img_type == PPM) ? 3 : 1;
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "read_pnm_roi");
+    scope.pixels = (long long)width*height;
+    scope.bytes = scope.pixels*bpp;
+
+    img->mat = pxrealloc(img->mat, width, height);
+    if (img->mat == NULL) {
+        trace_end(&scope);
+        return -3;
+    }
+    img->width = width;
+    img->height = height;
+    img->img_type = file->img_type;
+
+    // PGM segments go through a row buffer to be spread over the PIXELs
+    BYTE* row = NULL;
+    if (bpp == 1 && file->map == NULL) {
+        row = (BYTE*)malloc(width > 0 ? width : 1);
+        if (row == NULL) {
+            trace_end(&scope);
+            return -3;
+        }
+    }
 
-            int res = fread(
-                (void*)&img->mat[r][c],
-                sizeof(GPIXEL),
-                1,
-                imgfd
-            );
-
-            if (res < 1) {
-                if (feof(imgfd)) {
-                    printf("Error: unexpectedly reached end of file in %s !\n", filename);
-                } else {
-                    printf("Error: something went wrong while reading from %s !\n", filename);
+    int res = 0;
+    for (int i = 0; i < height && res == 0; i++) {
+        // only the segment of the row within the rectangle is read
+        off_t pos = file->offset + ((off_t)(r + i)*file->width + c)*bpp;
+
+        if (file->map != NULL) {
+            const BYTE* seg = file->map + pos;
+            if (bpp == 3) {
+                memcpy(img->mat[i], seg, (size_t)width*3);
+            } else {
+                for (int k = 0; k < width; k++) {
+                    img->mat[i][k].gpx.v = seg[k];
                 }
             }
 
+        } else if (bpp == 3) {
+            res = _pread_full(file->fd, img->mat[i], (size_t)width*3, pos);
+
+        } else {
+            res = _pread_full(file->fd, row, width, pos);
+            for (int k = 0; k < width && res == 0; k++) {
+                img->mat[i][k].gpx.v = row[k];
+            }
         }
     }
-    fclose(imgfd);
 
-    img->width = width;
-    img->height = height;
+    free(row);
+
+    trace_end(&scope);
+    trace_count("bytes_read", scope.bytes);
+
+    return res;
 }
 
-void write_pgm2pgm(char* destname, IMAGE* img) {
+void close_pnm_file(PNMFILE* file) {
 
-    FILE* imgfd = fopen(destname, "wb");
+    if (file->map != NULL) {
+        munmap(file->map, file->map_size);
+        file->map = NULL;
+    }
+    if (file->fd >= 0) {
+        close(file->fd);
+        file->fd = -1;
+    }
+}
 
-    // write the image file headers
-    fprintf(imgfd, "P5\r");
-    fprintf(imgfd, "%u %u\r255\r", img->width, img->height);
+int load_pnm_roi(char* filename, IMAGE* img, IMGTYPE type, int r, int c, int width, int height) {
 
-    for (int r = 0; r < img->height; r++) {
-        for (int c = 0; c < img->width; c++) {
+    PNMFILE file;
+    int res = open_pnm_file(filename, &file, type, 0);
+    if (res != 0) {
+        return res;
+    }
 
-            int res = fwrite(
-                (void*)&img->mat[r][c],
-                sizeof(BYTE),
-                1,
-                imgfd
-            );
-            if (res < 1) {
-                printf("Error writing pgm2pgm to %s\n", destname);
-                exit(EXIT_FAILURE);
-            }
-        }
+    res = read_pnm_roi(&file, img, r, c, width, height);
+    close_pnm_file(&file);
+
+    return res;
+}
+
+int open_row_writer(char* destname, ROWWRITER* writer, unsigned int width, unsigned int height, IMGTYPE type) {
+
+    int res = open_frame_writer(destname, writer);
+    if (res != 0) {
+        return res;
     }
-    fclose(imgfd);
+
+    return write_frame_header(writer, width, height, type);
 }
 
-void write_ppm2ppm(char* destname, IMAGE* img) {
+int write_rows(ROWWRITER* writer, PIXEL** rows, int nrows) {
 
-    FILE* imgfd = fopen(destname, "wb");
-    if (imgfd == NULL) {
-        printf("Error opening PPM image for writing\n");
+    if (writer->next_row + nrows > writer->height) {
+        return -2;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "write_rows");
+    scope.pixels = (long long)writer->width*nrows;
+    scope.bytes = scope.pixels*(writer->img_type == PPM ? 3 : 1);
+
+    IMAGE img = {.width = writer->width, .height = nrows, .mat = rows, .img_type = writer->img_type};
+    int res = _write_pixel_rows(writer->fd, &img, writer->img_type, 0, nrows);
+
+    if (res == 0) {
+        writer->next_row += nrows;
+    }
+
+    trace_end(&scope);
+    trace_count("bytes_written", scope.bytes);
+
+    return res;
+}
+
+int close_row_writer(ROWWRITER* writer) {
+
+    if (writer->fd == NULL) {
+        return 0;
+    }
+
+    int res = (writer->next_row == writer->height) ? 0 : -2;
+
+    // buffered data is only really written on close, so that can fail too
+    if (_close_stream(writer->fd) != 0) {
+        res = -2;
+    }
+    writer->fd = NULL;
+
+    return res;
+}
+
+int open_frame_writer(char* destname, ROWWRITER* writer) {
+
+    memset(writer, 0, sizeof(ROWWRITER));
+
+    writer->fd = _open_stream(destname, "wb");
+    return (writer->fd == NULL) ? -1 : 0;
+}
+
+int write_frame_header(ROWWRITER* writer, unsigned int width, unsigned int height, IMGTYPE type) {
+
+    // frames are only told apart by their headers, so a short one would shift every frame after it
+    if (writer->next_row != writer->height) {
+        return -2;
+    }
+
+    // same header as `save_pnm_image()`
+    fprintf(writer->fd, "P%d\r", type);
+    fprintf(writer->fd, "%u %u\r255\r", width, height);
+
+    writer->width = width;
+    writer->height = height;
+    writer->img_type = type;
+    writer->next_row = 0;
+
+    return 0;
+}
+
+int write_frame(ROWWRITER* writer, IMAGE* img, IMGTYPE type) {
+
+    int res = write_frame_header(writer, img->width, img->height, type);
+    if (res != 0) {
+        return res;
+    }
+
+    return write_rows(writer, img->mat, img->height);
+}
+
+int async_writer_init(ASYNCWRITER* writer, int nbuffers) {
+
+    memset(writer, 0, sizeof(ASYNCWRITER));
+    if (nbuffers < 1) {
+        return -1;
+    }
+
+    writer->nbuffers = nbuffers;
+    writer->buffers = (IMAGE*)calloc(nbuffers, sizeof(IMAGE));
+    writer->freeq = (int*)malloc(sizeof(int)*nbuffers);
+    writer->jobs = (ASYNCJOB*)malloc(sizeof(ASYNCJOB)*nbuffers);
+    if (writer->buffers == NULL || writer->freeq == NULL || writer->jobs == NULL) {
+        free(writer->buffers);
+        free(writer->freeq);
+        free(writer->jobs);
+        return -3;
+    }
+
+    for (int i = 0; i < nbuffers; i++) {
+        writer->freeq[i] = i;
+    }
+    writer->nfree = nbuffers;
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, _async_writer_loop, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->cond);
+        free(writer->buffers);
+        free(writer->freeq);
+        free(writer->jobs);
+        return -3;
+    }
+
+    return 0;
+}
+
+IMAGE* async_acquire(ASYNCWRITER* writer) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgio", "async_acquire");
+
+    // nothing free means every buffer is waiting to be written, one of them will be back soon
+    pthread_mutex_lock(&writer->lock);
+    while (writer->nfree == 0) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    int buf = writer->freeq[writer->freehead];
+    writer->freehead = (writer->freehead + 1) % writer->nbuffers;
+    writer->nfree--;
+    pthread_mutex_unlock(&writer->lock);
+
+    trace_end(&scope);
+
+    return &writer->buffers[buf];
+}
+
+int async_write(ASYNCWRITER* writer, IMAGE* img, char* destname, IMGTYPE type) {
+
+    int buf = img - writer->buffers;
+    if (buf < 0 || buf >= writer->nbuffers) {
+        return -1;
+    }
+
+    char* path = strdup(destname);
+    if (path == NULL) {
+        return -3;
+    }
+
+    // at most every buffer is waiting to be written, so the ring never fills up
+    pthread_mutex_lock(&writer->lock);
+    ASYNCJOB* job = &writer->jobs[(writer->jobhead + writer->njobs) % writer->nbuffers];
+    job->buf = buf;
+    job->path = path;
+    job->type = type;
+    writer->njobs++;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+
+    return 0;
+}
+
+void async_release(ASYNCWRITER* writer, IMAGE* img) {
+
+    int buf = img - writer->buffers;
+    if (buf < 0 || buf >= writer->nbuffers) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    _async_push_free(writer, buf);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+int async_writer_close(ASYNCWRITER* writer) {
+
+    if (writer->buffers == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->cond);
+
+    for (int i = 0; i < writer->nbuffers; i++) {
+        free_img_pxmat(&writer->buffers[i]);
+    }
+    free(writer->buffers);
+    free(writer->freeq);
+    free(writer->jobs);
+    writer->buffers = NULL;
+
+    return (writer->failed > 0) ? -2 : 0;
+}
+
+void read_ppm_image(char* filename, IMAGE* img) {
+
+    // this always reads into a new pixel matrix
+    img->mat = NULL;
+    int res = load_pnm_image(filename, img, PPM);
+
+    if (res == -1) {
+        printf("Error opening PPM file %s\n", filename);
+    } else if (res == -2 && img->img_type != PPM) {
+        printf("Incorrect file type! Tried opening PPM, P%d type recieved!\n", img->img_type);
+    } else if (res == -2) {
+        printf("Error: malformed header in PPM file %s\n", filename);
+    } else if (res == -3) {
+        printf("Error allocating pixel matrix memory for read PPM file %s\n", filename);
+    } else if (res == -4) {
+        printf("Error: unexpectedly reached end of file in %s !\n", filename);
+    }
+
+    if (res != 0) {
         exit(EXIT_FAILURE);
     }
+}
 
-    fprintf(imgfd, "P6\r");
-    fprintf(imgfd, "%u %u\r255\r", img->width, img->height);
+void read_pgm_image(char* filename, IMAGE* img) {
 
+    // this always reads into a new pixel matrix
+    img->mat = NULL;
+    int res = load_pnm_image(filename, img, PGM);
 
-    for (int r = 0; r < img->height; r++) {
-        for (int c = 0; c < img->width; c++) {
+    if (res == -1) {
+        printf("Error opening PGM file %s\n", filename);
+    } else if (res == -2 && img->img_type != PGM) {
+        printf("Incorrect file type! Tried opening PGM, P%d type recieved!\n", img->img_type);
+    } else if (res == -2) {
+        printf("Error: malformed header in PGM file %s\n", filename);
+    } else if (res == -3) {
+        printf("Error allocating pixel matrix memory for read PGM file %s\n", filename);
+    } else if (res == -4) {
+        printf("Error: unexpectedly reached end of file in %s !\n", filename);
+    }
 
-            int res = fwrite(
-                (void*)&img->mat[r][c],
-                sizeof(BYTE)*3,
-                1,
-                imgfd
-            );
+    if (res != 0) {
+        exit(EXIT_FAILURE);
+    }
+}
 
-            if (res < 1) {
-                printf("Error writing ppm2ppm to %s\n", destname);
-                exit(EXIT_FAILURE);
-            }
+void write_pgm2pgm(char* destname, IMAGE* img) {
 
-        }
+    int res = save_pnm_image(destname, img, PGM);
+
+    if (res == -1) {
+        printf("Error opening PGM image for writing\n");
+        exit(EXIT_FAILURE);
+    } else if (res != 0) {
+        printf("Error writing pgm2pgm to %s\n", destname);
+        exit(EXIT_FAILURE);
     }
+}
 
-    fclose(imgfd);
+void write_ppm2ppm(char* destname, IMAGE* img) {
+
+    int res = save_pnm_image(destname, img, PPM);
+
+    if (res == -1) {
+        printf("Error opening PPM image for writing\n");
+        exit(EXIT_FAILURE);
+    } else if (res != 0) {
+        printf("Error writing ppm2ppm to %s\n", destname);
+        exit(EXIT_FAILURE);
+    }
 }
 
 void free_img(IMAGE* img) {
@@ -217,12 +779,10 @@ void free_img(IMAGE* img) {
 
 void free_pxmat(PIXEL** mat, int height) {
 
-    // because each row of columns is individually allocated
-    for (int r = 0; r < height; r++) {
-        free(mat[r]);
+    // every row lives in the same block as the matrix (see `pxalloc()`), so `height` isn't needed anymore
+    if (mat != NULL) {
+        mem_free(_pxmat_header(mat));
     }
-
-    free(mat);
 }
 
 void free_img_pxmat(IMAGE* img) {
@@ -245,7 +805,10 @@ void copy_img(IMAGE* dest, IMAGE* src) {
     // copies the initial structure
     memcpy(dest, src, sizeof(IMAGE));
 
+    MEMOP memop;
+    mem_op_begin(&memop, "copy_img");
     dest->mat = pxalloc(dest->width, dest->height);
+    mem_op_end(&memop);
 
     copy_pxmat(dest->mat, src->mat, dest->width, dest->height);
 
@@ -259,6 +822,101 @@ void copy_pxmat(PIXEL** dest, PIXEL** src, int width, int height) {
     }
 }
 
+void copy_gpxmat(PIXEL** dest, PIXEL** src, int width, int height) {
+
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            dest[r][c].gpx.v = src[r][c].gpx.v;
+        }
+    }
+}
+
+int pad_img(PADDEDIMG* dest, IMAGE* src, int pad, BORDERMODE mode, PIXEL value) {
+
+    if (pad < 0) {
+        return -1;
+    }
+
+    int width = src->width;
+    int height = src->height;
+    int pwidth = width + 2*pad;
+    int pheight = height + 2*pad;
+
+    memset(dest, 0, sizeof(PADDEDIMG));
+    dest->width = width;
+    dest->height = height;
+    dest->pad = pad;
+    dest->mode = mode;
+    dest->img_type = src->img_type;
+
+    dest->mat = pxalloc(pwidth, pheight);
+    // row pointers, then the excluded counts of every row and column
+    dest->rowbase = (PIXEL**)malloc(sizeof(PIXEL*)*pheight + sizeof(int)*(height + width));
+    if (dest->mat == NULL || dest->rowbase == NULL) {
+        free_padded_img(dest);
+        return -3;
+    }
+
+    dest->rows = dest->rowbase + pad;
+    for (int r = -pad; r < height + pad; r++) {
+        dest->rows[r] = dest->mat[r + pad] + pad;
+    }
+
+    // BORDER_EXCLUDED is a constant 0 apron, as far as the pixels go
+    PIXEL fill = value;
+    if (mode == BORDER_EXCLUDED) {
+        memset(&fill, 0, sizeof(PIXEL));
+    }
+
+    for (int r = -pad; r < height + pad; r++) {
+        PIXEL* row = dest->rows[r];
+        int sr = (r >= 0 && r < height) ? r : _border_index(r, height, mode);
+
+        if (sr < 0) {
+            for (int c = -pad; c < width + pad; c++) row[c] = fill;
+            continue;
+        }
+
+        memcpy(row, src->mat[sr], sizeof(PIXEL)*width);
+
+        for (int c = 1; c <= pad; c++) {
+            int sc = _border_index(-c, width, mode);
+            row[-c] = (sc < 0) ? fill : row[sc];
+            sc = _border_index(width - 1 + c, width, mode);
+            row[width - 1 + c] = (sc < 0) ? fill : row[sc];
+        }
+    }
+
+    if (mode == BORDER_EXCLUDED) {
+        dest->rowcount = (int*)(dest->rowbase + pheight);
+        dest->colcount = dest->rowcount + height;
+
+        for (int r = 0; r < height; r++) {
+            int lo = (r - pad > 0) ? r - pad : 0;
+            int hi = (r + pad < height - 1) ? r + pad : height - 1;
+            dest->rowcount[r] = hi - lo + 1;
+        }
+        for (int c = 0; c < width; c++) {
+            int lo = (c - pad > 0) ? c - pad : 0;
+            int hi = (c + pad < width - 1) ? c + pad : width - 1;
+            dest->colcount[c] = hi - lo + 1;
+        }
+    }
+
+    return 0;
+}
+
+void free_padded_img(PADDEDIMG* img) {
+
+    free_pxmat(img->mat, 0);
+    free(img->rowbase);
+    memset(img, 0, sizeof(PADDEDIMG));
+}
+
+size_t padded_bytes(int width, int height, int pad) {
+    return pxmat_bytes(width + 2*pad, height + 2*pad) + sizeof(PIXEL*)*(height + 2*pad) + sizeof(int)*(height + width);
+}
+
 
 void extr_rchan_img(IMAGE* dest, IMAGE* src) {
     // yeah yeah it's just a wrapper, idc
@@ -332,32 +990,245 @@ void _skip_whitespace(FILE* fd) {
 
 }
 
-void _skip_comments(FILE* fd) {
-    char c;
+int _skip_comments(FILE* fd) {
+    int c;
     _skip_whitespace(fd);
-    if (feof(fd)) {
-        printf("End of file reached while skipping comments!\n");
-        fclose(fd);
-        exit(EXIT_FAILURE);
-    }
+
     while ((c = fgetc(fd)) == '#') {
-        while ((c = fgetc(fd)) != '\n');
+        // a comment goes on until the end of its line, which has to come before the end of the file
+        while ((c = fgetc(fd)) != '\n' && c != EOF) ;
+        if (c == EOF) {
+            return -4;
+        }
+    }
+
+    // the header can't end on its comments
+    if (c == EOF) {
+        return -4;
     }
     ungetc(c, fd);
+
+    return 0;
 }
 
-void _read_image_dimensions(FILE* fd, unsigned int* width, unsigned int* height) {
+int _read_image_dimensions(FILE* fd, unsigned int* width, unsigned int* height) {
 
-    int maxval;
+    unsigned int maxval;
 
     _skip_whitespace(fd);
-    fscanf(fd, "%u %u %u%*c", width, height, &maxval);
+    int n = fscanf(fd, "%u %u %u%*c", width, height, &maxval);
+
+    if (n != 3) {
+        // the header was cut short, or it isn't made of numbers
+        return feof(fd) ? -4 : -2;
+    }
+    if (maxval != 255) {
+        return -2;
+    }
+
+    return 0;
 }
 
 IMGTYPE _read_pnm_type(FILE* fd) {
-    IMGTYPE t;
+    // stays 0 (not a PNM) if there is no magic number to read
+    IMGTYPE t = 0;
 
     fscanf(fd, "P%u", &t);
 
     return t;
-}
\ No newline at end of file
+}
+
+int _read_pixel_rows(FILE* fd, IMAGE* img, int r1, int r2) {
+
+    // PPM rows are exactly laid out like RGBPIXEL rows, so they can be read directly
+    if (img->img_type == PPM) {
+        for (int r = r1; r < r2; r++) {
+            if (fread(img->mat[r], sizeof(BYTE)*3, img->width, fd) < img->width) {
+                return -4;
+            }
+        }
+        return 0;
+    }
+
+    // PGM rows need to be spread out over the PIXELs
+    BYTE* row = (BYTE*)malloc(img->width);
+    if (row == NULL) {
+        return -3;
+    }
+
+    int res = 0;
+    for (int r = r1; r < r2 && res == 0; r++) {
+        if (fread(row, sizeof(BYTE), img->width, fd) < img->width) {
+            res = -4;
+            break;
+        }
+        for (int c = 0; c < img->width; c++) {
+            img->mat[r][c].gpx.v = row[c];
+        }
+    }
+
+    free(row);
+    return res;
+}
+
+int _write_pixel_rows(FILE* fd, IMAGE* img, IMGTYPE type, int r1, int r2) {
+
+    if (type == PPM) {
+        for (int r = r1; r < r2; r++) {
+            if (fwrite(img->mat[r], sizeof(BYTE)*3, img->width, fd) < img->width) {
+                return -2;
+            }
+        }
+        return 0;
+    }
+
+    // only the gray value of each PIXEL is written for a PGM
+    BYTE* row = (BYTE*)malloc(img->width);
+    if (row == NULL) {
+        return -3;
+    }
+
+    int res = 0;
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < img->width; c++) {
+            row[c] = img->mat[r][c].gpx.v;
+        }
+        if (fwrite(row, sizeof(BYTE), img->width, fd) < img->width) {
+            res = -2;
+            break;
+        }
+    }
+
+    free(row);
+    return res;
+}
+
+FILE* _open_stream(char* path, const char* mode) {
+
+    if (strcmp(path, "-") == 0) {
+        return (mode[0] == 'r') ? stdin : stdout;
+    }
+    return fopen(path, mode);
+}
+
+int _close_stream(FILE* fd) {
+
+    // the standard streams stay open for whoever uses them next, only what is buffered has to go
+    if (fd == stdin) {
+        return 0;
+    } else if (fd == stdout) {
+        return fflush(fd);
+    }
+    return fclose(fd);
+}
+
+void* _async_writer_loop(void* arg) {
+
+    ASYNCWRITER* writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        while (writer->njobs == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->njobs == 0) {
+            break;
+        }
+        ASYNCJOB job = writer->jobs[writer->jobhead];
+        writer->jobhead = (writer->jobhead + 1) % writer->nbuffers;
+        writer->njobs--;
+
+        // the buffer belongs to this thread until it is back in the pool, so it is written without the lock
+        pthread_mutex_unlock(&writer->lock);
+        int res = save_pnm_image(job.path, &writer->buffers[job.buf], job.type);
+        if (res != 0) {
+            // nobody is waiting on this write anymore, so this is the only place left to say which file it was
+            fprintf(stderr, "Error writing %s\n", job.path);
+        }
+        free(job.path);
+        pthread_mutex_lock(&writer->lock);
+
+        if (res != 0) {
+            writer->failed++;
+        }
+        _async_push_free(writer, job.buf);
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+void _async_push_free(ASYNCWRITER* writer, int buf) {
+    writer->freeq[(writer->freehead + writer->nfree) % writer->nbuffers] = buf;
+    writer->nfree++;
+    pthread_cond_broadcast(&writer->cond);
+}
+
+int _border_index(int i, int n, BORDERMODE mode) {
+
+    switch (mode) {
+        case BORDER_REPLICATE:
+            return (i < 0) ? 0 : n - 1;
+
+        case BORDER_REFLECT:
+            if (n == 1) {
+                return 0;
+            }
+            // aprons wider than the image fold back and forth over it, which repeats every 2*(n-1) pixels:
+            // going down to a single period first leaves at most one fold, however far `i` is
+            int period = 2*(n - 1);
+            i %= period;
+            if (i < 0) {
+                i += period;
+            }
+            return (i < n) ? i : period - i;
+
+        default:
+            return -1;
+    }
+}
+
+int _pread_full(int fd, void* buf, size_t size, off_t offset) {
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, (BYTE*)buf + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -4;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+PXMATHEADER* _pxmat_header(PIXEL** mat) {
+    return ((PXMATHEADER*)mat) - 1;
+}
+
+void _layout_pxmat(PIXEL** mat, int width, int height) {
+
+    PXMATHEADER* header = _pxmat_header(mat);
+    PIXEL* pixels = (PIXEL*)(mat + header->row_capacity);
+
+    for (int r = 0; r < height; r++) {
+        mat[r] = pixels + (size_t)r*width;
+    }
+}
+
+PIXEL** _view_alloc(int height) {
+
+    // same layout as `pxalloc()` without the pixels, so views are resized and freed like any other matrix
+    PXMATHEADER* header = (PXMATHEADER*)mem_alloc(sizeof(PXMATHEADER) + sizeof(PIXEL*)*height);
+    if (header == NULL) {
+        return NULL;
+    }
+
+    header->px_capacity = 0;
+    header->row_capacity = height;
+
+    return (PIXEL**)(header + 1);
+}
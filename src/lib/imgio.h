@@ -2,6 +2,11 @@
 #define IMAGE_IO_H
 
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// buffers of an ASYNCWRITER when the caller has no reason to pick another amount: one being computed while the other is written
+#define ASYNC_WRITER_BUFFERS 2
 
 // the size of a color value within a pixel
 typedef unsigned char BYTE;
@@ -54,6 +59,57 @@ struct _image_type_struct {
 };
 typedef struct _image_type_struct IMAGE;
 
+/**
+ * @brief how the apron around a padded image is filled (see `pad_img()`)
+ *
+ * @member BORDER_EXCLUDED: apron set to 0, with counts of the in bounds pixels kept so averages can leave it out
+ * @member BORDER_REPLICATE: nearest edge pixel (aaa|abc|ccc)
+ * @member BORDER_REFLECT: mirrored around the edge pixel, which isn't repeated (cb|abc|ba)
+ * @member BORDER_CONSTANT: a given pixel value
+ */
+enum _border_mode_enum {
+    BORDER_EXCLUDED = 0,
+    BORDER_REPLICATE,
+    BORDER_REFLECT,
+    BORDER_CONSTANT
+};
+typedef enum _border_mode_enum BORDERMODE;
+
+/**
+ * @brief a copy of an image surrounded by an apron of `pad` pixels on every side, so a kernel of radius
+ * @brief up to `pad` can read around any pixel without bounds checks
+ *
+ * @member rows: rows[r][c] is valid for r in [-pad, height+pad[ and c in [-pad, width+pad[
+ * @member rowcount: BORDER_EXCLUDED only, amount of rows within `pad` of row r that are in the image
+ * @member colcount: BORDER_EXCLUDED only, same for columns
+ * @member mat: the underlying (width+2*pad) x (height+2*pad) matrix, from `pxalloc()`
+ */
+struct _padded_image_type_struct {
+    unsigned int width;
+    unsigned int height;
+    int pad;
+    BORDERMODE mode;
+    IMGTYPE img_type;
+    PIXEL** rows;
+    int* rowcount;
+    int* colcount;
+    PIXEL** mat;
+    PIXEL** rowbase;
+};
+typedef struct _padded_image_type_struct PADDEDIMG;
+
+/**
+ * @brief bookkeeping stored just before the row pointers of every pixel matrix allocated by `pxalloc()`
+ *
+ * @member px_capacity: amount of pixels the matrix can hold, 0 for a view (its rows point into another matrix)
+ * @member row_capacity: amount of row pointers the matrix can hold
+ */
+struct _pxmat_header_type_struct {
+    size_t px_capacity;
+    size_t row_capacity;
+};
+typedef struct _pxmat_header_type_struct PXMATHEADER;
+
 /**
  * @brief dynamic allocation of memory for pixel matrix
  *
@@ -64,6 +120,61 @@ typedef struct _image_type_struct IMAGE;
  */
 PIXEL** pxalloc(int width, int height);
 
+/**
+ * @brief amount of memory `pxalloc()` takes for a matrix of this size
+ *
+ * @param width: width of the pixel matrix
+ * @param height: height of the pixel matrix
+ *
+ * @returns size_t size in bytes
+ */
+size_t pxmat_bytes(int width, int height);
+
+/**
+ * @brief resizes a pixel matrix previously allocated with `pxalloc()`. The matrix is reused if it is big enough, else it is freed and a new one is allocated.
+ * @brief NOTE: pixel values are NOT kept when the rows are moved around
+ *
+ * @param mat: matrix to reuse (can be NULL, in which case this is the same as `pxalloc()`)
+ * @param width: new width of the pixel matrix
+ * @param height: new height of the pixel matrix
+ *
+ * @returns PIXEL** type (beginning of matrix, may be `mat`) | NULL if dynamic allocation failed (`mat` has then been freed)
+ */
+PIXEL** pxrealloc(PIXEL** mat, int width, int height);
+
+/**
+ * @brief makes `view` a window over a rectangle of `src`, without copying any pixel: ops given the view
+ * @brief read and write the pixels of `src` directly, so cropping or tiling an image costs a row pointer per row.
+ * @brief Only the row pointers are allocated, and they're freed with `free_img_pxmat()` like any other matrix.
+ * @brief NOTE: `src` must outlive the view. Loading an image into a view gives it pixels of its own (see `pxrealloc()`)
+ *
+ * @param view the image to set up
+ * @param src the image to look into (can itself be a view)
+ * @param r row of the top left corner of the window in `src`
+ * @param c column of the top left corner of the window in `src`
+ * @param width width of the window
+ * @param height height of the window
+ * @return int `0` if success. `-1` if the window isn't within `src`. `-3` if the row pointers couldn't be allocated
+ */
+int view_img(IMAGE* view, IMAGE* src, int r, int c, int width, int height);
+
+/**
+ * @brief makes `view` a gray image over one channel of `src`, without copying any pixel. The rows of the view start
+ * @brief `chan` bytes into those of `src`, so the gray value of each of its pixels is that channel: gray ops
+ * @brief read and write it in place and leave the other channels alone
+ *
+ * @param view the image to set up, as a PGM
+ * @param src the RGB image to look into (can itself be a view)
+ * @param chan 0 for red (or Y), 1 for green (or Cb/U), 2 for blue (or Cr/V)
+ * @return int `0` if success. `-1` if `chan` isn't a channel. `-3` if the row pointers couldn't be allocated
+ */
+int channel_view_img(IMAGE* view, IMAGE* src, int chan);
+
+/**
+ * @brief whether a matrix is a view (see `view_img()`) rather than one owning its pixels
+ */
+int is_view_pxmat(PIXEL** mat);
+
 
 /**
  * @brief Reads PPM image from a given filename.
@@ -84,6 +195,340 @@ void read_ppm_image(char* filename, IMAGE* img);
 void read_pgm_image(char* filename, IMAGE* img);
 
 
+/**
+ * @brief Reads a PGM or PPM image from a given filename without exiting on errors, reusing the pixel matrix already in `img` when it is big enough.
+ * @brief Only supports max pixel value of 255
+ *
+ * @param filename string representing path to the PNM file to open ("-" for stdin)
+ * @param img destination image. `img->mat` must be NULL or a matrix allocated by `pxalloc()`
+ * @param type expected type of the file (PGM or PPM). 0 accepts both, check `img->img_type` afterwards
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened. `-2` if the file isn't of type `type` (or not a PGM/PPM at all) (the received type is left in `img->img_type`), or if its header is malformed. `-3` if allocation failed. `-4` if the file ended early.
+ */
+int load_pnm_image(char* filename, IMAGE* img, IMGTYPE type);
+
+/**
+ * @brief Writes an IMAGE to a PGM or PPM file without exiting on errors.
+ *
+ * @param destname pathname of the image file to write ("-" for stdout)
+ * @param img IMAGE data to write to file
+ * @param type type of file to write (PGM writes the gray value of each pixel, PPM all 3 channels)
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened. `-2` if writing failed. `-3` if allocation failed.
+ */
+int save_pnm_image(char* destname, IMAGE* img, IMGTYPE type);
+
+/**
+ * @brief a PGM or PPM file read a few rows at a time, so images bigger than memory can be streamed through ops.
+ * @brief Also reads streams of concatenated frames, one header after the other (see `open_frame_reader()`)
+ *
+ * @member width: width of the current frame
+ * @member height: height of the current frame
+ * @member next_row: index of the next row `read_rows()` will read
+ */
+struct _row_reader_type_struct {
+    FILE* fd;
+    unsigned int width;
+    unsigned int height;
+    IMGTYPE img_type;
+    unsigned int next_row;
+};
+typedef struct _row_reader_type_struct ROWREADER;
+
+/**
+ * @brief a PGM or PPM file written a few rows at a time, or a stream of concatenated frames (see `open_frame_writer()`)
+ *
+ * @member next_row: index of the next row `write_rows()` will write
+ */
+struct _row_writer_type_struct {
+    FILE* fd;
+    unsigned int width;
+    unsigned int height;
+    IMGTYPE img_type;
+    unsigned int next_row;
+};
+typedef struct _row_writer_type_struct ROWWRITER;
+
+/**
+ * @brief opens a PGM or PPM file and reads its header, leaving the pixel rows to `read_rows()`
+ *
+ * @param filename string representing path to the PNM file to open ("-" for stdin)
+ * @param reader where to write the reader (dimensions and type included)
+ * @param type expected type of the file (PGM or PPM). 0 accepts both, check `reader->img_type` afterwards
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened. `-2` if the file isn't of type `type` (or not a PGM/PPM at all), or if its header is malformed. `-4` if the file ends within its header
+ */
+int open_row_reader(char* filename, ROWREADER* reader, IMGTYPE type);
+
+/**
+ * @brief reads the next rows of a file
+ *
+ * @param reader the reader to read from
+ * @param rows where to read the rows to (each at least `reader->width` pixels)
+ * @param nrows amount of rows to read
+ *
+ * @returns `0` if success. `-3` if allocation failed. `-4` if the file ended early (or there aren't `nrows` rows left)
+ */
+int read_rows(ROWREADER* reader, PIXEL** rows, int nrows);
+
+/**
+ * @brief closes the file of a reader
+ *
+ * @param reader the reader to close
+ */
+void close_row_reader(ROWREADER* reader);
+
+/**
+ * @brief creates a PGM or PPM file and writes its header, leaving the pixel rows to `write_rows()`
+ *
+ * @param destname pathname of the image file to write ("-" for stdout)
+ * @param writer where to write the writer
+ * @param width width of the image
+ * @param height height of the image
+ * @param type type of file to write (PGM writes the gray value of each pixel, PPM all 3 channels)
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened
+ */
+int open_row_writer(char* destname, ROWWRITER* writer, unsigned int width, unsigned int height, IMGTYPE type);
+
+/**
+ * @brief writes the next rows of a file
+ *
+ * @param writer the writer to write to
+ * @param rows the rows to write (each `writer->width` pixels)
+ * @param nrows amount of rows to write
+ *
+ * @returns `0` if success. `-2` if writing failed (or there aren't `nrows` rows left). `-3` if allocation failed
+ */
+int write_rows(ROWWRITER* writer, PIXEL** rows, int nrows);
+
+/**
+ * @brief closes the file of a writer
+ *
+ * @param writer the writer to close
+ *
+ * @returns `0` if success. `-2` if the buffered rows couldn't be written or some rows were never written
+ */
+int close_row_writer(ROWWRITER* writer);
+
+/**
+ * @brief opens a stream of concatenated PGM/PPM frames (ex: `ffmpeg -f image2pipe`), without reading any header yet.
+ * @brief Each frame starts with `read_frame_header()` (or `read_frame()`), its rows are then read with `read_rows()`.
+ * @brief Close it with `close_row_reader()`
+ *
+ * @param filename path of the file to read the frames from, "-" for stdin
+ * @param reader where to write the reader
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened
+ */
+int open_frame_reader(char* filename, ROWREADER* reader);
+
+/**
+ * @brief goes to the next frame of a stream and reads its header. Rows of the previous frame that weren't read are skipped
+ *
+ * @param reader the reader, its dimensions and type are those of the new frame afterwards
+ * @param type expected type of the frame (PGM or PPM). 0 accepts both, check `reader->img_type` afterwards
+ *
+ * @returns `0` if success. `1` if the stream ended (there are no more frames). `-2` if the frame isn't of type `type` (or not a PGM/PPM at all), or if its header is malformed.
+ * @returns `-4` if the stream ended within the previous frame or within this frame's header
+ */
+int read_frame_header(ROWREADER* reader, IMGTYPE type);
+
+/**
+ * @brief reads the whole next frame of a stream into an image, reusing its pixel matrix when it is big enough,
+ * @brief so a stream of frames of the same size is read without any allocation after the first one
+ *
+ * @param reader the reader to read from
+ * @param img destination image. `img->mat` must be NULL or a matrix allocated by `pxalloc()`
+ * @param type expected type of the frame. 0 accepts both, check `img->img_type` afterwards
+ *
+ * @returns same as `read_frame_header()`, plus `-3` if allocation failed and `-4` if the stream ended within the frame
+ */
+int read_frame(ROWREADER* reader, IMAGE* img, IMGTYPE type);
+
+/**
+ * @brief creates a file to write concatenated PGM/PPM frames to, without writing any header yet. Each frame starts with
+ * @brief `write_frame_header()` (or `write_frame()`), its rows are then written with `write_rows()`. Close it with `close_row_writer()`
+ *
+ * @param destname path of the file to write the frames to, "-" for stdout
+ * @param writer where to write the writer
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened
+ */
+int open_frame_writer(char* destname, ROWWRITER* writer);
+
+/**
+ * @brief starts the next frame of a stream by writing its header
+ *
+ * @param writer the writer to write to
+ * @param width width of the frame
+ * @param height height of the frame
+ * @param type type of the frame (PGM or PPM)
+ *
+ * @returns `0` if success. `-2` if some rows of the previous frame were never written
+ */
+int write_frame_header(ROWWRITER* writer, unsigned int width, unsigned int height, IMGTYPE type);
+
+/**
+ * @brief writes a whole image as the next frame of a stream
+ *
+ * @param writer the writer to write to
+ * @param img image to write
+ * @param type type of the frame (PGM writes the gray value of each pixel, PPM all 3 channels)
+ *
+ * @returns `0` if success. `-2` if writing failed (or the previous frame isn't done). `-3` if allocation failed
+ */
+int write_frame(ROWWRITER* writer, IMAGE* img, IMGTYPE type);
+
+/**
+ * @brief a write handed over to an ASYNCWRITER
+ *
+ * @member buf: index of the buffer to write
+ * @member path: copy of the path to write it to
+ */
+struct _async_job_type_struct {
+    int buf;
+    char* path;
+    IMGTYPE type;
+};
+typedef struct _async_job_type_struct ASYNCJOB;
+
+/**
+ * @brief pool of image buffers written to files by a background thread, so writing an image overlaps with computing the next one.
+ * @brief Buffers go round: `async_acquire()` takes the oldest free one, `async_write()` hands it to the thread,
+ * @brief which puts it back in the pool once it is written
+ *
+ * @member buffers: the images of the pool, their pixel matrices kept from one use to the next
+ * @member freeq: ring of the indices of the free buffers, oldest first, `nfree` of them from `freehead`
+ * @member jobs: ring of the writes waiting for the thread, oldest first, `njobs` of them from `jobhead`
+ * @member failed: amount of writes that failed
+ * @member closing: set by `async_writer_close()`, the thread stops once no write is left
+ */
+struct _async_writer_type_struct {
+    IMAGE* buffers;
+    int nbuffers;
+
+    int* freeq;
+    int freehead;
+    int nfree;
+
+    ASYNCJOB* jobs;
+    int jobhead;
+    int njobs;
+
+    int failed;
+    int closing;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+typedef struct _async_writer_type_struct ASYNCWRITER;
+
+/**
+ * @brief creates the buffers of an async writer and starts its thread
+ *
+ * @param writer the writer to initialize
+ * @param nbuffers amount of buffers (ASYNC_WRITER_BUFFERS for double buffering), at least 1
+ *
+ * @returns `0` if success. `-1` if `nbuffers` is below 1. `-3` if allocation failed or the thread couldn't be started
+ */
+int async_writer_init(ASYNCWRITER* writer, int nbuffers);
+
+/**
+ * @brief takes a free buffer of the pool, waiting for a write to be done if there is none. Its pixel matrix is the one it had last
+ * @brief (NULL the first time), to be resized with `pxrealloc()` before use. Buffers come out in the order they went back to the pool,
+ * @brief so the last buffer handed to `async_write()` can still be read while the next one is computed when there are 2 buffers or more
+ *
+ * @return IMAGE* the buffer, owned by the caller until it goes to `async_write()` or `async_release()`
+ */
+IMAGE* async_acquire(ASYNCWRITER* writer);
+
+/**
+ * @brief hands a buffer over to the writer thread, which writes it to `destname` and puts it back in the pool.
+ * @brief Returns right away: failed writes are reported on stderr with their path by the thread, and counted (see `async_writer_close()`)
+ *
+ * @param writer the writer
+ * @param img a buffer from `async_acquire()`
+ * @param destname pathname of the image file to write (copied)
+ * @param type type of file to write (PGM or PPM)
+ *
+ * @returns `0` if success. `-1` if `img` isn't a buffer of `writer`. `-3` if allocation failed
+ */
+int async_write(ASYNCWRITER* writer, IMAGE* img, char* destname, IMGTYPE type);
+
+/**
+ * @brief puts a buffer back in the pool without writing it
+ */
+void async_release(ASYNCWRITER* writer, IMAGE* img);
+
+/**
+ * @brief waits for every write handed over to be done, stops the thread and frees the buffers
+ *
+ * @returns `0` if every write succeeded. `-2` if some failed (`writer->failed` of them)
+ */
+int async_writer_close(ASYNCWRITER* writer);
+
+/**
+ * @brief a PGM or PPM file opened for reads of arbitrary rectangles (see `read_pnm_roi()`). Binary rasters
+ * @brief have a fixed size after the header, so the bytes of any pixel are at a known offset
+ *
+ * @member fd: file descriptor of the file
+ * @member offset: position of the first pixel in the file
+ * @member map: the whole file mapped in memory, NULL if rows are read with pread instead
+ * @member map_size: size of the mapping
+ */
+struct _pnm_file_type_struct {
+    int fd;
+    unsigned int width;
+    unsigned int height;
+    IMGTYPE img_type;
+    long offset;
+    BYTE* map;
+    size_t map_size;
+};
+typedef struct _pnm_file_type_struct PNMFILE;
+
+/**
+ * @brief opens a PGM or PPM file and reads its header, for `read_pnm_roi()`
+ *
+ * @param filename pathname of the image file
+ * @param file the file to set up, to be closed with `close_pnm_file()`
+ * @param type expected type of the file (PGM or PPM), or 0 to accept both
+ * @param use_mmap 1 to map the file in memory (best for many small or narrow reads, such as columns),
+ * @param          0 to read each row segment with pread
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened (or mapped). `-2` if the file isn't of type `type` (or not a PGM/PPM at all), or if its header is malformed. `-4` if the file ends within its header or is shorter than its header says
+ */
+int open_pnm_file(char* filename, PNMFILE* file, IMGTYPE type, int use_mmap);
+
+/**
+ * @brief reads a rectangle of a file into an image, reading only the bytes of its rows within the rectangle,
+ * @brief so the cost follows the size of the rectangle and not the size of the file
+ *
+ * @param file the file to read from
+ * @param img where to read the rectangle to, its matrix is reused if big enough (see `pxrealloc()`)
+ * @param r row of the top left corner of the rectangle
+ * @param c column of the top left corner of the rectangle
+ * @param width width of the rectangle
+ * @param height height of the rectangle
+ *
+ * @returns `0` if success. `-1` if the rectangle isn't within the image. `-3` if allocation failed. `-4` if the file ended early
+ */
+int read_pnm_roi(PNMFILE* file, IMAGE* img, int r, int c, int width, int height);
+
+/**
+ * @brief closes (and unmaps) a file opened with `open_pnm_file()`
+ */
+void close_pnm_file(PNMFILE* file);
+
+/**
+ * @brief reads a rectangle of a PGM or PPM file with pread, in one call (see `read_pnm_roi()`)
+ *
+ * @returns the codes of `open_pnm_file()` and `read_pnm_roi()`
+ */
+int load_pnm_roi(char* filename, IMAGE* img, IMGTYPE type, int r, int c, int width, int height);
+
 /**
  * @brief writes a given IMAGE to a PGM file.
  *
@@ -112,8 +557,8 @@ void free_img(IMAGE* img);
 /**
  * @brief De-allocates a dynamically allocated 2D pixel matrix of a given height
  *
- * @param mat: pointer towards the 2D array
- * @param height: height of the image
+ * @param mat: pointer towards the 2D array (allocated with `pxalloc()` or `pxrealloc()`)
+ * @param height: height of the image (no longer needed, kept for compatibility)
  */
 void free_pxmat(PIXEL** mat, int height);
 
@@ -151,6 +596,41 @@ void copy_img(IMAGE* dest, IMAGE* src);
  */
 void copy_pxmat(PIXEL** dest, PIXEL** src, int width, int height);
 
+/**
+ * @brief copies the gray value of every pixel of a 2D pixel matrix, leaving the other two bytes of `dest` as they are.
+ * @brief This is the copy to use into gray images, which may be channel views (see `channel_view_img()`)
+ *
+ * @param dest where to copy the matrix to
+ * @param src  the matrix to copy
+ * @param width width of the matrix
+ * @param height height of the matrix
+ */
+void copy_gpxmat(PIXEL** dest, PIXEL** src, int width, int height);
+
+/**
+ * @brief copies an image into a padded buffer, filling the apron around it as told by `mode`
+ *
+ * @param dest the padded image to fill, to be freed with `free_padded_img()`
+ * @param src the image to copy
+ * @param pad width of the apron, in pixels
+ * @param mode how to fill the apron
+ * @param value the apron's pixel for BORDER_CONSTANT (ignored otherwise)
+ * @return int `0` if success. `-1` if `pad` is negative. `-3` if the buffer couldn't be allocated
+ */
+int pad_img(PADDEDIMG* dest, IMAGE* src, int pad, BORDERMODE mode, PIXEL value);
+
+/**
+ * @brief frees the buffers of a padded image
+ *
+ * @param img the padded image (its members are reset)
+ */
+void free_padded_img(PADDEDIMG* img);
+
+/**
+ * @brief amount of memory `pad_img()` takes for an image of this size
+ */
+size_t padded_bytes(int width, int height, int pad);
+
 
 /**
  * @brief Extracts the red channel from an RGBPIXEL image and places it in a GPIXEL image
@@ -221,14 +701,25 @@ void _skip_whitespace(FILE* fd);
 /**
  * @brief skips whatever comments there is between the magic number and the beginning of the data
  * @brief NOTE: assums PNM type has already been read
+ *
+ * @returns `0` if success. `-4` if the file ended before the end of the header
  */
-void _skip_comments(FILE* fd);
+int _skip_comments(FILE* fd);
+
+/**
+ * @brief index of the in bounds pixel an apron index `i` of a row (or column) of `n` pixels takes its value from
+ *
+ * @return int the index, -1 if the apron pixel takes no pixel's value (BORDER_EXCLUDED and BORDER_CONSTANT)
+ */
+int _border_index(int i, int n, BORDERMODE mode);
 
  /**
   * @brief reads an image's dimesions from an open file
   * @brief NOTE: assumes PNM type and comments have already been read
+  *
+  * @returns `0` if success. `-2` if the dimensions aren't numbers or the max value isn't 255. `-4` if the file ended before the end of the header
   */
-void _read_image_dimensions(FILE* fd, unsigned int* width, unsigned int* height);
+int _read_image_dimensions(FILE* fd, unsigned int* width, unsigned int* height);
 
 /**
  * @brief returns an integer `n` representing the number in a pnm's file's Pn which descripes what kind of pnm file it is.
@@ -238,4 +729,64 @@ void _read_image_dimensions(FILE* fd, unsigned int* width, unsigned int* height)
  */
 unsigned int _read_pnm_type(FILE* fd);
 
+/**
+ * @brief opens a file with `fopen()`, except for "-" which is stdin when reading and stdout when writing
+ */
+FILE* _open_stream(char* path, const char* mode);
+
+/**
+ * @brief closes a file opened by `_open_stream()`. stdin and stdout are left open, stdout only flushed
+ *
+ * @return int `0` if success, EOF if buffered data couldn't be written
+ */
+int _close_stream(FILE* fd);
+
+/**
+ * @brief loop of the thread of an ASYNCWRITER (`arg`): writes the jobs in order until the writer is closed
+ */
+void* _async_writer_loop(void* arg);
+
+/**
+ * @brief puts buffer `buf` at the back of the free ring and wakes whoever waits for one. Call with the lock held
+ */
+void _async_push_free(ASYNCWRITER* writer, int buf);
+
+/**
+ * @brief reads rows [r1, r2[ of pixel data from an open PNM file into `img->mat`, depending on `img->img_type`
+ *
+ * @returns `0` if success. `-3` if allocation failed. `-4` if the file ended early
+ */
+int _read_pixel_rows(FILE* fd, IMAGE* img, int r1, int r2);
+
+/**
+ * @brief writes rows [r1, r2[ of `img` to an open PNM file as pixel data of the given type
+ *
+ * @returns `0` if success. `-2` if writing failed. `-3` if allocation failed
+ */
+int _write_pixel_rows(FILE* fd, IMAGE* img, IMGTYPE type, int r1, int r2);
+
+/**
+ * @brief returns the header placed before the row pointers of a matrix allocated by `pxalloc()`
+ */
+PXMATHEADER* _pxmat_header(PIXEL** mat);
+
+/**
+ * @brief points the first `height` rows of `mat` to consecutive `width` sized rows of its pixel block
+ */
+void _layout_pxmat(PIXEL** mat, int width, int height);
+
+/**
+ * @brief pread of exactly `size` bytes, going on after short reads
+ *
+ * @return int `0` if success, `-4` if the file ended (or failed) before
+ */
+int _pread_full(int fd, void* buf, size_t size, off_t offset);
+
+/**
+ * @brief allocates the header and row pointers of a view (a matrix with no pixels of its own)
+ *
+ * @return PIXEL** the row pointers, to be set by the caller | NULL if the allocation failed
+ */
+PIXEL** _view_alloc(int height);
+
 #endif
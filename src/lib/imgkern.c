@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "imgkern.h"
+
+// one table per copy of imgkern_impl.c, only built for x86 targets
+#ifdef IMG_KERN_X86
+extern const KERNELS kern_table_sse2;
+extern const KERNELS kern_table_avx2;
+extern const KERNELS kern_table_avx512;
+#endif
+
+static const char* _kern_names[_KERNEND] = {"scalar", "sse2", "avx2", "avx512"};
+
+static pthread_once_t _kern_once = PTHREAD_ONCE_INIT;
+static KERNLEVEL _kern_level = KERN_SCALAR;
+static const KERNELS* _kern_table = NULL;
+
+
+const KERNELS* kernels(void) {
+    pthread_once(&_kern_once, _kern_init);
+    return _kern_table;
+}
+
+KERNLEVEL kern_level(void) {
+    pthread_once(&_kern_once, _kern_init);
+    return _kern_level;
+}
+
+const char* kern_level_name(KERNLEVEL level) {
+    return (level >= KERN_SCALAR && level < _KERNEND) ? _kern_names[level] : "unknown";
+}
+
+size_t kern_blur_scratch(int width, int range) {
+    // column sums of a padded row, window sums, counts and their inverses
+    return sizeof(int)*(3*(size_t)(width + 2*range) + 3*(size_t)width + width) + sizeof(float)*width;
+}
+
+size_t kern_morpho_scratch(int width, int radius) {
+    return 3*(size_t)(width + 2*radius) + width;
+}
+
+size_t kern_area_scratch(int width, int factor) {
+    // column sums of the block rows, block sums, counts and their inverses
+    size_t destw = (width + factor - 1)/factor;
+    return sizeof(int)*(3*(size_t)width + 3*destw + destw) + sizeof(float)*destw;
+}
+
+size_t kern_resample_scratch(int width) {
+    return sizeof(int)*3*(size_t)width;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+KERNLEVEL _kern_detect(void) {
+
+#ifdef IMG_KERN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) {
+        return KERN_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return KERN_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return KERN_SSE2;
+    }
+#endif
+
+    return KERN_SCALAR;
+}
+
+void _kern_init(void) {
+
+    KERNLEVEL level = _kern_detect();
+
+    char* forced = getenv(KERN_ENV);
+    if (forced != NULL && forced[0] != '\0') {
+        int wanted = -1;
+        for (int i = 0; i < _KERNEND; i++) {
+            if (strcmp(forced, _kern_names[i]) == 0) {
+                wanted = i;
+            }
+        }
+
+        if (wanted < 0) {
+            fprintf(stderr, "%s: unknown level \"%s\", using %s\n", KERN_ENV, forced, _kern_names[level]);
+        } else if ((KERNLEVEL)wanted > level) {
+            fprintf(stderr, "%s: %s not supported here, using %s\n", KERN_ENV, forced, _kern_names[level]);
+        } else {
+            level = (KERNLEVEL)wanted;
+        }
+    }
+
+    _kern_level = level;
+
+#ifdef IMG_KERN_X86
+    switch (level) {
+        case KERN_SSE2: _kern_table = &kern_table_sse2; break;
+        case KERN_AVX2: _kern_table = &kern_table_avx2; break;
+        case KERN_AVX512: _kern_table = &kern_table_avx512; break;
+        default: _kern_table = NULL; break;
+    }
+#endif
+}
@@ -0,0 +1,127 @@
+#ifndef IMAGE_KERN_H
+#define IMAGE_KERN_H
+
+#include "imgio.h"
+
+// environment variable forcing a kernel level: "scalar", "sse2", "avx2" or "avx512".
+// A level the CPU (or the build) doesn't have falls back to the best one below it
+#define KERN_ENV "IMG_SIMD"
+
+// largest radius the blur kernel takes: a square window of 255s sums to less than 2^24 up to it,
+// so the float estimate of its average stays within one of the exact quotient
+#define KERN_BLUR_MAX_RADIUS 127
+
+// largest factor the area kernel takes, for the same reason: twice the sum of a block of 255s stays below 2^24
+#define KERN_AREA_MAX_FACTOR 128
+
+enum _kern_level_enum {
+    // the plain C paths of imgops, no kernel table
+    KERN_SCALAR = 0,
+    KERN_SSE2,
+    KERN_AVX2,
+    KERN_AVX512,
+    _KERNEND
+};
+typedef enum _kern_level_enum KERNLEVEL;
+
+/**
+ * @brief hot row kernels of imgops, compiled once per instruction set (see imgkern_impl.c).
+ * @brief Rows are handled as raw bytes, 3 per pixel. Gray kernels only change the first byte of each pixel
+ *
+ * @member blur: one output row of a square (`cross` 0) or cross (`cross` 1) blur of radius `range`, reading a padded
+ * @member       (BORDER_EXCLUDED, pad >= range) copy of the source. `scratch` holds `kern_blur_scratch()` bytes
+ * @member morpho: one output row of an erosion (`v` 0) or dilation (`v` 255), reading a padded (BORDER_CONSTANT
+ * @member         holding 255 - `v`, pad >= radius) copy of the source. `scratch` holds `kern_morpho_scratch()` bytes
+ * @member thresh: v = (t < v) ? above : under, over the gray values of `width` pixels
+ * @member tri_thresh: v = 0 under t1, 255 from t2, else 128
+ * @member invert: v = 255 - v
+ * @member add: v = v + k clamped to [0, 255]
+ * @member lut: v = lut[ch][v] over the first `nchan` (1 or 3) channels of `width` pixels
+ * @member rgb_thresh: each channel of `width` RGB pixels set to `under` if below its threshold, else `above`
+ * @member convert: `width` pixels of a color conversion (a CONVTYPE) between rows that don't overlap,
+ * @member          returns -1 if the conversion has no kernel
+ * @member histogram: adds the values of channel `chan` (of `nchan`) of a whole matrix to `hist` (stride `nchan`)
+ * @member area: one output row of an area downscale by `factor`, averaging the `nrows` rows of the block and `factor`
+ * @member       columns (fewer on the right edge). `scratch` holds `kern_area_scratch()` bytes
+ * @member resample_v: vertical pass of a resampler, `count` rows times their weights (RESAMPLE_BITS after the point) into
+ * @member             `nchan` values per pixel with RESAMPLE_ROW_BITS after the point. `scratch` holds `kern_resample_scratch()` bytes
+ * @member resample_h: horizontal pass of a resampler, from a row of `resample_v` into `width` pixels, rounded and clamped
+ * @member warp: `n` bilinear samples at fixed point coordinates (WARP_FRAC_BITS after the point), each at least one pixel
+ * @member       away from the right and bottom edges of `rows`
+ * @member warp_steps: `n` fixed point coordinates of an affine row, from (`x0`, `y0`) by (`dx`, `dy`), all with 16 more bits than
+ * @member             the coordinates. Returns 1 if every point is in [0, `xmax`[ x [0, `ymax`[, else 0
+ */
+struct _kernels_type_struct {
+    KERNLEVEL level;
+    void (*blur)(BYTE* dest, PIXEL** rows, int r, int width, int range, int nchan, int cross, const int* colcount, int rowcount, void* scratch);
+    void (*morpho)(BYTE* dest, PIXEL** rows, int r, int width, int radius, BYTE v, void* scratch);
+    void (*thresh)(BYTE* p, int width, int t, BYTE under, BYTE above);
+    void (*tri_thresh)(BYTE* p, int width, int t1, int t2);
+    void (*invert)(BYTE* p, int width);
+    void (*add)(BYTE* p, int width, int k);
+    void (*lut)(BYTE* p, int width, int nchan, const BYTE lut[3][256]);
+    void (*rgb_thresh)(BYTE* p, int width, const int t[3], BYTE under, BYTE above);
+    int (*convert)(BYTE* restrict dest, const BYTE* restrict src, int width, int conv);
+    void (*histogram)(PIXEL** mat, int width, int height, int chan, int nchan, int* hist);
+    void (*area)(BYTE* dest, PIXEL** rows, int nrows, int width, int factor, int nchan, void* scratch);
+    void (*resample_v)(short* dest, PIXEL** rows, int count, const short* w, int width, int nchan, void* scratch);
+    void (*resample_h)(BYTE* dest, const short* row, int width, int nchan, const int* start, const int* count, const short* w, int taps);
+    void (*warp)(BYTE* dest, PIXEL** rows, const int* xs, const int* ys, int n, int nchan);
+    int (*warp_steps)(int* xs, int* ys, long long x0, long long y0, long long dx, long long dy, int n, int xmax, int ymax);
+};
+typedef struct _kernels_type_struct KERNELS;
+
+
+/**
+ * @brief the kernels picked for this CPU (decided once, from cpuid and KERN_ENV)
+ *
+ * @return const KERNELS* the kernel table, NULL at KERN_SCALAR (ops then use their plain C paths)
+ */
+const KERNELS* kernels(void);
+
+/**
+ * @brief the level picked by `kernels()`
+ */
+KERNLEVEL kern_level(void);
+
+/**
+ * @brief name of a level, as accepted by KERN_ENV
+ */
+const char* kern_level_name(KERNLEVEL level);
+
+/**
+ * @brief scratch size `KERNELS.blur` needs for a row
+ */
+size_t kern_blur_scratch(int width, int range);
+
+/**
+ * @brief scratch size `KERNELS.morpho` needs for a row
+ */
+size_t kern_morpho_scratch(int width, int radius);
+
+/**
+ * @brief scratch size `KERNELS.area` needs for a row (the plain C path of imgscale uses the same)
+ */
+size_t kern_area_scratch(int width, int factor);
+
+/**
+ * @brief scratch size `KERNELS.resample_v` needs for a row
+ */
+size_t kern_resample_scratch(int width);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief best level both the build and the CPU support
+ */
+KERNLEVEL _kern_detect(void);
+
+/**
+ * @brief picks the level, run once
+ */
+void _kern_init(void);
+
+#endif
@@ -0,0 +1,490 @@
+// Row kernels of imgops, written so the compiler can vectorize them. This file is compiled once per
+// instruction set (see src/lib/CMakeLists.txt), KERN_SUFFIX and KERN_LEVEL telling the copies apart,
+// and `kernels()` picks one of the copies at runtime
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgkern.h"
+#include "imgscale.h"
+#include "imgwarp.h"
+
+#ifndef KERN_SUFFIX
+#error "imgkern_impl.c must be built with KERN_SUFFIX and KERN_LEVEL defined"
+#endif
+
+#define _KERN_CAT(a, b) a##b
+#define _KERN_NAME(a, b) _KERN_CAT(a, b)
+#define KERN_NAME(name) _KERN_NAME(name, KERN_SUFFIX)
+
+// which bytes of 64 pixels are gray values: the first of each pixel
+#define _GRAY_LANES4 1,0,0, 1,0,0, 1,0,0, 1,0,0
+#define _GRAY_LANES16 _GRAY_LANES4, _GRAY_LANES4, _GRAY_LANES4, _GRAY_LANES4
+static const BYTE _gray_lanes[192] = {_GRAY_LANES16, _GRAY_LANES16, _GRAY_LANES16, _GRAY_LANES16};
+
+// applies EXPR (of the byte `v`) to the gray value of `width` pixels, keeping the other two bytes.
+// Rows go by chunks of 64 pixels, where the constant lane pattern becomes a blend instead of a
+// stride 3 store the compiler couldn't vectorize. Chunks stop at the last gray value: on a channel
+// view the two bytes after it belong to the next row, which another thread may be writing
+#define _GRAY_MAP(p, width, EXPR) { \
+    int _n = 3*(width); \
+    int _k = 0; \
+    for (; _k + 192 <= _n - 2; _k += 192) { \
+        BYTE* _q = (p) + _k; \
+        for (int _j = 0; _j < 192; _j++) { \
+            BYTE v = _q[_j]; \
+            _q[_j] = _gray_lanes[_j] ? (BYTE)(EXPR) : v; \
+        } \
+    } \
+    for (; _k < _n; _k += 3) { \
+        BYTE v = (p)[_k]; \
+        (p)[_k] = (BYTE)(EXPR); \
+    } \
+}
+
+
+static void KERN_NAME(_blur)(BYTE* dest, PIXEL** rows, int r, int width, int range, int nchan, int cross, const int* colcount, int rowcount, void* scratch) {
+
+    // bytes of a padded row, from column -range to width+range
+    int n = 3*(width + 2*range);
+
+    int* restrict vsum = scratch;
+    int* restrict sums = vsum + n;
+    int* restrict counts = sums + 3*width;
+    float* restrict inv = (float*)(counts + width);
+
+    // vertical sums of the window rows (of the column for a cross), over every byte: the loops go
+    // straight through memory and every lane does the same thing
+    const BYTE* top = (const BYTE*)(rows[r - range] - range);
+    for (int k = 0; k < n; k++) {
+        vsum[k] = top[k];
+    }
+    for (int dr = -range + 1; dr <= range; dr++) {
+        const BYTE* row = (const BYTE*)(rows[r + dr] - range);
+        for (int k = 0; k < n; k++) {
+            vsum[k] += row[k];
+        }
+    }
+
+    if (!cross) {
+        for (int ch = 0; ch < nchan; ch++) {
+            for (int c = 0; c < width; c++) {
+                sums[c*nchan + ch] = vsum[3*c + ch];
+            }
+            for (int d = 1; d <= 2*range; d++) {
+                for (int c = 0; c < width; c++) {
+                    sums[c*nchan + ch] += vsum[3*(c + d) + ch];
+                }
+            }
+        }
+        for (int c = 0; c < width; c++) {
+            counts[c] = rowcount*colcount[c];
+        }
+
+    } else {
+        // column through the center, then the row through it (the center is counted twice, as in `blur_gpx_cross()`)
+        const BYTE* mid = (const BYTE*)(rows[r] - range);
+        for (int ch = 0; ch < nchan; ch++) {
+            for (int c = 0; c < width; c++) {
+                sums[c*nchan + ch] = vsum[3*(c + range) + ch];
+            }
+            for (int d = 0; d <= 2*range; d++) {
+                for (int c = 0; c < width; c++) {
+                    sums[c*nchan + ch] += mid[3*(c + d) + ch];
+                }
+            }
+        }
+        for (int c = 0; c < width; c++) {
+            counts[c] = rowcount + colcount[c];
+        }
+    }
+
+    // there is no integer division in SIMD: a float estimate (sums are exact in a float below 2^24)
+    // is off by at most one, which the two corrections below take back to the exact quotient
+    for (int c = 0; c < width; c++) {
+        inv[c] = 1.0f / counts[c];
+    }
+    for (int ch = 0; ch < nchan; ch++) {
+        for (int c = 0; c < width; c++) {
+            int s = sums[c*nchan + ch];
+            int m = counts[c];
+            int q = (int)(s*inv[c]);
+            q -= (q*m > s);
+            q += ((q + 1)*m <= s);
+            sums[c*nchan + ch] = q;
+        }
+    }
+
+    // only the blurred channels are written, as the plain paths do
+    if (nchan == 1) {
+        for (int c = 0; c < width; c++) {
+            dest[3*c] = (BYTE)sums[c];
+        }
+    } else {
+        for (int k = 0; k < 3*width; k++) {
+            dest[k] = (BYTE)sums[k];
+        }
+    }
+}
+
+static void KERN_NAME(_morpho)(BYTE* dest, PIXEL** rows, int r, int width, int radius, BYTE v, void* scratch) {
+
+    int n = 3*(width + 2*radius);
+
+    BYTE* restrict hits = scratch;
+    BYTE* restrict hitc = hits + n;
+
+    // which bytes of the window's columns hold `v`, then which windows do. Only the first byte of
+    // each pixel matters, the others just keep the loop straight
+    const BYTE* top = (const BYTE*)(rows[r - radius] - radius);
+    for (int k = 0; k < n; k++) {
+        hits[k] = (top[k] == v);
+    }
+    for (int dr = -radius + 1; dr <= radius; dr++) {
+        const BYTE* row = (const BYTE*)(rows[r + dr] - radius);
+        for (int k = 0; k < n; k++) {
+            hits[k] |= (row[k] == v);
+        }
+    }
+
+    for (int c = 0; c < width; c++) {
+        hitc[c] = hits[3*c];
+    }
+    for (int d = 1; d <= 2*radius; d++) {
+        for (int c = 0; c < width; c++) {
+            hitc[c] |= hits[3*(c + d)];
+        }
+    }
+
+    const BYTE* mid = (const BYTE*)rows[r];
+    for (int c = 0; c < width; c++) {
+        hitc[c] = hitc[c] ? v : mid[3*c];
+    }
+    for (int c = 0; c < width; c++) {
+        dest[3*c] = hitc[c];
+    }
+}
+
+static void KERN_NAME(_thresh)(BYTE* p, int width, int t, BYTE under, BYTE above) {
+    _GRAY_MAP(p, width, (t < v) ? above : under);
+}
+
+static void KERN_NAME(_tri_thresh)(BYTE* p, int width, int t1, int t2) {
+    _GRAY_MAP(p, width, (v < t1) ? 0 : ((v >= t2) ? 255 : 128));
+}
+
+static void KERN_NAME(_invert)(BYTE* p, int width) {
+    _GRAY_MAP(p, width, 255 - v);
+}
+
+static void KERN_NAME(_add)(BYTE* p, int width, int k) {
+    // clamped so that there are no overflows, as `clampg()` does
+    _GRAY_MAP(p, width, (v + k > 255) ? 255 : ((v + k < 0) ? 0 : v + k));
+}
+
+static void KERN_NAME(_lut)(BYTE* p, int width, int nchan, const BYTE lut[3][256]) {
+    if (nchan == 1) {
+        const BYTE* l = lut[0];
+        _GRAY_MAP(p, width, l[v]);
+        return;
+    }
+
+    const BYTE* l0 = lut[0];
+    const BYTE* l1 = lut[1];
+    const BYTE* l2 = lut[2];
+    for (int c = 0; c < width; c++) {
+        p[3*c] = l0[p[3*c]];
+        p[3*c + 1] = l1[p[3*c + 1]];
+        p[3*c + 2] = l2[p[3*c + 2]];
+    }
+}
+
+static void KERN_NAME(_rgb_thresh)(BYTE* p, int width, const int t[3], BYTE under, BYTE above) {
+    int t0 = t[0], t1 = t[1], t2 = t[2];
+    for (int c = 0; c < width; c++) {
+        p[3*c] = (p[3*c] < t0) ? under : above;
+        p[3*c + 1] = (p[3*c + 1] < t1) ? under : above;
+        p[3*c + 2] = (p[3*c + 2] < t2) ? under : above;
+    }
+}
+
+// same expressions, in the same order, as `convert_channel_px()`, and built with -ffp-contract=off,
+// so every copy of this file gives the exact same bytes as the plain C path
+static int KERN_NAME(_convert)(BYTE* restrict dest, const BYTE* restrict src, int width, int conv) {
+
+    switch (conv) {
+        case GRAY2RGB: case RED2RGB: case GREEN2RGB: case BLUE2RGB: {
+            int ch = (conv == GREEN2RGB) ? 1 : ((conv == BLUE2RGB) ? 2 : 0);
+            for (int c = 0; c < width; c++) {
+                BYTE v = src[3*c + ch];
+                dest[3*c] = v;
+                dest[3*c + 1] = v;
+                dest[3*c + 2] = v;
+            }
+            return 0;
+        }
+
+        case RGB2GRAY:
+            for (int c = 0; c < width; c++) {
+                int c1 = 0.299*src[3*c] + 0.587*src[3*c + 1] + 0.114*src[3*c + 2];
+                dest[3*c] = c1;
+                dest[3*c + 1] = c1;
+                dest[3*c + 2] = c1;
+            }
+            return 0;
+
+        case RGB2YUV:
+            for (int c = 0; c < width; c++) {
+                int r = src[3*c], g = src[3*c + 1], b = src[3*c + 2];
+                int c1 = 0.299*r + 0.587*g + 0.114*b;
+                int c2 = 0.492*(b - c1) + 128;
+                int c3 = 0.877*(r - c1) + 128;
+                dest[3*c] = c1;
+                dest[3*c + 1] = c2;
+                dest[3*c + 2] = c3;
+            }
+            return 0;
+
+        case RGB2YCBCR:
+            for (int c = 0; c < width; c++) {
+                int r = src[3*c], g = src[3*c + 1], b = src[3*c + 2];
+                int c1 = 0.299*r + 0.587*g + 0.114*b;
+                int c2 = -0.1687*r - 0.3313*g + 0.5*b + 128;
+                int c3 = 0.5*r - 0.4187*g - 0.0813*b + 128;
+                dest[3*c] = c1;
+                dest[3*c + 1] = c2;
+                dest[3*c + 2] = c3;
+            }
+            return 0;
+
+        case YUV2RGB:
+            for (int c = 0; c < width; c++) {
+                int y = src[3*c], u = src[3*c + 1], v = src[3*c + 2];
+                int c1 = y + 1.14*v;
+                int c2 = y - 0.395*u - 0.581*v;
+                int c3 = y + 2.033*v;
+                dest[3*c] = c1;
+                dest[3*c + 1] = c2;
+                dest[3*c + 2] = c3;
+            }
+            return 0;
+
+        case YCBCR2RGB:
+            for (int c = 0; c < width; c++) {
+                int y = src[3*c], cb = src[3*c + 1], cr = src[3*c + 2];
+                int c1 = y + 1.402*(cr - 128);
+                int c2 = y - 0.34414*(cb - 128) - 0.714414*(cr - 128);
+                int c3 = y + 1.772*(cb - 128);
+                c1 = (c1 > 255) ? 255 : ((c1 < 0) ? 0 : c1);
+                c2 = (c2 > 255) ? 255 : ((c2 < 0) ? 0 : c2);
+                c3 = (c3 > 255) ? 255 : ((c3 < 0) ? 0 : c3);
+                dest[3*c] = c1;
+                dest[3*c + 1] = c2;
+                dest[3*c + 2] = c3;
+            }
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+static void KERN_NAME(_histogram)(PIXEL** mat, int width, int height, int chan, int nchan, int* hist) {
+
+    // 4 histograms filled in turn, so runs of equal values don't wait on the same counter
+    int sub[4][256];
+    memset(sub, 0, sizeof(sub));
+
+    for (int r = 0; r < height; r++) {
+        const BYTE* p = (const BYTE*)mat[r] + chan;
+        int c = 0;
+        for (; c + 4 <= width; c += 4) {
+            sub[0][p[3*c]]++;
+            sub[1][p[3*c + 3]]++;
+            sub[2][p[3*c + 6]]++;
+            sub[3][p[3*c + 9]]++;
+        }
+        for (; c < width; c++) {
+            sub[0][p[3*c]]++;
+        }
+    }
+
+    for (int v = 0; v < 256; v++) {
+        hist[v*nchan + chan] += sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+    }
+}
+
+static void KERN_NAME(_area)(BYTE* dest, PIXEL** rows, int nrows, int width, int factor, int nchan, void* scratch) {
+
+    int destw = (width + factor - 1)/factor;
+    int full = width/factor;
+
+    int* restrict vsum = scratch;
+    int* restrict sums = vsum + 3*width;
+    int* restrict counts = sums + 3*destw;
+    float* restrict inv = (float*)(counts + destw);
+
+    // vertical sums of the block rows over every byte, as the blur does
+    const BYTE* top = (const BYTE*)rows[0];
+    for (int k = 0; k < 3*width; k++) {
+        vsum[k] = top[k];
+    }
+    for (int i = 1; i < nrows; i++) {
+        const BYTE* row = (const BYTE*)rows[i];
+        for (int k = 0; k < 3*width; k++) {
+            vsum[k] += row[k];
+        }
+    }
+
+    for (int ch = 0; ch < nchan; ch++) {
+        for (int c = 0; c < destw; c++) {
+            sums[c*nchan + ch] = 0;
+        }
+        for (int d = 0; d < factor; d++) {
+            for (int c = 0; c < full; c++) {
+                sums[c*nchan + ch] += vsum[3*(c*factor + d) + ch];
+            }
+        }
+        for (int k = full*factor; k < width; k++) {
+            sums[full*nchan + ch] += vsum[3*k + ch];
+        }
+    }
+    for (int c = 0; c < destw; c++) {
+        counts[c] = nrows*((c < full) ? factor : width - full*factor);
+    }
+
+    // rounded quotient (2s + m) / 2m, from a float estimate corrected by one as in the blur
+    for (int c = 0; c < destw; c++) {
+        inv[c] = 1.0f / (2*counts[c]);
+    }
+    for (int ch = 0; ch < nchan; ch++) {
+        for (int c = 0; c < destw; c++) {
+            int m = 2*counts[c];
+            int s = 2*sums[c*nchan + ch] + counts[c];
+            int q = (int)(s*inv[c]);
+            q -= (q*m > s);
+            q += ((q + 1)*m <= s);
+            sums[c*nchan + ch] = q;
+        }
+    }
+
+    if (nchan == 1) {
+        for (int c = 0; c < destw; c++) {
+            dest[3*c] = (BYTE)sums[c];
+        }
+    } else {
+        for (int k = 0; k < 3*destw; k++) {
+            dest[k] = (BYTE)sums[k];
+        }
+    }
+}
+
+static void KERN_NAME(_resample_v)(short* dest, PIXEL** rows, int count, const short* w, int width, int nchan, void* scratch) {
+
+    int n = nchan*width;
+    int* restrict acc = scratch;
+
+    for (int k = 0; k < n; k++) {
+        acc[k] = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        const BYTE* row = (const BYTE*)rows[i];
+        int wi = w[i];
+        if (nchan == 1) {
+            for (int c = 0; c < width; c++) {
+                acc[c] += wi*row[3*c];
+            }
+        } else {
+            for (int k = 0; k < n; k++) {
+                acc[k] += wi*row[k];
+            }
+        }
+    }
+
+    for (int k = 0; k < n; k++) {
+        dest[k] = (short)((acc[k] + (1 << (RESAMPLE_BITS - RESAMPLE_ROW_BITS - 1))) >> (RESAMPLE_BITS - RESAMPLE_ROW_BITS));
+    }
+}
+
+static void KERN_NAME(_resample_h)(BYTE* dest, const short* row, int width, int nchan, const int* start, const int* count, const short* w, int taps) {
+
+    const int shift = RESAMPLE_BITS + RESAMPLE_ROW_BITS;
+
+    for (int c = 0; c < width; c++) {
+        const short* wc = &w[c*taps];
+        const short* p = &row[start[c]*nchan];
+
+        for (int ch = 0; ch < nchan; ch++) {
+            int s = 0;
+            for (int i = 0; i < count[c]; i++) {
+                s += wc[i]*p[i*nchan + ch];
+            }
+            s = (s + (1 << (shift - 1))) >> shift;
+            dest[3*c + ch] = (BYTE)((s > 255) ? 255 : ((s < 0) ? 0 : s));
+        }
+    }
+}
+
+static void KERN_NAME(_warp)(BYTE* dest, PIXEL** rows, const int* xs, const int* ys, int n, int nchan) {
+
+    // 8 bits of each fraction weigh the 4 neighbors, same sums as `_warp_row()`. One loop per
+    // channel count, so the gathers of each lane don't wait on a channel loop
+    const int fshift = WARP_FRAC_BITS - 8;
+
+    if (nchan == 1) {
+        for (int i = 0; i < n; i++) {
+            int ix = xs[i] >> WARP_FRAC_BITS, iy = ys[i] >> WARP_FRAC_BITS;
+            int fx = (xs[i] >> fshift) & 255, fy = (ys[i] >> fshift) & 255;
+            const BYTE* p = (const BYTE*)rows[iy] + 3*ix;
+            const BYTE* q = (const BYTE*)rows[iy + 1] + 3*ix;
+            int top = p[0]*(256 - fx) + p[3]*fx;
+            int bottom = q[0]*(256 - fx) + q[3]*fx;
+            dest[3*i] = (BYTE)((top*(256 - fy) + bottom*fy + 32768) >> 16);
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int ix = xs[i] >> WARP_FRAC_BITS, iy = ys[i] >> WARP_FRAC_BITS;
+        int fx = (xs[i] >> fshift) & 255, fy = (ys[i] >> fshift) & 255;
+        const BYTE* p = (const BYTE*)rows[iy] + 3*ix;
+        const BYTE* q = (const BYTE*)rows[iy + 1] + 3*ix;
+        for (int ch = 0; ch < 3; ch++) {
+            int top = p[ch]*(256 - fx) + p[3 + ch]*fx;
+            int bottom = q[ch]*(256 - fx) + q[3 + ch]*fx;
+            dest[3*i + ch] = (BYTE)((top*(256 - fy) + bottom*fy + 32768) >> 16);
+        }
+    }
+}
+
+static int KERN_NAME(_warp_steps)(int* xs, int* ys, long long x0, long long y0, long long dx, long long dy, int n, int xmax, int ymax) {
+
+    int inside = 1;
+    for (int i = 0; i < n; i++) {
+        int x = (int)((x0 + i*dx + 32768) >> 16);
+        int y = (int)((y0 + i*dy + 32768) >> 16);
+        xs[i] = x;
+        ys[i] = y;
+        inside &= (x >= 0) & (x < xmax) & (y >= 0) & (y < ymax);
+    }
+    return inside;
+}
+
+
+const KERNELS KERN_NAME(kern_table) = {
+    .level = KERN_LEVEL,
+    .blur = KERN_NAME(_blur),
+    .morpho = KERN_NAME(_morpho),
+    .thresh = KERN_NAME(_thresh),
+    .tri_thresh = KERN_NAME(_tri_thresh),
+    .invert = KERN_NAME(_invert),
+    .add = KERN_NAME(_add),
+    .lut = KERN_NAME(_lut),
+    .rgb_thresh = KERN_NAME(_rgb_thresh),
+    .convert = KERN_NAME(_convert),
+    .histogram = KERN_NAME(_histogram),
+    .area = KERN_NAME(_area),
+    .resample_v = KERN_NAME(_resample_v),
+    .resample_h = KERN_NAME(_resample_h),
+    .warp = KERN_NAME(_warp),
+    .warp_steps = KERN_NAME(_warp_steps),
+};
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "imgmem.h"
+
+static pthread_once_t _mem_once = PTHREAD_ONCE_INIT;
+static int _mem_on = 0;
+static size_t _mem_budget = 0;
+
+// process wide totals, always kept up to date since the budget depends on them
+static atomic_llong _mem_current = 0;
+static atomic_llong _mem_peak = 0;
+
+// per op totals, only touched when the report is on
+static pthread_mutex_t _mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static MEMTOTAL _mem_totals[MEM_MAX_OPS];
+static int _mem_ntotals = 0;
+
+static _Thread_local int _mem_thread_op = -1;
+
+// freed blocks kept per size class, so the next allocation of a close size reuses pages that are
+// already faulted in instead of mapping fresh ones
+static pthread_mutex_t _pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static MEMHEADER* _pool_free[MEM_POOL_CLASSES];
+static size_t _pool_max = MEM_POOL_DEFAULT_MAX;
+static size_t _pool_kept = 0;
+static int _pool_thp = 0;
+static long long _pool_hits = 0;
+static long long _pool_misses = 0;
+
+
+static void _mem_atexit(void) {
+    mem_report();
+}
+
+
+int mem_enabled(void) {
+    pthread_once(&_mem_once, _mem_init);
+    return _mem_on;
+}
+
+void* mem_alloc(size_t size) {
+
+    pthread_once(&_mem_once, _mem_init);
+
+    MEMHEADER* header = NULL;
+    int cls = (_pool_max > 0) ? _mem_size_class(sizeof(MEMHEADER) + size) : -1;
+
+    if (cls >= 0) {
+        pthread_mutex_lock(&_pool_lock);
+        header = _pool_free[cls];
+        if (header != NULL) {
+            _pool_free[cls] = header->next;
+            _pool_kept -= _mem_class_size(cls);
+            _pool_hits++;
+        } else {
+            _pool_misses++;
+        }
+        pthread_mutex_unlock(&_pool_lock);
+
+        if (header == NULL) {
+            header = _mem_map(cls);
+        }
+    } else {
+        header = (MEMHEADER*)malloc(sizeof(MEMHEADER) + size);
+    }
+
+    if (header == NULL) {
+        return NULL;
+    }
+
+    header->size = size;
+    header->cls = cls;
+    header->next = NULL;
+    // allocations made outside of any op (ex: by an executable) go to the first entry, "(unscoped)"
+    header->owner = -1;
+    if (mem_enabled()) {
+        header->owner = (_mem_thread_op >= 0) ? _mem_thread_op : 0;
+    }
+
+    long long current = atomic_fetch_add(&_mem_current, (long long)size) + (long long)size;
+    long long peak = atomic_load(&_mem_peak);
+    while (current > peak && !atomic_compare_exchange_weak(&_mem_peak, &peak, current));
+
+    if (header->owner >= 0) {
+        _mem_charge(header->owner, (long long)size);
+    }
+
+    return header + 1;
+}
+
+void mem_free(void* ptr) {
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    MEMHEADER* header = ((MEMHEADER*)ptr) - 1;
+
+    atomic_fetch_sub(&_mem_current, (long long)header->size);
+    if (header->owner >= 0) {
+        _mem_charge(header->owner, -(long long)header->size);
+    }
+
+    if (header->cls < 0) {
+        free(header);
+        return;
+    }
+
+    size_t csize = _mem_class_size(header->cls);
+
+    pthread_mutex_lock(&_pool_lock);
+    int keep = (_pool_kept + csize <= _pool_max);
+    if (keep) {
+        header->next = _pool_free[header->cls];
+        _pool_free[header->cls] = header;
+        _pool_kept += csize;
+    }
+    pthread_mutex_unlock(&_pool_lock);
+
+    if (!keep) {
+        munmap(header, csize);
+    }
+}
+
+void mem_pool_trim(void) {
+
+    pthread_mutex_lock(&_pool_lock);
+
+    for (int cls = 0; cls < MEM_POOL_CLASSES; cls++) {
+        while (_pool_free[cls] != NULL) {
+            MEMHEADER* header = _pool_free[cls];
+            _pool_free[cls] = header->next;
+            munmap(header, _mem_class_size(cls));
+        }
+    }
+    _pool_kept = 0;
+
+    pthread_mutex_unlock(&_pool_lock);
+}
+
+void mem_op_begin(MEMOP* op, const char* name) {
+
+    op->on = mem_enabled();
+    if (!op->on) {
+        return;
+    }
+
+    op->prev = _mem_thread_op;
+    op->index = -1;
+    if (op->prev >= 0) {
+        // nested op, allocations keep going to the outer one
+        return;
+    }
+
+    pthread_mutex_lock(&_mem_lock);
+
+    int i = 0;
+    while (i < _mem_ntotals && _mem_totals[i].name != name && strcmp(_mem_totals[i].name, name) != 0) i++;
+    if (i == _mem_ntotals && _mem_ntotals < MEM_MAX_OPS) {
+        memset(&_mem_totals[i], 0, sizeof(MEMTOTAL));
+        _mem_totals[i].name = name;
+        _mem_ntotals++;
+    }
+
+    pthread_mutex_unlock(&_mem_lock);
+
+    if (i < MEM_MAX_OPS) {
+        op->index = i;
+        _mem_thread_op = i;
+    }
+}
+
+void mem_op_end(MEMOP* op) {
+
+    if (!op->on) {
+        return;
+    }
+
+    _mem_thread_op = op->prev;
+}
+
+size_t mem_current(void) {
+    return (size_t)atomic_load(&_mem_current);
+}
+
+size_t mem_peak(void) {
+    return (size_t)atomic_load(&_mem_peak);
+}
+
+size_t mem_budget(void) {
+    pthread_once(&_mem_once, _mem_init);
+    return _mem_budget;
+}
+
+int mem_fits(size_t bytes) {
+    size_t budget = mem_budget();
+    return budget == 0 || mem_current() + bytes <= budget;
+}
+
+void mem_report(void) {
+
+    pthread_mutex_lock(&_mem_lock);
+
+    fprintf(stderr, "%-24s %8s %12s %12s %12s\n", "op", "allocs", "total MB", "peak MB", "live MB");
+    for (int i = 0; i < _mem_ntotals; i++) {
+        MEMTOTAL* t = &_mem_totals[i];
+        fprintf(stderr, "%-24s %8lld %12.3f %12.3f %12.3f\n", t->name, t->allocs, t->bytes/1048576.0, t->peak/1048576.0, t->current/1048576.0);
+    }
+
+    fprintf(stderr, "process: peak %.3f MB, live at exit %.3f MB", mem_peak()/1048576.0, mem_current()/1048576.0);
+    if (_mem_budget > 0) {
+        fprintf(stderr, ", budget %.3f MB", _mem_budget/1048576.0);
+    }
+    fprintf(stderr, "\n");
+
+    pthread_mutex_lock(&_pool_lock);
+    fprintf(stderr, "pool: %lld hits, %lld misses, %.3f MB kept%s\n", _pool_hits, _pool_misses, _pool_kept/1048576.0, _pool_thp ? " (huge pages)" : "");
+    pthread_mutex_unlock(&_pool_lock);
+
+    pthread_mutex_unlock(&_mem_lock);
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void _mem_init(void) {
+
+    char* pool = getenv(MEM_POOL_ENV);
+    if (pool != NULL && pool[0] != '\0') {
+        // "0" parses as an error too, which is fine as both turn the pool off
+        _pool_max = _mem_parse_size(pool);
+    }
+
+    char* thp = getenv(MEM_POOL_THP_ENV);
+    _pool_thp = (thp != NULL && strcmp(thp, "1") == 0);
+
+    char* budget = getenv(MEM_BUDGET_ENV);
+    if (budget != NULL && budget[0] != '\0') {
+        _mem_budget = _mem_parse_size(budget);
+        if (_mem_budget == 0) {
+            fprintf(stderr, "%s: couldn't parse \"%s\", running without a budget\n", MEM_BUDGET_ENV, budget);
+        }
+    }
+
+    char* report = getenv(MEM_ENV);
+    if (report == NULL || report[0] == '\0' || strcmp(report, "0") == 0) {
+        return;
+    }
+
+    _mem_totals[0].name = "(unscoped)";
+    _mem_ntotals = 1;
+
+    _mem_on = 1;
+    atexit(_mem_atexit);
+}
+
+size_t _mem_parse_size(const char* str) {
+
+    char* end;
+    unsigned long long size = strtoull(str, &end, 10);
+    if (end == str) {
+        return 0;
+    }
+
+    switch (*end) {
+        case 'G': case 'g': size <<= 30; end++; break;
+        case 'M': case 'm': size <<= 20; end++; break;
+        case 'K': case 'k': size <<= 10; end++; break;
+        default: break;
+    }
+
+    // allow "512MB" or "512MiB" but nothing else after the number
+    if (*end == 'i') end++;
+    if (*end == 'B' || *end == 'b') end++;
+
+    return (*end == '\0') ? (size_t)size : 0;
+}
+
+void _mem_charge(int owner, long long delta) {
+
+    pthread_mutex_lock(&_mem_lock);
+
+    MEMTOTAL* t = &_mem_totals[owner];
+    t->current += delta;
+    if (delta > 0) {
+        t->allocs++;
+        t->bytes += delta;
+    }
+    if (t->current > t->peak) {
+        t->peak = t->current;
+    }
+
+    pthread_mutex_unlock(&_mem_lock);
+}
+
+int _mem_size_class(size_t size) {
+
+    if (size < MEM_POOL_MIN) {
+        return -1;
+    }
+
+    // 2^k <= size < 2^(k+1), the classes in between being 4, 5, 6 and 7 quarters of 2^k
+    int k = 63 - __builtin_clzll((unsigned long long)size);
+    size_t quarter = (size_t)1 << (k - 2);
+    int sub = (int)((size + quarter - 1) / quarter) - 4;
+
+    // sub can be 4, which is the first class of the next power of two, as it should
+    int cls = (k - 16)*4 + sub;
+    return (cls < MEM_POOL_CLASSES) ? cls : -1;
+}
+
+size_t _mem_class_size(int cls) {
+    int k = 16 + cls/4;
+    return (size_t)(4 + cls%4) << (k - 2);
+}
+
+MEMHEADER* _mem_map(int cls) {
+
+    size_t csize = _mem_class_size(cls);
+
+    if (!_pool_thp || csize < MEM_HUGE_PAGE) {
+        void* block = mmap(NULL, csize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (block == MAP_FAILED) ? NULL : (MEMHEADER*)block;
+    }
+
+    // huge pages need 2M aligned ranges: map a bit more, then unmap what sticks out on each side
+    size_t span = csize + MEM_HUGE_PAGE;
+    void* block = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        return NULL;
+    }
+
+    uintptr_t start = (uintptr_t)block;
+    uintptr_t aligned = (start + MEM_HUGE_PAGE - 1) & ~(uintptr_t)(MEM_HUGE_PAGE - 1);
+    if (aligned > start) {
+        munmap(block, aligned - start);
+    }
+    size_t tail = (start + span) - (aligned + csize);
+    if (tail > 0) {
+        munmap((void*)(aligned + csize), tail);
+    }
+
+    // only advice, blocks stay usable with normal pages if the kernel doesn't follow it
+    madvise((void*)aligned, csize, MADV_HUGEPAGE);
+
+    return (MEMHEADER*)aligned;
+}
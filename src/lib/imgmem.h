@@ -0,0 +1,192 @@
+#ifndef IMAGE_MEM_H
+#define IMAGE_MEM_H
+
+#include <stddef.h>
+
+// environment variable turning the per op memory report on. "1" or "stderr" prints it at exit
+#define MEM_ENV "IMG_MEM"
+
+// environment variable holding the memory budget, in bytes (a K, M or G suffix is allowed).
+// Ops that would go over it with full size intermediates run over bands of the image instead
+#define MEM_BUDGET_ENV "IMG_MEM_BUDGET"
+
+// max amount of distinct ops in the report
+#define MEM_MAX_OPS 64
+
+// environment variable holding how much freed memory the pool may keep for later allocations
+// (same format as MEM_BUDGET_ENV). "0" turns the pool off
+#define MEM_POOL_ENV "IMG_POOL_MAX"
+#define MEM_POOL_DEFAULT_MAX (256UL << 20)
+
+// environment variable asking for pooled blocks to be backed by transparent huge pages when set to "1"
+#define MEM_POOL_THP_ENV "IMG_POOL_THP"
+
+// blocks smaller than this are left to malloc, which already recycles them without page faults
+#define MEM_POOL_MIN (64UL << 10)
+
+// pooled sizes go up by steps of a quarter of a power of two (so less than 25% is wasted), up to 2^40
+#define MEM_POOL_CLASSES 100
+
+#define MEM_HUGE_PAGE (2UL << 20)
+
+/**
+ * @brief a scope allocations are charged to, from `mem_op_begin()` to `mem_op_end()`
+ *
+ * @member on: 0 when the report is off, every other member is then left untouched
+ * @member prev: op the calling thread was charging before this one (-1 if none)
+ */
+struct _mem_op_type_struct {
+    int on;
+    int index;
+    int prev;
+};
+typedef struct _mem_op_type_struct MEMOP;
+
+/**
+ * @brief totals of every allocation charged to an op with the same name
+ *
+ * @member current: bytes still allocated
+ * @member peak: max of `current` over the run
+ */
+struct _mem_total_type_struct {
+    const char* name;
+    long long allocs;
+    long long bytes;
+    long long current;
+    long long peak;
+};
+typedef struct _mem_total_type_struct MEMTOTAL;
+
+/**
+ * @brief bookkeeping stored just before every block allocated by `mem_alloc()`
+ *
+ * @member owner: index of the op the block is charged to (-1 when the report is off)
+ * @member cls: size class of the block if it comes from the pool, -1 if it comes from malloc
+ * @member next: next free block of the same class, while the block sits in the pool
+ */
+struct _mem_block_header_type_struct {
+    size_t size;
+    int owner;
+    int cls;
+    struct _mem_block_header_type_struct* next;
+    size_t pad;
+};
+typedef struct _mem_block_header_type_struct MEMHEADER;
+
+
+/**
+ * @brief whether the per op report is on (decided once, from MEM_ENV)
+ *
+ * @return int 1 if allocations are charged to ops, else 0
+ */
+int mem_enabled(void);
+
+/**
+ * @brief allocates a block and accounts for it. Every block must be freed with `mem_free()`
+ *
+ * @param size size of the block in bytes
+ * @return void* the block, NULL if malloc failed
+ */
+void* mem_alloc(size_t size);
+
+/**
+ * @brief frees a block allocated with `mem_alloc()`
+ *
+ * @param ptr the block (can be NULL)
+ */
+void mem_free(void* ptr);
+
+/**
+ * @brief starts charging the allocations of the calling thread to an op. When ops are nested,
+ * @brief allocations go to the outermost one, as that is the step holding the memory
+ *
+ * @param op the scope to start
+ * @param name name of the op, must be a string literal
+ */
+void mem_op_begin(MEMOP* op, const char* name);
+
+/**
+ * @brief stops charging allocations to an op
+ *
+ * @param op the scope to end
+ */
+void mem_op_end(MEMOP* op);
+
+/**
+ * @brief bytes currently allocated through `mem_alloc()`, by every thread
+ */
+size_t mem_current(void);
+
+/**
+ * @brief max of `mem_current()` since the start of the process
+ */
+size_t mem_peak(void);
+
+/**
+ * @brief the memory budget (decided once, from MEM_BUDGET_ENV)
+ *
+ * @return size_t the budget in bytes, 0 if there is none
+ */
+size_t mem_budget(void);
+
+/**
+ * @brief whether allocating more memory stays within the budget
+ *
+ * @param bytes amount about to be allocated
+ * @return int 1 if there is no budget or it isn't exceeded, else 0
+ */
+int mem_fits(size_t bytes);
+
+/**
+ * @brief gives every block sitting in the pool back to the system
+ */
+void mem_pool_trim(void);
+
+/**
+ * @brief prints the per op report (allocations, current and peak bytes) to stderr.
+ * @brief Called at exit when MEM_ENV is set, but can be called earlier
+ */
+void mem_report(void);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief reads MEM_ENV and MEM_BUDGET_ENV, run once
+ */
+void _mem_init(void);
+
+/**
+ * @brief parses a size such as "512M"
+ *
+ * @return size_t the size in bytes, 0 if it couldn't be parsed
+ */
+size_t _mem_parse_size(const char* str);
+
+/**
+ * @brief adds `delta` bytes to an op's totals
+ */
+void _mem_charge(int owner, long long delta);
+
+/**
+ * @brief size class of a block of `size` bytes (header included)
+ *
+ * @return int the class, -1 if the block is too small to be pooled
+ */
+int _mem_size_class(size_t size);
+
+/**
+ * @brief size of the blocks of a class
+ */
+size_t _mem_class_size(int cls);
+
+/**
+ * @brief maps a fresh block for a class, huge page aligned and advised when MEM_POOL_THP_ENV is on
+ *
+ * @return MEMHEADER* the block, NULL if mmap failed
+ */
+MEMHEADER* _mem_map(int cls);
+
+#endif
@@ -1,8 +1,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "imgio.h"
 #include "imgops.h"
+#include "imgsched.h"
+#include "imgtrace.h"
+#include "imgperf.h"
+#include "imgmem.h"
+#include "imgkern.h"
+
+// arguments shared by every tile of an image op run through `sched_parallel_rows()`
+struct _op_tile_args_type_struct {
+    IMAGE* destimg;
+    IMAGE* srcimg;
+    CONVTYPE conv;
+    GEOMTYPE geom;
+    int r0;
+    int c1;
+    int c2;
+    int thresh[3];
+    BYTE underv;
+    BYTE abovev;
+    unsigned int range;
+    int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int);
+    // for streamed ops, the tile function run on the rows of the ring buffer
+    void (*tile)(void*, int, int);
+    // for banded `blur_img_rep()`, the whole image blur repeated over each band
+    int (*blur_img_func)(IMAGE*, IMAGE*, unsigned int);
+    // padded copy of `srcimg` read by the branch free kernels
+    PADDEDIMG* padded;
+};
+typedef struct _op_tile_args_type_struct OPTILE;
+
+// a tile function wrapped so each thread reads its hardware counters around the tiles it runs
+struct _perf_tile_args_type_struct {
+    void (*tile)(void*, int, int);
+    void* arg;
+    PERFOP* op;
+};
+typedef struct _perf_tile_args_type_struct PERFTILE;
 
 
 
@@ -102,60 +139,296 @@ int convert_channel_img_range(IMAGE* destimg, IMAGE* srcimg, CONVTYPE conv, int
             return -3;
     }
 
-    for (int r = r1; r <= r2; r++) {
-        for (int c = c1; c <= c2; c++) {
-            
-            // we have already checked the bounds, so we don't need to worry about
-            // the return values of the get_pixel functions here
-            convert_channel_px(
-                get_pixel(r, c, destimg),
-                get_pixel(r, c, srcimg),
-                conv
-            );
+    // the tiles only know about rows starting from 0, so they get offset by r0
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg, .conv = conv, .r0 = r1, .c1 = c1, .c2 = c2};
+    _run_op("convert_channel_img", c2-c1+1, r2-r1+1, _convert_channel_tile, &args);
+
+    return 0;
+
+}
+
+int geom_img(IMAGE* destimg, IMAGE* srcimg, GEOMTYPE geom) {
+
+    if (geom < 0 || geom >= _GEOMEND) {
+        return -1;
+    }
+
+    int swapped = (geom == TRANSPOSE || geom == ROT90 || geom == ROT270);
+    int in_place = (destimg->mat == srcimg->mat);
+    if (in_place && swapped && srcimg->width != srcimg->height) {
+        return -3;
+    }
+
+    int destw = swapped ? srcimg->height : srcimg->width;
+    int desth = swapped ? srcimg->width : srcimg->height;
+    if (destimg->width != destw || destimg->height != desth) {
+        return -2;
+    }
 
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg, .geom = geom};
+
+    if (!in_place) {
+        _run_op("geom_img", destw, desth, _geom_tile, &args);
+        return 0;
+    }
+
+    // in place, the quarter turns are a transpose followed by a flip
+    if (swapped) {
+        args.geom = TRANSPOSE;
+        _run_op("geom_img", destw, desth, _geom_inplace_tile, &args);
+        if (geom == TRANSPOSE) {
+            return 0;
         }
+        args.geom = (geom == ROT90) ? FLIP_H : FLIP_V;
     }
 
-    return 0;
+    // the mirrored ops only go over the rows that own a swap
+    int nrows = desth;
+    if (args.geom == FLIP_V) nrows = desth/2;
+    else if (args.geom == ROT180) nrows = (desth+1)/2;
+
+    _run_op("geom_img", destw, nrows, _geom_inplace_tile, &args);
 
+    return 0;
 }
 
 void bin_gthresh_img(IMAGE* img, int thresh, BYTE underv, BYTE abovev) {
 
+    OPTILE args = {.destimg = img, .thresh = {thresh}, .underv = underv, .abovev = abovev};
+    _run_op("bin_gthresh_img", img->width, img->height, _bin_gthresh_tile, &args);
+}
+
+void bin_rgbthresh_img(IMAGE* img, int rthresh, int gthresh, int bthresh, BYTE underv, BYTE abovev) {
+
+    OPTILE args = {.destimg = img, .thresh = {rthresh, gthresh, bthresh}, .underv = underv, .abovev = abovev};
+    _run_op("bin_rgbthresh_img", img->width, img->height, _bin_rgbthresh_tile, &args);
+}
+
+void tri_gthresh_img(IMAGE* img, int thresh1, int thresh2) {
+
+    OPTILE args = {.destimg = img, .thresh = {thresh1, thresh2}};
+    _run_op("tri_gthresh_img", img->width, img->height, _tri_gthresh_tile, &args);
+}
+
+void invert_gimg(IMAGE* img) {
+
+    OPTILE args = {.destimg = img};
+    _run_op("invert_gimg", img->width, img->height, _invert_gtile, &args);
+}
+
+void add_gimg(IMAGE* img, int k) {
+
+    OPTILE args = {.destimg = img, .thresh = {k}};
+    _run_op("add_gimg", img->width, img->height, _add_gtile, &args);
+}
+
+void hysteresis_gthresh_img(IMAGE* img, int minthresh, int maxthresh) {
+
+    // first threshold go over
+    OPTILE args = {.destimg = img, .thresh = {minthresh, maxthresh}};
+    _run_op("hysteresis_gthresh_img", img->width, img->height, _hysteresis_tile, &args);
+
+    // second threshold go over. This one stays sequential on purpose: pixels set to 255 earlier
+    // in the scan can promote the pixels that come after them
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "hysteresis_propagate");
+    scope.pixels = (long long)img->width*img->height;
+
     for (int r = 0; r < img->height; r++) {
         for (int c = 0; c < img->width; c++) {
+            GPIXEL* gradpx = get_gpixel(r, c, img);
 
-            GPIXEL* px = get_gpixel(r,c,img);
+            if (!(minthresh < gradpx->v && gradpx->v < maxthresh)) {
+                continue;
+            }
 
-            BYTE thresh_res = (thresh < px->v) ? abovev : underv;
+            // look for at least one 255 in 8 neighbors
+            int strong = 0;
+            for (int rr = r-1; rr <= r+1 && !strong; rr++) {
+                for (int cc = c-1; cc <= c+1; cc++) {
+                    GPIXEL* npx = get_gpixel(rr, cc, img);
+                    if (npx != NULL && !(rr == r && cc == c) && npx->v == 255) {
+                        strong = 1;
+                        break;
+                    }
+                }
+            }
 
-            set_gpixel(px, thresh_res);
+            gradpx->v = strong ? 255 : 0;
+        }
+    }
+
+    trace_end(&scope);
+}
+
+void histogram_gimg(IMAGE* img, int hist[256]) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "histogram_gimg");
+    scope.pixels = (long long)img->width*img->height;
+
+    memset(hist, 0, sizeof(int)*256);
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        kern->histogram(img->mat, img->width, img->height, 0, 1, hist);
+        trace_end(&scope);
+        return;
+    }
+
+    for (int r = 0; r < img->height; r++) {
+        for (int c = 0; c < img->width; c++) {
+            hist[img->mat[r][c].gpx.v]++;
         }
     }
+
+    trace_end(&scope);
 }
 
-void bin_rgbthresh_img(IMAGE* img, int rthresh, int gthresh, int bthresh, BYTE underv, BYTE abovev) {
-    
+void histogram_rgbimg(IMAGE* img, int hist[256][3]) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "histogram_rgbimg");
+    scope.pixels = (long long)img->width*img->height;
+
+    memset(hist, 0, sizeof(int)*256*3);
+
+    // one pass per channel, each with the 4 sub histograms of the kernel
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int ch = 0; ch < 3; ch++) {
+            kern->histogram(img->mat, img->width, img->height, ch, 3, &hist[0][0]);
+        }
+        trace_end(&scope);
+        return;
+    }
+
     for (int r = 0; r < img->height; r++) {
         for (int c = 0; c < img->width; c++) {
-            RGBPIXEL* px = get_rgbpixel(r,c,img);
+            RGBPIXEL* px = &img->mat[r][c].cpx;
+            hist[px->r][0]++;
+            hist[px->g][1]++;
+            hist[px->b][2]++;
+        }
+    }
+
+    trace_end(&scope);
+}
+
+int profile_gimg(IMAGE* img, int is_row, int index, int profile[256]) {
 
+    memset(profile, 0, sizeof(int)*256);
+
+    if (index < 0 || index >= (is_row ? img->height : img->width)) {
+        return -1;
+    }
 
-            px->r = (px->r < rthresh) ? underv : abovev;
-            px->g = (px->g < gthresh) ? underv : abovev;
-            px->b = (px->b < bthresh) ? underv : abovev;
+    if (is_row) {
+        for (int c = 0; c < img->width; c++) {
+            profile[img->mat[index][c].gpx.v]++;
+        }
+    } else {
+        for (int r = 0; r < img->height; r++) {
+            profile[img->mat[r][index].gpx.v]++;
         }
     }
 
+    return 0;
+}
+
+int profile_set_init(PROFILESET* set, IMAGE* img, int* rows, int nrows, int* cols, int ncols) {
+
+    memset(set, 0, sizeof(PROFILESET));
+
+    int res = _profile_indices(&set->rows, &set->row_order, &set->nrows, rows, nrows, img->height);
+    if (res == 0) {
+        res = _profile_indices(&set->cols, &set->col_order, &set->ncols, cols, ncols, img->width);
+    }
+    if (res == 0) {
+        // an empty set of rows or columns has no profiles at all
+        if (set->nrows > 0) {
+            set->row_profiles = (int*)malloc(sizeof(int)*256*set->nrows);
+        }
+        if (set->ncols > 0) {
+            set->col_profiles = (int*)malloc(sizeof(int)*256*set->ncols);
+        }
+        if ((set->nrows > 0 && set->row_profiles == NULL) || (set->ncols > 0 && set->col_profiles == NULL)) {
+            res = -3;
+        }
+    }
+
+    if (res != 0) {
+        free_profile_set(set);
+    }
+    return res;
+}
+
+void profiles_gimg(IMAGE* img, PROFILESET* set) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "profiles_gimg");
+    scope.pixels = (long long)img->width*img->height;
+
+    if (set->nrows > 0) {
+        memset(set->row_profiles, 0, sizeof(int)*256*set->nrows);
+    }
+    if (set->ncols > 0) {
+        memset(set->col_profiles, 0, sizeof(int)*256*set->ncols);
+    }
+
+    // the image is swept by strips of PROFILE_STRIP columns, top to bottom: the profiles of the set's
+    // columns within a strip stay in cache while every row adds to them, and every pixel is still read once
+    int k = 0;
+    for (int c1 = 0; c1 < img->width; c1 += PROFILE_STRIP) {
+        int c2 = (c1 + PROFILE_STRIP < img->width) ? c1 + PROFILE_STRIP : img->width;
+        int k2 = k;
+        while (k2 < set->ncols && set->cols[set->col_order[k2]] < c2) k2++;
+
+        int next = 0;
+        for (int r = 0; r < img->height; r++) {
+            PIXEL* row = img->mat[r];
+
+            // rows of the set come up in order, each gets the counts of its part of the strip
+            for (; next < set->nrows && set->rows[set->row_order[next]] == r; next++) {
+                int* profile = set->row_profiles + 256*set->row_order[next];
+                for (int c = c1; c < c2; c++) {
+                    profile[row[c].gpx.v]++;
+                }
+            }
+
+            for (int i = k; i < k2; i++) {
+                int slot = set->col_order[i];
+                set->col_profiles[256*slot + row[set->cols[slot]].gpx.v]++;
+            }
+        }
+
+        k = k2;
+    }
+
+    trace_end(&scope);
+}
+
+void free_profile_set(PROFILESET* set) {
+
+    free(set->rows);
+    free(set->row_order);
+    free(set->row_profiles);
+    free(set->cols);
+    free(set->col_order);
+    free(set->col_profiles);
+    memset(set, 0, sizeof(PROFILESET));
 }
 
 int erode_px(int r, int c, IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
 
     int effective_errosions = 0;
 
+    // `radius` has to be compared as an int, else `rr <= r+radius` is an unsigned comparison
+    // and every neighbourhood going over the top or left edge was skipped entirely
+
     if (get_gpixel(r,c,srcimg)->v == 0) {
-        for (int rr = r-radius; rr <= r+radius; rr++) {
-            for (int cc = c-radius; cc <= c+radius; cc++) {
+        for (int rr = r-(int)radius; rr <= r+(int)radius; rr++) {
+            for (int cc = c-(int)radius; cc <= c+(int)radius; cc++) {
                 GPIXEL* px = get_gpixel(rr,cc,destimg);
 
                 if (px != NULL) {
@@ -175,8 +448,8 @@ int dilate_px(int r, int c, IMAGE* destimg, IMAGE* srcimg, unsigned int radius){
     int effective_dilations = 0;
 
     if (get_gpixel(r,c,srcimg)->v == 255) {
-        for (int rr = r-radius; rr <= r+radius; rr++) {
-            for (int cc = c-radius; cc <= c+radius; cc++) {
+        for (int rr = r-(int)radius; rr <= r+(int)radius; rr++) {
+            for (int cc = c-(int)radius; cc <= c+(int)radius; cc++) {
                 GPIXEL* px = get_gpixel(rr,cc,destimg);
 
                 if (px != NULL) {
@@ -199,19 +472,18 @@ int dilate_px(int r, int c, IMAGE* destimg, IMAGE* srcimg, unsigned int radius){
  */
 void erode_img(IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
 
-    // copies the current contents of srcimg into the destination
-    copy_pxmat(
-        destimg->mat,
-        srcimg->mat,
-        srcimg->width,
-        srcimg->height
-    );
+    // each tile gathers its erosion from the source instead of spreading it like `erode_px()` does,
+    // so tiles never write on each other's rows
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg, .range = radius, .underv = 0};
 
-    // apply the erosion to each individual pixel
-    for (int r = 0; r < srcimg->height; r++) {
-        for (int c = 0; c < srcimg->width; c++) {
-            erode_px(r, c, destimg, srcimg, radius);
-        }
+    // out of bounds pixels never spread anything, so the apron holds the other value
+    PADDEDIMG padded;
+    if (_pad_for_op(&padded, srcimg, radius, BORDER_CONSTANT, 255) == 0) {
+        args.padded = &padded;
+        _run_op("erode_img", srcimg->width, srcimg->height, kernels() ? _morpho_kern_tile : _morpho_padded_tile, &args);
+        free_padded_img(&padded);
+    } else {
+        _run_op("erode_img", srcimg->width, srcimg->height, _morpho_tile, &args);
     }
 }
 
@@ -223,49 +495,66 @@ void erode_img(IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
  * @param radius how far to dilate around each pixel
  */
 void dilate_img(IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
-    // copies the current contents of srcimg into the destination
-    copy_pxmat(
-        destimg->mat,
-        srcimg->mat,
-        srcimg->width,
-        srcimg->height
-    );
 
-    // apply the erosion to each individual pixel
-    for (int r = 0; r < srcimg->height; r++) {
-        for (int c = 0; c < srcimg->width; c++) {
-            dilate_px(r, c, destimg, srcimg, radius);
-        }
+    // same as `erode_img()`, but gathering 255s
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg, .range = radius, .underv = 255};
+
+    PADDEDIMG padded;
+    if (_pad_for_op(&padded, srcimg, radius, BORDER_CONSTANT, 0) == 0) {
+        args.padded = &padded;
+        _run_op("dilate_img", srcimg->width, srcimg->height, kernels() ? _morpho_kern_tile : _morpho_padded_tile, &args);
+        free_padded_img(&padded);
+    } else {
+        _run_op("dilate_img", srcimg->width, srcimg->height, _morpho_tile, &args);
     }
 }
 
 
 void fermeture_img(IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
 
-    // temporary image for holding the first dilation
-    IMAGE tempimg;
-    copy_img(&tempimg, srcimg);
+    MEMOP memop;
+    mem_op_begin(&memop, "fermeture_img");
+
+    // over the memory budget, the dilation is only ever held for a band of rows at a time
+    OPTILE args = {.range = radius, .underv = 255};
+    if (!_use_bands(destimg, srcimg, 1) || _run_banded(destimg, srcimg, 2, radius, _morpho_step, &args) != 0) {
+
+        // temporary image for holding the first dilation
+        IMAGE tempimg;
+        copy_img(&tempimg, srcimg);
 
 
-    dilate_img(&tempimg, srcimg, radius);
+        dilate_img(&tempimg, srcimg, radius);
 
-    erode_img(destimg, &tempimg, radius);
+        erode_img(destimg, &tempimg, radius);
 
-    free_pxmat(tempimg.mat, tempimg.height);
+        free_pxmat(tempimg.mat, tempimg.height);
+    }
+
+    mem_op_end(&memop);
 }
 
 void ouverture_img(IMAGE* destimg, IMAGE* srcimg, unsigned int radius) {
 
-    // temporary image for holding the first erosion
-    IMAGE tempimg;
-    copy_img(&tempimg, srcimg);
+    MEMOP memop;
+    mem_op_begin(&memop, "ouverture_img");
+
+    OPTILE args = {.range = radius, .underv = 0};
+    if (!_use_bands(destimg, srcimg, 1) || _run_banded(destimg, srcimg, 2, radius, _morpho_step, &args) != 0) {
+
+        // temporary image for holding the first erosion
+        IMAGE tempimg;
+        copy_img(&tempimg, srcimg);
 
 
-    erode_img(&tempimg, srcimg, radius);
+        erode_img(&tempimg, srcimg, radius);
 
-    dilate_img(destimg, &tempimg, radius);
+        dilate_img(destimg, &tempimg, radius);
 
-    free_pxmat(tempimg.mat, tempimg.height);
+        free_pxmat(tempimg.mat, tempimg.height);
+    }
+
+    mem_op_end(&memop);
 }
 
 int blur_gpx_cross(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int range) {
@@ -278,7 +567,7 @@ int blur_gpx_cross(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int ran
     int sum = 0;
 
     // sum the rows of the c column
-    for (int rr = r-range; rr <= r+range; rr++) {
+    for (int rr = r-(int)range; rr <= r+(int)range; rr++) {
         GPIXEL* px = get_gpixel(rr, c, srcimg);
 
         if (px != NULL) {
@@ -288,7 +577,7 @@ int blur_gpx_cross(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int ran
     }
 
     // sum the columns of the r row
-    for (int cc = c-range; cc <= c+range; cc++) {
+    for (int cc = c-(int)range; cc <= c+(int)range; cc++) {
         GPIXEL* px = get_gpixel(r, cc, srcimg);
 
         if (px != NULL) {
@@ -322,7 +611,7 @@ int blur_rgbpx_cross(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int r
     int sum[3] = {0};
 
     // sum the rows of the c column
-    for (int rr = r-range; rr <= r+range; rr++) {
+    for (int rr = r-(int)range; rr <= r+(int)range; rr++) {
         RGBPIXEL* px = get_rgbpixel(rr, c, srcimg);
 
         if (px != NULL) {
@@ -334,7 +623,7 @@ int blur_rgbpx_cross(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int r
     }
 
     // sum the columns of the r row
-    for (int cc = c-range; cc <= c+range; cc++) {
+    for (int cc = c-(int)range; cc <= c+(int)range; cc++) {
         RGBPIXEL* px = get_rgbpixel(r, cc, srcimg);
 
         if (px != NULL) {
@@ -370,8 +659,8 @@ int blur_gpx_square(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int ra
     int n = 0;
     int sum = 0;
 
-    for (int rr = r-range; rr <= r+range; rr++) {
-        for (int cc = c-range; cc <= c+range; cc++) {
+    for (int rr = r-(int)range; rr <= r+(int)range; rr++) {
+        for (int cc = c-(int)range; cc <= c+(int)range; cc++) {
             GPIXEL* px = get_gpixel(rr,cc,srcimg);
 
             if (px != NULL) {
@@ -405,8 +694,8 @@ int blur_rgbpx_square(IMAGE* destimg, IMAGE* srcimg, int r, int c, unsigned int
     int n = 0;
     int sum[3] = {0};
 
-    for (int rr = r-range; rr <= r+range; rr++) {
-        for (int cc = c-range; cc <= c+range; cc++) {
+    for (int rr = r-(int)range; rr <= r+(int)range; rr++) {
+        for (int cc = c-(int)range; cc <= c+(int)range; cc++) {
             RGBPIXEL* px = get_rgbpixel(rr,cc,srcimg);
 
             if (px != NULL) {
@@ -444,12 +733,19 @@ int apply_blur2img(
         return -1;
     }
     
-    for (int r = 0; r < srcimg->height; r++) {
-        for (int c = 0; c < srcimg->width; c++) {
-            // no worry about return values because `apply_blur2img` already assures we're in bounds
-            // out of bounds caused by the range are disregarded
-            blur_func(destimg, srcimg,r,c,range);
-        }
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg, .range = range, .blur_func = blur_func};
+
+    // the library's own blurs average over the in bounds pixels only, which an excluded apron
+    // and its counts give without a single bounds check. Any other blur goes pixel by pixel
+    int kind = _blur_kind(blur_func);
+
+    PADDEDIMG padded;
+    if (kind >= 0 && _pad_for_op(&padded, srcimg, range, BORDER_EXCLUDED, 0) == 0) {
+        args.padded = &padded;
+        _run_op("apply_blur2img", srcimg->width, srcimg->height, _blur_padded_tile_for(kind, range), &args);
+        free_padded_img(&padded);
+    } else {
+        _run_op("apply_blur2img", srcimg->width, srcimg->height, _blur_tile, &args);
     }
 
     return 0;
@@ -458,6 +754,29 @@ int apply_blur2img(
 
 int blur_img_rep(int (*blur_img_func)(IMAGE* , IMAGE*, unsigned int), IMAGE* destimg, IMAGE* srcimg, unsigned int range, int n_reps) {
 
+    MEMOP memop;
+    mem_op_begin(&memop, "blur_img_rep");
+
+    // over the memory budget, the repeated blurs are run band by band, each band reading
+    // `n_reps*range` more rows around it (which is as far as the blurs spread)
+    if (n_reps > 0 && _use_bands(destimg, srcimg, 2)) {
+        OPTILE args = {.range = range, .blur_img_func = blur_img_func};
+        int res = _run_banded(destimg, srcimg, n_reps, range, _blur_rep_step, &args);
+        if (res == 0) {
+            mem_op_end(&memop);
+            return 0;
+        }
+    }
+
+    int res = _blur_img_rep_full(blur_img_func, destimg, srcimg, range, n_reps);
+
+    mem_op_end(&memop);
+
+    return res;
+}
+
+int _blur_img_rep_full(int (*blur_img_func)(IMAGE* , IMAGE*, unsigned int), IMAGE* destimg, IMAGE* srcimg, unsigned int range, int n_reps) {
+
     // create a temporary image for intermediate blurs
     IMAGE tempimg1 = {0};
     IMAGE tempimg2 = {0};
@@ -484,7 +803,7 @@ int blur_img_rep(int (*blur_img_func)(IMAGE* , IMAGE*, unsigned int), IMAGE* des
     // now that we have done all of the repetitive bluring, we copy resulting pixel matrix
     // values into the pixel matrix of the destination image
     // the reason we don't just move the pointer is because the destimg->mat pointer could be used elsewhere, and we don't want to overwrite it
-    copy_pxmat(destimg->mat, tempimg1.mat, tempimg1.width, tempimg1.height);
+    _copy_into(destimg, destimg->mat, tempimg1.mat, tempimg1.width, tempimg1.height);
 
     // free the allocated pixel matrixes for this function
     free_img_pxmat(&tempimg1);
@@ -533,19 +852,17 @@ int grad_gimg(IMAGE* destimg, IMAGE* srcimg) {
         return -1;
     }
 
-    for (int r = 0; r < destimg->height; r++) {
-        for (int c = 0; c < destimg->width; c++) {
-            GPIXEL* px = get_gpixel(r,c,destimg);
-            if (px == NULL) {
-                return -2;
-            }
+    // shapes match, so every (r,c) of srcimg is also in destimg
+    OPTILE args = {.destimg = destimg, .srcimg = srcimg};
 
-            set_gpixel(
-                px,
-                grad_gpx(r, c, srcimg)
-            );
-
-        }
+    // out of bounds neighbours count as 0
+    PADDEDIMG padded;
+    if (_pad_for_op(&padded, srcimg, 1, BORDER_CONSTANT, 0) == 0) {
+        args.padded = &padded;
+        _run_op("grad_gimg", destimg->width, destimg->height, _grad_padded_tile, &args);
+        free_padded_img(&padded);
+    } else {
+        _run_op("grad_gimg", destimg->width, destimg->height, _grad_tile, &args);
     }
 
     return 0;
@@ -577,7 +894,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
 
         case GRAY2RGB: case RED2RGB: // they're equivalent
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 px.r,
                 px.r,
                 px.r
@@ -585,7 +902,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             break;
         case GREEN2RGB:
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 px.g,
                 px.g,
                 px.g
@@ -593,7 +910,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             break;
         case BLUE2RGB:
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 px.b,
                 px.b,
                 px.b
@@ -605,7 +922,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             // Y
             c1 = 0.299*px.r + 0.587*px.g + 0.114*px.b;
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 c1,c1,c1
             );
             break;
@@ -618,7 +935,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             // V
             c3 = 0.877*(px.r - c1) + 128;
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 c1,c2,c3
             );
             break;
@@ -631,7 +948,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             // Cr
             c3 = 0.5*px.r - 0.4187*px.g - 0.0813*px.b + 128;
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 c1, c2, c3
             );
             break;
@@ -647,7 +964,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             c3 = px.r + 2.033*px.b;
 
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 c1, c2, c3
             );
             break;
@@ -664,7 +981,7 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
             clamp(&c1, &c2, &c3);
 
             set_rgbpixel(
-                &srcpx->cpx,
+                &destpx->cpx,
                 c1, c2, c3
             );
             break;
@@ -674,4 +991,1145 @@ int convert_channel_px(PIXEL* destpx, PIXEL* srcpx, CONVTYPE conv) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+int stream_blur(
+    int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int),
+    ROWREADER* reader,
+    ROWWRITER* writer,
+    unsigned int range
+) {
+    // same tiles as `apply_blur2img()`, any other blur goes pixel by pixel over the ring
+    int kind = _blur_kind(blur_func);
+    OPTILE args = {.range = range, .blur_func = blur_func, .tile = (kind >= 0) ? _blur_padded_tile_for(kind, range) : _blur_tile};
+    return _stream_rows(reader, writer, range, 0, &args);
+}
+
+int stream_grad(ROWREADER* reader, ROWWRITER* writer) {
+    // only the next row is read, but a symmetric halo of 1 covers it
+    OPTILE args = {.tile = _grad_padded_tile};
+    return _stream_rows(reader, writer, 1, 0, &args);
+}
+
+int stream_erode(ROWREADER* reader, ROWWRITER* writer, unsigned int radius) {
+    OPTILE args = {.range = radius, .underv = 0, .tile = kernels() ? _morpho_kern_tile : _morpho_padded_tile};
+    return _stream_rows(reader, writer, radius, 255, &args);
+}
+
+int stream_dilate(ROWREADER* reader, ROWWRITER* writer, unsigned int radius) {
+    OPTILE args = {.range = radius, .underv = 255, .tile = kernels() ? _morpho_kern_tile : _morpho_padded_tile};
+    return _stream_rows(reader, writer, radius, 0, &args);
+}
+
+
+void area_row(PIXEL* dest, PIXEL** rows, int nrows, int width, int factor, int nchan, void* scratch) {
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL && factor <= KERN_AREA_MAX_FACTOR) {
+        kern->area(&dest[0].cpx.r, rows, nrows, width, factor, nchan, scratch);
+        return;
+    }
+
+    // column sums of the block rows, then sums of `factor` of them
+    int* vsum = scratch;
+    for (int c = 0; c < width; c++) {
+        for (int ch = 0; ch < nchan; ch++) {
+            int s = 0;
+            for (int i = 0; i < nrows; i++) {
+                s += (&rows[i][c].cpx.r)[ch];
+            }
+            vsum[c*nchan + ch] = s;
+        }
+    }
+
+    int destw = (width + factor - 1)/factor;
+    for (int c = 0; c < destw; c++) {
+        int c2 = (c*factor + factor < width) ? c*factor + factor : width;
+        int count = nrows*(c2 - c*factor);
+
+        for (int ch = 0; ch < nchan; ch++) {
+            int s = 0;
+            for (int k = c*factor; k < c2; k++) {
+                s += vsum[k*nchan + ch];
+            }
+            (&dest[c].cpx.r)[ch] = (BYTE)((2*s + count)/(2*count));
+        }
+    }
+}
+
+void chroma_size(CHROMATYPE chroma, int width, int height, int* cwidth, int* cheight) {
+    *cwidth = (chroma == CHROMA_444) ? width : (width + 1)/2;
+    *cheight = (chroma == CHROMA_420) ? (height + 1)/2 : height;
+}
+
+int stream_split_ycbcr(ROWREADER* reader, ROWWRITER* ywriter, ROWWRITER* cbwriter, ROWWRITER* crwriter, CHROMATYPE chroma) {
+
+    if (chroma < 0 || chroma >= _CHROMAEND || reader->img_type != PPM) {
+        return -1;
+    }
+
+    int width = reader->width;
+    int height = reader->height;
+    int cwidth, cheight;
+    chroma_size(chroma, width, height, &cwidth, &cheight);
+    if (ywriter->width != width || ywriter->height != height || cbwriter->width != cwidth || cbwriter->height != cheight
+        || crwriter->width != cwidth || crwriter->height != cheight) {
+        return -1;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "stream_split_ycbcr");
+    scope.pixels = (long long)width*height;
+    scope.bytes = scope.pixels*3;
+
+    // STREAM_MAX_ROWS is even, so 2x2 chroma blocks never straddle two batches
+    int batch = STREAM_MAX_ROWS;
+    int vfactor = (chroma == CHROMA_420) ? 2 : 1;
+    PIXEL** rows = pxalloc(width, batch);
+    PIXEL** crows = (chroma == CHROMA_444) ? NULL : pxalloc(cwidth, batch);
+    PIXEL** cbrows = (PIXEL**)malloc(sizeof(PIXEL*)*batch);
+    PIXEL** crrows = (PIXEL**)malloc(sizeof(PIXEL*)*batch);
+    void* scratch = malloc(kern_area_scratch(width, 2));
+
+    int res = 0;
+    if (rows == NULL || (chroma != CHROMA_444 && crows == NULL) || cbrows == NULL || crrows == NULL || scratch == NULL) {
+        res = -3;
+    }
+
+    for (int r = 0; r < height && res == 0; r += batch) {
+        int n = (r + batch < height) ? batch : height - r;
+        res = read_rows(reader, rows, n);
+        if (res != 0) break;
+
+        // converted in place, Y Cb Cr taking the place of R G B
+        IMAGE block = {.width = width, .height = n, .mat = rows, .img_type = PPM};
+        convert_channel_img(&block, &block, RGB2YCBCR);
+
+        // subsampled chroma averages the converted rows (Y gets averaged along, and is never written)
+        PIXEL** csrc = rows;
+        int cn = n;
+        if (chroma != CHROMA_444) {
+            cn = (n + vfactor - 1)/vfactor;
+            for (int i = 0; i < cn; i++) {
+                int nrows = (i*vfactor + vfactor <= n) ? vfactor : n - i*vfactor;
+                area_row(crows[i], rows + i*vfactor, nrows, width, 2, 3, scratch);
+            }
+            csrc = crows;
+        }
+
+        // Cb and Cr rows are shifted by 1 and 2 bytes, like `channel_view_img()` does, so nothing is copied out
+        for (int i = 0; i < cn; i++) {
+            cbrows[i] = (PIXEL*)(&csrc[i][0].cpx.r + 1);
+            crrows[i] = (PIXEL*)(&csrc[i][0].cpx.r + 2);
+        }
+
+        res = write_rows(ywriter, rows, n);
+        if (res == 0) res = write_rows(cbwriter, cbrows, cn);
+        if (res == 0) res = write_rows(crwriter, crrows, cn);
+    }
+
+    if (rows != NULL) {
+        free_pxmat(rows, batch);
+    }
+    if (crows != NULL) {
+        free_pxmat(crows, batch);
+    }
+    free(cbrows);
+    free(crrows);
+    free(scratch);
+    trace_end(&scope);
+
+    return res;
+}
+
+int chroma_of_size(int width, int height, int cwidth, int cheight) {
+
+    for (int chroma = 0; chroma < _CHROMAEND; chroma++) {
+        int cw, ch;
+        chroma_size(chroma, width, height, &cw, &ch);
+        if (cw == cwidth && ch == cheight) {
+            return chroma;
+        }
+    }
+    return -1;
+}
+
+int stream_merge_ycbcr(ROWREADER* yreader, ROWREADER* cbreader, ROWREADER* crreader, ROWWRITER* writer) {
+
+    int width = yreader->width;
+    int height = yreader->height;
+    int chroma = chroma_of_size(width, height, cbreader->width, cbreader->height);
+
+    if (yreader->img_type != PGM || cbreader->img_type != PGM || crreader->img_type != PGM || chroma < 0
+        || crreader->width != cbreader->width || crreader->height != cbreader->height
+        || writer->img_type != PPM || writer->width != width || writer->height != height) {
+        return -1;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "stream_merge_ycbcr");
+    scope.pixels = (long long)width*height;
+    scope.bytes = scope.pixels*3;
+
+    // STREAM_MAX_ROWS is even, so a row of 4:2:0 chroma is never needed by two batches
+    int batch = STREAM_MAX_ROWS;
+    int cwidth = cbreader->width;
+    int vfactor = (chroma == CHROMA_420) ? 2 : 1;
+    PIXEL** rows = pxalloc(width, batch);
+    PIXEL** crows = (chroma == CHROMA_444) ? NULL : pxalloc(cwidth, batch);
+    PIXEL** cbrows = (PIXEL**)malloc(sizeof(PIXEL*)*batch);
+    PIXEL** crrows = (PIXEL**)malloc(sizeof(PIXEL*)*batch);
+
+    int res = 0;
+    if (rows == NULL || (chroma != CHROMA_444 && crows == NULL) || cbrows == NULL || crrows == NULL) {
+        res = -3;
+    }
+
+    for (int r = 0; r < height && res == 0; r += batch) {
+        int n = (r + batch < height) ? batch : height - r;
+        int cn = (n + vfactor - 1)/vfactor;
+
+        // a PGM read only writes the gray value of each PIXEL, so rows shifted by 1 and 2 bytes (like `channel_view_img()` does)
+        // get the planes into the G and B channels. Full size chroma goes straight there, subsampled chroma into the first two
+        // channels of its own rows first
+        PIXEL** csrc = (chroma == CHROMA_444) ? rows : crows;
+        int shift = (chroma == CHROMA_444) ? 1 : 0;
+        for (int i = 0; i < cn; i++) {
+            cbrows[i] = (PIXEL*)(&csrc[i][0].cpx.r + shift);
+            crrows[i] = (PIXEL*)(&csrc[i][0].cpx.r + shift + 1);
+        }
+
+        res = read_rows(yreader, rows, n);
+        if (res == 0) res = read_rows(cbreader, cbrows, cn);
+        if (res == 0) res = read_rows(crreader, crrows, cn);
+        if (res != 0) break;
+
+        if (chroma != CHROMA_444) {
+            for (int i = 0; i < n; i++) {
+                PIXEL* crow = crows[i/vfactor];
+                for (int c = 0; c < width; c++) {
+                    rows[i][c].cpx.g = crow[c/2].cpx.r;
+                    rows[i][c].cpx.b = crow[c/2].cpx.g;
+                }
+            }
+        }
+
+        IMAGE block = {.width = width, .height = n, .mat = rows, .img_type = PPM};
+        convert_channel_img(&block, &block, YCBCR2RGB);
+
+        res = write_rows(writer, rows, n);
+    }
+
+    if (rows != NULL) {
+        free_pxmat(rows, batch);
+    }
+    if (crows != NULL) {
+        free_pxmat(crows, batch);
+    }
+    free(cbrows);
+    free(crrows);
+    trace_end(&scope);
+
+    return res;
+}
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void _geom_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    IMAGE* src = args->srcimg;
+    IMAGE* dest = args->destimg;
+    int gray = (src->img_type == PGM);
+    GEOMTYPE geom = args->geom;
+
+    if (geom == TRANSPOSE || geom == ROT90 || geom == ROT270) {
+        // dest (r,c) comes from src (c,r), (h-1-c,r) or (c,w-1-r): a block of dest rows reads a block of src rows
+        for (int rb = r1; rb < r2; rb += GEOM_BLOCK) {
+            int re = (rb + GEOM_BLOCK < r2) ? rb + GEOM_BLOCK : r2;
+
+            for (int cb = 0; cb < dest->width; cb += GEOM_BLOCK) {
+                int ce = (cb + GEOM_BLOCK < dest->width) ? cb + GEOM_BLOCK : dest->width;
+
+                for (int r = rb; r < re; r++) {
+                    PIXEL* destrow = dest->mat[r];
+                    int sc = (geom == ROT270) ? src->width-1-r : r;
+
+                    for (int c = cb; c < ce; c++) {
+                        int sr = (geom == ROT90) ? src->height-1-c : c;
+                        if (gray) destrow[c].gpx.v = src->mat[sr][sc].gpx.v;
+                        else destrow[c] = src->mat[sr][sc];
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    // the others map rows to rows, reversed or not
+    int reversed = (geom == ROT180 || geom == FLIP_H);
+    for (int r = r1; r < r2; r++) {
+        PIXEL* destrow = dest->mat[r];
+        PIXEL* srcrow = src->mat[(geom == FLIP_H) ? r : src->height-1-r];
+
+        if (!reversed && !gray) {
+            memcpy(destrow, srcrow, sizeof(PIXEL)*dest->width);
+            continue;
+        }
+
+        for (int c = 0; c < dest->width; c++) {
+            PIXEL* srcpx = &srcrow[reversed ? src->width-1-c : c];
+            if (gray) destrow[c].gpx.v = srcpx->gpx.v;
+            else destrow[c] = *srcpx;
+        }
+    }
+}
+
+void _geom_inplace_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    IMAGE* img = args->destimg;
+    int gray = (img->img_type == PGM);
+    int w = img->width;
+    int h = img->height;
+
+    switch (args->geom) {
+
+    case TRANSPOSE:
+        // row r swaps the pixels right of the diagonal, block by block so the column side stays in cache
+        for (int rb = r1; rb < r2; rb += GEOM_BLOCK) {
+            int re = (rb + GEOM_BLOCK < r2) ? rb + GEOM_BLOCK : r2;
+
+            for (int cb = rb; cb < w; cb += GEOM_BLOCK) {
+                int ce = (cb + GEOM_BLOCK < w) ? cb + GEOM_BLOCK : w;
+
+                for (int r = rb; r < re; r++) {
+                    for (int c = (cb > r) ? cb : r+1; c < ce; c++) {
+                        _swap_px(&img->mat[r][c], &img->mat[c][r], gray);
+                    }
+                }
+            }
+        }
+        break;
+
+    case FLIP_H:
+        for (int r = r1; r < r2; r++) {
+            for (int c = 0; c < w/2; c++) {
+                _swap_px(&img->mat[r][c], &img->mat[r][w-1-c], gray);
+            }
+        }
+        break;
+
+    case FLIP_V:
+        for (int r = r1; r < r2; r++) {
+            for (int c = 0; c < w; c++) {
+                _swap_px(&img->mat[r][c], &img->mat[h-1-r][c], gray);
+            }
+        }
+        break;
+
+    case ROT180:
+        for (int r = r1; r < r2; r++) {
+            // the middle row of an odd height only swaps with itself
+            int n = (r == h-1-r) ? w/2 : w;
+            for (int c = 0; c < n; c++) {
+                _swap_px(&img->mat[r][c], &img->mat[h-1-r][w-1-c], gray);
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void _swap_px(PIXEL* a, PIXEL* b, int gray) {
+
+    if (gray) {
+        BYTE v = a->gpx.v;
+        a->gpx.v = b->gpx.v;
+        b->gpx.v = v;
+        return;
+    }
+
+    PIXEL px = *a;
+    *a = *b;
+    *b = px;
+}
+
+void _convert_channel_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    int r = args->r0+r1;
+
+    // conversions can be in place, so the kernel writes to a row buffer first. Conversions without
+    // a kernel stop at the first row and go pixel by pixel
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        int n = args->c2 - args->c1 + 1;
+        BYTE* row = malloc(sizeof(PIXEL)*n);
+        for (; row != NULL && r < args->r0+r2; r++) {
+            if (kern->convert(row, &args->srcimg->mat[r][args->c1].cpx.r, n, args->conv) != 0) {
+                break;
+            }
+            memcpy(&args->destimg->mat[r][args->c1], row, sizeof(PIXEL)*n);
+        }
+        free(row);
+    }
+
+    for (; r < args->r0+r2; r++) {
+        for (int c = args->c1; c <= args->c2; c++) {
+
+            // bounds have already been checked by `convert_channel_img_range()`, so we don't need
+            // to worry about the return values of the get_pixel functions here
+            convert_channel_px(
+                get_pixel(r, c, args->destimg),
+                get_pixel(r, c, args->srcimg),
+                args->conv
+            );
+        }
+    }
+}
+
+void _bin_gthresh_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int r = r1; r < r2; r++) {
+            kern->thresh(&args->destimg->mat[r][0].cpx.r, args->destimg->width, args->thresh[0], args->underv, args->abovev);
+        }
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+
+            GPIXEL* px = get_gpixel(r,c,args->destimg);
+
+            BYTE thresh_res = (args->thresh[0] < px->v) ? args->abovev : args->underv;
+
+            set_gpixel(px, thresh_res);
+        }
+    }
+}
+
+void _bin_rgbthresh_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int r = r1; r < r2; r++) {
+            kern->rgb_thresh(&args->destimg->mat[r][0].cpx.r, args->destimg->width, args->thresh, args->underv, args->abovev);
+        }
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            RGBPIXEL* px = get_rgbpixel(r,c,args->destimg);
+
+            px->r = (px->r < args->thresh[0]) ? args->underv : args->abovev;
+            px->g = (px->g < args->thresh[1]) ? args->underv : args->abovev;
+            px->b = (px->b < args->thresh[2]) ? args->underv : args->abovev;
+        }
+    }
+}
+
+void _tri_gthresh_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int r = r1; r < r2; r++) {
+            kern->tri_thresh(&args->destimg->mat[r][0].cpx.r, args->destimg->width, args->thresh[0], args->thresh[1]);
+        }
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            GPIXEL* px = &args->destimg->mat[r][c].gpx;
+
+            if (px->v < args->thresh[0]) {
+                px->v = 0;
+            } else if (px->v >= args->thresh[1]) {
+                px->v = 255;
+            } else {
+                px->v = 128;
+            }
+        }
+    }
+}
+
+void _invert_gtile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int r = r1; r < r2; r++) {
+            kern->invert(&args->destimg->mat[r][0].cpx.r, args->destimg->width);
+        }
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            GPIXEL* px = &args->destimg->mat[r][c].gpx;
+            px->v = 255 - px->v;
+        }
+    }
+}
+
+void _add_gtile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        for (int r = r1; r < r2; r++) {
+            kern->add(&args->destimg->mat[r][0].cpx.r, args->destimg->width, args->thresh[0]);
+        }
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            GPIXEL* px = &args->destimg->mat[r][c].gpx;
+            int v = px->v + args->thresh[0];
+            // we clamp so that there are no overflows before putting it back on the image
+            clampg(&v);
+            px->v = v;
+        }
+    }
+}
+
+void _hysteresis_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            GPIXEL* gradpx = &args->destimg->mat[r][c].gpx;
+
+            if (gradpx->v <= args->thresh[0]) {
+                gradpx->v = 0;
+            } else if (args->thresh[1] <= gradpx->v) {
+                gradpx->v = 255;
+            }
+        }
+    }
+}
+
+void _morpho_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    // value being spread (0 for an erosion, 255 for a dilation)
+    BYTE v = args->underv;
+    int radius = args->range;
+    int width = args->srcimg->width;
+    int height = args->srcimg->height;
+
+    for (int r = r1; r < r2; r++) {
+        int rmin = (r-radius > 0) ? r-radius : 0;
+        int rmax = (r+radius < height-1) ? r+radius : height-1;
+
+        for (int c = 0; c < width; c++) {
+            int cmin = (c-radius > 0) ? c-radius : 0;
+            int cmax = (c+radius < width-1) ? c+radius : width-1;
+
+            // a pixel takes `v` if any pixel within `radius` of it has `v`, which is
+            // exactly what spreading `v` around every source pixel ends up doing
+            BYTE res = args->srcimg->mat[r][c].gpx.v;
+            for (int rr = rmin; rr <= rmax && res != v; rr++) {
+                for (int cc = cmin; cc <= cmax; cc++) {
+                    if (args->srcimg->mat[rr][cc].gpx.v == v) {
+                        res = v;
+                        break;
+                    }
+                }
+            }
+
+            args->destimg->mat[r][c].gpx.v = res;
+        }
+    }
+}
+
+void _blur_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->srcimg->width; c++) {
+            // no worry about return values because `apply_blur2img` already assures we're in bounds
+            // out of bounds caused by the range are disregarded
+            args->blur_func(args->destimg, args->srcimg, r, c, args->range);
+        }
+    }
+}
+
+int _pad_for_op(PADDEDIMG* padded, IMAGE* srcimg, int pad, BORDERMODE mode, BYTE fill) {
+
+    // the copy is only worth it (and only made) when it stays within the memory budget
+    if (srcimg->width == 0 || srcimg->height == 0 || !mem_fits(padded_bytes(srcimg->width, srcimg->height, pad))) {
+        return -1;
+    }
+
+    PIXEL value;
+    memset(&value, fill, sizeof(PIXEL));
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", "pad_img");
+    scope.pixels = (long long)(srcimg->width + 2*pad)*(srcimg->height + 2*pad);
+
+    int res = pad_img(padded, srcimg, pad, mode, value);
+
+    trace_end(&scope);
+
+    return (res == 0) ? 0 : -1;
+}
+
+// Blur kernels specialized per blur, pixel type and radius. The window sums below expand to one term per
+// pixel, so every one of these kernels runs without a loop over the window, even unoptimized.
+// `rows`, `r` and `c` are those of the loop in _DEFINE_BLUR_TILE
+#define _PX(dr, dc, ch) (((BYTE*)&rows[r + (dr)][c + (dc)])[ch])
+
+#define _ROW1(dr, ch) (_PX(dr, -1, ch) + _PX(dr, 0, ch) + _PX(dr, 1, ch))
+#define _ROW2(dr, ch) (_PX(dr, -2, ch) + _ROW1(dr, ch) + _PX(dr, 2, ch))
+#define _ROW3(dr, ch) (_PX(dr, -3, ch) + _ROW2(dr, ch) + _PX(dr, 3, ch))
+
+#define _COL1(ch) (_PX(-1, 0, ch) + _PX(0, 0, ch) + _PX(1, 0, ch))
+#define _COL2(ch) (_PX(-2, 0, ch) + _COL1(ch) + _PX(2, 0, ch))
+#define _COL3(ch) (_PX(-3, 0, ch) + _COL2(ch) + _PX(3, 0, ch))
+
+#define _SQUARE1(ch) (_ROW1(-1, ch) + _ROW1(0, ch) + _ROW1(1, ch))
+#define _SQUARE2(ch) (_ROW2(-2, ch) + _ROW2(-1, ch) + _ROW2(0, ch) + _ROW2(1, ch) + _ROW2(2, ch))
+#define _SQUARE3(ch) (_ROW3(-3, ch) + _ROW3(-2, ch) + _ROW3(-1, ch) + _ROW3(0, ch) + _ROW3(1, ch) + _ROW3(2, ch) + _ROW3(3, ch))
+
+// the center is counted twice, once in its column and once in its row
+#define _CROSS1(ch) (_COL1(ch) + _ROW1(0, ch))
+#define _CROSS2(ch) (_COL2(ch) + _ROW2(0, ch))
+#define _CROSS3(ch) (_COL3(ch) + _ROW3(0, ch))
+
+#define _SQUARE_COUNT (src->rowcount[r]*src->colcount[c])
+#define _CROSS_COUNT (src->rowcount[r] + src->colcount[c])
+
+#define _DEFINE_BLUR_TILE(NAME, SUM, COUNT, NCHAN) \
+static void NAME(void* arg, int r1, int r2) { \
+    OPTILE* args = arg; \
+    PADDEDIMG* src = args->padded; \
+    PIXEL** rows = src->rows; \
+    int width = src->width; \
+    for (int r = r1; r < r2; r++) { \
+        BYTE* dest = (BYTE*)args->destimg->mat[r]; \
+        for (int c = 0; c < width; c++) { \
+            int n = COUNT; \
+            dest[3*c] = SUM(0) / n; \
+            if (NCHAN == 3) { \
+                dest[3*c + 1] = SUM(1) / n; \
+                dest[3*c + 2] = SUM(2) / n; \
+            } \
+        } \
+    } \
+}
+
+_DEFINE_BLUR_TILE(_blur_gsquare1_tile, _SQUARE1, _SQUARE_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_gsquare2_tile, _SQUARE2, _SQUARE_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_gsquare3_tile, _SQUARE3, _SQUARE_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_gcross1_tile, _CROSS1, _CROSS_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_gcross2_tile, _CROSS2, _CROSS_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_gcross3_tile, _CROSS3, _CROSS_COUNT, 1)
+_DEFINE_BLUR_TILE(_blur_rgbsquare1_tile, _SQUARE1, _SQUARE_COUNT, 3)
+_DEFINE_BLUR_TILE(_blur_rgbsquare2_tile, _SQUARE2, _SQUARE_COUNT, 3)
+_DEFINE_BLUR_TILE(_blur_rgbsquare3_tile, _SQUARE3, _SQUARE_COUNT, 3)
+_DEFINE_BLUR_TILE(_blur_rgbcross1_tile, _CROSS1, _CROSS_COUNT, 3)
+_DEFINE_BLUR_TILE(_blur_rgbcross2_tile, _CROSS2, _CROSS_COUNT, 3)
+_DEFINE_BLUR_TILE(_blur_rgbcross3_tile, _CROSS3, _CROSS_COUNT, 3)
+
+// indexed by `_blur_kind()`, then by radius - 1
+void (*_blur_kernels[4][BLUR_MAX_UNROLLED])(void*, int, int) = {
+    {_blur_gsquare1_tile, _blur_gsquare2_tile, _blur_gsquare3_tile},
+    {_blur_gcross1_tile, _blur_gcross2_tile, _blur_gcross3_tile},
+    {_blur_rgbsquare1_tile, _blur_rgbsquare2_tile, _blur_rgbsquare3_tile},
+    {_blur_rgbcross1_tile, _blur_rgbcross2_tile, _blur_rgbcross3_tile},
+};
+
+int _blur_kind(int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int)) {
+    if (blur_func == blur_gpx_square) return 0;
+    if (blur_func == blur_gpx_cross) return 1;
+    if (blur_func == blur_rgbpx_square) return 2;
+    if (blur_func == blur_rgbpx_cross) return 3;
+    return -1;
+}
+
+void (*_blur_padded_tile_for(int kind, unsigned int range))(void*, int, int) {
+
+    // common radii have a kernel of their own, with the whole window unrolled
+    if (kernels() != NULL && range <= KERN_BLUR_MAX_RADIUS) {
+        return _blur_kern_tile;
+    } else if (range >= 1 && range <= BLUR_MAX_UNROLLED) {
+        return _blur_kernels[kind][range - 1];
+    }
+    return _blur_padded_tile;
+}
+
+void _blur_padded_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    PADDEDIMG* src = args->padded;
+    int range = args->range;
+    int width = src->width;
+
+    // one loop per blur, so the kind of blur is decided once per tile instead of once per pixel
+    if (args->blur_func == blur_gpx_square) {
+        for (int r = r1; r < r2; r++) {
+            PIXEL* dest = args->destimg->mat[r];
+            for (int c = 0; c < width; c++) {
+                int sum = 0;
+                for (int rr = -range; rr <= range; rr++) {
+                    PIXEL* row = src->rows[r + rr] + c;
+                    for (int cc = -range; cc <= range; cc++) {
+                        sum += row[cc].gpx.v;
+                    }
+                }
+                dest[c].gpx.v = sum / (src->rowcount[r]*src->colcount[c]);
+            }
+        }
+
+    } else if (args->blur_func == blur_gpx_cross) {
+        for (int r = r1; r < r2; r++) {
+            PIXEL* dest = args->destimg->mat[r];
+            PIXEL* row = src->rows[r];
+            for (int c = 0; c < width; c++) {
+                // the center is counted twice, once in its column and once in its row
+                int sum = 0;
+                for (int rr = -range; rr <= range; rr++) {
+                    sum += src->rows[r + rr][c].gpx.v;
+                }
+                for (int cc = -range; cc <= range; cc++) {
+                    sum += row[c + cc].gpx.v;
+                }
+                dest[c].gpx.v = sum / (src->rowcount[r] + src->colcount[c]);
+            }
+        }
+
+    } else if (args->blur_func == blur_rgbpx_square) {
+        for (int r = r1; r < r2; r++) {
+            PIXEL* dest = args->destimg->mat[r];
+            for (int c = 0; c < width; c++) {
+                int sum[3] = {0};
+                for (int rr = -range; rr <= range; rr++) {
+                    PIXEL* row = src->rows[r + rr] + c;
+                    for (int cc = -range; cc <= range; cc++) {
+                        sum[0] += row[cc].cpx.r;
+                        sum[1] += row[cc].cpx.g;
+                        sum[2] += row[cc].cpx.b;
+                    }
+                }
+                int n = src->rowcount[r]*src->colcount[c];
+                dest[c].cpx.r = sum[0] / n;
+                dest[c].cpx.g = sum[1] / n;
+                dest[c].cpx.b = sum[2] / n;
+            }
+        }
+
+    } else {
+        for (int r = r1; r < r2; r++) {
+            PIXEL* dest = args->destimg->mat[r];
+            PIXEL* row = src->rows[r];
+            for (int c = 0; c < width; c++) {
+                int sum[3] = {0};
+                for (int rr = -range; rr <= range; rr++) {
+                    PIXEL* px = &src->rows[r + rr][c];
+                    sum[0] += px->cpx.r;
+                    sum[1] += px->cpx.g;
+                    sum[2] += px->cpx.b;
+                }
+                for (int cc = -range; cc <= range; cc++) {
+                    sum[0] += row[c + cc].cpx.r;
+                    sum[1] += row[c + cc].cpx.g;
+                    sum[2] += row[c + cc].cpx.b;
+                }
+                int n = src->rowcount[r] + src->colcount[c];
+                dest[c].cpx.r = sum[0] / n;
+                dest[c].cpx.g = sum[1] / n;
+                dest[c].cpx.b = sum[2] / n;
+            }
+        }
+    }
+}
+
+void _morpho_padded_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    PADDEDIMG* src = args->padded;
+    BYTE v = args->underv;
+    int radius = args->range;
+    int width = src->width;
+
+    for (int r = r1; r < r2; r++) {
+        PIXEL* dest = args->destimg->mat[r];
+        for (int c = 0; c < width; c++) {
+            // no branch within a row of the window, a row finding `v` still skips the next ones
+            int hit = 0;
+            for (int rr = -radius; rr <= radius && !hit; rr++) {
+                PIXEL* row = src->rows[r + rr] + c;
+                for (int cc = -radius; cc <= radius; cc++) {
+                    hit |= (row[cc].gpx.v == v);
+                }
+            }
+            dest[c].gpx.v = hit ? v : src->rows[r][c].gpx.v;
+        }
+    }
+}
+
+void _blur_kern_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    PADDEDIMG* src = args->padded;
+    int kind = _blur_kind(args->blur_func);
+
+    void* scratch = malloc(kern_blur_scratch(src->width, args->range));
+    if (scratch == NULL) {
+        _blur_padded_tile(arg, r1, r2);
+        return;
+    }
+
+    const KERNELS* kern = kernels();
+    for (int r = r1; r < r2; r++) {
+        kern->blur(&args->destimg->mat[r][0].cpx.r, src->rows, r, src->width, args->range, (kind >= 2) ? 3 : 1, kind % 2, src->colcount, src->rowcount[r], scratch);
+    }
+
+    free(scratch);
+}
+
+void _morpho_kern_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    PADDEDIMG* src = args->padded;
+
+    void* scratch = malloc(kern_morpho_scratch(src->width, args->range));
+    if (scratch == NULL) {
+        _morpho_padded_tile(arg, r1, r2);
+        return;
+    }
+
+    const KERNELS* kern = kernels();
+    for (int r = r1; r < r2; r++) {
+        kern->morpho(&args->destimg->mat[r][0].cpx.r, src->rows, r, src->width, args->range, args->underv, scratch);
+    }
+
+    free(scratch);
+}
+
+void _grad_padded_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    PADDEDIMG* src = args->padded;
+    int width = src->width;
+
+    for (int r = r1; r < r2; r++) {
+        PIXEL* dest = args->destimg->mat[r];
+        PIXEL* row = src->rows[r];
+        PIXEL* next = src->rows[r + 1];
+        for (int c = 0; c < width; c++) {
+            int Ir = row[c].gpx.v - next[c].gpx.v;
+            int Ic = row[c].gpx.v - row[c + 1].gpx.v;
+            // same truncations as `grad_gpx()` then `set_gpixel()`
+            dest[c].gpx.v = (BYTE)(int)sqrt(Ir*Ir + Ic*Ic);
+        }
+    }
+}
+
+void _grad_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+
+    for (int r = r1; r < r2; r++) {
+        for (int c = 0; c < args->destimg->width; c++) {
+            set_gpixel(
+                get_gpixel(r,c,args->destimg),
+                grad_gpx(r, c, args->srcimg)
+            );
+        }
+    }
+}
+
+int _stream_rows(ROWREADER* reader, ROWWRITER* writer, int halo, BYTE fill, void* arg) {
+    OPTILE* args = arg;
+    int width = reader->width;
+    int height = reader->height;
+
+    if (writer->width != width || writer->height != height) {
+        return -1;
+    }
+
+    // amount of output rows computed at once: enough rows for every thread to get a tile,
+    // but never more than STREAM_MAX_ROWS so memory stays at a few rows of the image
+    SCHEDULER* sched = sched_default();
+    int nthreads = (sched != NULL) ? sched->nthreads : 1;
+    int batch = (width > 0) ? ((long)SCHED_MIN_TILE_PX*nthreads) / width : STREAM_MAX_ROWS;
+    if (batch > STREAM_MAX_ROWS) batch = STREAM_MAX_ROWS;
+    if (batch < 1) batch = 1;
+
+    // the ring holds the rows of a batch plus the halo above and under it. Its rows have an apron of `halo`
+    // pixels on each side, and one more row of apron stands for the rows above and under the image
+    int nrows = batch + 2*halo;
+    int pwidth = width + 2*halo;
+    MEMOP memop;
+    mem_op_begin(&memop, "stream_rows");
+    PIXEL** ringmat = pxalloc(pwidth, nrows + 1);
+    PIXEL** outmat = pxalloc(width, batch);
+    mem_op_end(&memop);
+    // ring, destrows and dropped, then the rows of the padded view, then the counts of rows and columns
+    PIXEL** ring = (PIXEL**)malloc(sizeof(PIXEL*)*(4*nrows + 2*halo) + sizeof(int)*(nrows + width));
+
+    int res = 0;
+    if (ringmat == NULL || outmat == NULL || ring == NULL) {
+        res = -3;
+    }
+
+    PADDEDIMG padded = {.width = width, .pad = halo, .mode = BORDER_EXCLUDED, .img_type = reader->img_type};
+    PIXEL** destrows = ring + nrows;
+    PIXEL** dropped = destrows + nrows;
+    if (res == 0) {
+        // the aprons are never read over, so they are filled once
+        for (int i = 0; i <= nrows; i++) {
+            memset(ringmat[i], fill, sizeof(PIXEL)*pwidth);
+        }
+        for (int i = 0; i < nrows; i++) {
+            ring[i] = ringmat[i] + halo;
+        }
+        padded.rowbase = dropped + nrows;
+        padded.rows = padded.rowbase + halo;
+        padded.rowcount = (int*)(padded.rowbase + nrows + 2*halo);
+        padded.colcount = padded.rowcount + nrows;
+        for (int c = 0; c < width; c++) {
+            int lo = (c - halo > 0) ? c - halo : 0;
+            int hi = (c + halo < width - 1) ? c + halo : width - 1;
+            padded.colcount[c] = hi - lo + 1;
+        }
+    }
+    PIXEL* apron = (res == 0) ? ringmat[nrows] + halo : NULL;
+
+    // rows [wr1, wr2[ of the image are in the ring
+    int wr1 = 0, wr2 = 0;
+
+    for (int r = 0; r < height && res == 0; r += batch) {
+        int rb = (r + batch < height) ? batch : height - r;
+        int need1 = (r - halo > 0) ? r - halo : 0;
+        int need2 = (r + rb + halo < height) ? r + rb + halo : height;
+
+        // rows no output row needs anymore go to the back of the ring, to be read over
+        int drop = need1 - wr1;
+        if (drop > 0) {
+            memcpy(dropped, ring, sizeof(PIXEL*)*drop);
+            memmove(ring, ring + drop, sizeof(PIXEL*)*(nrows - drop));
+            memcpy(ring + nrows - drop, dropped, sizeof(PIXEL*)*drop);
+            wr1 = need1;
+        }
+
+        if (need2 > wr2) {
+            res = read_rows(reader, ring + (wr2 - wr1), need2 - wr2);
+            wr2 = need2;
+        }
+        if (res != 0) break;
+
+        // the ring is seen as an image clipped to the rows it holds, so bounds checks at the top and bottom
+        // of the image behave exactly as on a whole image, and the halo covers every other row the op reads
+        IMAGE srcimg = {.width = width, .height = wr2 - wr1, .mat = ring, .img_type = reader->img_type};
+
+        // and as a padded image with the same rows, the rows past the top and bottom of the image being apron
+        padded.height = wr2 - wr1;
+        for (int i = -halo; i < wr2 - wr1 + halo; i++) {
+            padded.rows[i] = (i >= 0 && i < wr2 - wr1) ? ring[i] : apron;
+        }
+        for (int i = 0; i < wr2 - wr1; i++) {
+            int lo = (wr1 + i - halo > 0) ? wr1 + i - halo : 0;
+            int hi = (wr1 + i + halo < height - 1) ? wr1 + i + halo : height - 1;
+            padded.rowcount[i] = hi - lo + 1;
+        }
+
+        int off = r - wr1;
+        for (int i = 0; i < wr2 - wr1; i++) {
+            destrows[i] = outmat[(off <= i && i < off + rb) ? i - off : 0];
+        }
+        IMAGE destimg = {.width = width, .height = wr2 - wr1, .mat = destrows, .img_type = writer->img_type};
+
+        args->srcimg = &srcimg;
+        args->destimg = &destimg;
+        args->padded = &padded;
+        args->r0 = off;
+        _run_op("stream_rows", width, rb, _stream_tile, args);
+
+        res = write_rows(writer, outmat, rb);
+    }
+
+    free_pxmat(ringmat, nrows + 1);
+    free_pxmat(outmat, batch);
+    free(ring);
+
+    return res;
+}
+
+void _stream_tile(void* arg, int r1, int r2) {
+    OPTILE* args = arg;
+    args->tile(arg, args->r0 + r1, args->r0 + r2);
+}
+
+void _run_op(const char* name, int width, int height, void (*tile)(void*, int, int), void* arg) {
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgops", name);
+    scope.pixels = (long long)width*height;
+
+    if (perf_enabled()) {
+        PERFOP op;
+        perf_op_begin(&op, name, (long long)width*height);
+        PERFTILE wrapped = {.tile = tile, .arg = arg, .op = &op};
+        sched_parallel_rows(sched_default(), width, height, _perf_tile, &wrapped);
+        perf_op_end(&op);
+    } else {
+        sched_parallel_rows(sched_default(), width, height, tile, arg);
+    }
+
+    trace_end(&scope);
+}
+
+void _perf_tile(void* arg, int r1, int r2) {
+    PERFTILE* args = (PERFTILE*)arg;
+
+    PERFSAMPLE sample;
+    perf_sample_begin(&sample);
+    args->tile(args->arg, r1, r2);
+    perf_sample_end(&sample, args->op);
+}
+
+int _use_bands(IMAGE* destimg, IMAGE* srcimg, int ntemps) {
+
+    // bands are written to `destimg` as they are done, which would overwrite source rows
+    // later bands still need if both share their pixels
+    if (destimg->height == 0 || destimg->mat[0] == srcimg->mat[0]) {
+        return 0;
+    }
+
+    return !mem_fits(pxmat_bytes(srcimg->width, srcimg->height)*ntemps);
+}
+
+int _run_banded(IMAGE* destimg, IMAGE* srcimg, int nsteps, int halo, void (*step)(int, IMAGE*, IMAGE*, void*), void* arg) {
+    int width = srcimg->width;
+    int height = srcimg->height;
+
+    // every step spreads the errors at the cut edges of a band by `halo` rows
+    long reach = (long)nsteps*halo;
+
+    // two temps of `band + 2*reach` rows each, as many as the budget left allows
+    size_t budget = mem_budget();
+    size_t used = mem_current();
+    size_t avail = (budget > used) ? budget - used : 0;
+    size_t rowbytes = sizeof(PIXEL)*width + sizeof(PIXEL*);
+    long band = (long)(avail / (2*rowbytes)) - 2*reach;
+    if (band > height) band = height;
+    if (band < 1) band = 1;
+
+    long maxrows = band + 2*reach;
+    if (maxrows > height) maxrows = height;
+
+    PIXEL** tmp1 = pxalloc(width, maxrows);
+    PIXEL** tmp2 = pxalloc(width, maxrows);
+    if (tmp1 == NULL || tmp2 == NULL) {
+        free_pxmat(tmp1, maxrows);
+        free_pxmat(tmp2, maxrows);
+        return -3;
+    }
+
+    for (int r = 0; r < height; r += band) {
+        int rb = (r + band < height) ? band : height - r;
+        int a = (r - reach > 0) ? r - reach : 0;
+        int b = (r + rb + reach < height) ? r + rb + reach : height;
+
+        // the band is seen as an image clipped to its rows: at the top and bottom of the image this is
+        // exactly the whole image, elsewhere the wrong rows near the cut never reach rows [r, r+rb[
+        IMAGE bandimg = {.width = width, .height = b - a, .mat = srcimg->mat + a, .img_type = srcimg->img_type};
+        IMAGE tempimg1 = {.width = width, .height = b - a, .mat = tmp1, .img_type = srcimg->img_type};
+        IMAGE tempimg2 = {.width = width, .height = b - a, .mat = tmp2, .img_type = srcimg->img_type};
+
+        IMAGE* in = &bandimg;
+        IMAGE* out = &tempimg1;
+        for (int i = 0; i < nsteps; i++) {
+            step(i, out, in, arg);
+            in = out;
+            out = (out == &tempimg1) ? &tempimg2 : &tempimg1;
+        }
+
+        _copy_into(destimg, destimg->mat + r, in->mat + (r - a), width, rb);
+    }
+
+    free_pxmat(tmp1, maxrows);
+    free_pxmat(tmp2, maxrows);
+
+    return 0;
+}
+
+static int _cmp_key(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+int _profile_indices(int** indices, int** order, int* count, int* given, int ngiven, int n) {
+
+    int all = (ngiven == PROFILE_ALL);
+    int m = all ? n : ngiven;
+    if (m < 0) {
+        return -1;
+    }
+
+    *count = m;
+    if (m == 0) {
+        return 0;
+    }
+
+    *indices = (int*)malloc(sizeof(int)*m);
+    *order = (int*)malloc(sizeof(int)*m);
+    // index in the high half, slot in the low half, so sorting the keys sorts slots by index
+    long long* keys = (long long*)malloc(sizeof(long long)*m);
+    if (*indices == NULL || *order == NULL || keys == NULL) {
+        free(keys);
+        return -3;
+    }
+
+    for (int i = 0; i < m; i++) {
+        int index = all ? i : given[i];
+        if (index < 0 || index >= n) {
+            free(keys);
+            return -1;
+        }
+        (*indices)[i] = index;
+        keys[i] = ((long long)index << 32) | i;
+    }
+
+    if (!all) {
+        qsort(keys, m, sizeof(long long), _cmp_key);
+    }
+    for (int i = 0; i < m; i++) {
+        (*order)[i] = (int)(keys[i] & 0xffffffff);
+    }
+
+    free(keys);
+    return 0;
+}
+
+void _copy_into(IMAGE* destimg, PIXEL** dest, PIXEL** src, int width, int height) {
+    if (destimg->img_type == PGM) {
+        copy_gpxmat(dest, src, width, height);
+    } else {
+        copy_pxmat(dest, src, width, height);
+    }
+}
+
+void _morpho_step(int i, IMAGE* destimg, IMAGE* srcimg, void* arg) {
+    OPTILE* args = arg;
+
+    // `underv` is what the first step spreads, the second one spreads the other value
+    if ((i == 0) == (args->underv == 255)) {
+        dilate_img(destimg, srcimg, args->range);
+    } else {
+        erode_img(destimg, srcimg, args->range);
+    }
+}
+
+void _blur_rep_step(int i, IMAGE* destimg, IMAGE* srcimg, void* arg) {
+    OPTILE* args = arg;
+    args->blur_img_func(destimg, srcimg, args->range);
+}
@@ -2,6 +2,22 @@
 #define IMAGE_OPS_H
 #include "imgio.h"
 
+// amount of rows or columns of a PROFILESET meaning every one of them (see `profile_set_init()`)
+#define PROFILE_ALL -1
+
+// width of the strips `profiles_gimg()` sweeps the image by, so the column profiles of a strip fit in cache
+#define PROFILE_STRIP 256
+
+// max amount of output rows a streamed op computes at once (see `_stream_rows()`)
+#define STREAM_MAX_ROWS 64
+
+// largest blur radius with kernels of its own (see `_blur_kernels`), bigger ones loop over the window
+#define BLUR_MAX_UNROLLED 3
+
+// side of the square blocks `geom_img()` moves pixels by when rows become columns,
+// so the source and destination rows of a block both stay in L1
+#define GEOM_BLOCK 32
+
 // no conversions from gray to anything else (as there's only gray)
 enum _channel_conversion_type_enum {
     
@@ -41,6 +57,33 @@ enum _channel_conversion_type_enum {
 };
 typedef enum _channel_conversion_type_enum CONVTYPE;
 
+enum _chroma_subsampling_type_enum {
+    // Cb and Cr at full resolution
+    CHROMA_444 = 0,
+    // Cb and Cr halved horizontally
+    CHROMA_422,
+    // Cb and Cr halved horizontally and vertically
+    CHROMA_420,
+
+    //! Is just used for enum type checking
+    _CHROMAEND
+};
+typedef enum _chroma_subsampling_type_enum CHROMATYPE;
+
+// rotations are clockwise
+enum _geometry_type_enum {
+    TRANSPOSE = 0, // (r,c) goes to (c,r)
+    ROT90,
+    ROT180,
+    ROT270,
+    FLIP_H, // mirrors the columns (left becomes right)
+    FLIP_V, // mirrors the rows (top becomes bottom)
+
+    //! Is just used for enum type checking
+    _GEOMEND
+};
+typedef enum _geometry_type_enum GEOMTYPE;
+
 /**
  * @brief returns wether (r,c) is within the bounds of img
  *
@@ -158,6 +201,20 @@ int convert_channel_img(IMAGE* destimg, IMAGE* srcimg, CONVTYPE conv);
  */
 int convert_channel_img_range(IMAGE* destimg, IMAGE* srcimg, CONVTYPE conv, int r1, int c1, int r2, int c2);
 
+/**
+ * @brief Transposes, rotates or flips `srcimg` into `destimg`, for gray and RGB images. Ops that turn rows into columns
+ * @brief (TRANSPOSE, ROT90, ROT270) go by GEOM_BLOCK x GEOM_BLOCK blocks instead of walking the source down its columns
+ *
+ * @param destimg image to write to, of the size of the result (width and height swapped for TRANSPOSE, ROT90 and ROT270).
+ * @param         Can be `srcimg` for the flips and ROT180, and for the others when the image is square
+ * @param srcimg image to transform
+ * @param geom the transform (ex: `ROT90`)
+ *
+ * @returns `int` `0` if success. `-1` if `geom` is a non existant transform. `-2` if `destimg` isn't the size of the result.
+ * @returns `-3` if asked to turn a non square image in place
+ */
+int geom_img(IMAGE* destimg, IMAGE* srcimg, GEOMTYPE geom);
+
 /**
  * @brief Applies a binary threhold to a grayscale image (sets to 0 if strictly under threshold, else 255)
  * 
@@ -181,6 +238,118 @@ void bin_gthresh_img(IMAGE* img, int thresh, BYTE underv, BYTE abovev);
 void bin_rgbthresh_img(IMAGE* img, int rthresh, int gthresh, int bthresh, BYTE underv, BYTE abovev);
 
 
+/**
+ * @brief Applies a 3 level threshold to a grayscale image: 0 if strictly under `thresh1`, 255 if at least `thresh2`, else 128
+ * 
+ * @param img grayscale image to apply the threshold to
+ * @param thresh1 lower threshold bound
+ * @param thresh2 upper threshold bound
+ */
+void tri_gthresh_img(IMAGE* img, int thresh1, int thresh2);
+
+/**
+ * @brief Inverts the gray values of an image (v becomes 255-v)
+ * 
+ * @param img grayscale image to invert
+ */
+void invert_gimg(IMAGE* img);
+
+/**
+ * @brief Adds `k` to every gray value of an image, clamping the results between 0 and 255
+ * 
+ * @param img grayscale image to modify
+ * @param k value to add (can be negative)
+ */
+void add_gimg(IMAGE* img, int k);
+
+/**
+ * @brief Applies a hysteresis threshold to a (gradient) grayscale image. Pixels under or at `minthresh` become 0, at or above `maxthresh` become 255.
+ * @brief Pixels in between become 255 if one of their 8 neighbors is 255, else 0.
+ * 
+ * @param img grayscale image to threshold
+ * @param minthresh lower threshold bound
+ * @param maxthresh upper threshold bound
+ */
+void hysteresis_gthresh_img(IMAGE* img, int minthresh, int maxthresh);
+
+/**
+ * @brief Counts the amount of pixels of each gray value in an image
+ * 
+ * @param img grayscale image
+ * @param hist where to write the count of each gray value
+ */
+void histogram_gimg(IMAGE* img, int hist[256]);
+
+/**
+ * @brief Counts the amount of pixels of each value of each channel in an rgb image
+ * 
+ * @param img rgb image
+ * @param hist where to write the counts. `hist[v][0]` is the count of red values `v`, `[1]` green and `[2]` blue
+ */
+void histogram_rgbimg(IMAGE* img, int hist[256][3]);
+
+/**
+ * @brief Counts the amount of pixels of each gray value in a single row or column of an image
+ * 
+ * @param img grayscale image
+ * @param is_row 1 to profile row `index`, 0 to profile column `index`
+ * @param index row or column to profile
+ * @param profile where to write the count of each gray value
+ * @return int `0` if success. `-1` if `index` is out of bounds
+ */
+int profile_gimg(IMAGE* img, int is_row, int index, int profile[256]);
+
+/**
+ * @brief rows and columns of an image to profile together with `profiles_gimg()`
+ *
+ * @member rows: indices of the rows to profile, in the order they were given (duplicates allowed). Like every list
+ * @member       of the set, NULL when there are no rows to profile
+ * @member row_profiles: `nrows` profiles of 256 counts, the one of rows[i] starting at row_profiles[i*256]
+ * @member cols: indices of the columns to profile
+ * @member col_profiles: `ncols` profiles of 256 counts, the one of cols[j] starting at col_profiles[j*256]
+ * @member row_order: slots of `rows` sorted by row, so the sweep goes down the image once
+ * @member col_order: slots of `cols` sorted by column, so each row is read from left to right
+ */
+struct _profile_set_type_struct {
+    int nrows;
+    int* rows;
+    int* row_profiles;
+    int ncols;
+    int* cols;
+    int* col_profiles;
+    int* row_order;
+    int* col_order;
+};
+typedef struct _profile_set_type_struct PROFILESET;
+
+/**
+ * @brief sets up the rows and columns `profiles_gimg()` will profile
+ *
+ * @param set the set to fill, to be freed with `free_profile_set()`
+ * @param img the image the set will be used on (for its dimensions)
+ * @param rows indices of the rows to profile (ignored if `nrows` is PROFILE_ALL)
+ * @param nrows amount of rows in `rows`, or PROFILE_ALL for every row of `img`
+ * @param cols indices of the columns to profile (ignored if `ncols` is PROFILE_ALL)
+ * @param ncols amount of columns in `cols`, or PROFILE_ALL for every column of `img`
+ * @return int `0` if success. `-1` if an index is out of bounds. `-3` if allocation failed
+ */
+int profile_set_init(PROFILESET* set, IMAGE* img, int* rows, int nrows, int* cols, int ncols);
+
+/**
+ * @brief computes every profile of a set in a single sweep of the image, by strips of PROFILE_STRIP columns:
+ * @brief each row segment adds to its row's profile if it is in the set and to the profiles of the set's
+ * @brief columns it crosses, so column profiles are built row by row instead of by strided walks down each column
+ *
+ * @param img grayscale image
+ * @param set rows and columns to profile (from `profile_set_init()` on an image of the same size)
+ */
+void profiles_gimg(IMAGE* img, PROFILESET* set);
+
+/**
+ * @brief frees the buffers of a set (its members are reset)
+ */
+void free_profile_set(PROFILESET* set);
+
 /**
  * @brief Erodes pixels in a `radius` square around (r,c)
  * 
@@ -354,4 +523,298 @@ int grad_gpx(int r, int c, IMAGE* img);
 int grad_gimg(IMAGE* destimg, IMAGE* srcimg);
 
 
+/**
+ * @brief blurs an image streamed from a reader to a writer, row by row, only ever holding the rows the blur needs.
+ * @brief Gives the same result as `apply_blur2img()`
+ *
+ * @param blur_func the blur function to apply to each pixel
+ * @param reader where to read the image from
+ * @param writer where to write the blurred image to (same size as the reader's image)
+ * @param range the range of the blur
+ * @return int `0` if success. `-1` if the reader and writer sizes don't match. `-2` if writing failed. `-3` if allocation failed. `-4` if reading failed
+ */
+int stream_blur(
+    int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int),
+    ROWREADER* reader,
+    ROWWRITER* writer,
+    unsigned int range
+);
+
+/**
+ * @brief same as `grad_gimg()`, but streamed from a reader to a writer (see `stream_blur()`)
+ */
+int stream_grad(ROWREADER* reader, ROWWRITER* writer);
+
+/**
+ * @brief same as `erode_img()`, but streamed from a reader to a writer (see `stream_blur()`)
+ */
+int stream_erode(ROWREADER* reader, ROWWRITER* writer, unsigned int radius);
+
+/**
+ * @brief same as `dilate_img()`, but streamed from a reader to a writer (see `stream_blur()`)
+ */
+int stream_dilate(ROWREADER* reader, ROWWRITER* writer, unsigned int radius);
+
+/**
+ * @brief one destination row of an area downscale from the `nrows` source rows of its block.
+ * @brief Runs `KERNELS.area` when there is one (and `factor` is at most KERN_AREA_MAX_FACTOR). Shared by the downscales of imgscale
+ * @brief and the chroma subsampling of `stream_split_ycbcr()`
+ *
+ * @param dest destination row, of `width` divided by `factor` (rounded up) pixels. Only the gray value is written if `nchan` is 1
+ * @param rows the source rows of the block
+ * @param scratch `kern_area_scratch()` bytes
+ */
+void area_row(PIXEL* dest, PIXEL** rows, int nrows, int width, int factor, int nchan, void* scratch);
+
+/**
+ * @brief size of the Cb and Cr planes of a `width` x `height` image subsampled by `chroma` (halved sizes rounded up)
+ */
+void chroma_size(CHROMATYPE chroma, int width, int height, int* cwidth, int* cheight);
+
+/**
+ * @brief Splits a PPM into its Y, Cb and Cr planes in a single pass: each block of rows read is converted once (same as
+ * @brief `convert_channel_img()` with RGB2YCBCR) and written to the three planes right away, so only a few rows are ever held.
+ * @brief Subsampled chroma is the rounded average of each 2x1 (4:2:2) or 2x2 (4:2:0) block, as `downscale_img()` would give
+ *
+ * @param reader opened row reader of a PPM
+ * @param ywriter writer of the Y plane, a PGM of the size of the source
+ * @param cbwriter writer of the Cb plane, a PGM of `chroma_size()`
+ * @param crwriter writer of the Cr plane, a PGM of `chroma_size()`
+ * @param chroma chroma subsampling (ex: `CHROMA_420`)
+ *
+ * @returns `int` `0` if success. `-1` if `chroma` is a non existant subsampling, the source isn't a PPM or a writer isn't of the right size.
+ * @returns `-2` if writing failed. `-3` if allocation failed. `-4` if the file ended early
+ */
+int stream_split_ycbcr(ROWREADER* reader, ROWWRITER* ywriter, ROWWRITER* cbwriter, ROWWRITER* crwriter, CHROMATYPE chroma);
+
+/**
+ * @brief chroma subsampling whose `chroma_size()` of a `width` x `height` image is `cwidth` x `cheight`
+ *
+ * @returns `int` the CHROMATYPE (the least subsampled one when several fit). `-1` if none does
+ */
+int chroma_of_size(int width, int height, int cwidth, int cheight);
+
+/**
+ * @brief Merges Y, Cb and Cr planes back into a PPM in a single pass, the reverse of `stream_split_ycbcr()`: the three files are
+ * @brief read in lockstep by blocks of rows, straight into the channels of the output rows, converted (same as `convert_channel_img()`
+ * @brief with YCBCR2RGB) and written, so only a few rows are ever held. Subsampled chroma (told by the size of its planes, see
+ * @brief `chroma_of_size()`) is upsampled by repeating each sample over the 2x1 or 2x2 block it stands for
+ *
+ * @param yreader opened row reader of the Y plane, a PGM
+ * @param cbreader opened row reader of the Cb plane, a PGM
+ * @param crreader opened row reader of the Cr plane, a PGM of the size of the Cb plane
+ * @param writer writer of the merged image, a PPM of the size of the Y plane
+ *
+ * @returns `int` `0` if success. `-1` if a plane isn't a PGM, the chroma planes aren't of a subsampled size of the Y plane or the writer isn't
+ * @returns a PPM of its size. `-2` if writing failed. `-3` if allocation failed. `-4` if a file ended early
+ */
+int stream_merge_ycbcr(ROWREADER* yreader, ROWREADER* cbreader, ROWREADER* crreader, ROWWRITER* writer);
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+// Tile functions handed to `sched_parallel_rows()` by the image ops above.
+// Each one works on rows [r1, r2[ and gets its parameters from an OPTILE passed as `arg`.
+
+/**
+ * @brief tile of `convert_channel_img_range()`. Rows are relative to the start row of the range
+ */
+void _convert_channel_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `geom_img()` between two images, over rows of the destination
+ */
+void _geom_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `geom_img()` in place (TRANSPOSE, ROT180, FLIP_H or FLIP_V). Each row of the tile owns
+ * @brief the pixels it swaps with: the ones right of the diagonal for TRANSPOSE, the mirrored row for ROT180 and FLIP_V
+ * @brief (which then only run over the top half of the rows)
+ */
+void _geom_inplace_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief swaps two pixels, only their gray value if `gray`
+ */
+void _swap_px(PIXEL* a, PIXEL* b, int gray);
+
+/**
+ * @brief tile of `bin_gthresh_img()`
+ */
+void _bin_gthresh_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `bin_rgbthresh_img()`
+ */
+void _bin_rgbthresh_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `tri_gthresh_img()`
+ */
+void _tri_gthresh_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `invert_gimg()`
+ */
+void _invert_gtile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `add_gimg()`, the value to add is in `thresh[0]`
+ */
+void _add_gtile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of the first pass of `hysteresis_gthresh_img()`
+ */
+void _hysteresis_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `erode_img()` and `dilate_img()`, spreads the value in `underv` (0 or 255)
+ */
+void _morpho_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `apply_blur2img()`
+ */
+void _blur_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `grad_gimg()`
+ */
+void _grad_tile(void* arg, int r1, int r2);
+
+
+/**
+ * @brief runs a tile function over an image streamed from `reader` to `writer`. A ring of row buffers holds a batch of
+ * @brief rows plus `halo` rows above and under it. Rows are read as the batch moves down the image, and the
+ * @brief buffers of the rows falling behind are reused.
+ * @brief The tile reads the ring either as `srcimg`, clipped to the rows it holds, or as `padded`, where only the columns
+ * @brief and the rows past the top and bottom of the image get an apron (with the counts of BORDER_EXCLUDED)
+ *
+ * @param halo how many rows above and under each output row the tile function reads, and how wide the apron is
+ * @param fill value of every byte of the apron
+ * @param arg an OPTILE, with `tile` set to the tile function to run
+ * @return int same as `stream_blur()`
+ */
+int _stream_rows(ROWREADER* reader, ROWWRITER* writer, int halo, BYTE fill, void* arg);
+
+/**
+ * @brief runs `tile` of an OPTILE on its rows offset by `r0`
+ */
+void _stream_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief runs the tiles of a whole image op over the default scheduler, timing it when tracing is on
+ * @brief and reading hardware counters around it when they are on
+ *
+ * @param name name of the op, as it shows up in the trace (must be a string literal)
+ */
+void _run_op(const char* name, int width, int height, void (*tile)(void*, int, int), void* arg);
+
+/**
+ * @brief runs a tile between two reads of the hardware counters of the calling thread
+ */
+void _perf_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief makes the padded copy of `srcimg` read by the branch free kernels, unless it would go over the memory budget
+ *
+ * @param fill value of every channel of the apron for BORDER_CONSTANT
+ * @return int `0` if `padded` is ready (free it with `free_padded_img()`), `-1` if the op should read `srcimg` itself
+ */
+int _pad_for_op(PADDEDIMG* padded, IMAGE* srcimg, int pad, BORDERMODE mode, BYTE fill);
+
+/**
+ * @brief which of the library's blurs `blur_func` is, as an index of `_blur_kernels`
+ *
+ * @return int 0 for `blur_gpx_square()`, 1 `blur_gpx_cross()`, 2 `blur_rgbpx_square()`, 3 `blur_rgbpx_cross()`, -1 for any other
+ */
+int _blur_kind(int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int));
+
+/**
+ * @brief tiles of the library's blurs specialized for radii 1 to BLUR_MAX_UNROLLED, indexed by `_blur_kind()` then radius - 1.
+ * @brief They read a padded copy of the source, like `_blur_padded_tile()`
+ */
+extern void (*_blur_kernels[4][BLUR_MAX_UNROLLED])(void*, int, int);
+
+/**
+ * @brief the fastest tile for a blur of the library over a padded copy of the source (see `_blur_padded_tile()`)
+ *
+ * @param kind the blur, from `_blur_kind()` (not -1)
+ * @param range the range of the blur
+ */
+void (*_blur_padded_tile_for(int kind, unsigned int range))(void*, int, int);
+
+/**
+ * @brief the library's four blurs over a padded copy (BORDER_EXCLUDED, `pad` >= range) of the source
+ */
+void _blur_padded_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief erosion or dilation over a padded copy (BORDER_CONSTANT holding the value not spread) of the source
+ */
+void _morpho_padded_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief the library's four blurs through the blur kernel picked by `kernels()`, same padded copy as `_blur_padded_tile()`
+ */
+void _blur_kern_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief erosion or dilation through the morphology kernel picked by `kernels()`, same padded copy as `_morpho_padded_tile()`
+ */
+void _morpho_kern_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief gradient over a padded copy (BORDER_CONSTANT 0, `pad` >= 1) of the source
+ */
+void _grad_padded_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief whether an op needing `ntemps` full size temps of `srcimg` should run over bands instead,
+ * @brief to stay within the memory budget (see `mem_budget()`)
+ */
+int _use_bands(IMAGE* destimg, IMAGE* srcimg, int ntemps);
+
+/**
+ * @brief runs a chain of `nsteps` whole image steps band by band, each band only going through
+ * @brief two temps of its size (plus the rows the steps read around it)
+ *
+ * @param destimg where the result of the last step goes. Must not share pixels with `srcimg`
+ * @param halo how many rows around a pixel one step reads
+ * @param step called with the index of the step and the band images to read and write
+ * @return int `0` if success. `-3` if the temps couldn't be allocated
+ */
+int _run_banded(IMAGE* destimg, IMAGE* srcimg, int nsteps, int halo, void (*step)(int, IMAGE*, IMAGE*, void*), void* arg);
+
+/**
+ * @brief fills a PROFILESET index list (every index up to `n` for PROFILE_ALL) and the order of its slots.
+ * @brief An empty list leaves both NULL
+ *
+ * @return int `0` if success. `-1` if an index isn't in [0, n[. `-3` if allocation failed
+ */
+int _profile_indices(int** indices, int** order, int* count, int* given, int ngiven, int n);
+
+/**
+ * @brief copies rows of a result into `destimg`, only the gray values if it is a gray image,
+ * @brief so a channel view (see `channel_view_img()`) keeps the other channels of its image
+ */
+void _copy_into(IMAGE* destimg, PIXEL** dest, PIXEL** src, int width, int height);
+
+/**
+ * @brief dilation then erosion (or the opposite, depending on `OPTILE.underv`), as steps of `_run_banded()`
+ */
+void _morpho_step(int i, IMAGE* destimg, IMAGE* srcimg, void* arg);
+
+/**
+ * @brief one blur of `blur_img_rep()`, as a step of `_run_banded()`
+ */
+void _blur_rep_step(int i, IMAGE* destimg, IMAGE* srcimg, void* arg);
+
+/**
+ * @brief `blur_img_rep()` over the whole image, with two full size temps
+ */
+int _blur_img_rep_full(int (*blur_img_func)(IMAGE*, IMAGE*, unsigned int), IMAGE* destimg, IMAGE* srcimg, unsigned int range, int n_reps);
+
 #endif
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "imgperf.h"
+
+static const char* _perf_event_names[PERF_NCOUNTERS] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+static const unsigned long long _perf_event_configs[PERF_NCOUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static pthread_once_t _perf_once = PTHREAD_ONCE_INIT;
+static int _perf_on = 0;
+static char* _perf_path = NULL;
+// events the first thread could open. Events missing there (ex: no LLC event in a VM) are reported as n/a
+static int _perf_available[PERF_NCOUNTERS];
+
+static pthread_mutex_t _perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static PERFTOTAL _perf_totals[PERF_MAX_OPS];
+static int _perf_ntotals = 0;
+
+// counters of the calling thread, opened on its first sample. fds are never closed, the threads live
+// as long as the process
+static _Thread_local int _perf_thread_state = 0;      // 0 not opened yet, 1 opened, -1 failed
+static _Thread_local int _perf_leader = -1;
+static _Thread_local int _perf_slots[PERF_NCOUNTERS];  // position of each event in a group read, -1 if not opened
+static _Thread_local int _perf_nslots = 0;
+
+
+static void _perf_atexit(void) {
+    perf_report();
+}
+
+
+int perf_enabled(void) {
+    pthread_once(&_perf_once, _perf_init);
+    return _perf_on;
+}
+
+void perf_op_begin(PERFOP* op, const char* name, long long pixels) {
+
+    op->on = perf_enabled();
+    if (!op->on) {
+        return;
+    }
+
+    op->name = name;
+    op->pixels = pixels;
+    for (int i = 0; i < PERF_NCOUNTERS; i++) {
+        atomic_init(&op->counts[i], 0);
+    }
+}
+
+void perf_op_end(PERFOP* op) {
+
+    if (!op->on) {
+        return;
+    }
+
+    pthread_mutex_lock(&_perf_lock);
+
+    int i = 0;
+    while (i < _perf_ntotals && _perf_totals[i].name != op->name && strcmp(_perf_totals[i].name, op->name) != 0) i++;
+    if (i == _perf_ntotals && _perf_ntotals < PERF_MAX_OPS) {
+        memset(&_perf_totals[i], 0, sizeof(PERFTOTAL));
+        _perf_totals[i].name = op->name;
+        _perf_ntotals++;
+    }
+
+    if (i < _perf_ntotals) {
+        _perf_totals[i].calls++;
+        _perf_totals[i].pixels += op->pixels;
+        for (int e = 0; e < PERF_NCOUNTERS; e++) {
+            _perf_totals[i].counts[e] += atomic_load(&op->counts[e]);
+        }
+    }
+
+    pthread_mutex_unlock(&_perf_lock);
+}
+
+void perf_sample_begin(PERFSAMPLE* sample) {
+    sample->on = perf_enabled() && _perf_read(sample->values) == 0;
+}
+
+void perf_sample_end(PERFSAMPLE* sample, PERFOP* op) {
+
+    if (!sample->on || !op->on) {
+        return;
+    }
+
+    long long values[PERF_NCOUNTERS];
+    if (_perf_read(values) != 0) {
+        return;
+    }
+
+    for (int e = 0; e < PERF_NCOUNTERS; e++) {
+        atomic_fetch_add(&op->counts[e], values[e] - sample->values[e]);
+    }
+}
+
+int perf_report(void) {
+
+    if (!perf_enabled()) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&_perf_lock);
+
+    int res = 0;
+    int to_stderr = (strcmp(_perf_path, "1") == 0 || strcmp(_perf_path, "stderr") == 0);
+
+    if (to_stderr) {
+        fprintf(stderr, "%-24s %8s %10s %10s %6s %12s %12s\n", "op", "calls", "Mpx", "cycles/px", "IPC", "llc_miss/px", "br_miss/px");
+
+        for (int i = 0; i < _perf_ntotals; i++) {
+            PERFTOTAL* t = &_perf_totals[i];
+            double px = t->pixels > 0 ? (double)t->pixels : 1.0;
+
+            fprintf(stderr, "%-24s %8lld %10.3f %10.2f ", t->name, t->calls, t->pixels/1e6, t->counts[PERF_CYCLES]/px);
+
+            if (_perf_available[PERF_INSTRUCTIONS] && t->counts[PERF_CYCLES] > 0) {
+                fprintf(stderr, "%6.2f ", (double)t->counts[PERF_INSTRUCTIONS]/t->counts[PERF_CYCLES]);
+            } else {
+                fprintf(stderr, "%6s ", "n/a");
+            }
+            if (_perf_available[PERF_LLC_MISSES]) {
+                fprintf(stderr, "%12.4f ", t->counts[PERF_LLC_MISSES]/px);
+            } else {
+                fprintf(stderr, "%12s ", "n/a");
+            }
+            if (_perf_available[PERF_BRANCH_MISSES]) {
+                fprintf(stderr, "%12.4f\n", t->counts[PERF_BRANCH_MISSES]/px);
+            } else {
+                fprintf(stderr, "%12s\n", "n/a");
+            }
+        }
+
+    } else {
+        FILE* fd = fopen(_perf_path, "w");
+        if (fd == NULL) {
+            pthread_mutex_unlock(&_perf_lock);
+            return -1;
+        }
+
+        fprintf(fd, "{\"ops\": [");
+        for (int i = 0; i < _perf_ntotals; i++) {
+            PERFTOTAL* t = &_perf_totals[i];
+            double px = t->pixels > 0 ? (double)t->pixels : 1.0;
+
+            fprintf(fd, "%s\n  {\"op\": \"%s\", \"calls\": %lld, \"pixels\": %lld", i == 0 ? "" : ",", t->name, t->calls, t->pixels);
+
+            // unavailable events are null rather than a misleading 0
+            for (int e = 0; e < PERF_NCOUNTERS; e++) {
+                if (_perf_available[e]) {
+                    fprintf(fd, ", \"%s\": %lld", _perf_event_names[e], t->counts[e]);
+                } else {
+                    fprintf(fd, ", \"%s\": null", _perf_event_names[e]);
+                }
+            }
+
+            if (_perf_available[PERF_INSTRUCTIONS] && t->counts[PERF_CYCLES] > 0) {
+                fprintf(fd, ", \"ipc\": %.4f", (double)t->counts[PERF_INSTRUCTIONS]/t->counts[PERF_CYCLES]);
+            } else {
+                fprintf(fd, ", \"ipc\": null");
+            }
+            if (_perf_available[PERF_LLC_MISSES]) {
+                fprintf(fd, ", \"llc_misses_per_px\": %.6f", t->counts[PERF_LLC_MISSES]/px);
+            } else {
+                fprintf(fd, ", \"llc_misses_per_px\": null");
+            }
+            if (_perf_available[PERF_BRANCH_MISSES]) {
+                fprintf(fd, ", \"branch_misses_per_px\": %.6f}", t->counts[PERF_BRANCH_MISSES]/px);
+            } else {
+                fprintf(fd, ", \"branch_misses_per_px\": null}");
+            }
+        }
+        fprintf(fd, "\n]}\n");
+
+        res = (fclose(fd) == 0) ? 0 : -1;
+    }
+
+    pthread_mutex_unlock(&_perf_lock);
+
+    return res;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void _perf_init(void) {
+
+    char* path = getenv(PERF_ENV);
+    if (path == NULL || path[0] == '\0' || strcmp(path, "0") == 0) {
+        return;
+    }
+
+    _perf_path = strdup(path);
+    if (_perf_path == NULL) {
+        return;
+    }
+
+    // the thread reading PERF_ENV opens its counters right away, so a refusal is reported once, here
+    if (_perf_open_thread() != 0) {
+        fprintf(stderr, "%s: hardware counters unavailable (%s), running without them\n", PERF_ENV, strerror(errno));
+        return;
+    }
+
+    for (int e = 0; e < PERF_NCOUNTERS; e++) {
+        _perf_available[e] = (_perf_slots[e] >= 0);
+    }
+
+    _perf_on = 1;
+    atexit(_perf_atexit);
+}
+
+int _perf_open_thread(void) {
+
+    if (_perf_thread_state != 0) {
+        return _perf_thread_state > 0 ? 0 : -1;
+    }
+
+    _perf_thread_state = -1;
+    _perf_nslots = 0;
+
+    for (int e = 0; e < PERF_NCOUNTERS; e++) {
+        _perf_slots[e] = -1;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = _perf_event_configs[e];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = (_perf_leader < 0);
+        // user space only, this is what perf_event_paranoid 2 allows and the kernels are user code anyway
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, _perf_leader, 0);
+        if (fd < 0) {
+            if (_perf_leader < 0) {
+                // without a leader nothing can be counted
+                return -1;
+            }
+            continue;
+        }
+
+        if (_perf_leader < 0) {
+            _perf_leader = fd;
+        }
+        _perf_slots[e] = _perf_nslots++;
+    }
+
+    ioctl(_perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    _perf_thread_state = 1;
+    return 0;
+}
+
+int _perf_read(long long values[PERF_NCOUNTERS]) {
+
+    if (_perf_open_thread() != 0) {
+        return -1;
+    }
+
+    // group read layout: nr, then one value per opened event
+    unsigned long long buf[1 + PERF_NCOUNTERS];
+    ssize_t n = read(_perf_leader, buf, sizeof(unsigned long long)*(1 + _perf_nslots));
+    if (n < (ssize_t)sizeof(unsigned long long)*(1 + _perf_nslots)) {
+        return -1;
+    }
+
+    for (int e = 0; e < PERF_NCOUNTERS; e++) {
+        values[e] = (_perf_slots[e] >= 0) ? (long long)buf[1 + _perf_slots[e]] : 0;
+    }
+    return 0;
+}
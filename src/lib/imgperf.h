@@ -0,0 +1,127 @@
+#ifndef IMAGE_PERF_H
+#define IMAGE_PERF_H
+
+#include <stdatomic.h>
+
+// environment variable turning hardware counters on. "1" or "stderr" prints a table at exit,
+// any other value is taken as the path of a JSON report to write at exit
+#define PERF_ENV "IMG_PERF"
+
+// max amount of distinct ops in the report
+#define PERF_MAX_OPS 64
+
+// counted hardware events, in the order of `PERFOP.counts`
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_LLC_MISSES 2
+#define PERF_BRANCH_MISSES 3
+#define PERF_NCOUNTERS 4
+
+/**
+ * @brief hardware counters of one run of an op, summed over every thread that ran a part of it
+ *
+ * @member on: 0 when counters are off, every other member is then left untouched
+ * @member counts: summed counter deltas, indexed by PERF_CYCLES, PERF_INSTRUCTIONS...
+ */
+struct _perf_op_type_struct {
+    int on;
+    const char* name;
+    long long pixels;
+    atomic_llong counts[PERF_NCOUNTERS];
+};
+typedef struct _perf_op_type_struct PERFOP;
+
+/**
+ * @brief counter values read by one thread when it starts a part of an op
+ */
+struct _perf_sample_type_struct {
+    int on;
+    long long values[PERF_NCOUNTERS];
+};
+typedef struct _perf_sample_type_struct PERFSAMPLE;
+
+/**
+ * @brief totals of every run of an op with the same name
+ */
+struct _perf_total_type_struct {
+    const char* name;
+    long long calls;
+    long long pixels;
+    long long counts[PERF_NCOUNTERS];
+};
+typedef struct _perf_total_type_struct PERFTOTAL;
+
+
+/**
+ * @brief whether counters are on (decided once, from PERF_ENV). When the kernel refuses the counters
+ * @brief (no PMU, perf_event_paranoid...) a note is printed once and they stay off
+ *
+ * @return int 1 if counters are read, else 0
+ */
+int perf_enabled(void);
+
+/**
+ * @brief starts counting an op. Every thread running a part of it then wraps that part
+ * @brief in `perf_sample_begin()` / `perf_sample_end()`
+ *
+ * @param op the op to start
+ * @param name name of the op, must be a string literal
+ * @param pixels pixels processed by the op
+ */
+void perf_op_begin(PERFOP* op, const char* name, long long pixels);
+
+/**
+ * @brief ends an op and adds its counts to the totals of its name
+ *
+ * @param op the op to end
+ */
+void perf_op_end(PERFOP* op);
+
+/**
+ * @brief reads the counters of the calling thread (opened on first use)
+ *
+ * @param sample where to keep the values
+ */
+void perf_sample_begin(PERFSAMPLE* sample);
+
+/**
+ * @brief reads the counters of the calling thread again and adds the difference to an op
+ *
+ * @param sample the values read by `perf_sample_begin()`, on the same thread
+ * @param op the op the counted work belongs to
+ */
+void perf_sample_end(PERFSAMPLE* sample, PERFOP* op);
+
+/**
+ * @brief writes the per op report (IPC, LLC and branch misses per pixel), to stderr or JSON
+ * @brief depending on PERF_ENV. Called at exit, but can be called earlier
+ *
+ * @return int `0` if success. `-1` if the JSON file couldn't be written
+ */
+int perf_report(void);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief reads PERF_ENV and checks the counters can be opened, run once
+ */
+void _perf_init(void);
+
+/**
+ * @brief opens the counters of the calling thread as one group
+ *
+ * @return int `0` if at least the leader could be opened, else `-1`
+ */
+int _perf_open_thread(void);
+
+/**
+ * @brief reads the counters of the calling thread, events that couldn't be opened read as 0
+ *
+ * @return int `0` if success, else `-1`
+ */
+int _perf_read(long long values[PERF_NCOUNTERS]);
+
+#endif
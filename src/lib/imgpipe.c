@@ -0,0 +1,670 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgtools.h"
+#include "imgpipe.h"
+#include "imgkern.h"
+
+
+static int _pipe_blur(IMAGE* destimg, IMAGE* srcimg, char** args, int square) {
+    int radius = -1;
+    sscanf(args[0], "%d", &radius);
+    if (radius < 0) {
+        return -1;
+    }
+
+    if (srcimg->img_type == PPM) {
+        return apply_blur2img(square ? &blur_rgbpx_square : &blur_rgbpx_cross, destimg, srcimg, radius);
+    }
+    return apply_blur2img(square ? &blur_gpx_square : &blur_gpx_cross, destimg, srcimg, radius);
+}
+
+static int _pipe_blur_square(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_blur(destimg, srcimg, args, 1);
+}
+
+static int _pipe_blur_cross(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_blur(destimg, srcimg, args, 0);
+}
+
+static int _pipe_morpho(IMAGE* destimg, IMAGE* srcimg, char** args, void (*morpho_func)(IMAGE*, IMAGE*, unsigned int)) {
+    int radius = -1;
+    sscanf(args[0], "%d", &radius);
+    if (radius < 0) {
+        return -1;
+    }
+
+    morpho_func(destimg, srcimg, radius);
+    return 0;
+}
+
+static int _pipe_erode(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_morpho(destimg, srcimg, args, erode_img);
+}
+
+static int _pipe_dilate(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_morpho(destimg, srcimg, args, dilate_img);
+}
+
+static int _pipe_open(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_morpho(destimg, srcimg, args, ouverture_img);
+}
+
+static int _pipe_close(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return _pipe_morpho(destimg, srcimg, args, fermeture_img);
+}
+
+static int _pipe_gradient(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return grad_gimg(destimg, srcimg);
+}
+
+static int _pipe_hysteresis(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int minthresh = 0, maxthresh = 0;
+    sscanf(args[0], "%d", &minthresh);
+    sscanf(args[1], "%d", &maxthresh);
+
+    hysteresis_gthresh_img(destimg, minthresh, maxthresh);
+    return 0;
+}
+
+// steps that only exist in pipelines, because the executables have them with fixed parameters (or not at all)
+static TOOL _pipe_tools[] = {
+    {"blur_square", 0,   0,   1, "<radius>",               0, _pipe_blur_square, NULL},
+    {"blur_cross",  0,   0,   1, "<radius>",               0, _pipe_blur_cross, NULL},
+    {"erode",       PGM, PGM, 1, "<radius>",               0, _pipe_erode, NULL},
+    {"dilate",      PGM, PGM, 1, "<radius>",               0, _pipe_dilate, NULL},
+    {"open",        PGM, PGM, 1, "<radius>",               0, _pipe_open, NULL},
+    {"close",       PGM, PGM, 1, "<radius>",               0, _pipe_close, NULL},
+    {"gradient",    PGM, PGM, 0, "",                       0, _pipe_gradient, NULL},
+    {"hysteresis",  PGM, PGM, 2, "<minthresh> <maxthresh>", 1, _pipe_hysteresis, NULL},
+};
+
+// channel names usable in `<chan>+=<k>`, `<chan>-=<k>` and `select <chan>`, and the channel they are stored in
+// (Y, Cb, Cr and Y, U, V are stored in R, G, B, the same as `convert_channel_px()` does)
+static char* _chan_names[] = {"y", "cb", "cr", "r", "g", "b", "v", "u"};
+static int _chan_index[] = {0, 1, 2, 0, 1, 2, 2, 1};
+
+
+static TOOL* _get_pipe_tool(char* name) {
+
+    for (int i = 0; i < sizeof(_pipe_tools)/sizeof(TOOL); i++) {
+        if (strcmp(_pipe_tools[i].name, name) == 0) {
+            return &_pipe_tools[i];
+        }
+    }
+
+    // every single image executable can be a step too
+    return get_tool(name);
+}
+
+static int _get_chan(char* name, int len) {
+
+    for (int i = 0; i < sizeof(_chan_names)/sizeof(char*); i++) {
+        if (strlen(_chan_names[i]) == len && strncmp(_chan_names[i], name, len) == 0) {
+            return _chan_index[i];
+        }
+    }
+    return -1;
+}
+
+static void _identity_lut(POINTOP* op) {
+    op->kind = POINT_LUT;
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 0; v < 256; v++) {
+            op->lut[ch][v] = v;
+        }
+    }
+}
+
+
+int parse_pipeline(char* spec, PIPELINE* pipe) {
+
+    memset(pipe, 0, sizeof(PIPELINE));
+
+    pipe->text = strdup(spec);
+    // at most one stage per `|`, plus one
+    int maxstages = 1;
+    for (char* c = spec; *c != '\0'; c++) maxstages += (*c == '|');
+    pipe->stages = (PIPESTAGE*)calloc(maxstages, sizeof(PIPESTAGE));
+    if (pipe->text == NULL || pipe->stages == NULL) {
+        free_pipeline(pipe);
+        return -2;
+    }
+
+    // type of the image flowing through the pipeline at this point (0 if it's not known yet)
+    IMGTYPE cur = 0;
+    int have_img = 0;
+    // the read stage the current image comes from, so its expected type can be narrowed down
+    int last_read = -1;
+
+    char* stepsave = NULL;
+    for (char* step = strtok_r(pipe->text, "|", &stepsave); step != NULL; step = strtok_r(NULL, "|", &stepsave)) {
+
+        char* words[PIPE_MAX_WORDS] = {0};
+        int nwords = 0;
+        char* wordsave = NULL;
+        for (char* w = strtok_r(step, " \t\n", &wordsave); w != NULL; w = strtok_r(NULL, " \t\n", &wordsave)) {
+            if (nwords == PIPE_MAX_WORDS) {
+                fprintf(stderr, "Error: too many arguments in pipeline step %s\n", words[0]);
+                free_pipeline(pipe);
+                return -1;
+            }
+            words[nwords++] = w;
+        }
+
+        if (nwords == 0) {
+            fprintf(stderr, "Error: empty pipeline step\n");
+            free_pipeline(pipe);
+            return -1;
+        }
+
+        if (strcmp(words[0], "read") == 0 || strcmp(words[0], "write") == 0) {
+            int is_read = (words[0][0] == 'r');
+            if (nwords != 2) {
+                fprintf(stderr, "Error: expected `%s <path>`\n", words[0]);
+                free_pipeline(pipe);
+                return -1;
+            }
+            if (!is_read && !have_img) {
+                fprintf(stderr, "Error: nothing to write before `write %s`\n", words[1]);
+                free_pipeline(pipe);
+                return -1;
+            }
+
+            PIPESTAGE* stage = &pipe->stages[pipe->nstages];
+            stage->kind = is_read ? STAGE_READ : STAGE_WRITE;
+            stage->path = words[1];
+
+            if (is_read) {
+                last_read = pipe->nstages;
+                have_img = 1;
+                cur = 0;
+            }
+            pipe->nstages++;
+            continue;
+        }
+
+        if (!have_img) {
+            fprintf(stderr, "Error: the pipeline has to start with `read <path>`\n");
+            free_pipeline(pipe);
+            return -1;
+        }
+
+        IMGTYPE intype = 0, outtype = 0;
+        POINTOP op;
+        int is_point = parse_point_op(words, nwords, &op, &intype, &outtype);
+        TOOL* tool = NULL;
+
+        if (is_point < 0) {
+            fprintf(stderr, "Error: invalid arguments for pipeline step %s\n", words[0]);
+            free_pipeline(pipe);
+            return -1;
+        }
+
+        if (!is_point) {
+            tool = _get_pipe_tool(words[0]);
+            if (tool == NULL) {
+                fprintf(stderr, "Error: unknown pipeline step %s\n", words[0]);
+                free_pipeline(pipe);
+                return -1;
+            }
+            if (nwords-1 != tool->nargs) {
+                fprintf(stderr, "Error: expected `%s %s`\n", tool->name, tool->args_usage);
+                free_pipeline(pipe);
+                return -1;
+            }
+            intype = tool->intype;
+            outtype = tool->outtype;
+        }
+
+        // check the step gets the type of image it expects
+        if (intype != 0) {
+            if (cur == 0) {
+                // nothing changed the type since the last read, so that's the file that has to be of this type
+                pipe->stages[last_read].intype = intype;
+                cur = intype;
+            } else if (cur != intype) {
+                fprintf(stderr, "Error: pipeline step %s expects a P%d, but gets a P%d\n", words[0], intype, cur);
+                free_pipeline(pipe);
+                return -1;
+            }
+        }
+
+        if (is_point) {
+            // a PGM only has its gray value to go over
+            op.nchan = (cur == PGM) ? 1 : 3;
+
+            // fuse with the previous stage if it's also made of point ops
+            PIPESTAGE* stage = &pipe->stages[pipe->nstages-1];
+            if (stage->kind != STAGE_POINT) {
+                stage = &pipe->stages[pipe->nstages++];
+                stage->kind = STAGE_POINT;
+                stage->intype = cur;
+            }
+            if (_append_point_op(stage, &op) != 0) {
+                free_pipeline(pipe);
+                return -2;
+            }
+            if (outtype != 0) {
+                stage->outtype = outtype;
+            }
+        } else {
+            PIPESTAGE* stage = &pipe->stages[pipe->nstages++];
+            stage->kind = STAGE_TOOL;
+            stage->intype = intype;
+            stage->outtype = outtype;
+            stage->tool = tool;
+            memcpy(stage->args, &words[1], sizeof(char*)*(nwords-1));
+        }
+
+        if (outtype != 0) {
+            cur = outtype;
+        }
+    }
+
+    if (pipe->nstages == 0) {
+        fprintf(stderr, "Error: empty pipeline\n");
+        free_pipeline(pipe);
+        return -1;
+    }
+
+    return 0;
+}
+
+int run_pipeline(PIPELINE* pipe) {
+
+    IMAGE img = {0};
+    IMAGE tmpimg = {0};
+
+    // every read and write step is a stream of frames, opened once for all of them (writes only when they first get a frame).
+    // Files both read and written by the pipeline are whole images instead, loaded once and saved over at each write
+    ROWREADER* readers = (ROWREADER*)calloc(pipe->nstages, sizeof(ROWREADER));
+    ROWWRITER* writers = (ROWWRITER*)calloc(pipe->nstages, sizeof(ROWWRITER));
+    int* whole = (int*)calloc(pipe->nstages, sizeof(int));
+    if (readers == NULL || writers == NULL || whole == NULL) {
+        free(readers);
+        free(writers);
+        free(whole);
+        fprintf(stderr, "Error allocating the pipeline streams\n");
+        return -2;
+    }
+
+    int res = 0;
+    // reports of the text tools can't go to stdout when the frames do
+    FILE* out = stdout;
+    for (int s = 0; s < pipe->nstages; s++) {
+        PIPESTAGE* stage = &pipe->stages[s];
+        if (stage->kind != STAGE_READ && stage->kind != STAGE_WRITE) {
+            continue;
+        }
+
+        if (strcmp(stage->path, "-") == 0) {
+            out = (stage->kind == STAGE_WRITE) ? stderr : out;
+            continue;
+        }
+        for (int o = 0; o < pipe->nstages; o++) {
+            STAGEKIND other = (stage->kind == STAGE_READ) ? STAGE_WRITE : STAGE_READ;
+            if (pipe->stages[o].kind == other && strcmp(pipe->stages[o].path, stage->path) == 0) {
+                whole[s] = 1;
+            }
+        }
+    }
+    for (int s = 0; s < pipe->nstages && res == 0; s++) {
+        PIPESTAGE* stage = &pipe->stages[s];
+        if (stage->kind == STAGE_READ && !whole[s] && open_frame_reader(stage->path, &readers[s]) != 0) {
+            fprintf(stderr, "Error reading %s (-1)\n", stage->path);
+            res = -2;
+        }
+    }
+
+    int nframes = 0;
+    while (res == 0) {
+        res = _run_frame(pipe, readers, writers, whole, &img, &tmpimg, out);
+        if (res == 1) {
+            if (nframes == 0) {
+                fprintf(stderr, "Error: no image to read\n");
+                res = -2;
+            } else {
+                res = 0;
+            }
+            break;
+        }
+        nframes++;
+    }
+
+    for (int s = 0; s < pipe->nstages; s++) {
+        close_row_reader(&readers[s]);
+        if (close_row_writer(&writers[s]) != 0 && res == 0) {
+            fprintf(stderr, "Error writing %s\n", pipe->stages[s].path);
+            res = -2;
+        }
+    }
+    free(readers);
+    free(writers);
+    free(whole);
+
+    free_pxmat(img.mat, img.height);
+    free_pxmat(tmpimg.mat, tmpimg.height);
+
+    return res;
+}
+
+void free_pipeline(PIPELINE* pipe) {
+
+    if (pipe->stages != NULL) {
+        for (int s = 0; s < pipe->nstages; s++) {
+            free(pipe->stages[s].ops);
+        }
+    }
+    free(pipe->stages);
+    free(pipe->text);
+    memset(pipe, 0, sizeof(PIPELINE));
+}
+
+int parse_point_op(char** words, int nwords, POINTOP* op, IMGTYPE* intype, IMGTYPE* outtype) {
+
+    memset(op, 0, sizeof(POINTOP));
+    *intype = 0;
+    *outtype = 0;
+    char* name = words[0];
+
+    // colorspace conversions
+    struct { char* name; CONVTYPE conv; IMGTYPE outtype; } convs[] = {
+        {"rgb2ycbcr", RGB2YCBCR, 0}, {"RGB2YCBCR", RGB2YCBCR, 0},
+        {"ycbcr2rgb", YCBCR2RGB, 0},
+        {"rgb2yuv", RGB2YUV, 0},
+        {"yuv2rgb", YUV2RGB, 0},
+        {"rgb2gray", RGB2GRAY, PGM}, {"rgb2y", RGB2GRAY, PGM},
+    };
+    for (int i = 0; i < sizeof(convs)/sizeof(convs[0]); i++) {
+        if (strcmp(name, convs[i].name) == 0) {
+            if (nwords != 1) return -1;
+            op->kind = POINT_CONV;
+            op->conv = convs[i].conv;
+            *intype = PPM;
+            *outtype = convs[i].outtype;
+            return 1;
+        }
+    }
+
+    if (strcmp(name, "select") == 0) {
+        if (nwords != 2) return -1;
+        op->kind = POINT_SELECT;
+        op->chan = _get_chan(words[1], strlen(words[1]));
+        if (op->chan < 0) return -1;
+        *intype = PPM;
+        *outtype = PGM;
+        return 1;
+    }
+
+    // everything after this is a lookup table
+    _identity_lut(op);
+
+    // <chan>+=<k> and <chan>-=<k>
+    char* opstr = strstr(name, "+=");
+    if (opstr == NULL) opstr = strstr(name, "-=");
+    if (opstr != NULL || strcmp(name, "modifY") == 0) {
+        int chan = 0;
+        int k = 0;
+
+        if (opstr != NULL) {
+            chan = _get_chan(name, opstr - name);
+            if (nwords != 1 || chan < 0 || sscanf(opstr+2, "%d", &k) != 1) return -1;
+            if (opstr[0] == '-') k = -k;
+        } else {
+            if (nwords != 2 || sscanf(words[1], "%d", &k) != 1) return -1;
+            if (k <= -128 || 128 <= k) return -1;
+            *intype = PGM;
+        }
+
+        for (int v = 0; v < 256; v++) {
+            int nv = v + k;
+            // clamped so that there are no overflows, same as `add_gimg()`
+            clampg(&nv);
+            op->lut[chan][v] = nv;
+        }
+        // only the gray value exists in a PGM, so other channels only make sense on a PPM
+        if (chan != 0) *intype = PPM;
+        return 1;
+    }
+
+    if (strcmp(name, "invert") == 0 || strcmp(name, "invert_pgm") == 0) {
+        if (nwords != 1) return -1;
+        for (int ch = 0; ch < 3; ch++) {
+            for (int v = 0; v < 256; v++) op->lut[ch][v] = 255 - v;
+        }
+        *intype = (strcmp(name, "invert_pgm") == 0) ? PGM : 0;
+        return 1;
+    }
+
+    if (strcmp(name, "thresh") == 0 || strcmp(name, "bin_thresh_pgm") == 0) {
+        int thresh = 0;
+        if (nwords != 2 || sscanf(words[1], "%d", &thresh) != 1) return -1;
+        // same as `bin_gthresh_img()`
+        for (int v = 0; v < 256; v++) op->lut[0][v] = (thresh < v) ? 255 : 0;
+        *intype = PGM;
+        return 1;
+    }
+
+    if (strcmp(name, "bin_thresh_ppm") == 0) {
+        int thresh[3] = {0};
+        if (nwords != 4) return -1;
+        for (int ch = 0; ch < 3; ch++) {
+            if (sscanf(words[ch+1], "%d", &thresh[ch]) != 1) return -1;
+            // same as `bin_rgbthresh_img()`
+            for (int v = 0; v < 256; v++) op->lut[ch][v] = (v < thresh[ch]) ? 0 : 255;
+        }
+        *intype = PPM;
+        return 1;
+    }
+
+    if (strcmp(name, "tri_thresh") == 0 || strcmp(name, "tri_thresh_pgm") == 0) {
+        int thresh1 = 0, thresh2 = 0;
+        if (nwords != 3 || sscanf(words[1], "%d", &thresh1) != 1 || sscanf(words[2], "%d", &thresh2) != 1) return -1;
+        // same as `tri_gthresh_img()`
+        for (int v = 0; v < 256; v++) {
+            op->lut[0][v] = (v < thresh1) ? 0 : ((v >= thresh2) ? 255 : 128);
+        }
+        *intype = PGM;
+        return 1;
+    }
+
+    return 0;
+}
+
+void apply_point_ops(POINTOP* ops, int nops, PIXEL* row, int width) {
+
+    const KERNELS* kern = kernels();
+
+    for (int o = 0; o < nops; o++) {
+        POINTOP* op = &ops[o];
+
+        switch (op->kind) {
+            case POINT_LUT:
+                if (kern != NULL) {
+                    kern->lut(&row[0].cpx.r, width, op->nchan, op->lut);
+                } else if (op->nchan == 1) {
+                    for (int c = 0; c < width; c++) {
+                        row[c].gpx.v = op->lut[0][row[c].gpx.v];
+                    }
+                } else {
+                    for (int c = 0; c < width; c++) {
+                        row[c].cpx.r = op->lut[0][row[c].cpx.r];
+                        row[c].cpx.g = op->lut[1][row[c].cpx.g];
+                        row[c].cpx.b = op->lut[2][row[c].cpx.b];
+                    }
+                }
+                break;
+
+            case POINT_CONV: {
+                // the kernel can't convert in place, so the row goes through a buffer a chunk at a time.
+                // Conversions without a kernel stop at the first chunk and go pixel by pixel
+                int c = 0;
+                if (kern != NULL) {
+                    BYTE buf[sizeof(PIXEL)*POINT_CONV_CHUNK];
+                    for (; c < width; c += POINT_CONV_CHUNK) {
+                        int n = (width - c < POINT_CONV_CHUNK) ? width - c : POINT_CONV_CHUNK;
+                        if (kern->convert(buf, &row[c].cpx.r, n, op->conv) != 0) {
+                            break;
+                        }
+                        memcpy(&row[c], buf, sizeof(PIXEL)*n);
+                    }
+                }
+                for (; c < width; c++) {
+                    convert_channel_px(&row[c], &row[c], op->conv);
+                }
+                break;
+            }
+
+            case POINT_SELECT:
+                for (int c = 0; c < width; c++) {
+                    BYTE* chans = &row[c].cpx.r;
+                    row[c].gpx.v = chans[op->chan];
+                }
+                break;
+        }
+    }
+}
+
+void print_pipeline_steps(FILE* out) {
+
+    fprintf(out, "  read <path> (\"-\" for stdin, every frame of the file goes through the pipeline)\n");
+    fprintf(out, "  write <path> (\"-\" for stdout)\n");
+    fprintf(out, "Point ops (adjacent ones are fused into a single pass):\n");
+    fprintf(out, "  rgb2ycbcr | ycbcr2rgb | rgb2yuv | yuv2rgb | rgb2gray\n");
+    fprintf(out, "  <chan>+=<k> | <chan>-=<k> (chan: y cb cr r g b v u)\n");
+    fprintf(out, "  select <chan>\n");
+    fprintf(out, "  invert\n");
+    fprintf(out, "  thresh <threshvalue>\n");
+    fprintf(out, "  tri_thresh <thresh1> <thresh2>\n");
+    fprintf(out, "Other ops:\n");
+    for (int i = 0; i < sizeof(_pipe_tools)/sizeof(TOOL); i++) {
+        fprintf(out, "  %s %s\n", _pipe_tools[i].name, _pipe_tools[i].args_usage);
+    }
+    fprintf(out, "Executables usable as steps:\n");
+    print_tools(out);
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+int _append_point_op(PIPESTAGE* stage, POINTOP* op) {
+
+    // two lookup tables in a row are the same as a single composed one
+    if (stage->nops > 0 && op->kind == POINT_LUT && stage->ops[stage->nops-1].kind == POINT_LUT) {
+        POINTOP* last = &stage->ops[stage->nops-1];
+        for (int ch = 0; ch < 3; ch++) {
+            for (int v = 0; v < 256; v++) {
+                last->lut[ch][v] = op->lut[ch][last->lut[ch][v]];
+            }
+        }
+        if (op->nchan > last->nchan) last->nchan = op->nchan;
+        return 0;
+    }
+
+    POINTOP* newops = (POINTOP*)realloc(stage->ops, sizeof(POINTOP)*(stage->nops+1));
+    if (newops == NULL) {
+        return -2;
+    }
+    stage->ops = newops;
+    stage->ops[stage->nops++] = *op;
+
+    return 0;
+}
+
+int _run_frame(PIPELINE* pipe, ROWREADER* readers, ROWWRITER* writers, int* whole, IMAGE* img, IMAGE* tmpimg, FILE* out) {
+
+    for (int s = 0; s < pipe->nstages; s++) {
+        PIPESTAGE* stage = &pipe->stages[s];
+
+        if (stage->kind != STAGE_READ && stage->intype != 0 && img->img_type != stage->intype) {
+            fprintf(stderr, "Error: pipeline stage %d expects a P%d, but gets a P%d\n", s, stage->intype, img->img_type);
+            return -1;
+        }
+
+        switch (stage->kind) {
+
+            case STAGE_READ: {
+                // the pixel matrix of the previous frame is read over, so frames of the same size need no allocation
+                int lres;
+                if (whole[s]) {
+                    // a file the pipeline also writes to is a single image, read as it is at this point of the pipeline
+                    lres = (whole[s] == 2) ? 1 : load_pnm_image(stage->path, img, stage->intype);
+                    whole[s] = 2;
+                } else {
+                    lres = read_frame(&readers[s], img, stage->intype);
+                }
+
+                if (lres == 1) {
+                    return 1;
+                } else if (lres == -2 && stage->intype != 0 && img->img_type != stage->intype && (img->img_type == PGM || img->img_type == PPM)) {
+                    fprintf(stderr, "Error: %s is a P%d, but the pipeline expects a P%d\n", stage->path, img->img_type, stage->intype);
+                } else if (lres != 0) {
+                    fprintf(stderr, "Error reading %s (%d)\n", stage->path, lres);
+                }
+                if (lres != 0) {
+                    return -2;
+                }
+                break;
+            }
+
+            case STAGE_WRITE:
+                if (whole[s]) {
+                    if (save_pnm_image(stage->path, img, img->img_type) != 0) {
+                        fprintf(stderr, "Error writing %s\n", stage->path);
+                        return -2;
+                    }
+                    break;
+                }
+
+                if (writers[s].fd == NULL && open_frame_writer(stage->path, &writers[s]) != 0) {
+                    fprintf(stderr, "Error writing %s\n", stage->path);
+                    return -2;
+                }
+                if (write_frame(&writers[s], img, img->img_type) != 0) {
+                    fprintf(stderr, "Error writing %s\n", stage->path);
+                    return -2;
+                }
+                break;
+
+            case STAGE_POINT: {
+                // every fused op is done row by row, so the image is only gone over once
+                POINTTILE args = {stage, img};
+                _run_op("pipeline_point", img->width, img->height, _point_stage_tile, &args);
+                if (stage->outtype != 0) {
+                    img->img_type = stage->outtype;
+                }
+                break;
+            }
+
+            case STAGE_TOOL: {
+                IMAGE* resimg = run_tool(stage->tool, tmpimg, img, stage->args, out);
+                if (resimg == NULL) {
+                    fprintf(stderr, "Error running pipeline step %s\n", stage->tool->name);
+                    return -1;
+                } else if (resimg == tmpimg) {
+                    // the result becomes the current image, and the old one is kept around for the next step
+                    IMAGE t = *img;
+                    *img = *tmpimg;
+                    *tmpimg = t;
+                }
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void _point_stage_tile(void* arg, int r1, int r2) {
+    POINTTILE* args = arg;
+
+    for (int r = r1; r < r2; r++) {
+        // the row stays in cache while every op of the stage goes over it
+        apply_point_ops(args->stage->ops, args->stage->nops, args->img->mat[r], args->img->width);
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef IMAGE_PIPE_H
+#define IMAGE_PIPE_H
+
+#include "imgio.h"
+#include "imgops.h"
+#include "imgtools.h"
+
+// max amount of words (op name + arguments) in a single pipeline step
+#define PIPE_MAX_WORDS 8
+
+// pixels a POINT_CONV op converts at once through the conversion kernel (see `apply_point_ops()`)
+#define POINT_CONV_CHUNK 256
+
+enum _pipe_stage_kind_enum {
+    STAGE_READ = 0,
+    STAGE_WRITE,
+    // one or more point ops fused together into a single pass
+    STAGE_POINT,
+    // any other op (neighbourhood ops, reports), run through a TOOL
+    STAGE_TOOL
+};
+typedef enum _pipe_stage_kind_enum STAGEKIND;
+
+enum _point_op_kind_enum {
+    // per channel lookup table, consecutive ones are merged into a single table
+    POINT_LUT = 0,
+    // colorspace conversion, same as `convert_channel_px()`
+    POINT_CONV,
+    // moves a channel to the gray value (channel 0)
+    POINT_SELECT
+};
+typedef enum _point_op_kind_enum POINTKIND;
+
+/**
+ * @brief a single point op of a fused stage
+ *
+ * @member lut: for POINT_LUT, new value of each channel for each old value
+ * @member conv: for POINT_CONV, the conversion to apply
+ * @member chan: for POINT_SELECT, the channel to select
+ * @member nchan: for POINT_LUT, amount of channels to go over (1 when the image is known to be a PGM, else 3)
+ */
+struct _point_op_type_struct {
+    POINTKIND kind;
+    BYTE lut[3][256];
+    CONVTYPE conv;
+    int chan;
+    int nchan;
+};
+typedef struct _point_op_type_struct POINTOP;
+
+/**
+ * @brief one step of a pipeline
+ *
+ * @member intype: type of image the stage expects (0 if it accepts any)
+ * @member outtype: type of image the stage produces (0 if it keeps the input type)
+ * @member path: for STAGE_READ and STAGE_WRITE, the file to read or write
+ * @member ops: for STAGE_POINT, the fused point ops, applied in order
+ * @member tool: for STAGE_TOOL, the tool to run with `args`
+ */
+struct _pipe_stage_type_struct {
+    STAGEKIND kind;
+    IMGTYPE intype;
+    IMGTYPE outtype;
+
+    char* path;
+
+    POINTOP* ops;
+    int nops;
+
+    TOOL* tool;
+    char* args[PIPE_MAX_WORDS];
+};
+typedef struct _pipe_stage_type_struct PIPESTAGE;
+
+/**
+ * @brief a parsed pipeline
+ *
+ * @member text: copy of the pipeline spec, every path and argument points inside of it
+ */
+struct _pipeline_type_struct {
+    PIPESTAGE* stages;
+    int nstages;
+    char* text;
+};
+typedef struct _pipeline_type_struct PIPELINE;
+
+/**
+ * @brief what the tiles of a fused point stage work on
+ */
+struct _point_tile_type_struct {
+    PIPESTAGE* stage;
+    IMAGE* img;
+};
+typedef struct _point_tile_type_struct POINTTILE;
+
+
+/**
+ * @brief parses a pipeline spec, ex: `read a.ppm | rgb2ycbcr | y+=20 | ycbcr2rgb | write b.ppm`
+ * @brief Steps are separated by `|`. Adjacent point ops are fused into a single stage.
+ *
+ * @param spec the pipeline spec
+ * @param pipe where to write the parsed pipeline
+ * @return int `0` if success. `-1` if the spec is invalid (the reason is printed). `-2` if allocation failed
+ */
+int parse_pipeline(char* spec, PIPELINE* pipe);
+
+/**
+ * @brief runs a parsed pipeline, all in memory. Only `read` and `write` steps touch files.
+ * @brief Files can hold several frames one after the other (and "-" is stdin or stdout): the whole pipeline runs on each
+ * @brief frame in turn, until a `read` step has none left, and `write` steps write one frame after the other.
+ *
+ * @param pipe the pipeline to run
+ * @return int `0` if success. `-1` if a stage got the wrong image type or failed (the reason is printed). `-2` if reading or writing failed
+ */
+int run_pipeline(PIPELINE* pipe);
+
+/**
+ * @brief frees everything allocated by `parse_pipeline()`
+ *
+ * @param pipe the pipeline to free
+ */
+void free_pipeline(PIPELINE* pipe);
+
+/**
+ * @brief applies point ops, in order, to a single row of pixels, through the kernels picked by `kernels()` when there are some
+ *
+ * @param ops the point ops to apply
+ * @param nops amount of point ops
+ * @param row the row of pixels to modify
+ * @param width amount of pixels in the row
+ */
+void apply_point_ops(POINTOP* ops, int nops, PIXEL* row, int width);
+
+/**
+ * @brief parses a single point op (ex: `y+=20`, `thresh 100`, `rgb2ycbcr`). `words` holds the op name followed by its arguments.
+ *
+ * @param words op name followed by its arguments
+ * @param nwords amount of words
+ * @param op where to write the parsed op
+ * @param intype where to write the type of image the op expects (0 if any)
+ * @param outtype where to write the type of image the op produces (0 if it keeps the input type)
+ * @return int `1` if the words are a point op. `0` if they aren't a point op. `-1` if the arguments are invalid
+ */
+int parse_point_op(char** words, int nwords, POINTOP* op, IMGTYPE* intype, IMGTYPE* outtype);
+
+/**
+ * @brief prints every step the pipeline spec understands
+ *
+ * @param out where to print the list
+ */
+void print_pipeline_steps(FILE* out);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief appends a point op to a fused stage, merging it into the last op when both are lookup tables
+ *
+ * @return int `0` if success. `-2` if allocation failed
+ */
+int _append_point_op(PIPESTAGE* stage, POINTOP* op);
+
+/**
+ * @brief runs every stage of a pipeline on the next frame of its `read` steps
+ *
+ * @param readers frame readers of the `read` stages, by stage index
+ * @param writers frame writers of the `write` stages, by stage index (opened on their first frame)
+ * @param whole by stage index, non zero for the `read` and `write` steps of files both read and written (whole images, read once)
+ * @param img current image, its pixel matrix reused from one frame to the next
+ * @param tmpimg result buffer of the tools, reused as well
+ * @param out where text tools write their reports
+ * @return int `0` if success. `1` if a `read` step has no frame left. Else same as `run_pipeline()`
+ */
+int _run_frame(PIPELINE* pipe, ROWREADER* readers, ROWWRITER* writers, int* whole, IMAGE* img, IMAGE* tmpimg, FILE* out);
+
+/**
+ * @brief tile function running the fused point ops of a stage on rows [r1, r2[ (`arg` is a POINTTILE)
+ */
+void _point_stage_tile(void* arg, int r1, int r2);
+
+#endif
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgscale.h"
+#include "imgtrace.h"
+#include "imgkern.h"
+
+// arguments shared by the tiles of a resize
+struct _scale_tile_args_type_struct {
+    IMAGE* destimg;
+    IMAGE* srcimg;
+    int nchan;
+    int factor;
+    RSWEIGHTS* wx;
+    RSWEIGHTS* wy;
+    // set by a tile whose buffers couldn't be allocated
+    int failed;
+};
+typedef struct _scale_tile_args_type_struct SCALETILE;
+
+
+
+int downscaled_size(int n, int factor) {
+    return (n + factor - 1)/factor;
+}
+
+int downscale_img(IMAGE* destimg, IMAGE* srcimg, int factor) {
+
+    if (factor < 1) {
+        return -1;
+    }
+
+    if (destimg->width != downscaled_size(srcimg->width, factor) || destimg->height != downscaled_size(srcimg->height, factor)) {
+        return -2;
+    }
+
+    SCALETILE args = {.destimg = destimg, .srcimg = srcimg, .nchan = (srcimg->img_type == PGM) ? 1 : 3, .factor = factor};
+    _run_op("downscale_img", destimg->width, destimg->height, _downscale_tile, &args);
+
+    return args.failed ? -3 : 0;
+}
+
+int load_pnm_scaled(char* filename, IMAGE* img, IMGTYPE type, int factor) {
+
+    if (factor < 1) {
+        return -5;
+    }
+
+    ROWREADER reader;
+    int res = open_row_reader(filename, &reader, type);
+    img->img_type = reader.img_type;
+    if (res != 0) {
+        return res;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgscale", "load_pnm_scaled");
+    scope.pixels = (long long)reader.width*reader.height;
+    scope.bytes = scope.pixels*(reader.img_type == PPM ? 3 : 1);
+
+    int width = downscaled_size(reader.width, factor);
+    int height = downscaled_size(reader.height, factor);
+    img->mat = pxrealloc(img->mat, width, height);
+    PIXEL** rows = pxalloc(reader.width, factor);
+    void* scratch = malloc(kern_area_scratch(reader.width, factor));
+    if (img->mat == NULL || rows == NULL || scratch == NULL) {
+        res = -3;
+    } else {
+        img->width = width;
+        img->height = height;
+    }
+
+    // one block of rows of the file at a time, straight into its output row
+    int nchan = (reader.img_type == PGM) ? 1 : 3;
+    for (int r = 0; r < height && res == 0; r++) {
+        int nrows = (r*factor + factor < reader.height) ? factor : reader.height - r*factor;
+        res = read_rows(&reader, rows, nrows);
+        if (res == 0) {
+            area_row(img->mat[r], rows, nrows, reader.width, factor, nchan, scratch);
+        }
+    }
+
+    close_row_reader(&reader);
+    if (rows != NULL) {
+        free_pxmat(rows, factor);
+    }
+    free(scratch);
+    trace_end(&scope);
+
+    return res;
+}
+
+int resample_img(IMAGE* destimg, IMAGE* srcimg, RESAMPLETYPE filter) {
+
+    if (filter < 0 || filter >= _RESAMPLEEND) {
+        return -1;
+    }
+
+    if (destimg->width < 1 || destimg->height < 1) {
+        return -2;
+    }
+
+    RSWEIGHTS wx, wy;
+    if (resample_weights_init(&wx, srcimg->width, destimg->width, filter) != 0) {
+        return -3;
+    }
+    if (resample_weights_init(&wy, srcimg->height, destimg->height, filter) != 0) {
+        free_resample_weights(&wx);
+        return -3;
+    }
+
+    SCALETILE args = {.destimg = destimg, .srcimg = srcimg, .nchan = (srcimg->img_type == PGM) ? 1 : 3, .wx = &wx, .wy = &wy};
+    _run_op("resample_img", destimg->width, destimg->height, _resample_tile, &args);
+
+    free_resample_weights(&wx);
+    free_resample_weights(&wy);
+
+    return args.failed ? -3 : 0;
+}
+
+int resample_weights_init(RSWEIGHTS* weights, int srcsize, int destsize, RESAMPLETYPE filter) {
+
+    memset(weights, 0, sizeof(RSWEIGHTS));
+
+    if (filter < 0 || filter >= _RESAMPLEEND) {
+        return -1;
+    }
+    if (srcsize < 1 || destsize < 1) {
+        return -2;
+    }
+
+    // shrinking stretches the filter over the source pixels each destination pixel covers
+    double scale = (double)srcsize/destsize;
+    double filterscale = (scale > 1.0) ? scale : 1.0;
+    double support = _resample_support(filter)*filterscale;
+
+    weights->n = destsize;
+    weights->taps = (int)ceil(support)*2 + 1;
+    weights->start = malloc(sizeof(int)*destsize);
+    weights->count = malloc(sizeof(int)*destsize);
+    weights->w = calloc((size_t)destsize*weights->taps, sizeof(short));
+    double* real = malloc(sizeof(double)*weights->taps);
+    if (weights->start == NULL || weights->count == NULL || weights->w == NULL || real == NULL) {
+        free(real);
+        free_resample_weights(weights);
+        return -3;
+    }
+
+    for (int i = 0; i < destsize; i++) {
+        double center = (i + 0.5)*scale;
+        int xmin = (int)floor(center - support + 0.5);
+        int xmax = (int)floor(center + support + 0.5);
+        if (xmin < 0) xmin = 0;
+        if (xmax > srcsize) xmax = srcsize;
+        if (xmax - xmin > weights->taps) xmax = xmin + weights->taps;
+
+        // pixels past the edges are left out, the ones left share their weight
+        double total = 0.0;
+        for (int x = xmin; x < xmax; x++) {
+            real[x - xmin] = _resample_filter(filter, (x + 0.5 - center)/filterscale);
+            total += real[x - xmin];
+        }
+
+        short* w = &weights->w[i*weights->taps];
+        int sum = 0, largest = 0;
+        for (int k = 0; k < xmax - xmin; k++) {
+            w[k] = (short)lround(real[k]/total*(1 << RESAMPLE_BITS));
+            sum += w[k];
+            if (w[k] > w[largest]) largest = k;
+        }
+        // rounding leftovers go to the largest weight, so a flat image stays flat
+        w[largest] += (1 << RESAMPLE_BITS) - sum;
+
+        weights->start[i] = xmin;
+        weights->count[i] = xmax - xmin;
+    }
+
+    free(real);
+    return 0;
+}
+
+void free_resample_weights(RSWEIGHTS* weights) {
+
+    free(weights->start);
+    free(weights->count);
+    free(weights->w);
+    memset(weights, 0, sizeof(RSWEIGHTS));
+}
+
+int pyramid_build(PYRAMID* pyr, IMAGE* srcimg, int nlevels) {
+
+    int res = _pyramid_alloc(pyr, srcimg->width, srcimg->height, srcimg->img_type, nlevels);
+    if (res != 0 || pyr->nlevels == 0) {
+        return res;
+    }
+
+    void* scratch = malloc(kern_area_scratch(srcimg->width, 2));
+    if (scratch == NULL) {
+        free_pyramid(pyr);
+        return -3;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgscale", "pyramid_build");
+    scope.pixels = (long long)srcimg->width*srcimg->height;
+
+    int nchan = (srcimg->img_type == PGM) ? 1 : 3;
+    for (int r = 0; r < srcimg->height; r += 2) {
+        int nrows = (r + 1 < srcimg->height) ? 2 : 1;
+        area_row(pyr->levels[0].mat[r/2], &srcimg->mat[r], nrows, srcimg->width, 2, nchan, scratch);
+        _pyramid_cascade(pyr, 0, r/2, scratch);
+    }
+
+    trace_end(&scope);
+    free(scratch);
+
+    return 0;
+}
+
+int stream_pyramid(ROWREADER* reader, PYRAMID* pyr, int nlevels) {
+
+    int width = reader->width;
+    int height = reader->height;
+
+    int res = _pyramid_alloc(pyr, width, height, reader->img_type, nlevels);
+    if (res != 0 || pyr->nlevels == 0) {
+        return res;
+    }
+
+    // the two source rows of a level 0 row are all that is held of the source
+    PIXEL** rows = pxalloc(width, 2);
+    void* scratch = malloc(kern_area_scratch(width, 2));
+    if (rows == NULL || scratch == NULL) {
+        free_pxmat(rows, 2);
+        free(scratch);
+        free_pyramid(pyr);
+        return -3;
+    }
+
+    TRACESCOPE scope;
+    trace_begin(&scope, "imgscale", "stream_pyramid");
+    scope.pixels = (long long)width*height;
+
+    int nchan = (reader->img_type == PGM) ? 1 : 3;
+    for (int r = 0; r < height && res == 0; r += 2) {
+        int nrows = (r + 1 < height) ? 2 : 1;
+        res = read_rows(reader, rows, nrows);
+        if (res == 0) {
+            area_row(pyr->levels[0].mat[r/2], rows, nrows, width, 2, nchan, scratch);
+            _pyramid_cascade(pyr, 0, r/2, scratch);
+        }
+    }
+
+    trace_end(&scope);
+    free_pxmat(rows, 2);
+    free(scratch);
+
+    if (res != 0) {
+        free_pyramid(pyr);
+    }
+
+    return res;
+}
+
+void free_pyramid(PYRAMID* pyr) {
+
+    for (int i = 0; i < pyr->nlevels; i++) {
+        free_img_pxmat(&pyr->levels[i]);
+    }
+    pyr->nlevels = 0;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+double _resample_filter(RESAMPLETYPE filter, double x) {
+
+    x = fabs(x);
+
+    switch (filter) {
+        case BILINEAR:
+            return (x < 1.0) ? 1.0 - x : 0.0;
+
+        case LANCZOS3:
+            if (x < 1e-9) return 1.0;
+            if (x >= 3.0) return 0.0;
+            return 3.0*sin(M_PI*x)*sin(M_PI*x/3.0)/(M_PI*M_PI*x*x);
+
+        default:
+            return 0.0;
+    }
+}
+
+double _resample_support(RESAMPLETYPE filter) {
+    return (filter == LANCZOS3) ? 3.0 : 1.0;
+}
+
+void _downscale_tile(void* arg, int r1, int r2) {
+    SCALETILE* args = arg;
+    IMAGE* src = args->srcimg;
+    int factor = args->factor;
+
+    void* scratch = malloc(kern_area_scratch(src->width, factor));
+    if (scratch == NULL) {
+        args->failed = 1;
+        return;
+    }
+
+    for (int r = r1; r < r2; r++) {
+        int sr = r*factor;
+        int nrows = (sr + factor < src->height) ? factor : src->height - sr;
+        area_row(args->destimg->mat[r], &src->mat[sr], nrows, src->width, factor, args->nchan, scratch);
+    }
+
+    free(scratch);
+}
+
+void _resample_tile(void* arg, int r1, int r2) {
+    SCALETILE* args = arg;
+    IMAGE* src = args->srcimg;
+    RSWEIGHTS* wx = args->wx;
+    RSWEIGHTS* wy = args->wy;
+    int nchan = args->nchan;
+    const int rowshift = RESAMPLE_BITS - RESAMPLE_ROW_BITS;
+    const int shift = RESAMPLE_BITS + RESAMPLE_ROW_BITS;
+
+    short* row = malloc(sizeof(short)*nchan*src->width);
+    int* acc = malloc(kern_resample_scratch(src->width));
+    if (row == NULL || acc == NULL) {
+        free(row);
+        free(acc);
+        args->failed = 1;
+        return;
+    }
+
+    const KERNELS* kern = kernels();
+    for (int r = r1; r < r2; r++) {
+        PIXEL** rows = &src->mat[wy->start[r]];
+        const short* w = &wy->w[r*wy->taps];
+        BYTE* dest = &args->destimg->mat[r][0].cpx.r;
+
+        if (kern != NULL) {
+            kern->resample_v(row, rows, wy->count[r], w, src->width, nchan, acc);
+            kern->resample_h(dest, row, args->destimg->width, nchan, wx->start, wx->count, wx->w, wx->taps);
+            continue;
+        }
+
+        // vertical pass over the rows of this destination row, rounded to RESAMPLE_ROW_BITS after the point
+        for (int c = 0; c < src->width; c++) {
+            for (int ch = 0; ch < nchan; ch++) {
+                int s = 0;
+                for (int i = 0; i < wy->count[r]; i++) {
+                    s += w[i]*(&rows[i][c].cpx.r)[ch];
+                }
+                row[c*nchan + ch] = (short)((s + (1 << (rowshift - 1))) >> rowshift);
+            }
+        }
+
+        // horizontal pass, rounded and clamped back to a byte
+        for (int c = 0; c < args->destimg->width; c++) {
+            const short* wc = &wx->w[c*wx->taps];
+            for (int ch = 0; ch < nchan; ch++) {
+                int s = 0;
+                for (int i = 0; i < wx->count[c]; i++) {
+                    s += wc[i]*row[(wx->start[c] + i)*nchan + ch];
+                }
+                s = (s + (1 << (shift - 1))) >> shift;
+                dest[3*c + ch] = (BYTE)((s > 255) ? 255 : ((s < 0) ? 0 : s));
+            }
+        }
+    }
+
+    free(row);
+    free(acc);
+}
+
+void _pyramid_cascade(PYRAMID* pyr, int level, int r, void* scratch) {
+
+    // walks down the levels for as long as a row completes the next one
+    while (level + 1 < pyr->nlevels) {
+        IMAGE* img = &pyr->levels[level];
+        if (r % 2 == 0 && r != img->height - 1) {
+            return;
+        }
+
+        int first = r - r % 2;
+        area_row(pyr->levels[level + 1].mat[first/2], &img->mat[first], r - first + 1, img->width, 2,
+            (img->img_type == PGM) ? 1 : 3, scratch);
+
+        level++;
+        r = first/2;
+    }
+}
+
+int _pyramid_alloc(PYRAMID* pyr, int width, int height, IMGTYPE type, int nlevels) {
+
+    pyr->nlevels = 0;
+    if (nlevels < 0 || nlevels > PYRAMID_MAX_LEVELS) {
+        return -1;
+    }
+
+    int w = width, h = height;
+    for (int i = 0; i < nlevels && (w > 1 || h > 1); i++) {
+        w = downscaled_size(w, 2);
+        h = downscaled_size(h, 2);
+
+        IMAGE* level = &pyr->levels[i];
+        level->width = w;
+        level->height = h;
+        level->img_type = type;
+        level->mat = pxalloc(w, h);
+        if (level->mat == NULL) {
+            free_pyramid(pyr);
+            return -3;
+        }
+        // so the bytes gray levels don't write are set
+        memset(level->mat[0], 0, sizeof(PIXEL)*w*h);
+        pyr->nlevels++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#ifndef IMAGE_SCALE_H
+#define IMAGE_SCALE_H
+#include "imgio.h"
+
+// weights of the resamplers are fixed point, RESAMPLE_BITS bits after the point
+#define RESAMPLE_BITS 14
+
+// the vertical pass of `resample_img()` keeps RESAMPLE_ROW_BITS bits after the point in its row buffer,
+// so the horizontal pass still sums in an int (255 << 6 times weights of RESAMPLE_BITS bits)
+#define RESAMPLE_ROW_BITS 6
+
+// max amount of levels of a PYRAMID (a 2^31 pixel wide image is one pixel wide at level 31)
+#define PYRAMID_MAX_LEVELS 31
+
+enum _resample_filter_type_enum {
+    // triangle of radius 1 (stretched over the source when shrinking, so every source pixel counts)
+    BILINEAR = 0,
+    // sinc windowed by a sinc 3 times wider
+    LANCZOS3,
+
+    //! Is just used for enum type checking
+    _RESAMPLEEND
+};
+typedef enum _resample_filter_type_enum RESAMPLETYPE;
+
+/**
+ * @brief precomputed weights of a resampler along one axis: the value of destination pixel `i` is the sum of the
+ * @brief `count[i]` source pixels from `start[i]`, each times its weight in `w[i*taps]`
+ *
+ * @member n: amount of destination pixels
+ * @member taps: stride of `w`, the largest `count`
+ * @member start: first source pixel of each destination pixel
+ * @member count: amount of source pixels of each destination pixel
+ * @member w: weights, with RESAMPLE_BITS bits after the point. Those of a destination pixel sum to exactly 1 << RESAMPLE_BITS
+ */
+struct _resample_weights_type_struct {
+    int n;
+    int taps;
+    int* start;
+    int* count;
+    short* w;
+};
+typedef struct _resample_weights_type_struct RSWEIGHTS;
+
+/**
+ * @brief levels of an image pyramid, each one the 2x area downscale of the one before
+ *
+ * @member nlevels: amount of levels
+ * @member levels: the levels, levels[0] being half the size of the source (rounded up)
+ */
+struct _pyramid_type_struct {
+    int nlevels;
+    IMAGE levels[PYRAMID_MAX_LEVELS];
+};
+typedef struct _pyramid_type_struct PYRAMID;
+
+
+/**
+ * @brief size of `n` pixels downscaled by `factor`, partial blocks at the end counting as a pixel
+ */
+int downscaled_size(int n, int factor);
+
+/**
+ * @brief Downscales an image by an integer factor, each destination pixel being the rounded average of a `factor` x `factor`
+ * @brief block of source pixels (partial blocks on the right and bottom edges average the pixels they have)
+ *
+ * @param destimg image to write to, of `downscaled_size()` of the source's width and height
+ * @param srcimg image to downscale (gray or RGB)
+ * @param factor downscale factor, 1 or more
+ *
+ * @returns `int` `0` if success. `-1` if `factor` is below 1. `-2` if `destimg` isn't the downscaled size. `-3` if allocation failed
+ */
+int downscale_img(IMAGE* destimg, IMAGE* srcimg, int factor);
+
+/**
+ * @brief Reads a PGM or PPM file already downscaled by `factor` (same result as `downscale_img()` on the whole image): rows are
+ * @brief averaged by blocks as they are read, so only the output and `factor` rows of the file are ever held.
+ * @brief Reuses the pixel matrix already in `img` when it is big enough
+ *
+ * @param filename string representing path to the PNM file to open
+ * @param img destination image. `img->mat` must be NULL or a matrix allocated by `pxalloc()`
+ * @param type expected type of the file (PGM or PPM). 0 accepts both, check `img->img_type` afterwards
+ * @param factor downscale factor (2, 4 and 8 for thumbnails, any factor of 1 or more works)
+ *
+ * @returns `0` if success. `-1` if the file couldn't be opened. `-2` if the file isn't of type `type` (or not a PGM/PPM at all).
+ * @returns `-3` if allocation failed. `-4` if the file ended early. `-5` if `factor` is below 1
+ */
+int load_pnm_scaled(char* filename, IMAGE* img, IMGTYPE type, int factor);
+
+/**
+ * @brief Resamples an image to the size of `destimg`, with separable weights computed once per axis. When shrinking, the filter
+ * @brief is stretched by the scale so that it averages every source pixel (no aliasing). Source pixels past the edges are left
+ * @brief out and the weights of the ones left renormalized
+ *
+ * @param destimg image to write to, of any size
+ * @param srcimg image to resample (gray or RGB)
+ * @param filter the filter (ex: `LANCZOS3`)
+ *
+ * @returns `int` `0` if success. `-1` if `filter` is a non existant filter. `-2` if a dimension of `destimg` is below 1. `-3` if allocation failed
+ */
+int resample_img(IMAGE* destimg, IMAGE* srcimg, RESAMPLETYPE filter);
+
+/**
+ * @brief computes the weights of resampling `srcsize` pixels into `destsize` pixels
+ *
+ * @param weights weights to fill, to be freed with `free_resample_weights()`
+ * @returns `int` `0` if success. `-1` if `filter` is a non existant filter. `-2` if a size is below 1. `-3` if allocation failed
+ */
+int resample_weights_init(RSWEIGHTS* weights, int srcsize, int destsize, RESAMPLETYPE filter);
+
+/**
+ * @brief frees the buffers of a set of weights (its members are reset)
+ */
+void free_resample_weights(RSWEIGHTS* weights);
+
+/**
+ * @brief Builds `nlevels` levels of a pyramid in a single pass down the source: as soon as two rows of a level are done
+ * @brief (or its last one), the row of the next level they average is computed, so every level is made from rows still in cache
+ *
+ * @param pyr pyramid to fill, to be freed with `free_pyramid()`
+ * @param srcimg image to build the pyramid of (gray or RGB)
+ * @param nlevels amount of levels, PYRAMID_MAX_LEVELS at most. Levels stop early once they are 1x1
+ *
+ * @returns `int` `0` if success. `-1` if `nlevels` is out of range. `-3` if allocation failed
+ */
+int pyramid_build(PYRAMID* pyr, IMAGE* srcimg, int nlevels);
+
+/**
+ * @brief same as `pyramid_build()`, reading the source rows from a file instead of an image, so it is never held whole
+ *
+ * @param pyr pyramid to fill, to be freed with `free_pyramid()`
+ * @param reader opened row reader of the source
+ * @param nlevels amount of levels
+ *
+ * @returns `int` `0` if success. `-1` if `nlevels` is out of range. `-3` if allocation failed. `-4` if the file ended early
+ */
+int stream_pyramid(ROWREADER* reader, PYRAMID* pyr, int nlevels);
+
+/**
+ * @brief frees the levels of a pyramid
+ */
+void free_pyramid(PYRAMID* pyr);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief filter value at `x` (in source pixels of the unstretched filter)
+ */
+double _resample_filter(RESAMPLETYPE filter, double x);
+
+/**
+ * @brief support radius of a filter
+ */
+double _resample_support(RESAMPLETYPE filter);
+
+/**
+ * @brief tile of `downscale_img()`, over rows of the destination
+ */
+void _downscale_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief tile of `resample_img()`, over rows of the destination: the vertical pass of each row into a buffer, then its horizontal pass
+ */
+void _resample_tile(void* arg, int r1, int r2);
+
+/**
+ * @brief row `r` of level `level` is done: computes the row of the next level it completes (if it does), and so on down the pyramid
+ */
+void _pyramid_cascade(PYRAMID* pyr, int level, int r, void* scratch);
+
+/**
+ * @brief allocates the levels of a pyramid of a `width` x `height` source
+ */
+int _pyramid_alloc(PYRAMID* pyr, int width, int height, IMGTYPE type, int nlevels);
+
+#endif
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "imgsched.h"
+
+// which scheduler the current thread belongs to, and its index in it
+static _Thread_local SCHEDULER* _sched_current = NULL;
+static _Thread_local int _sched_tid = 0;
+
+static SCHEDULER* _sched_default = NULL;
+static pthread_once_t _sched_default_once = PTHREAD_ONCE_INIT;
+
+// argument given to a worker thread when it starts
+struct _worker_start_type_struct {
+    SCHEDULER* sched;
+    int tid;
+};
+
+// one tile of `sched_parallel_rows()`
+struct _row_tile_type_struct {
+    TILEFUNC func;
+    void* arg;
+    int r1;
+    int r2;
+};
+
+
+SCHEDULER* sched_create(int nthreads) {
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0) nthreads = 1;
+    }
+
+    SCHEDULER* sched = (SCHEDULER*)calloc(1, sizeof(SCHEDULER));
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    sched->nthreads = nthreads;
+    sched->queues = (TASKDEQUE*)calloc(nthreads, sizeof(TASKDEQUE));
+    // the calling thread doesn't need a pthread_t, but it keeps the indexes of both arrays the same
+    sched->workers = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    if (sched->queues == NULL || sched->workers == NULL) {
+        free(sched->queues);
+        free(sched->workers);
+        free(sched);
+        return NULL;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        pthread_mutex_init(&sched->queues[i].lock, NULL);
+    }
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->cond, NULL);
+    atomic_init(&sched->nqueued, 0);
+    atomic_init(&sched->nsubmitted, 0);
+
+    // the creating thread is thread 0 of this scheduler
+    _sched_current = sched;
+    _sched_tid = 0;
+
+    for (int i = 1; i < nthreads; i++) {
+        struct _worker_start_type_struct* start = malloc(sizeof(struct _worker_start_type_struct));
+        if (start != NULL) {
+            start->sched = sched;
+            start->tid = i;
+        }
+
+        if (start == NULL || pthread_create(&sched->workers[i], NULL, _sched_worker_loop, start) != 0) {
+            printf("Error starting scheduler worker %d, continuing with %d threads\n", i, i);
+            free(start);
+            sched->nthreads = i;
+            break;
+        }
+    }
+
+    return sched;
+}
+
+void sched_destroy(SCHEDULER* sched) {
+
+    if (sched == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    sched->shutdown = 1;
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+
+    for (int i = 1; i < sched->nthreads; i++) {
+        pthread_join(sched->workers[i], NULL);
+    }
+
+    for (int i = 0; i < sched->nthreads; i++) {
+        pthread_mutex_destroy(&sched->queues[i].lock);
+        free(sched->queues[i].tasks);
+    }
+    pthread_mutex_destroy(&sched->lock);
+    pthread_cond_destroy(&sched->cond);
+
+    if (_sched_current == sched) {
+        _sched_current = NULL;
+    }
+
+    free(sched->queues);
+    free(sched->workers);
+    free(sched);
+}
+
+static void _sched_default_init(void) {
+
+    int nthreads = 0;
+    char* env = getenv(SCHED_THREADS_ENV);
+    if (env != NULL) {
+        sscanf(env, "%d", &nthreads);
+    }
+
+    _sched_default = sched_create(nthreads);
+}
+
+SCHEDULER* sched_default(void) {
+
+    pthread_once(&_sched_default_once, _sched_default_init);
+    return _sched_default;
+}
+
+int sched_thread_id(void) {
+    return _sched_tid;
+}
+
+void sched_group_init(TASKGROUP* group) {
+    atomic_init(&group->pending, 0);
+}
+
+int sched_submit(SCHEDULER* sched, TASKGROUP* group, TASKFUNC func, void* arg) {
+
+    TASK task = {func, arg, group};
+
+    // threads that don't belong to this scheduler share queue 0 with the thread that created it
+    int self = (_sched_current == sched) ? _sched_tid : 0;
+
+    atomic_fetch_add(&group->pending, 1);
+
+    if (_deque_push(&sched->queues[self], &task) != 0) {
+        // we couldn't queue it, so we run it here instead of losing it
+        func(arg);
+        atomic_fetch_sub(&group->pending, 1);
+        return -1;
+    }
+
+    // nqueued is only ever incremented while holding the lock, so sleeping threads can't miss it
+    pthread_mutex_lock(&sched->lock);
+    atomic_fetch_add(&sched->nqueued, 1);
+    atomic_fetch_add(&sched->nsubmitted, 1);
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+
+    return 0;
+}
+
+void sched_wait(SCHEDULER* sched, TASKGROUP* group) {
+
+    int self = (_sched_current == sched) ? _sched_tid : 0;
+
+    while (atomic_load(&group->pending) > 0) {
+
+        // read before looking at the queues, so a task submitted while we look isn't slept through
+        int seen = atomic_load(&sched->nsubmitted);
+
+        if (_sched_run_one(sched, self, group)) {
+            continue;
+        }
+
+        // nothing we may run, the remaining tasks of the group are running on other threads.
+        // Tasks of other groups may still be queued, so we sleep until new tasks come in instead
+        pthread_mutex_lock(&sched->lock);
+        while (atomic_load(&sched->nsubmitted) == seen && atomic_load(&group->pending) > 0) {
+            pthread_cond_wait(&sched->cond, &sched->lock);
+        }
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
+static void _run_row_tile(void* arg) {
+    struct _row_tile_type_struct* tile = arg;
+    tile->func(tile->arg, tile->r1, tile->r2);
+}
+
+int sched_parallel_rows(SCHEDULER* sched, int width, int height, TILEFUNC func, void* arg) {
+
+    if (height <= 0) {
+        return 0;
+    }
+
+    // too small to be worth splitting, or nobody to split it with
+    if (sched == NULL || sched->nthreads <= 1 || (long)width*height < SCHED_MIN_TILE_PX) {
+        func(arg, 0, height);
+        return 1;
+    }
+
+    // enough tiles for stealing to balance the load, but no tile under SCHED_MIN_TILE_PX pixels
+    int min_rows = (SCHED_MIN_TILE_PX + width - 1) / width;
+    int ntiles = sched->nthreads * SCHED_TILES_PER_THREAD;
+    int tile_rows = (height + ntiles - 1) / ntiles;
+    if (tile_rows < min_rows) tile_rows = min_rows;
+    ntiles = (height + tile_rows - 1) / tile_rows;
+
+    struct _row_tile_type_struct* tiles = malloc(sizeof(struct _row_tile_type_struct)*ntiles);
+    if (tiles == NULL) {
+        func(arg, 0, height);
+        return 1;
+    }
+
+    TASKGROUP group;
+    sched_group_init(&group);
+
+    // tile 0 is kept for this thread, the rest are up for grabs
+    for (int t = ntiles-1; t >= 0; t--) {
+        tiles[t].func = func;
+        tiles[t].arg = arg;
+        tiles[t].r1 = t*tile_rows;
+        tiles[t].r2 = (t+1)*tile_rows < height ? (t+1)*tile_rows : height;
+
+        if (t > 0) {
+            sched_submit(sched, &group, _run_row_tile, &tiles[t]);
+        }
+    }
+
+    _run_row_tile(&tiles[0]);
+    sched_wait(sched, &group);
+
+    free(tiles);
+
+    return ntiles;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void* _sched_worker_loop(void* arg) {
+
+    struct _worker_start_type_struct* start = arg;
+    SCHEDULER* sched = start->sched;
+    _sched_current = sched;
+    _sched_tid = start->tid;
+    free(start);
+
+    while (1) {
+
+        if (_sched_run_one(sched, _sched_tid, NULL)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&sched->lock);
+        while (atomic_load(&sched->nqueued) == 0 && !sched->shutdown) {
+            pthread_cond_wait(&sched->cond, &sched->lock);
+        }
+        int done = sched->shutdown;
+        pthread_mutex_unlock(&sched->lock);
+
+        if (done) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int _sched_run_one(SCHEDULER* sched, int self, TASKGROUP* only) {
+
+    TASK task;
+    int found = _deque_pop(&sched->queues[self], &task, only);
+
+    // steal from the others, starting with our neighbour so thieves don't all pile on the same queue
+    for (int i = 1; !found && i < sched->nthreads; i++) {
+        found = _deque_steal(&sched->queues[(self + i) % sched->nthreads], &task, only);
+    }
+
+    if (!found) {
+        return 0;
+    }
+
+    atomic_fetch_sub(&sched->nqueued, 1);
+
+    task.func(task.arg);
+
+    // the last task of a group wakes whoever is waiting on it
+    if (atomic_fetch_sub(&task.group->pending, 1) == 1) {
+        pthread_mutex_lock(&sched->lock);
+        pthread_cond_broadcast(&sched->cond);
+        pthread_mutex_unlock(&sched->lock);
+    }
+
+    return 1;
+}
+
+int _deque_push(TASKDEQUE* dq, TASK* task) {
+
+    pthread_mutex_lock(&dq->lock);
+
+    if (dq->bottom == dq->capacity) {
+        if (dq->top > 0) {
+            // slide the remaining tasks back to the start instead of growing
+            memmove(dq->tasks, &dq->tasks[dq->top], sizeof(TASK)*(dq->bottom - dq->top));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        } else {
+            int newcap = dq->capacity > 0 ? dq->capacity*2 : 64;
+            TASK* newtasks = (TASK*)realloc(dq->tasks, sizeof(TASK)*newcap);
+            if (newtasks == NULL) {
+                pthread_mutex_unlock(&dq->lock);
+                return -1;
+            }
+            dq->tasks = newtasks;
+            dq->capacity = newcap;
+        }
+    }
+
+    dq->tasks[dq->bottom++] = *task;
+
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+int _task_allowed(TASK* task, TASKGROUP* only) {
+    return only == NULL || task->group == only || task->func == _run_row_tile;
+}
+
+int _deque_pop(TASKDEQUE* dq, TASK* task, TASKGROUP* only) {
+
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+
+    for (int i = dq->bottom - 1; i >= dq->top && !found; i--) {
+        if (_task_allowed(&dq->tasks[i], only)) {
+            *task = dq->tasks[i];
+            _deque_remove(dq, i);
+            found = 1;
+        }
+    }
+    if (dq->bottom == dq->top) {
+        dq->bottom = dq->top = 0;
+    }
+
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+int _deque_steal(TASKDEQUE* dq, TASK* task, TASKGROUP* only) {
+
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+
+    for (int i = dq->top; i < dq->bottom && !found; i++) {
+        if (_task_allowed(&dq->tasks[i], only)) {
+            *task = dq->tasks[i];
+            _deque_remove(dq, i);
+            found = 1;
+        }
+    }
+    if (dq->bottom == dq->top) {
+        dq->bottom = dq->top = 0;
+    }
+
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+void _deque_remove(TASKDEQUE* dq, int i) {
+
+    // the tasks on the shorter side close the gap
+    if (i - dq->top < dq->bottom - 1 - i) {
+        memmove(&dq->tasks[dq->top + 1], &dq->tasks[dq->top], sizeof(TASK)*(i - dq->top));
+        dq->top++;
+    } else {
+        memmove(&dq->tasks[i], &dq->tasks[i + 1], sizeof(TASK)*(dq->bottom - 1 - i));
+        dq->bottom--;
+    }
+}
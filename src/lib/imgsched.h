@@ -0,0 +1,198 @@
+#ifndef IMAGE_SCHED_H
+#define IMAGE_SCHED_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// environment variable used to override the amount of threads of the default scheduler
+#define SCHED_THREADS_ENV "IMG_THREADS"
+
+// images with less pixels than this are never split into tiles
+#define SCHED_MIN_TILE_PX (1 << 16)
+
+// how many tiles per thread an image op is split into (more tiles = better balancing when stealing)
+#define SCHED_TILES_PER_THREAD 4
+
+// a task function, `arg` is whatever was given to `sched_submit()`
+typedef void (*TASKFUNC)(void* arg);
+
+// a tile function, works on rows [r1, r2[ of whatever is pointed to by `arg`
+typedef void (*TILEFUNC)(void* arg, int r1, int r2);
+
+/**
+ * @brief a group of tasks that can be waited on together
+ *
+ * @member pending: amount of tasks submitted to the group that haven't finished yet
+ */
+struct _task_group_type_struct {
+    atomic_int pending;
+};
+typedef struct _task_group_type_struct TASKGROUP;
+
+/**
+ * @brief a single unit of work living in one of the scheduler's queues
+ */
+struct _task_type_struct {
+    TASKFUNC func;
+    void* arg;
+    TASKGROUP* group;
+};
+typedef struct _task_type_struct TASK;
+
+/**
+ * @brief double ended queue of tasks. The owner pushes and pops at the bottom, thieves steal from the top
+ */
+struct _task_deque_type_struct {
+    pthread_mutex_t lock;
+    TASK* tasks;
+    int capacity;
+    int top;
+    int bottom;
+};
+typedef struct _task_deque_type_struct TASKDEQUE;
+
+/**
+ * @brief work stealing scheduler shared by image ops (tile tasks) and batch drivers (per-image tasks)
+ * @brief NOTE: the thread that creates the scheduler also runs tasks while it waits on a group, so a scheduler
+ *        created for `n` threads only starts `n-1` workers. This is what keeps us from over-subscribing the cores.
+ *
+ * @member nthreads: total amount of threads running tasks (workers + the calling thread)
+ * @member queues: one deque per thread, index 0 belongs to the calling (non-worker) thread
+ * @member nqueued: amount of tasks sitting in all of the queues
+ * @member nsubmitted: amount of tasks ever submitted, so a waiter can tell whether new tasks came in since it last looked
+ */
+struct _scheduler_type_struct {
+    int nthreads;
+    pthread_t* workers;
+    TASKDEQUE* queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int nqueued;
+    atomic_int nsubmitted;
+    int shutdown;
+};
+typedef struct _scheduler_type_struct SCHEDULER;
+
+
+/**
+ * @brief creates a scheduler running tasks on `nthreads` threads (the caller included)
+ *
+ * @param nthreads total amount of threads. If <= 0, the amount of online processors is used
+ * @return SCHEDULER* | NULL if allocation or thread creation failed
+ */
+SCHEDULER* sched_create(int nthreads);
+
+/**
+ * @brief stops all workers and frees the scheduler. Every task group must have been waited on before.
+ *
+ * @param sched scheduler to destroy
+ */
+void sched_destroy(SCHEDULER* sched);
+
+/**
+ * @brief returns the process wide scheduler used by the image ops, creating it on first use.
+ * @brief Its thread count can be set with the `IMG_THREADS` environment variable (`IMG_THREADS=1` disables threading).
+ *
+ * @return SCHEDULER* | NULL if it couldn't be created (everything then runs on the calling thread)
+ */
+SCHEDULER* sched_default(void);
+
+/**
+ * @brief returns the index of the thread currently running, within the scheduler it belongs to.
+ * @brief NOTE: 0 is the thread driving the scheduler (not a worker), workers go from 1 to nthreads-1.
+ *        Useful for per-thread buffers, which then need `sched->nthreads` slots.
+ */
+int sched_thread_id(void);
+
+/**
+ * @brief initialises an empty task group
+ *
+ * @param group group to initialise
+ */
+void sched_group_init(TASKGROUP* group);
+
+/**
+ * @brief submits a task to the scheduler. It is pushed on the current thread's queue so idle threads can steal it.
+ *
+ * @param sched scheduler to run the task on
+ * @param group group the task belongs to (what `sched_wait()` waits on)
+ * @param func function to run
+ * @param arg argument passed to `func`
+ * @return int `0` if success. `-1` if the task queue couldn't grow (the task is then run right away)
+ */
+int sched_submit(SCHEDULER* sched, TASKGROUP* group, TASKFUNC func, void* arg);
+
+/**
+ * @brief waits for every task of `group` to be done. The waiting thread runs queued tasks (its own first, then stolen ones) in the meantime,
+ * @brief but only tasks of `group` and tiles of `sched_parallel_rows()`: a task of another group (such as a batch runner going through
+ * @brief a whole list of images) could keep it busy long after `group` is done
+ *
+ * @param sched scheduler the tasks were submitted to
+ * @param group group to wait on
+ */
+void sched_wait(SCHEDULER* sched, TASKGROUP* group);
+
+/**
+ * @brief runs `func` over all rows of a `width`x`height` image, split in horizontal tiles when the image is big enough.
+ * @brief Small images run directly on the calling thread, so a batch running one image per thread doesn't split them further.
+ *
+ * @param sched scheduler to run the tiles on (NULL runs everything on the calling thread)
+ * @param width width of the image (only used to decide on the tile size)
+ * @param height height of the image
+ * @param func function to call on each tile of rows
+ * @param arg argument passed to `func`
+ * @return int amount of tiles the rows were split into
+ */
+int sched_parallel_rows(SCHEDULER* sched, int width, int height, TILEFUNC func, void* arg);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief main loop of a worker thread. `arg` is the SCHEDULER it belongs to.
+ */
+void* _sched_worker_loop(void* arg);
+
+/**
+ * @brief tries to run a single queued task, first from the thread's own queue, then by stealing from the others
+ *
+ * @param only if not NULL, only tasks of this group and tiles of `sched_parallel_rows()` are run (see `sched_wait()`)
+ * @return int 1 if a task was run, else 0
+ */
+int _sched_run_one(SCHEDULER* sched, int self, TASKGROUP* only);
+
+/**
+ * @brief whether a task can be run by a thread waiting on `only` (any task if `only` is NULL)
+ */
+int _task_allowed(TASK* task, TASKGROUP* only);
+
+/**
+ * @brief pushes a task at the bottom of a deque, growing it if needed
+ *
+ * @return int `0` if success. `-1` if the deque couldn't grow
+ */
+int _deque_push(TASKDEQUE* dq, TASK* task);
+
+/**
+ * @brief pops a task from the bottom (owner side) of a deque, the one nearest to the bottom allowed by `only` (see `_task_allowed()`)
+ *
+ * @return int 1 if a task was written to `task`, else 0
+ */
+int _deque_pop(TASKDEQUE* dq, TASK* task, TASKGROUP* only);
+
+/**
+ * @brief steals a task from the top (thief side) of a deque, the one nearest to the top allowed by `only` (see `_task_allowed()`)
+ *
+ * @return int 1 if a task was written to `task`, else 0
+ */
+int _deque_steal(TASKDEQUE* dq, TASK* task, TASKGROUP* only);
+
+/**
+ * @brief removes task `i` of a deque (the deque must be locked), keeping the others in order
+ */
+void _deque_remove(TASKDEQUE* dq, int i);
+
+#endif
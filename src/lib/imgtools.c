@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgtools.h"
+
+
+static int _tool_rgb2y(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    // places Y on all 3 channels, so the gray value of each pixel is Y
+    convert_channel_img(destimg, srcimg, RGB2GRAY);
+    return 0;
+}
+
+static int _tool_rgb2ycbcr(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    convert_channel_img(destimg, srcimg, RGB2YCBCR);
+    return 0;
+}
+
+static int _tool_bin_thresh_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int thresh = 0;
+    sscanf(args[0], "%d", &thresh);
+
+    bin_gthresh_img(destimg, thresh, 0, 255);
+    return 0;
+}
+
+static int _tool_bin_thresh_ppm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int rthresh = 0, gthresh = 0, bthresh = 0;
+    sscanf(args[0], "%d", &rthresh);
+    sscanf(args[1], "%d", &gthresh);
+    sscanf(args[2], "%d", &bthresh);
+
+    bin_rgbthresh_img(destimg, rthresh, gthresh, bthresh, 0, 255);
+    return 0;
+}
+
+static int _tool_tri_thresh_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int thresh1 = 0, thresh2 = 0;
+    sscanf(args[0], "%d", &thresh1);
+    sscanf(args[1], "%d", &thresh2);
+
+    tri_gthresh_img(destimg, thresh1, thresh2);
+    return 0;
+}
+
+static int _tool_erode_bin_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    erode_img(destimg, srcimg, 1);
+    return 0;
+}
+
+static int _tool_dilate_bin_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    dilate_img(destimg, srcimg, 1);
+    return 0;
+}
+
+static int _tool_invert_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    invert_gimg(destimg);
+    return 0;
+}
+
+static int _tool_filtre_flou1_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return apply_blur2img(&blur_gpx_cross, destimg, srcimg, 1);
+}
+
+static int _tool_filtre_flou1_ppm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return apply_blur2img(&blur_rgbpx_square, destimg, srcimg, 1);
+}
+
+static int _tool_modify(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int k = 0;
+    sscanf(args[0], "%d", &k);
+    if (k <= -128 || 128 <= k) {
+        return -1;
+    }
+
+    add_gimg(destimg, k);
+    return 0;
+}
+
+static int _tool_norme_gradient_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    return grad_gimg(destimg, srcimg);
+}
+
+static int _tool_hysteresis_thresh_pgm(IMAGE* destimg, IMAGE* srcimg, char** args) {
+    int minthresh = 0, maxthresh = 0;
+    sscanf(args[0], "%d", &minthresh);
+    sscanf(args[1], "%d", &maxthresh);
+
+    if (grad_gimg(destimg, srcimg) != 0) {
+        return -1;
+    }
+    hysteresis_gthresh_img(destimg, minthresh, maxthresh);
+    return 0;
+}
+
+static int _tool_histogram_pgm(IMAGE* img, char** args, FILE* out) {
+    int hist[256];
+    histogram_gimg(img, hist);
+
+    for (int i = 0; i < 256; i++) {
+        fprintf(out, "%d %d\n", i, hist[i]);
+    }
+    return 0;
+}
+
+static int _tool_histogram_ppm(IMAGE* img, char** args, FILE* out) {
+    int hist[256][3];
+    histogram_rgbimg(img, hist);
+
+    for (int i = 0; i < 256; i++) {
+        fprintf(out, "%d\t%d\t%d\t%d\n", i, hist[i][0], hist[i][1], hist[i][2]);
+    }
+    return 0;
+}
+
+static int _tool_profile_pgm(IMAGE* img, char** args, FILE* out) {
+    int index = 0;
+    sscanf(args[1], "%d", &index);
+
+    int profile[256];
+    if (profile_gimg(img, args[0][0] == 'r', index, profile) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        fprintf(out, "%d\t%d\n", i, profile[i]);
+    }
+    return 0;
+}
+
+// every single image operation of the executables
+// (sepYCrCb, YCbCr, difference_pgm and filtre_flou2_pgm read or write several images, so they aren't in here)
+static TOOL _tools[] = {
+    {"rgb2y",                 PPM, PGM, 0, "",                         1, _tool_rgb2y, NULL},
+    {"RGB2YCBCR",             PPM, PPM, 0, "",                         1, _tool_rgb2ycbcr, NULL},
+    {"bin_thresh_pgm",        PGM, PGM, 1, "<threshvalue>",            1, _tool_bin_thresh_pgm, NULL},
+    {"bin_thresh_ppm",        PPM, PPM, 3, "<rthresh> <gthresh> <bthresh>", 1, _tool_bin_thresh_ppm, NULL},
+    {"tri_thresh_pgm",        PGM, PGM, 2, "<thresh1> <thresh2>",      1, _tool_tri_thresh_pgm, NULL},
+    {"erode_bin_pgm",         PGM, PGM, 0, "",                         0, _tool_erode_bin_pgm, NULL},
+    {"dilate_bin_pgm",        PGM, PGM, 0, "",                         0, _tool_dilate_bin_pgm, NULL},
+    {"invert_pgm",            PGM, PGM, 0, "",                         1, _tool_invert_pgm, NULL},
+    {"filtre_flou1_pgm",      PGM, PGM, 0, "",                         0, _tool_filtre_flou1_pgm, NULL},
+    {"filtre_flou1_ppm",      PPM, PPM, 0, "",                         0, _tool_filtre_flou1_ppm, NULL},
+    {"modifY",                PGM, PGM, 1, "<k:-127 to 127>",          1, _tool_modify, NULL},
+    {"norme_gradient_pgm",    PGM, PGM, 0, "",                         0, _tool_norme_gradient_pgm, NULL},
+    {"hysteresis_thresh_pgm", PGM, PGM, 2, "<minthresh> <maxthresh>",  0, _tool_hysteresis_thresh_pgm, NULL},
+    {"histogram_pgm",         PGM, 0,   0, "",                         1, NULL, _tool_histogram_pgm},
+    {"histogram_ppm",         PPM, 0,   0, "",                         1, NULL, _tool_histogram_ppm},
+    {"profile_pgm",           PGM, 0,   2, "<c|r> <index>",            1, NULL, _tool_profile_pgm},
+};
+
+
+TOOL* get_tool(char* name) {
+
+    for (int i = 0; i < sizeof(_tools)/sizeof(TOOL); i++) {
+        if (strcmp(_tools[i].name, name) == 0) {
+            return &_tools[i];
+        }
+    }
+
+    return NULL;
+}
+
+void print_tools(FILE* out) {
+
+    for (int i = 0; i < sizeof(_tools)/sizeof(TOOL); i++) {
+        fprintf(out, "  %s %s\n", _tools[i].name, _tools[i].args_usage);
+    }
+}
+
+IMAGE* run_tool(TOOL* tool, IMAGE* destimg, IMAGE* srcimg, char** args, FILE* out) {
+
+    if (tool->report != NULL) {
+        return tool->report(srcimg, args, out) == 0 ? srcimg : NULL;
+    }
+
+    if (!tool->in_place) {
+        destimg->mat = pxrealloc(destimg->mat, srcimg->width, srcimg->height);
+        if (destimg->mat == NULL) {
+            return NULL;
+        }
+        destimg->width = srcimg->width;
+        destimg->height = srcimg->height;
+    } else {
+        destimg = srcimg;
+    }
+
+    if (tool->apply(destimg, srcimg, args) != 0) {
+        return NULL;
+    }
+
+    destimg->img_type = (tool->outtype != 0) ? tool->outtype : srcimg->img_type;
+
+    return destimg;
+}
@@ -0,0 +1,60 @@
+#ifndef IMAGE_TOOLS_H
+#define IMAGE_TOOLS_H
+
+#include <stdio.h>
+#include "imgio.h"
+
+/**
+ * @brief describes one of the single image operations done by the executables, so drivers
+ * @brief (batch, pipeline) can run them on images that are already in memory
+ *
+ * @member name: same name as the executable doing this operation
+ * @member intype: type of image the operation expects (PGM or PPM), or 0 if it works on both
+ * @member outtype: type of image the operation produces (PGM or PPM), or 0 if it keeps the type of its input (always 0 for text operations)
+ * @member nargs: amount of arguments the operation expects (after the in/out paths of the executable)
+ * @member args_usage: description of the arguments, same as in the executable's usage
+ * @member in_place: 1 if `apply` can be given the same image as source and destination
+ * @member apply: runs the operation from `srcimg` into `destimg` (same size, already allocated). Returns `0` if success, `-1` on bad arguments
+ * @member report: for text operations, writes the result for `img` to `out`. Returns `0` if success, `-1` on bad arguments
+ */
+struct _tool_type_struct {
+    char* name;
+    IMGTYPE intype;
+    IMGTYPE outtype;
+    int nargs;
+    char* args_usage;
+    int in_place;
+    int (*apply)(IMAGE* destimg, IMAGE* srcimg, char** args);
+    int (*report)(IMAGE* img, char** args, FILE* out);
+};
+typedef struct _tool_type_struct TOOL;
+
+
+/**
+ * @brief finds a tool by its name
+ *
+ * @param name name of the tool (same as the executable)
+ * @return TOOL* | NULL if there is no tool with that name
+ */
+TOOL* get_tool(char* name);
+
+/**
+ * @brief prints the name and arguments of every available tool
+ *
+ * @param out where to print the list
+ */
+void print_tools(FILE* out);
+
+/**
+ * @brief runs a tool on an image. Allocates (or reuses) the pixel matrix of `destimg` when the tool isn't in place.
+ *
+ * @param tool tool to run
+ * @param destimg image to write the result to. Ignored for in place and text tools
+ * @param srcimg image to run the tool on
+ * @param args arguments of the tool (`tool->nargs` of them)
+ * @param out where to write the result of text tools
+ * @return IMAGE* the image holding the result (`srcimg` or `destimg`) | NULL if the tool failed
+ */
+IMAGE* run_tool(TOOL* tool, IMAGE* destimg, IMAGE* srcimg, char** args, FILE* out);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "imgtrace.h"
+
+static pthread_once_t _trace_once = PTHREAD_ONCE_INIT;
+static int _trace_on = 0;
+static char* _trace_path = NULL;
+static long long _trace_t0 = 0;
+
+// every recorded event, shared by all threads. Only touched when tracing is on
+static pthread_mutex_t _trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TRACEEVENT* _trace_events = NULL;
+static int _trace_nevents = 0;
+static int _trace_capacity = 0;
+
+static const char* _counter_names[TRACE_MAX_COUNTERS];
+static long long _counter_totals[TRACE_MAX_COUNTERS];
+static int _ncounters = 0;
+
+static atomic_int _trace_next_tid = 0;
+static _Thread_local int _trace_self_tid = -1;
+
+
+static void _trace_atexit(void) {
+    trace_flush();
+}
+
+
+int trace_enabled(void) {
+    pthread_once(&_trace_once, _trace_init);
+    return _trace_on;
+}
+
+void trace_begin(TRACESCOPE* scope, const char* cat, const char* name) {
+
+    scope->on = trace_enabled();
+    if (!scope->on) {
+        return;
+    }
+
+    scope->cat = cat;
+    scope->name = name;
+    scope->bytes = 0;
+    scope->pixels = 0;
+    scope->start_ns = _trace_now_ns();
+}
+
+void trace_end(TRACESCOPE* scope) {
+
+    if (!scope->on) {
+        return;
+    }
+
+    long long end = _trace_now_ns();
+
+    TRACEEVENT event = {
+        .cat = scope->cat,
+        .name = scope->name,
+        .ph = 'X',
+        .tid = _trace_tid(),
+        .ts_ns = scope->start_ns,
+        .dur_ns = end - scope->start_ns,
+        .bytes = scope->bytes,
+        .pixels = scope->pixels,
+    };
+    _trace_record(&event);
+}
+
+void trace_count(const char* name, long long delta) {
+
+    if (!trace_enabled()) {
+        return;
+    }
+
+    TRACEEVENT event = {.cat = "counter", .name = name, .ph = 'C', .tid = _trace_tid(), .ts_ns = _trace_now_ns()};
+
+    pthread_mutex_lock(&_trace_lock);
+
+    // counters are few, names are string literals so comparing pointers is enough most of the time
+    int i = 0;
+    while (i < _ncounters && _counter_names[i] != name && strcmp(_counter_names[i], name) != 0) i++;
+    if (i == _ncounters && _ncounters < TRACE_MAX_COUNTERS) {
+        _counter_names[_ncounters++] = name;
+        _counter_totals[i] = 0;
+    }
+
+    if (i < _ncounters) {
+        _counter_totals[i] += delta;
+        event.value = _counter_totals[i];
+    }
+
+    pthread_mutex_unlock(&_trace_lock);
+
+    if (i < _ncounters) {
+        _trace_record(&event);
+    }
+}
+
+int trace_flush(void) {
+
+    if (!trace_enabled()) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&_trace_lock);
+
+    // the whole file is rewritten every time, so it always holds a valid trace
+    FILE* fd = fopen(_trace_path, "w");
+    if (fd == NULL) {
+        pthread_mutex_unlock(&_trace_lock);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    fprintf(fd, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+    for (int i = 0; i < _trace_nevents; i++) {
+        TRACEEVENT* e = &_trace_events[i];
+        double ts = (e->ts_ns - _trace_t0) / 1000.0;
+
+        fprintf(fd, "%s\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, ",
+            i == 0 ? "" : ",", e->name, e->cat, e->ph, pid, e->tid, ts);
+
+        if (e->ph == 'X') {
+            fprintf(fd, "\"dur\": %.3f, \"args\": {\"bytes\": %lld, \"pixels\": %lld}}", e->dur_ns / 1000.0, e->bytes, e->pixels);
+        } else {
+            fprintf(fd, "\"args\": {\"%s\": %lld}}", e->name, e->value);
+        }
+    }
+
+    fprintf(fd, "\n]}\n");
+
+    int res = (fclose(fd) == 0) ? 0 : -1;
+
+    pthread_mutex_unlock(&_trace_lock);
+
+    return res;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void _trace_init(void) {
+
+    char* path = getenv(TRACE_ENV);
+    if (path == NULL || path[0] == '\0') {
+        return;
+    }
+
+    _trace_path = strdup(path);
+    if (_trace_path == NULL) {
+        return;
+    }
+
+    _trace_t0 = _trace_now_ns();
+    _trace_on = 1;
+    atexit(_trace_atexit);
+}
+
+void _trace_record(TRACEEVENT* event) {
+
+    pthread_mutex_lock(&_trace_lock);
+
+    if (_trace_nevents == _trace_capacity) {
+        int capacity = _trace_capacity > 0 ? _trace_capacity*2 : 1024;
+        TRACEEVENT* events = (TRACEEVENT*)realloc(_trace_events, sizeof(TRACEEVENT)*capacity);
+        if (events == NULL) {
+            // losing events is better than failing the op being traced
+            pthread_mutex_unlock(&_trace_lock);
+            return;
+        }
+        _trace_events = events;
+        _trace_capacity = capacity;
+    }
+
+    _trace_events[_trace_nevents++] = *event;
+
+    pthread_mutex_unlock(&_trace_lock);
+}
+
+int _trace_tid(void) {
+
+    if (_trace_self_tid < 0) {
+        _trace_self_tid = atomic_fetch_add(&_trace_next_tid, 1);
+    }
+    return _trace_self_tid;
+}
+
+long long _trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,111 @@
+#ifndef IMAGE_TRACE_H
+#define IMAGE_TRACE_H
+
+// environment variable holding the path of the trace file to write at exit. Tracing is off when it isn't set
+#define TRACE_ENV "IMG_TRACE"
+
+// max amount of distinct counters (see `trace_count()`)
+#define TRACE_MAX_COUNTERS 16
+
+/**
+ * @brief a scoped timer, from `trace_begin()` to `trace_end()`
+ *
+ * @member on: 0 when tracing is off, every other member is then left untouched
+ * @member bytes: bytes read, written or allocated within the scope (set by the caller, reported in the trace)
+ * @member pixels: pixels processed within the scope (set by the caller, reported in the trace)
+ */
+struct _trace_scope_type_struct {
+    int on;
+    const char* cat;
+    const char* name;
+    long long start_ns;
+    long long bytes;
+    long long pixels;
+};
+typedef struct _trace_scope_type_struct TRACESCOPE;
+
+/**
+ * @brief a recorded event, written out in the Chrome trace format
+ *
+ * @member ph: 'X' for a complete event (a scope), 'C' for a counter
+ * @member value: for counters, total of the counter after this event
+ */
+struct _trace_event_type_struct {
+    const char* cat;
+    const char* name;
+    char ph;
+    int tid;
+    long long ts_ns;
+    long long dur_ns;
+    long long bytes;
+    long long pixels;
+    long long value;
+};
+typedef struct _trace_event_type_struct TRACEEVENT;
+
+
+/**
+ * @brief whether tracing is on (decided once, from TRACE_ENV)
+ *
+ * @return int 1 if events are recorded, else 0
+ */
+int trace_enabled(void);
+
+/**
+ * @brief starts a scoped timer. When tracing is off this only checks a flag
+ *
+ * @param scope the scope to start
+ * @param cat category of the event (library name), must be a string literal
+ * @param name name of the event (function name), must be a string literal
+ */
+void trace_begin(TRACESCOPE* scope, const char* cat, const char* name);
+
+/**
+ * @brief ends a scoped timer and records it, with its byte and pixel counts
+ *
+ * @param scope the scope to end
+ */
+void trace_end(TRACESCOPE* scope);
+
+/**
+ * @brief adds to a named counter (ex: "bytes_read") and records its new total
+ *
+ * @param name name of the counter, must be a string literal
+ * @param delta amount to add
+ */
+void trace_count(const char* name, long long delta);
+
+/**
+ * @brief writes every recorded event to the trace file. Called at exit, but can be called earlier
+ * @brief (events recorded afterwards are written at the next flush)
+ *
+ * @return int `0` if success. `-1` if the file couldn't be written
+ */
+int trace_flush(void);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief reads TRACE_ENV, run once
+ */
+void _trace_init(void);
+
+/**
+ * @brief appends an event to the recorded ones
+ */
+void _trace_record(TRACEEVENT* event);
+
+/**
+ * @brief small id of the calling thread, as shown in the trace
+ */
+int _trace_tid(void);
+
+/**
+ * @brief monotonic time in nanoseconds
+ */
+long long _trace_now_ns(void);
+
+#endif
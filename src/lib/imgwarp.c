@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imgwarp.h"
+#include "imgkern.h"
+
+// arguments shared by the tiles of a warp
+struct _warp_tile_args_type_struct {
+    IMAGE* destimg;
+    IMAGE* srcimg;
+    int nchan;
+    const double* m;
+    int affine;
+    BORDERMODE mode;
+    PIXEL border;
+};
+typedef struct _warp_tile_args_type_struct WARPTILE;
+
+
+
+
+int warp_img(IMAGE* destimg, IMAGE* srcimg, const double m[9], BORDERMODE mode, PIXEL border) {
+
+    if (mode < BORDER_EXCLUDED || mode > BORDER_CONSTANT) {
+        return -1;
+    }
+
+    if (srcimg->width >= WARP_MAX_SIZE || srcimg->height >= WARP_MAX_SIZE || destimg->width >= WARP_MAX_SIZE || destimg->height >= WARP_MAX_SIZE) {
+        return -2;
+    }
+
+    WARPTILE args = {.destimg = destimg, .srcimg = srcimg, .nchan = (srcimg->img_type == PGM) ? 1 : 3, .m = m, .mode = mode, .border = border};
+    args.affine = (m[6] == 0.0 && m[7] == 0.0 && m[8] == 1.0);
+    _run_op("warp_img", destimg->width, destimg->height, _warp_tile, &args);
+
+    return 0;
+}
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+void _warp_row(BYTE* dest, PIXEL** rows, const int* xs, const int* ys, int n, int nchan) {
+
+    const KERNELS* kern = kernels();
+    if (kern != NULL) {
+        kern->warp(dest, rows, xs, ys, n, nchan);
+        return;
+    }
+
+    const int fshift = WARP_FRAC_BITS - 8;
+    for (int i = 0; i < n; i++) {
+        int ix = xs[i] >> WARP_FRAC_BITS, iy = ys[i] >> WARP_FRAC_BITS;
+        int fx = (xs[i] >> fshift) & 255, fy = (ys[i] >> fshift) & 255;
+        BYTE* p = &rows[iy][ix].cpx.r;
+        BYTE* q = &rows[iy + 1][ix].cpx.r;
+
+        for (int ch = 0; ch < nchan; ch++) {
+            int top = p[ch]*(256 - fx) + p[3 + ch]*fx;
+            int bottom = q[ch]*(256 - fx) + q[3 + ch]*fx;
+            dest[3*i + ch] = (BYTE)((top*(256 - fy) + bottom*fy + 32768) >> 16);
+        }
+    }
+}
+
+int _warp_px(BYTE* dest, IMAGE* src, int x, int y, int nchan, BORDERMODE mode, PIXEL* border) {
+
+    int w = src->width, h = src->height;
+    if (mode == BORDER_EXCLUDED && (x < 0 || y < 0 || x > (w - 1) << WARP_FRAC_BITS || y > (h - 1) << WARP_FRAC_BITS)) {
+        return -1;
+    }
+
+    int ix = x >> WARP_FRAC_BITS, iy = y >> WARP_FRAC_BITS;
+    int fx = (x >> (WARP_FRAC_BITS - 8)) & 255, fy = (y >> (WARP_FRAC_BITS - 8)) & 255;
+
+    // the 4 neighbors, wherever the border mode puts those outside of the source
+    BYTE* taps[4];
+    for (int k = 0; k < 4; k++) {
+        int tx = ix + k % 2, ty = iy + k / 2;
+        if (tx >= 0 && tx < w && ty >= 0 && ty < h) {
+            taps[k] = &src->mat[ty][tx].cpx.r;
+        } else if (mode == BORDER_CONSTANT) {
+            taps[k] = &border->cpx.r;
+        } else if (mode == BORDER_EXCLUDED) {
+            // only the zero weight neighbors of a point on the last row or column get here
+            taps[k] = &src->mat[(ty < h) ? ty : h - 1][(tx < w) ? tx : w - 1].cpx.r;
+        } else {
+            if (tx < 0 || tx >= w) tx = _border_index(tx, w, mode);
+            if (ty < 0 || ty >= h) ty = _border_index(ty, h, mode);
+            taps[k] = &src->mat[ty][tx].cpx.r;
+        }
+    }
+
+    for (int ch = 0; ch < nchan; ch++) {
+        int top = taps[0][ch]*(256 - fx) + taps[1][ch]*fx;
+        int bottom = taps[2][ch]*(256 - fx) + taps[3][ch]*fx;
+        dest[ch] = (BYTE)((top*(256 - fy) + bottom*fy + 32768) >> 16);
+    }
+
+    return 0;
+}
+
+void _warp_tile(void* arg, int r1, int r2) {
+    WARPTILE* args = arg;
+    IMAGE* src = args->srcimg;
+    IMAGE* dest = args->destimg;
+    const double* m = args->m;
+    const double one = 1 << WARP_FRAC_BITS;
+    // coordinates are clamped to what the fixed point holds, far enough out that clamping doesn't move them back in
+    const double lim = WARP_MAX_SIZE;
+    const int xmax = (src->width - 1) << WARP_FRAC_BITS;
+    const int ymax = (src->height - 1) << WARP_FRAC_BITS;
+
+    int xs[WARP_TILE], ys[WARP_TILE];
+    const KERNELS* kern = kernels();
+
+    for (int rb = r1; rb < r2; rb += WARP_TILE) {
+        int re = (rb + WARP_TILE < r2) ? rb + WARP_TILE : r2;
+
+        for (int cb = 0; cb < dest->width; cb += WARP_TILE) {
+            int n = (cb + WARP_TILE < dest->width) ? WARP_TILE : dest->width - cb;
+
+            for (int r = rb; r < re; r++) {
+                double x0 = m[0]*cb + m[1]*r + m[2];
+                double y0 = m[3]*cb + m[4]*r + m[5];
+                double x1 = x0 + m[0]*(n - 1);
+                double y1 = y0 + m[3]*(n - 1);
+
+                int inside = 1;
+                if (args->affine && fabs(x0) < lim && fabs(y0) < lim && fabs(x1) < lim && fabs(y1) < lim) {
+                    // affine rows step in fixed point from an exact start. The steps keep 16 more bits than the
+                    // coordinates, so WARP_TILE of them drift by far less than a step of the coordinates
+                    const double wide = one*65536.0;
+                    long long fx0 = llround(x0*wide), fy0 = llround(y0*wide);
+                    long long dx = llround(m[0]*wide), dy = llround(m[3]*wide);
+                    if (kern != NULL) {
+                        inside = kern->warp_steps(xs, ys, fx0, fy0, dx, dy, n, xmax, ymax);
+                    } else {
+                        for (int i = 0; i < n; i++) {
+                            xs[i] = (int)((fx0 + i*dx + 32768) >> 16);
+                            ys[i] = (int)((fy0 + i*dy + 32768) >> 16);
+                            inside &= (xs[i] >= 0) & (xs[i] < xmax) & (ys[i] >= 0) & (ys[i] < ymax);
+                        }
+                    }
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        int c = cb + i;
+                        double pw = args->affine ? 1.0 : m[6]*c + m[7]*r + m[8];
+                        double px = -lim, py = -lim;
+                        // points behind the plane of the view are outside of everything
+                        if (pw > 1e-12) {
+                            px = (m[0]*c + m[1]*r + m[2])/pw;
+                            py = (m[3]*c + m[4]*r + m[5])/pw;
+                        }
+                        px = (px < -lim) ? -lim : ((px > lim) ? lim : px);
+                        py = (py < -lim) ? -lim : ((py > lim) ? lim : py);
+                        xs[i] = (int)lround(px*one);
+                        ys[i] = (int)lround(py*one);
+                        inside &= (xs[i] >= 0) & (xs[i] < xmax) & (ys[i] >= 0) & (ys[i] < ymax);
+                    }
+                }
+
+                BYTE* out = &dest->mat[r][cb].cpx.r;
+                if (inside) {
+                    _warp_row(out, src->mat, xs, ys, n, args->nchan);
+                    continue;
+                }
+
+                // rows of a tile crossing the edges go pixel by pixel
+                for (int i = 0; i < n; i++) {
+                    if (xs[i] >= 0 && xs[i] < xmax && ys[i] >= 0 && ys[i] < ymax) {
+                        _warp_row(out + 3*i, src->mat, &xs[i], &ys[i], 1, args->nchan);
+                    } else {
+                        _warp_px(out + 3*i, src, xs[i], ys[i], args->nchan, args->mode, &args->border);
+                    }
+                }
+            }
+        }
+    }
+}
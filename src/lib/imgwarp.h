@@ -0,0 +1,54 @@
+#ifndef IMAGE_WARP_H
+#define IMAGE_WARP_H
+#include "imgio.h"
+
+// coordinates of `warp_img()` are fixed point with WARP_FRAC_BITS bits after the point, so images must be smaller than WARP_MAX_SIZE
+#define WARP_FRAC_BITS 16
+#define WARP_MAX_SIZE 32767
+
+// side of the tiles `warp_img()` goes through the destination by: the source pixels a tile reads stay close together
+// even when rows of the destination cut across the source at an angle, and each row of a tile starts from an exact coordinate
+#define WARP_TILE 64
+
+
+/**
+ * @brief Warps an image with an affine or perspective transform, sampling the source bilinearly. Each destination pixel (c,r)
+ * @brief reads the source at (x/w, y/w) where (x, y, w) = m * (c, r, 1), so `m` maps the destination onto the source (the inverse
+ * @brief of the transform to apply). When the last row of `m` is (0, 0, 1), coordinates are stepped in fixed point along each row
+ *
+ * @param destimg image to write to, of any size below WARP_MAX_SIZE
+ * @param srcimg image to warp (gray or RGB), smaller than WARP_MAX_SIZE
+ * @param m 3x3 matrix, row major
+ * @param mode what is read around the source: BORDER_REPLICATE, BORDER_REFLECT, BORDER_CONSTANT (`border`), or BORDER_EXCLUDED
+ * @param      where destination pixels that fall outside the source are left as they are
+ * @param border value read outside the source with BORDER_CONSTANT
+ *
+ * @returns `int` `0` if success. `-1` if `mode` isn't a border mode. `-2` if an image is WARP_MAX_SIZE or more along a side.
+ * @returns `-3` if allocation failed
+ */
+int warp_img(IMAGE* destimg, IMAGE* srcimg, const double m[9], BORDERMODE mode, PIXEL border);
+
+
+///////////////////////////////////////
+// PRIVATE FUNCTIONS
+///////////////////////////////////////
+
+/**
+ * @brief bilinear samples of `n` source points all at least one pixel away from the right and bottom edges, from their fixed point coordinates.
+ * @brief Runs `KERNELS.warp` when there is one
+ */
+void _warp_row(BYTE* dest, PIXEL** rows, const int* xs, const int* ys, int n, int nchan);
+
+/**
+ * @brief bilinear sample of a single source point anywhere, reading around the source as `mode` says
+ *
+ * @return int `0` if `dest` was written, `-1` if the point is outside the source with BORDER_EXCLUDED
+ */
+int _warp_px(BYTE* dest, IMAGE* src, int x, int y, int nchan, BORDERMODE mode, PIXEL* border);
+
+/**
+ * @brief tile of `warp_img()`, over rows of the destination
+ */
+void _warp_tile(void* arg, int r1, int r2);
+
+#endif
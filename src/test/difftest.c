@@ -0,0 +1,1603 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "imgio.h"
+#include "imgops.h"
+#include "imggraph.h"
+#include "imgscale.h"
+#include "imgwarp.h"
+
+// defaults, overridable from the command line
+#define DIFF_DEFAULT_CASES 100
+#define DIFF_DEFAULT_SEED 12345
+
+// every `DIFF_BIG_EVERY`th case is big enough for the ops to be split into tiles
+#define DIFF_BIG_EVERY 10
+#define DIFF_MAX_RADIUS 4
+
+enum _diff_content_enum {
+    CONTENT_RANDOM = 0,
+    CONTENT_FLAT,
+    CONTENT_BINARY,
+    // mostly 255 with a few 0s, so erosions don't just end up all black
+    CONTENT_SPARSE,
+    _CONTENTEND
+};
+typedef enum _diff_content_enum DIFFCONTENT;
+
+static char* _content_names[] = {"random", "flat", "binary", "sparse"};
+
+/**
+ * @brief a randomized case every check is run on
+ */
+struct _diff_case_type_struct {
+    unsigned int width;
+    unsigned int height;
+    int radius;
+    DIFFCONTENT content;
+    unsigned int seed;
+};
+typedef struct _diff_case_type_struct DIFFCASE;
+
+/**
+ * @brief an optimized path checked against a reference oracle (the plain per pixel implementation)
+ *
+ * @member check: runs both on `src` and compares them. Returns `0` if they match, `-1` after printing the first mismatch
+ */
+struct _diff_check_type_struct {
+    char* name;
+    IMGTYPE type;
+    int (*check)(IMAGE* src, DIFFCASE* dc);
+};
+typedef struct _diff_check_type_struct DIFFCHECK;
+
+
+// xorshift32, so a seed gives the same cases everywhere
+static unsigned int _next_rand(unsigned int* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static void _fill_image(IMAGE* img, DIFFCONTENT content, unsigned int seed) {
+
+    unsigned int x = seed ? seed : 1;
+
+    for (int r = 0; r < img->height; r++) {
+        BYTE* row = &img->mat[r][0].cpx.r;
+        for (int i = 0; i < img->width*3; i++) {
+            unsigned int v = _next_rand(&x);
+
+            if (content == CONTENT_RANDOM) row[i] = v >> 24;
+            else if (content == CONTENT_FLAT) row[i] = 77;
+            else if (content == CONTENT_BINARY) row[i] = (v >> 31) ? 255 : 0;
+            else row[i] = (v >> 24) < 8 ? 0 : 255;
+        }
+    }
+}
+
+static int _new_image(IMAGE* img, IMAGE* like) {
+
+    *img = *like;
+    img->mat = pxalloc(like->width, like->height);
+    if (img->mat == NULL) {
+        printf("Error allocating a %ux%u image\n", like->width, like->height);
+        return -1;
+    }
+
+    // so channels an op doesn't write compare equal
+    memset(img->mat[0], 0, sizeof(PIXEL)*like->width*like->height);
+    return 0;
+}
+
+/**
+ * @brief compares the first `nchan` channels of two images, printing the first mismatching pixel
+ *
+ * @return int `0` if they match, else `-1`
+ */
+static int _compare(char* name, IMAGE* got, IMAGE* expected, int nchan, DIFFCASE* dc) {
+
+    if (got->width != expected->width || got->height != expected->height) {
+        printf("%s: got a %ux%u image, expected %ux%u\n", name, got->width, got->height, expected->width, expected->height);
+        return -1;
+    }
+
+    for (int r = 0; r < expected->height; r++) {
+        for (int c = 0; c < expected->width; c++) {
+            BYTE* g = &got->mat[r][c].cpx.r;
+            BYTE* e = &expected->mat[r][c].cpx.r;
+
+            for (int ch = 0; ch < nchan; ch++) {
+                if (g[ch] != e[ch]) {
+                    printf("%s: first mismatch at (r=%d, c=%d, chan %d): got %d, expected %d [%ux%u, radius %d, %s content, seed %u]\n",
+                        name, r, c, ch, g[ch], e[ch], dc->width, dc->height, dc->radius, _content_names[dc->content], dc->seed);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+///////////////////////////////////////
+// REFERENCE ORACLES
+///////////////////////////////////////
+
+static void _oracle_blur(int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int), IMAGE* dest, IMAGE* src, int range) {
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            blur_func(dest, src, r, c, range);
+        }
+    }
+}
+
+static void _oracle_morpho(int (*morpho_px)(int, int, IMAGE*, IMAGE*, unsigned int), IMAGE* dest, IMAGE* src, int radius) {
+    // `erode_px()` and `dilate_px()` spread over a copy of the source
+    copy_pxmat(dest->mat, src->mat, src->width, src->height);
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            morpho_px(r, c, dest, src, radius);
+        }
+    }
+}
+
+static void _oracle_grad(IMAGE* dest, IMAGE* src) {
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            dest->mat[r][c].gpx.v = grad_gpx(r, c, src);
+        }
+    }
+}
+
+static void _oracle_convert(IMAGE* dest, IMAGE* src, CONVTYPE conv) {
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            convert_channel_px(&dest->mat[r][c], &src->mat[r][c], conv);
+        }
+    }
+}
+
+static void _oracle_thresh(IMAGE* img, int thresh) {
+    for (int r = 0; r < img->height; r++) {
+        for (int c = 0; c < img->width; c++) {
+            img->mat[r][c].gpx.v = (thresh < img->mat[r][c].gpx.v) ? 255 : 0;
+        }
+    }
+}
+
+
+static void _oracle_add(IMAGE* img, int chan, int k) {
+    for (int r = 0; r < img->height; r++) {
+        for (int c = 0; c < img->width; c++) {
+            BYTE* px = &img->mat[r][c].cpx.r;
+            int v = px[chan] + k;
+            px[chan] = (v > 255) ? 255 : ((v < 0) ? 0 : v);
+        }
+    }
+}
+
+///////////////////////////////////////
+// CHECKS
+///////////////////////////////////////
+
+static int _check_blur(IMAGE* src, DIFFCASE* dc, char* name, int (*blur_func)(IMAGE*, IMAGE*, int, int, unsigned int), int nchan) {
+
+    IMAGE got, expected;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0) return -1;
+
+    _oracle_blur(blur_func, &expected, src, dc->radius);
+    apply_blur2img(blur_func, &got, src, dc->radius);
+
+    int res = _compare(name, &got, &expected, nchan, dc);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+static int _check_blur_gsquare(IMAGE* src, DIFFCASE* dc) {
+    return _check_blur(src, dc, "apply_blur2img(blur_gpx_square)", blur_gpx_square, 1);
+}
+
+static int _check_blur_gcross(IMAGE* src, DIFFCASE* dc) {
+    return _check_blur(src, dc, "apply_blur2img(blur_gpx_cross)", blur_gpx_cross, 1);
+}
+
+static int _check_blur_rgbsquare(IMAGE* src, DIFFCASE* dc) {
+    return _check_blur(src, dc, "apply_blur2img(blur_rgbpx_square)", blur_rgbpx_square, 3);
+}
+
+static int _check_blur_rgbcross(IMAGE* src, DIFFCASE* dc) {
+    return _check_blur(src, dc, "apply_blur2img(blur_rgbpx_cross)", blur_rgbpx_cross, 3);
+}
+
+static int _check_morpho(IMAGE* src, DIFFCASE* dc, int erode) {
+
+    IMAGE got, expected;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0) return -1;
+
+    _oracle_morpho(erode ? erode_px : dilate_px, &expected, src, dc->radius);
+    if (erode) erode_img(&got, src, dc->radius);
+    else dilate_img(&got, src, dc->radius);
+
+    int res = _compare(erode ? "erode_img" : "dilate_img", &got, &expected, 1, dc);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+static int _check_erode(IMAGE* src, DIFFCASE* dc) { return _check_morpho(src, dc, 1); }
+static int _check_dilate(IMAGE* src, DIFFCASE* dc) { return _check_morpho(src, dc, 0); }
+
+static int _check_grad(IMAGE* src, DIFFCASE* dc) {
+
+    IMAGE got, expected;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0) return -1;
+
+    _oracle_grad(&expected, src);
+    grad_gimg(&got, src);
+
+    int res = _compare("grad_gimg", &got, &expected, 1, dc);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+static int _check_convert(IMAGE* src, DIFFCASE* dc) {
+
+    CONVTYPE convs[] = {GRAY2RGB, RED2RGB, GREEN2RGB, BLUE2RGB, RGB2GRAY, RGB2YUV, RGB2YCBCR, YUV2RGB, YCBCR2RGB};
+    char name[64];
+
+    IMAGE got, expected;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0) return -1;
+
+    int res = 0;
+    for (int i = 0; i < sizeof(convs)/sizeof(CONVTYPE) && res == 0; i++) {
+        _oracle_convert(&expected, src, convs[i]);
+        convert_channel_img(&got, src, convs[i]);
+
+        snprintf(name, sizeof(name), "convert_channel_img(%d)", convs[i]);
+        res = _compare(name, &got, &expected, 3, dc);
+    }
+
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+// point ops and histograms, which go through the kernels picked by `kernels()` (see IMG_SIMD).
+// Gray ops must leave the other two bytes of each pixel alone, so all 3 channels are compared
+static int _check_point(IMAGE* src, DIFFCASE* dc) {
+
+    IMAGE got, expected;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0) return -1;
+
+    int t1 = dc->seed % 256;
+    int t2 = t1 + (dc->seed >> 8) % (257 - t1);
+    int k = (int)((dc->seed >> 16) % 601) - 300;
+    int res = 0;
+
+    for (int op = 0; op < 5 && res == 0; op++) {
+        copy_pxmat(got.mat, src->mat, src->width, src->height);
+        copy_pxmat(expected.mat, src->mat, src->width, src->height);
+
+        for (int r = 0; r < src->height; r++) {
+            for (int c = 0; c < src->width; c++) {
+                BYTE* px = &expected.mat[r][c].cpx.r;
+                int v = px[0] + k;
+                if (op == 0) px[0] = (t1 < px[0]) ? 255 : 0;
+                else if (op == 1) px[0] = (px[0] < t1) ? 0 : ((px[0] >= t2) ? 255 : 128);
+                else if (op == 2) px[0] = 255 - px[0];
+                else if (op == 3) px[0] = (v > 255) ? 255 : ((v < 0) ? 0 : v);
+                else for (int ch = 0; ch < 3; ch++) px[ch] = (px[ch] < t1 + ch) ? 10 : 200;
+            }
+        }
+
+        if (op == 0) bin_gthresh_img(&got, t1, 0, 255);
+        else if (op == 1) tri_gthresh_img(&got, t1, t2);
+        else if (op == 2) invert_gimg(&got);
+        else if (op == 3) add_gimg(&got, k);
+        else bin_rgbthresh_img(&got, t1, t1 + 1, t1 + 2, 10, 200);
+
+        char* names[] = {"bin_gthresh_img", "tri_gthresh_img", "invert_gimg", "add_gimg", "bin_rgbthresh_img"};
+        res = _compare(names[op], &got, &expected, 3, dc);
+    }
+
+    int hist[256], expected_hist[256] = {0};
+    int rgbhist[256][3], expected_rgbhist[256][3] = {{0}};
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            expected_hist[src->mat[r][c].gpx.v]++;
+            expected_rgbhist[src->mat[r][c].cpx.r][0]++;
+            expected_rgbhist[src->mat[r][c].cpx.g][1]++;
+            expected_rgbhist[src->mat[r][c].cpx.b][2]++;
+        }
+    }
+    histogram_gimg(src, hist);
+    histogram_rgbimg(src, rgbhist);
+
+    if (res == 0 && (memcmp(hist, expected_hist, sizeof(hist)) != 0 || memcmp(rgbhist, expected_rgbhist, sizeof(rgbhist)) != 0)) {
+        printf("histogram: mismatch [%ux%u, %s content, seed %u]\n", dc->width, dc->height, _content_names[dc->content], dc->seed);
+        res = -1;
+    }
+
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+// every profile of a set against `profile_gimg()` on its own, with duplicate indices and PROFILE_ALL
+static int _check_profiles(IMAGE* src, DIFFCASE* dc) {
+
+    int rows[8], cols[8];
+    unsigned int x = dc->seed;
+    for (int i = 0; i < 8; i++) {
+        rows[i] = _next_rand(&x) % src->height;
+        cols[i] = _next_rand(&x) % src->width;
+    }
+
+    int res = 0;
+    for (int mode = 0; mode < 2 && res == 0; mode++) {
+        PROFILESET set;
+        if (profile_set_init(&set, src, rows, mode ? PROFILE_ALL : 8, cols, mode ? 5 : PROFILE_ALL) != 0) {
+            printf("profile_set_init: failed\n");
+            return -1;
+        }
+        profiles_gimg(src, &set);
+
+        int expected[256];
+        for (int i = 0; i < set.nrows + set.ncols && res == 0; i++) {
+            int is_row = i < set.nrows;
+            int index = is_row ? set.rows[i] : set.cols[i - set.nrows];
+            int* got = is_row ? &set.row_profiles[256*i] : &set.col_profiles[256*(i - set.nrows)];
+
+            profile_gimg(src, is_row, index, expected);
+            if (memcmp(got, expected, sizeof(expected)) != 0) {
+                printf("profiles_gimg: %s %d differs [%ux%u, %s content, seed %u]\n", is_row ? "row" : "column", index, dc->width, dc->height, _content_names[dc->content], dc->seed);
+                res = -1;
+            }
+        }
+
+        free_profile_set(&set);
+    }
+
+    // and out of bounds indices are refused
+    PROFILESET set;
+    int bad = src->width;
+    if (res == 0 && profile_set_init(&set, src, NULL, 0, &bad, 1) != -1) {
+        printf("profile_set_init: accepted column %d of a %ux%u image\n", bad, dc->width, dc->height);
+        res = -1;
+    }
+
+    return res;
+}
+
+// oracle of `geom_img()`, pixel by pixel from the definition of each transform
+static void _geom_naive(IMAGE* dest, IMAGE* src, GEOMTYPE geom) {
+
+    for (int r = 0; r < dest->height; r++) {
+        for (int c = 0; c < dest->width; c++) {
+            int sr = r, sc = c;
+            switch (geom) {
+                case TRANSPOSE: sr = c; sc = r; break;
+                case ROT90: sr = src->height-1-c; sc = r; break;
+                case ROT180: sr = src->height-1-r; sc = src->width-1-c; break;
+                case ROT270: sr = c; sc = src->width-1-r; break;
+                case FLIP_H: sc = src->width-1-c; break;
+                case FLIP_V: sr = src->height-1-r; break;
+                default: break;
+            }
+            dest->mat[r][c] = src->mat[sr][sc];
+        }
+    }
+}
+
+static int _check_geom(IMAGE* src, DIFFCASE* dc) {
+
+    char* names[] = {"TRANSPOSE", "ROT90", "ROT180", "ROT270", "FLIP_H", "FLIP_V"};
+    char name[64];
+
+    // a square window too, so the quarter turns get done in place
+    int n = (src->width < src->height) ? src->width : src->height;
+    IMAGE window, square;
+    if (view_img(&window, src, 0, 0, n, n) != 0) return -1;
+    copy_img(&square, &window);
+    free_img_pxmat(&window);
+
+    int res = 0;
+    for (int geom = 0; geom < _GEOMEND && res == 0; geom++) {
+        int swapped = (geom == TRANSPOSE || geom == ROT90 || geom == ROT270);
+
+        for (int sq = 0; sq < 2 && res == 0; sq++) {
+            IMAGE* in = sq ? &square : src;
+            IMAGE shape = *in;
+            if (swapped) {
+                shape.width = in->height;
+                shape.height = in->width;
+            }
+
+            IMAGE got, expected, inplace;
+            if (_new_image(&got, &shape) != 0 || _new_image(&expected, &shape) != 0) return -1;
+            _geom_naive(&expected, in, geom);
+
+            snprintf(name, sizeof(name), "geom_img(%s)", names[geom]);
+            if (geom_img(&got, in, geom) != 0) {
+                printf("%s: failed [%ux%u, seed %u]\n", name, in->width, in->height, dc->seed);
+                res = -1;
+            }
+            if (res == 0) res = _compare(name, &got, &expected, 3, dc);
+
+            // in place, refused only for the quarter turns of non square images
+            copy_img(&inplace, in);
+            int ret = geom_img(&inplace, &inplace, geom);
+            snprintf(name, sizeof(name), "geom_img(%s, in place)", names[geom]);
+            if (swapped && in->width != in->height) {
+                if (res == 0 && ret != -3) {
+                    printf("%s: returned %d on a %ux%u image, expected -3\n", name, ret, in->width, in->height);
+                    res = -1;
+                }
+            } else if (res == 0) {
+                res = (ret == 0) ? _compare(name, &inplace, &expected, 3, dc) : -1;
+            }
+
+            // gray images only have their gray value moved
+            if (res == 0) {
+                memset(got.mat[0], 0, sizeof(PIXEL)*shape.width*shape.height);
+                IMAGE gray = *in;
+                gray.img_type = PGM;
+                got.img_type = PGM;
+                geom_img(&got, &gray, geom);
+                snprintf(name, sizeof(name), "geom_img(%s, gray)", names[geom]);
+                res = _compare(name, &got, &expected, 1, dc);
+                for (int r = 0; r < got.height && res == 0; r++) {
+                    for (int c = 0; c < got.width && res == 0; c++) {
+                        if (got.mat[r][c].cpx.g != 0 || got.mat[r][c].cpx.b != 0) {
+                            printf("%s: wrote past the gray value of (r=%d, c=%d) [seed %u]\n", name, r, c, dc->seed);
+                            res = -1;
+                        }
+                    }
+                }
+            }
+
+            free_img_pxmat(&got);
+            free_img_pxmat(&expected);
+            free_img_pxmat(&inplace);
+        }
+    }
+
+    free_img_pxmat(&square);
+    return res;
+}
+
+// oracle of `resample_img()`: the same fixed point sums, computed pixel by pixel
+static void _resample_naive(IMAGE* dest, IMAGE* src, RSWEIGHTS* wx, RSWEIGHTS* wy, int nchan) {
+
+    const int rowshift = RESAMPLE_BITS - RESAMPLE_ROW_BITS;
+    const int shift = RESAMPLE_BITS + RESAMPLE_ROW_BITS;
+
+    for (int r = 0; r < dest->height; r++) {
+        for (int c = 0; c < dest->width; c++) {
+            for (int ch = 0; ch < nchan; ch++) {
+                int s = 0;
+                for (int i = 0; i < wx->count[c]; i++) {
+                    int sc = wx->start[c] + i;
+                    int v = 0;
+                    for (int j = 0; j < wy->count[r]; j++) {
+                        v += wy->w[r*wy->taps + j]*(&src->mat[wy->start[r] + j][sc].cpx.r)[ch];
+                    }
+                    s += wx->w[c*wx->taps + i]*((v + (1 << (rowshift - 1))) >> rowshift);
+                }
+                s = (s + (1 << (shift - 1))) >> shift;
+                (&dest->mat[r][c].cpx.r)[ch] = (s > 255) ? 255 : ((s < 0) ? 0 : s);
+            }
+        }
+    }
+}
+
+// oracle of `downscale_img()`
+static void _downscale_naive(IMAGE* dest, IMAGE* src, int factor, int nchan) {
+
+    for (int r = 0; r < dest->height; r++) {
+        for (int c = 0; c < dest->width; c++) {
+            for (int ch = 0; ch < nchan; ch++) {
+                int s = 0, n = 0;
+                for (int sr = r*factor; sr < (r + 1)*factor && sr < src->height; sr++) {
+                    for (int sc = c*factor; sc < (c + 1)*factor && sc < src->width; sc++) {
+                        s += (&src->mat[sr][sc].cpx.r)[ch];
+                        n++;
+                    }
+                }
+                (&dest->mat[r][c].cpx.r)[ch] = (2*s + n)/(2*n);
+            }
+        }
+    }
+}
+
+static int _check_scale(IMAGE* src, DIFFCASE* dc) {
+
+    char name[64];
+    int res = 0;
+
+    for (int nchan = 3; nchan >= 1 && res == 0; nchan -= 2) {
+        IMAGE in = *src;
+        in.img_type = (nchan == 1) ? PGM : PPM;
+
+        // area downscales, by 2 and by a factor of the case (past the size of the image sometimes)
+        int factors[2] = {2, 1 + dc->seed % 9};
+        for (int i = 0; i < 2 && res == 0; i++) {
+            IMAGE shape = in, got, expected;
+            shape.width = downscaled_size(in.width, factors[i]);
+            shape.height = downscaled_size(in.height, factors[i]);
+            if (_new_image(&got, &shape) != 0 || _new_image(&expected, &shape) != 0) return -1;
+
+            snprintf(name, sizeof(name), "downscale_img(%d, %d chan)", factors[i], nchan);
+            _downscale_naive(&expected, &in, factors[i], nchan);
+            res = (downscale_img(&got, &in, factors[i]) == 0) ? _compare(name, &got, &expected, nchan, dc) : -1;
+
+            free_img_pxmat(&got);
+            free_img_pxmat(&expected);
+        }
+
+        // resamples to a size of the case, up or down along each axis
+        for (int filter = 0; filter < _RESAMPLEEND && res == 0; filter++) {
+            IMAGE shape = in, got, expected;
+            shape.width = 1 + (dc->seed >> 4) % (2*in.width);
+            shape.height = 1 + (dc->seed >> 12) % (2*in.height);
+            if (_new_image(&got, &shape) != 0 || _new_image(&expected, &shape) != 0) return -1;
+
+            RSWEIGHTS wx, wy;
+            if (resample_weights_init(&wx, in.width, shape.width, filter) != 0 || resample_weights_init(&wy, in.height, shape.height, filter) != 0) {
+                printf("resample_weights_init: failed\n");
+                return -1;
+            }
+            for (int c = 0; c < wx.n && res == 0; c++) {
+                int sum = 0;
+                for (int k = 0; k < wx.count[c]; k++) sum += wx.w[c*wx.taps + k];
+                if (sum != 1 << RESAMPLE_BITS) {
+                    printf("resample_weights_init: weights of pixel %d sum to %d [%d to %d, filter %d]\n", c, sum, in.width, shape.width, filter);
+                    res = -1;
+                }
+            }
+
+            snprintf(name, sizeof(name), "resample_img(%s, %d chan)", filter == BILINEAR ? "BILINEAR" : "LANCZOS3", nchan);
+            _resample_naive(&expected, &in, &wx, &wy, nchan);
+            if (res == 0) {
+                res = (resample_img(&got, &in, filter) == 0) ? _compare(name, &got, &expected, nchan, dc) : -1;
+            }
+
+            free_resample_weights(&wx);
+            free_resample_weights(&wy);
+            free_img_pxmat(&got);
+            free_img_pxmat(&expected);
+        }
+
+        // resampling to the same size gives the image back
+        if (res == 0) {
+            IMAGE got;
+            if (_new_image(&got, &in) != 0) return -1;
+            snprintf(name, sizeof(name), "resample_img(same size, %d chan)", nchan);
+            res = (resample_img(&got, &in, LANCZOS3) == 0) ? _compare(name, &got, &in, nchan, dc) : -1;
+            free_img_pxmat(&got);
+        }
+
+        // each level of a pyramid is the 2x downscale of the one before
+        PYRAMID pyr = {0};
+        if (res == 0 && pyramid_build(&pyr, &in, 4) != 0) {
+            printf("pyramid_build: failed\n");
+            return -1;
+        }
+        for (int level = 0; level < pyr.nlevels && res == 0; level++) {
+            IMAGE* prev = (level == 0) ? &in : &pyr.levels[level - 1];
+            IMAGE expected;
+            if (_new_image(&expected, &pyr.levels[level]) != 0) return -1;
+            _downscale_naive(&expected, prev, 2, nchan);
+            snprintf(name, sizeof(name), "pyramid_build(level %d, %d chan)", level, nchan);
+            res = _compare(name, &pyr.levels[level], &expected, nchan, dc);
+            free_img_pxmat(&expected);
+        }
+
+        // and streamed from a file, the same levels
+        char path[64];
+        snprintf(path, sizeof(path), "difftest_%d_pyr.pnm", (int)getpid());
+        ROWREADER reader;
+        PYRAMID streamed = {0};
+        if (res == 0 && (save_pnm_image(path, &in, in.img_type) != 0 || open_row_reader(path, &reader, in.img_type) != 0)) {
+            printf("Error writing %s\n", path);
+            res = -1;
+        } else if (res == 0) {
+            if (stream_pyramid(&reader, &streamed, 4) != 0 || streamed.nlevels != pyr.nlevels) {
+                printf("stream_pyramid: failed\n");
+                res = -1;
+            }
+            close_row_reader(&reader);
+            for (int level = 0; level < streamed.nlevels && res == 0; level++) {
+                snprintf(name, sizeof(name), "stream_pyramid(level %d, %d chan)", level, nchan);
+                res = _compare(name, &streamed.levels[level], &pyr.levels[level], nchan, dc);
+            }
+        }
+
+        // reading the file downscaled gives the same as downscaling it once read
+        for (int factor = 2; factor <= 8 && res == 0; factor *= 2) {
+            IMAGE got = {0}, expected, shape = in;
+            shape.width = downscaled_size(in.width, factor);
+            shape.height = downscaled_size(in.height, factor);
+            if (_new_image(&expected, &shape) != 0) return -1;
+            downscale_img(&expected, &in, factor);
+
+            snprintf(name, sizeof(name), "load_pnm_scaled(%d, %d chan)", factor, nchan);
+            if (load_pnm_scaled(path, &got, in.img_type, factor) != 0) {
+                printf("%s: failed\n", name);
+                res = -1;
+            } else {
+                res = _compare(name, &got, &expected, nchan, dc);
+            }
+
+            if (got.mat != NULL) free_img_pxmat(&got);
+            free_img_pxmat(&expected);
+        }
+        unlink(path);
+
+        free_pyramid(&streamed);
+        free_pyramid(&pyr);
+    }
+
+    return res;
+}
+
+// oracle of `warp_img()`: coordinates computed exactly for every pixel, then the same 8 bit bilinear weights
+static void _warp_naive(IMAGE* dest, IMAGE* src, double m[9], BORDERMODE mode, PIXEL border, int nchan) {
+
+    const double lim = WARP_MAX_SIZE;
+    int w = src->width, h = src->height;
+
+    for (int r = 0; r < dest->height; r++) {
+        for (int c = 0; c < dest->width; c++) {
+            double pw = m[6]*c + m[7]*r + m[8];
+            double px = -lim, py = -lim;
+            if (pw > 1e-12) {
+                px = (m[0]*c + m[1]*r + m[2])/pw;
+                py = (m[3]*c + m[4]*r + m[5])/pw;
+            }
+            px = fmin(fmax(px, -lim), lim);
+            py = fmin(fmax(py, -lim), lim);
+            int x = (int)lround(px*65536), y = (int)lround(py*65536);
+
+            if (mode == BORDER_EXCLUDED && (x < 0 || y < 0 || x > (w - 1)*65536 || y > (h - 1)*65536)) {
+                continue;
+            }
+
+            int ix = x >> 16, iy = y >> 16, fx = (x >> 8) & 255, fy = (y >> 8) & 255;
+            int v[4][3];
+            for (int k = 0; k < 4; k++) {
+                int tx = ix + k % 2, ty = iy + k / 2;
+                PIXEL* px = &border;
+                if (tx >= 0 && tx < w && ty >= 0 && ty < h) {
+                    px = &src->mat[ty][tx];
+                } else if (mode == BORDER_REPLICATE || mode == BORDER_EXCLUDED) {
+                    px = &src->mat[ty < 0 ? 0 : (ty >= h ? h - 1 : ty)][tx < 0 ? 0 : (tx >= w ? w - 1 : tx)];
+                } else if (mode == BORDER_REFLECT) {
+                    while (tx < 0 || tx >= w) tx = (w == 1) ? 0 : ((tx < 0) ? -tx : 2*(w - 1) - tx);
+                    while (ty < 0 || ty >= h) ty = (h == 1) ? 0 : ((ty < 0) ? -ty : 2*(h - 1) - ty);
+                    px = &src->mat[ty][tx];
+                }
+                BYTE* chans = (BYTE*)px;
+                for (int ch = 0; ch < 3; ch++) v[k][ch] = chans[ch];
+            }
+
+            BYTE* dchans = (BYTE*)&dest->mat[r][c];
+            for (int ch = 0; ch < nchan; ch++) {
+                int top = v[0][ch]*(256 - fx) + v[1][ch]*fx;
+                int bottom = v[2][ch]*(256 - fx) + v[3][ch]*fx;
+                dchans[ch] = (top*(256 - fy) + bottom*fy + 32768) >> 16;
+            }
+        }
+    }
+}
+
+static int _check_warp(IMAGE* src, DIFFCASE* dc) {
+
+    char* modes[] = {"EXCLUDED", "REPLICATE", "REFLECT", "CONSTANT"};
+    char name[64];
+    unsigned int x = dc->seed;
+    int res = 0;
+
+    for (int kind = 0; kind < 3 && res == 0; kind++) {
+        // an integer translation, a rotation with a scale, and a perspective
+        double angle = (_next_rand(&x) % 360)*M_PI/180.0;
+        double scale = 0.5 + (_next_rand(&x) % 100)/50.0;
+        double cx = src->width/2.0, cy = src->height/2.0;
+        double m[9] = {1, 0, (int)(_next_rand(&x) % 7) - 3, 0, 1, (int)(_next_rand(&x) % 7) - 3, 0, 0, 1};
+        if (kind >= 1) {
+            double a = cos(angle)*scale, b = sin(angle)*scale;
+            double rot[9] = {a, -b, cx - a*cx + b*cy, b, a, cy - b*cx - a*cy, 0, 0, 1};
+            memcpy(m, rot, sizeof(m));
+        }
+        if (kind == 2) {
+            m[6] = ((int)(_next_rand(&x) % 21) - 10)*1e-3;
+            m[7] = ((int)(_next_rand(&x) % 21) - 10)*1e-3;
+        }
+
+        BORDERMODE mode = _next_rand(&x) % 4;
+        PIXEL border;
+        set_rgbpixel(&border.cpx, _next_rand(&x) % 256, _next_rand(&x) % 256, _next_rand(&x) % 256);
+
+        for (int nchan = 3; nchan >= 1 && res == 0; nchan -= 2) {
+            IMAGE in = *src, shape = *src, got, expected;
+            in.img_type = (nchan == 1) ? PGM : PPM;
+            shape.width = 1 + (_next_rand(&x) % (2*src->width));
+            shape.height = 1 + (_next_rand(&x) % (2*src->height));
+            if (_new_image(&got, &shape) != 0 || _new_image(&expected, &shape) != 0) return -1;
+
+            _warp_naive(&expected, &in, m, mode, border, nchan);
+            snprintf(name, sizeof(name), "warp_img(%s, %s, %d chan)", kind == 0 ? "translation" : (kind == 1 ? "affine" : "perspective"), modes[mode], nchan);
+            if (warp_img(&got, &in, m, mode, border) != 0) {
+                printf("%s: failed\n", name);
+                res = -1;
+            }
+
+            // affine rows are stepped in fixed point, which can land a coordinate on the other side of a 1/256 of a pixel
+            int tolerance = (kind == 1) ? 1 : 0;
+            for (int r = 0; r < shape.height && res == 0; r++) {
+                for (int c = 0; c < shape.width && res == 0; c++) {
+                    for (int ch = 0; ch < nchan; ch++) {
+                        int d = (&got.mat[r][c].cpx.r)[ch] - (&expected.mat[r][c].cpx.r)[ch];
+                        if (d > tolerance || d < -tolerance) {
+                            printf("%s: first mismatch at (r=%d, c=%d, chan %d): got %d, expected %d [%ux%u to %ux%u, seed %u]\n", name, r, c, ch,
+                                (&got.mat[r][c].cpx.r)[ch], (&expected.mat[r][c].cpx.r)[ch], dc->width, dc->height, shape.width, shape.height, dc->seed);
+                            res = -1;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            free_img_pxmat(&got);
+            free_img_pxmat(&expected);
+        }
+    }
+
+    return res;
+}
+
+// streamed ops go through files, which are written next to wherever the test runs
+static int _check_stream(IMAGE* src, DIFFCASE* dc) {
+
+    char inpath[64], outpath[64];
+    snprintf(inpath, sizeof(inpath), "difftest_%d_in.pgm", (int)getpid());
+    snprintf(outpath, sizeof(outpath), "difftest_%d_out.pgm", (int)getpid());
+
+    IMAGE got = {0}, expected;
+    if (_new_image(&expected, src) != 0) return -1;
+    if (save_pnm_image(inpath, src, PGM) != 0) {
+        printf("Error writing %s\n", inpath);
+        return -1;
+    }
+
+    char* names[] = {"stream_blur(blur_gpx_square)", "stream_grad", "stream_erode", "stream_dilate", "stream_blur(blur_gpx_cross)"};
+    int res = 0;
+
+    for (int op = 0; op < 5 && res == 0; op++) {
+        ROWREADER reader;
+        ROWWRITER writer;
+        if (open_row_reader(inpath, &reader, PGM) != 0 || open_row_writer(outpath, &writer, src->width, src->height, PGM) != 0) {
+            printf("Error opening the streamed files\n");
+            res = -1;
+            break;
+        }
+
+        int sres = 0;
+        switch (op) {
+            case 0:
+                _oracle_blur(blur_gpx_square, &expected, src, dc->radius);
+                sres = stream_blur(&blur_gpx_square, &reader, &writer, dc->radius);
+                break;
+            case 1:
+                _oracle_grad(&expected, src);
+                sres = stream_grad(&reader, &writer);
+                break;
+            case 2:
+                _oracle_morpho(erode_px, &expected, src, dc->radius);
+                sres = stream_erode(&reader, &writer, dc->radius);
+                break;
+            case 3:
+                _oracle_morpho(dilate_px, &expected, src, dc->radius);
+                sres = stream_dilate(&reader, &writer, dc->radius);
+                break;
+            case 4:
+                _oracle_blur(blur_gpx_cross, &expected, src, dc->radius);
+                sres = stream_blur(&blur_gpx_cross, &reader, &writer, dc->radius);
+                break;
+        }
+        close_row_reader(&reader);
+        if (close_row_writer(&writer) != 0 && sres == 0) sres = -2;
+
+        if (sres != 0 || load_pnm_image(outpath, &got, PGM) != 0) {
+            printf("%s: failed (%d) [%ux%u, radius %d, seed %u]\n", names[op], sres, dc->width, dc->height, dc->radius, dc->seed);
+            res = -1;
+            break;
+        }
+        res = _compare(names[op], &got, &expected, 1, dc);
+    }
+
+    remove(inpath);
+    remove(outpath);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+// the Y, Cb and Cr planes written by `stream_split_ycbcr()`, against the converted image with its chroma averaged by blocks,
+// then those planes merged back by `stream_merge_ycbcr()`
+static int _check_split(IMAGE* src, DIFFCASE* dc) {
+
+    char inpath[64], mergedpath[64], outpaths[3][64];
+    snprintf(inpath, sizeof(inpath), "difftest_%d_in.ppm", (int)getpid());
+    snprintf(mergedpath, sizeof(mergedpath), "difftest_%d_merged.ppm", (int)getpid());
+    for (int i = 0; i < 3; i++) {
+        snprintf(outpaths[i], sizeof(outpaths[i]), "difftest_%d_out%d.pgm", (int)getpid(), i);
+    }
+
+    IMAGE conv;
+    if (_new_image(&conv, src) != 0) return -1;
+    _oracle_convert(&conv, src, RGB2YCBCR);
+    if (save_pnm_image(inpath, src, PPM) != 0) {
+        printf("Error writing %s\n", inpath);
+        return -1;
+    }
+
+    char* names[] = {"stream_split_ycbcr(444)", "stream_split_ycbcr(422)", "stream_split_ycbcr(420)"};
+    IMAGE got = {0};
+    int res = 0;
+
+    for (int chroma = 0; chroma < _CHROMAEND && res == 0; chroma++) {
+        int cw, ch;
+        chroma_size(chroma, src->width, src->height, &cw, &ch);
+        int fx = (chroma == CHROMA_444) ? 1 : 2;
+        int fy = (chroma == CHROMA_420) ? 2 : 1;
+
+        ROWREADER reader;
+        ROWWRITER writers[3];
+        if (open_row_reader(inpath, &reader, PPM) != 0 || open_row_writer(outpaths[0], &writers[0], src->width, src->height, PGM) != 0
+            || open_row_writer(outpaths[1], &writers[1], cw, ch, PGM) != 0 || open_row_writer(outpaths[2], &writers[2], cw, ch, PGM) != 0) {
+            printf("Error opening the streamed files\n");
+            res = -1;
+            break;
+        }
+
+        int sres = stream_split_ycbcr(&reader, &writers[0], &writers[1], &writers[2], chroma);
+        close_row_reader(&reader);
+        for (int i = 0; i < 3; i++) {
+            if (close_row_writer(&writers[i]) != 0 && sres == 0) sres = -2;
+        }
+
+        for (int i = 0; i < 3 && res == 0; i++) {
+            if (sres != 0 || load_pnm_image(outpaths[i], &got, PGM) != 0) {
+                printf("%s: failed (%d) [%ux%u, seed %u]\n", names[chroma], sres, dc->width, dc->height, dc->seed);
+                res = -1;
+                break;
+            }
+
+            IMAGE shape = got, expected;
+            if (_new_image(&expected, &shape) != 0) return -1;
+            int bx = (i == 0) ? 1 : fx, by = (i == 0) ? 1 : fy;
+            for (int r = 0; r < expected.height; r++) {
+                for (int c = 0; c < expected.width; c++) {
+                    int s = 0, n = 0;
+                    for (int y = r*by; y < r*by + by && y < src->height; y++) {
+                        for (int x = c*bx; x < c*bx + bx && x < src->width; x++) {
+                            s += (&conv.mat[y][x].cpx.r)[i];
+                            n++;
+                        }
+                    }
+                    expected.mat[r][c].gpx.v = (2*s + n)/(2*n);
+                }
+            }
+
+            res = _compare(names[chroma], &got, &expected, 1, dc);
+            free_img_pxmat(&expected);
+        }
+
+        // merged back, every pixel gets the chroma of the block it is in
+        ROWREADER readers[3];
+        ROWWRITER writer;
+        for (int i = 0; i < 3 && res == 0; i++) {
+            if (open_row_reader(outpaths[i], &readers[i], PGM) != 0) {
+                printf("Error opening the streamed files\n");
+                res = -1;
+            }
+        }
+        if (res == 0 && open_row_writer(mergedpath, &writer, src->width, src->height, PPM) != 0) {
+            printf("Error opening the streamed files\n");
+            res = -1;
+        }
+        if (res != 0) break;
+
+        sres = stream_merge_ycbcr(&readers[0], &readers[1], &readers[2], &writer);
+        for (int i = 0; i < 3; i++) {
+            close_row_reader(&readers[i]);
+        }
+        if (close_row_writer(&writer) != 0 && sres == 0) sres = -2;
+
+        IMAGE planes[3] = {{0}, {0}, {0}}, merged, expected;
+        if (_new_image(&merged, src) != 0 || _new_image(&expected, src) != 0) return -1;
+        for (int i = 0; i < 3; i++) {
+            load_pnm_image(outpaths[i], &planes[i], PGM);
+        }
+        for (int r = 0; r < src->height; r++) {
+            for (int c = 0; c < src->width; c++) {
+                merged.mat[r][c].cpx.r = planes[0].mat[r][c].gpx.v;
+                merged.mat[r][c].cpx.g = planes[1].mat[r/fy][c/fx].gpx.v;
+                merged.mat[r][c].cpx.b = planes[2].mat[r/fy][c/fx].gpx.v;
+            }
+        }
+        _oracle_convert(&expected, &merged, YCBCR2RGB);
+
+        char* mnames[] = {"stream_merge_ycbcr(444)", "stream_merge_ycbcr(422)", "stream_merge_ycbcr(420)"};
+        if (sres != 0 || load_pnm_image(mergedpath, &got, PPM) != 0) {
+            printf("%s: failed (%d) [%ux%u, seed %u]\n", mnames[chroma], sres, dc->width, dc->height, dc->seed);
+            res = -1;
+        } else {
+            res = _compare(mnames[chroma], &got, &expected, 3, dc);
+        }
+
+        for (int i = 0; i < 3; i++) {
+            free_img_pxmat(&planes[i]);
+        }
+        free_img_pxmat(&merged);
+        free_img_pxmat(&expected);
+    }
+
+    remove(inpath);
+    remove(mergedpath);
+    for (int i = 0; i < 3; i++) {
+        remove(outpaths[i]);
+    }
+    free_img_pxmat(&got);
+    free_img_pxmat(&conv);
+    return res;
+}
+
+// a stream of frames of different types and sizes written one after the other, read back whole into the same buffer,
+// then read again skipping the rows of every other frame
+static int _check_frames(IMAGE* src, DIFFCASE* dc) {
+
+    char path[64];
+    snprintf(path, sizeof(path), "difftest_%d_frames.pnm", (int)getpid());
+
+    IMAGE frames[3];
+    IMGTYPE types[3] = {PPM, PGM, PPM};
+    frames[0] = *src;
+    frames[1] = *src;
+    if (view_img(&frames[2], src, dc->seed % src->height, (dc->seed >> 8) % src->width, 1 + (dc->seed >> 4) % (src->width - (dc->seed >> 8) % src->width),
+                 1 + (dc->seed >> 12) % (src->height - dc->seed % src->height)) != 0) {
+        printf("view_img: failed\n");
+        return -1;
+    }
+
+    ROWWRITER writer;
+    int res = open_frame_writer(path, &writer);
+    for (int i = 0; i < 3 && res == 0; i++) {
+        res = write_frame(&writer, &frames[i], types[i]);
+    }
+    if (close_row_writer(&writer) != 0 || res != 0) {
+        printf("Error writing %s\n", path);
+        free_img_pxmat(&frames[2]);
+        return -1;
+    }
+
+    IMAGE got = {0};
+    for (int pass = 0; pass < 2 && res == 0; pass++) {
+        ROWREADER reader;
+        if (open_frame_reader(path, &reader) != 0) {
+            printf("Error opening %s\n", path);
+            res = -1;
+            break;
+        }
+
+        for (int i = 0; i < 3 && res == 0; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "read_frame(%d)", i);
+
+            // on the second pass, every other frame only has its first row read
+            if (pass == 1 && i % 2 == 0) {
+                res = read_frame_header(&reader, 0);
+                if (res == 0 && (reader.width != frames[i].width || reader.height != frames[i].height || reader.img_type != types[i])) {
+                    printf("read_frame_header(%d): header doesn't match [%ux%u, seed %u]\n", i, dc->width, dc->height, dc->seed);
+                    res = -1;
+                }
+                if (res == 0) res = read_rows(&reader, got.mat, 1);
+                continue;
+            }
+
+            int fres = read_frame(&reader, &got, 0);
+            if (fres != 0 || got.img_type != types[i] || got.width != frames[i].width || got.height != frames[i].height) {
+                printf("%s: failed (%d) [%ux%u, seed %u]\n", name, fres, dc->width, dc->height, dc->seed);
+                res = -1;
+                break;
+            }
+            res = _compare(name, &got, &frames[i], (types[i] == PPM) ? 3 : 1, dc);
+        }
+
+        if (res == 0 && read_frame(&reader, &got, 0) != 1) {
+            printf("read_frame: expected the end of the stream [%ux%u, seed %u]\n", dc->width, dc->height, dc->seed);
+            res = -1;
+        }
+        close_row_reader(&reader);
+    }
+
+    remove(path);
+    free_img_pxmat(&got);
+    free_img_pxmat(&frames[2]);
+    return res;
+}
+
+// a good frame followed by one whose header or pixels are cut short or malformed, then the bad frame as a file of its own:
+// every reader has to report it instead of exiting or waiting forever for the end of a comment
+static int _check_bad_frames(IMAGE* src, DIFFCASE* dc) {
+
+    struct { const char* bytes; int expected; } bad[] = {
+        {"P5", -4},
+        {"P5\n# unterminated comment", -4},
+        {"P5\nabc", -2},
+        {"P5\n2 2", -4},
+        {"P5\n2 2 65535\n", -2},
+        {"P5\n2 2 255\nabc", -4},
+    };
+    int nbad = sizeof(bad)/sizeof(bad[0]);
+
+    char path[64];
+    snprintf(path, sizeof(path), "difftest_%d_badframes.pnm", (int)getpid());
+
+    IMAGE got = {0};
+    int res = 0;
+    for (int i = 0; i < nbad && res == 0; i++) {
+        FILE* fd = NULL;
+        if (save_pnm_image(path, src, PGM) != 0 || (fd = fopen(path, "ab")) == NULL || fputs(bad[i].bytes, fd) == EOF) {
+            printf("Error writing %s\n", path);
+            if (fd != NULL) fclose(fd);
+            res = -1;
+            break;
+        }
+        fclose(fd);
+
+        ROWREADER reader;
+        int fres[2] = {-1, -1};
+        if (open_frame_reader(path, &reader) == 0) {
+            fres[0] = read_frame(&reader, &got, PGM);
+            fres[1] = read_frame(&reader, &got, PGM);
+            close_row_reader(&reader);
+        }
+
+        fd = fopen(path, "wb");
+        if (fd == NULL || fputs(bad[i].bytes, fd) == EOF) {
+            printf("Error writing %s\n", path);
+            if (fd != NULL) fclose(fd);
+            res = -1;
+            break;
+        }
+        fclose(fd);
+
+        int lres = load_pnm_image(path, &got, PGM);
+        PNMFILE file;
+        int ores = open_pnm_file(path, &file, PGM, 0);
+        if (ores == 0) close_pnm_file(&file);
+
+        if (fres[0] != 0 || fres[1] != bad[i].expected || lres != bad[i].expected || ores != bad[i].expected) {
+            printf("bad frame %d: expected %d, got read_frame %d then %d, load_pnm_image %d, open_pnm_file %d [%ux%u, seed %u]\n",
+                   i, bad[i].expected, fres[0], fres[1], lres, ores, dc->width, dc->height, dc->seed);
+            res = -1;
+        }
+    }
+
+    remove(path);
+    free_img_pxmat(&got);
+    return res;
+}
+
+// images computed into the buffers of an async writer, each one from the one handed over just before (still being written),
+// then read back from their files
+static int _check_async(IMAGE* src, DIFFCASE* dc) {
+
+    enum { NIMAGES = 4 };
+    char paths[NIMAGES][64];
+    IMAGE expected[NIMAGES];
+
+    ASYNCWRITER writer;
+    if (async_writer_init(&writer, ASYNC_WRITER_BUFFERS) != 0) {
+        printf("async_writer_init: failed\n");
+        return -1;
+    }
+
+    IMAGE* prev = src;
+    for (int i = 0; i < NIMAGES; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "difftest_%d_async%d.ppm", (int)getpid(), i);
+
+        // a buffer taken and given back unused doesn't change the order they go round in
+        if (i == 1) {
+            async_release(&writer, async_acquire(&writer));
+        }
+
+        IMAGE* img = async_acquire(&writer);
+        img->mat = pxrealloc(img->mat, src->width, src->height);
+        if (img->mat == NULL || _new_image(&expected[i], src) != 0) return -1;
+        img->width = src->width;
+        img->height = src->height;
+        img->img_type = PPM;
+
+        for (int r = 0; r < src->height; r++) {
+            for (int c = 0; c < src->width; c++) {
+                for (int ch = 0; ch < 3; ch++) {
+                    BYTE v = 255 - (&prev->mat[r][c].cpx.r)[(ch + 1) % 3];
+                    (&img->mat[r][c].cpx.r)[ch] = v;
+                    (&expected[i].mat[r][c].cpx.r)[ch] = v;
+                }
+            }
+        }
+
+        if (async_write(&writer, img, paths[i], PPM) != 0) {
+            printf("async_write: failed\n");
+            return -1;
+        }
+        prev = img;
+    }
+
+    int res = (async_writer_close(&writer) == 0) ? 0 : -1;
+    if (res != 0) {
+        printf("async_writer_close: %d writes failed [%ux%u, seed %u]\n", writer.failed, dc->width, dc->height, dc->seed);
+    }
+
+    IMAGE got = {0};
+    for (int i = 0; i < NIMAGES; i++) {
+        if (res == 0) {
+            char name[64];
+            snprintf(name, sizeof(name), "async_write(%d)", i);
+            res = (load_pnm_image(paths[i], &got, PPM) == 0) ? _compare(name, &got, &expected[i], 3, dc) : -1;
+        }
+        remove(paths[i]);
+        free_img_pxmat(&expected[i]);
+    }
+    free_img_pxmat(&got);
+
+    return res;
+}
+
+// a pipeline spec of point ops, parsed into a single fused stage where the channel offsets in a row are merged into one
+// lookup table, against the same ops run one after the other over the whole image
+static int _check_pipeline(IMAGE* src, DIFFCASE* dc) {
+
+    char inpath[64], outpath[64], spec[512];
+    snprintf(inpath, sizeof(inpath), "difftest_%d_pipein.ppm", (int)getpid());
+    snprintf(outpath, sizeof(outpath), "difftest_%d_pipeout.pgm", (int)getpid());
+
+    int k1 = dc->seed % 61;
+    int k2 = (dc->seed >> 8) % 41;
+    int thresh = 40 + (dc->seed >> 16) % 176;
+    snprintf(spec, sizeof(spec), "read %s | rgb2yuv | v+=%d | u-=15 | y+=7 | v-=4 | yuv2rgb | invert | rgb2ycbcr | cr+=25 | cb-=%d | ycbcr2rgb"
+             " | select g | thresh %d | write %s", inpath, k1, k2, thresh, outpath);
+
+    if (save_pnm_image(inpath, src, PPM) != 0) {
+        printf("Error writing %s\n", inpath);
+        return -1;
+    }
+
+    PIPELINE pipe;
+    int res = parse_pipeline(spec, &pipe);
+    // read, a single point stage and write. The point stage holds the 4 conversions and select, then the offsets
+    // before `yuv2rgb`, `invert`, the offsets before `ycbcr2rgb` and `thresh` as one table each
+    if (res == 0 && (pipe.nstages != 3 || pipe.stages[1].kind != STAGE_POINT || pipe.stages[1].nops != 9)) {
+        printf("parse_pipeline: point ops weren't fused (%d stages, %d ops in the second one)\n", pipe.nstages, pipe.stages[1].nops);
+        res = -1;
+    }
+    if (res == 0) {
+        res = run_pipeline(&pipe);
+    }
+    free_pipeline(&pipe);
+
+    IMAGE got = {0}, expected;
+    if (res != 0 || load_pnm_image(outpath, &got, PGM) != 0 || _new_image(&expected, src) != 0) {
+        printf("pipeline: failed (%d) [%ux%u, seed %u]\n", res, dc->width, dc->height, dc->seed);
+        remove(inpath);
+        remove(outpath);
+        free_img_pxmat(&got);
+        return -1;
+    }
+
+    copy_pxmat(expected.mat, src->mat, src->width, src->height);
+    _oracle_convert(&expected, &expected, RGB2YUV);
+    // YUV is stored as Y, U, V in the R, G, B channels
+    _oracle_add(&expected, 2, k1);
+    _oracle_add(&expected, 1, -15);
+    _oracle_add(&expected, 0, 7);
+    _oracle_add(&expected, 2, -4);
+    _oracle_convert(&expected, &expected, YUV2RGB);
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            RGBPIXEL* px = &expected.mat[r][c].cpx;
+            set_rgbpixel(px, 255 - px->r, 255 - px->g, 255 - px->b);
+        }
+    }
+    _oracle_convert(&expected, &expected, RGB2YCBCR);
+    _oracle_add(&expected, 2, 25);
+    _oracle_add(&expected, 1, -k2);
+    _oracle_convert(&expected, &expected, YCBCR2RGB);
+    for (int r = 0; r < src->height; r++) {
+        for (int c = 0; c < src->width; c++) {
+            expected.mat[r][c].gpx.v = expected.mat[r][c].cpx.g;
+        }
+    }
+    _oracle_thresh(&expected, thresh);
+
+    res = _compare("pipeline", &got, &expected, 1, dc);
+
+    remove(inpath);
+    remove(outpath);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    return res;
+}
+
+static int _check_graph(IMAGE* src, DIFFCASE* dc) {
+
+    IMAGE got, expected, tmp;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0 || _new_image(&tmp, src) != 0) return -1;
+
+    // blur -> gradient -> threshold -> dilation, materialized one op at a time
+    _oracle_blur(blur_gpx_square, &expected, src, dc->radius);
+    _oracle_grad(&tmp, &expected);
+    _oracle_thresh(&tmp, 20);
+    _oracle_morpho(dilate_px, &expected, &tmp, dc->radius);
+
+    GRAPH graph;
+    graph_init(&graph);
+    // small tiles on small images so every tile border and halo gets exercised,
+    // big images keep the tile size picked from the cache size
+    if (dc->width*dc->height < 256*256) graph.tile_size = 1 + dc->seed % 40;
+
+    GRAPHNODE* node = graph_source(&graph, src);
+    node = graph_blur(&graph, node, blur_gpx_square, dc->radius);
+    node = graph_gradient(&graph, node);
+    node = graph_thresh(&graph, node, 20);
+    node = graph_dilate(&graph, node, dc->radius);
+
+    int res = graph_eval(&graph, node, &got);
+    if (res != 0) {
+        printf("graph_eval: failed (%d)\n", res);
+    } else {
+        res = _compare("graph_eval(blur,gradient,thresh,dilate)", &got, &expected, 1, dc);
+    }
+
+    free_graph(&graph);
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    free_img_pxmat(&tmp);
+    return res;
+}
+
+// apron pixel (r, c) of `pad_img()`, worked out from the definition of each mode
+static int _oracle_border(int i, int n, BORDERMODE mode) {
+    if (i >= 0 && i < n) return i;
+    if (mode == BORDER_REPLICATE) return (i < 0) ? 0 : n - 1;
+    if (mode != BORDER_REFLECT) return -1;
+
+    // reflecting is periodic over 2*(n-1): abcdcb abcdcb...
+    if (n == 1) return 0;
+    int period = 2*(n - 1);
+    int k = ((i % period) + period) % period;
+    return (k < n) ? k : period - k;
+}
+
+static int _check_pad(IMAGE* src, DIFFCASE* dc) {
+
+    BORDERMODE modes[] = {BORDER_EXCLUDED, BORDER_REPLICATE, BORDER_REFLECT, BORDER_CONSTANT};
+    char* names[] = {"pad_img(excluded)", "pad_img(replicate)", "pad_img(reflect)", "pad_img(constant)"};
+    PIXEL value = {.gpx = {77}};
+    // aprons wider than small images, so reflections fold more than once
+    int pad = dc->radius + (int)(dc->seed % 7);
+
+    for (int m = 0; m < 4; m++) {
+        PADDEDIMG padded;
+        if (pad_img(&padded, src, pad, modes[m], value) != 0) {
+            printf("%s: failed\n", names[m]);
+            return -1;
+        }
+
+        for (int r = -pad; r < (int)src->height + pad; r++) {
+            for (int c = -pad; c < (int)src->width + pad; c++) {
+                int sr = _oracle_border(r, src->height, modes[m]);
+                int sc = _oracle_border(c, src->width, modes[m]);
+
+                int expected = 0;
+                if (sr >= 0 && sc >= 0) expected = src->mat[sr][sc].gpx.v;
+                else if (modes[m] == BORDER_CONSTANT) expected = value.gpx.v;
+
+                if (padded.rows[r][c].gpx.v != expected) {
+                    printf("%s: first mismatch at (r=%d, c=%d): got %d, expected %d [%ux%u, pad %d, seed %u]\n",
+                        names[m], r, c, padded.rows[r][c].gpx.v, expected, dc->width, dc->height, pad, dc->seed);
+                    free_padded_img(&padded);
+                    return -1;
+                }
+            }
+        }
+
+        free_padded_img(&padded);
+    }
+
+    return 0;
+}
+
+// ops given views must give what they give on copies of the same pixels, and leave every pixel
+// (or channel) outside of the view as it was
+static int _check_view(IMAGE* src, DIFFCASE* dc) {
+
+    int h = 1 + dc->seed % src->height;
+    int w = 1 + (dc->seed >> 8) % src->width;
+    int r0 = (dc->seed >> 16) % (src->height - h + 1);
+    int c0 = (dc->seed >> 20) % (src->width - w + 1);
+    int chan = dc->seed % 3;
+    int other = (chan + 1) % 3;
+
+    IMAGE big, crop, got, expected, roi;
+    IMAGE cview = {0}, oview = {0};
+    if (_new_image(&big, src) != 0) return -1;
+    copy_pxmat(big.mat, src->mat, src->width, src->height);
+
+    if (view_img(&roi, &big, r0, c0, w, h) != 0 || view_img(&crop, src, r0, c0, w, h) != 0) {
+        printf("view_img: failed [%ux%u, window %dx%d at (%d, %d)]\n", dc->width, dc->height, w, h, r0, c0);
+        return -1;
+    }
+    // owned copy of the window, the reference every op on the view is compared to
+    IMAGE tmp = crop;
+    copy_img(&crop, &tmp);
+    free_img_pxmat(&tmp);
+
+    if (_new_image(&got, &crop) != 0 || _new_image(&expected, &crop) != 0) return -1;
+
+    // reading through a window
+    apply_blur2img(blur_rgbpx_square, &got, &roi, dc->radius);
+    apply_blur2img(blur_rgbpx_square, &expected, &crop, dc->radius);
+    int res = _compare("apply_blur2img(window)", &got, &expected, 3, dc);
+
+    // writing through a window, which must not spill out of it
+    if (res == 0) {
+        bin_rgbthresh_img(&roi, 100, 150, 200, 0, 255);
+        bin_rgbthresh_img(&crop, 100, 150, 200, 0, 255);
+        res = _compare("bin_rgbthresh_img(window)", &roi, &crop, 3, dc);
+    }
+    for (int r = 0; r < src->height && res == 0; r++) {
+        for (int c = 0; c < src->width && res == 0; c++) {
+            if ((r < r0 || r >= r0 + h || c < c0 || c >= c0 + w) && memcmp(&big.mat[r][c], &src->mat[r][c], sizeof(PIXEL)) != 0) {
+                printf("bin_rgbthresh_img(window): pixel (r=%d, c=%d) outside of the window changed [%ux%u, seed %u]\n", r, c, dc->width, dc->height, dc->seed);
+                res = -1;
+            }
+        }
+    }
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    free_img_pxmat(&roi);
+    free_img_pxmat(&crop);
+
+    // a channel eroded into another channel of the same image, then inverted in place
+    copy_pxmat(big.mat, src->mat, src->width, src->height);
+    IMAGE gray = {.width = src->width, .height = src->height, .img_type = PGM};
+    IMAGE grayout = gray;
+    if (res == 0 && (channel_view_img(&cview, &big, chan) != 0 || channel_view_img(&oview, &big, other) != 0
+        || _new_image(&gray, &gray) != 0 || _new_image(&grayout, &grayout) != 0)) {
+        printf("channel_view_img: failed\n");
+        return -1;
+    }
+
+    if (res == 0) {
+        extr_rchan_pxmat(gray.mat, cview.mat, src->width, src->height);
+        erode_img(&grayout, &gray, dc->radius);
+        erode_img(&oview, &cview, dc->radius);
+        res = _compare("erode_img(channel view)", &oview, &grayout, 1, dc);
+    }
+    if (res == 0) {
+        invert_gimg(&gray);
+        invert_gimg(&cview);
+        res = _compare("invert_gimg(channel view)", &cview, &gray, 1, dc);
+    }
+    for (int r = 0; r < src->height && res == 0; r++) {
+        for (int c = 0; c < src->width && res == 0; c++) {
+            int third = 3 - chan - other;
+            if ((&big.mat[r][c].cpx.r)[third] != (&src->mat[r][c].cpx.r)[third]) {
+                printf("channel views: channel %d of pixel (r=%d, c=%d) changed [%ux%u, seed %u]\n", third, r, c, dc->width, dc->height, dc->seed);
+                res = -1;
+            }
+        }
+    }
+
+    if (cview.mat != NULL) free_img_pxmat(&cview);
+    if (oview.mat != NULL) free_img_pxmat(&oview);
+    free_img_pxmat(&gray);
+    free_img_pxmat(&grayout);
+    free_img_pxmat(&big);
+    return res;
+}
+
+// rectangles read straight from a file, with pread and from a mapping, against the same window of the whole image
+static int _check_roi(IMAGE* src, DIFFCASE* dc) {
+
+    IMGTYPE types[] = {PGM, PPM};
+    char path[64];
+    int res = 0;
+
+    for (int t = 0; t < 2 && res == 0; t++) {
+        snprintf(path, sizeof(path), "difftest_%d_roi.p%cm", (int)getpid(), types[t] == PGM ? 'g' : 'p');
+        if (save_pnm_image(path, src, types[t]) != 0) {
+            printf("Error writing %s\n", path);
+            return -1;
+        }
+
+        unsigned int x = dc->seed;
+        for (int i = 0; i < 4 && res == 0; i++) {
+            int h = 1 + _next_rand(&x) % src->height;
+            int w = 1 + _next_rand(&x) % src->width;
+            int r0 = _next_rand(&x) % (src->height - h + 1);
+            int c0 = _next_rand(&x) % (src->width - w + 1);
+            int use_mmap = i % 2;
+
+            IMAGE got = {0}, window;
+            PNMFILE file;
+            if (open_pnm_file(path, &file, types[t], use_mmap) != 0 || read_pnm_roi(&file, &got, r0, c0, w, h) != 0) {
+                printf("read_pnm_roi: failed [%ux%u, window %dx%d at (%d, %d)]\n", dc->width, dc->height, w, h, r0, c0);
+                res = -1;
+            }
+            close_pnm_file(&file);
+
+            if (res == 0 && view_img(&window, src, r0, c0, w, h) == 0) {
+                res = _compare(use_mmap ? "read_pnm_roi(mmap)" : "read_pnm_roi(pread)", &got, &window, types[t] == PPM ? 3 : 1, dc);
+                free_img_pxmat(&window);
+            }
+            free_img_pxmat(&got);
+        }
+
+        // and a rectangle sticking out of the image is refused
+        IMAGE got = {0};
+        if (res == 0 && load_pnm_roi(path, &got, types[t], 0, 1, src->width, 1) != -1) {
+            printf("load_pnm_roi: accepted a window out of a %ux%u image\n", dc->width, dc->height);
+            res = -1;
+        }
+        free_img_pxmat(&got);
+
+        remove(path);
+    }
+
+    return res;
+}
+
+// steps of `_run_banded()`: a closing (dilation then erosion), or blurs repeated `nsteps` times
+static void _close_step(int i, IMAGE* dest, IMAGE* src, void* arg) {
+    int radius = *(int*)arg;
+    if (i == 0) dilate_img(dest, src, radius);
+    else erode_img(dest, src, radius);
+}
+
+static void _blur_step(int i, IMAGE* dest, IMAGE* src, void* arg) {
+    apply_blur2img(blur_gpx_square, dest, src, *(int*)arg);
+}
+
+// without a memory budget the bands are a single row high, the worst case for the halos.
+// That recomputes every row `2*reach + 1` times, so big cases are left to the other checks
+static int _check_banded(IMAGE* src, DIFFCASE* dc) {
+
+    if (dc->width*dc->height >= 256*256) return 0;
+
+    IMAGE got, expected, tmp;
+    if (_new_image(&got, src) != 0 || _new_image(&expected, src) != 0 || _new_image(&tmp, src) != 0) return -1;
+
+    _oracle_morpho(dilate_px, &tmp, src, dc->radius);
+    _oracle_morpho(erode_px, &expected, &tmp, dc->radius);
+
+    int res = _run_banded(&got, src, 2, dc->radius, _close_step, &dc->radius);
+    if (res == 0) {
+        res = _compare("_run_banded(dilate,erode)", &got, &expected, 1, dc);
+    }
+
+    if (res == 0) {
+        _oracle_blur(blur_gpx_square, &tmp, src, dc->radius);
+        _oracle_blur(blur_gpx_square, &expected, &tmp, dc->radius);
+        _oracle_blur(blur_gpx_square, &tmp, &expected, dc->radius);
+
+        res = _run_banded(&got, src, 3, dc->radius, _blur_step, &dc->radius);
+        if (res == 0) {
+            res = _compare("_run_banded(blur x3)", &got, &tmp, 1, dc);
+        }
+    }
+
+    free_img_pxmat(&got);
+    free_img_pxmat(&expected);
+    free_img_pxmat(&tmp);
+    return res;
+}
+
+static DIFFCHECK _checks[] = {
+    {"blur_gpx_square",   PGM, _check_blur_gsquare},
+    {"blur_gpx_cross",    PGM, _check_blur_gcross},
+    {"blur_rgbpx_square", PPM, _check_blur_rgbsquare},
+    {"blur_rgbpx_cross",  PPM, _check_blur_rgbcross},
+    {"erode",             PGM, _check_erode},
+    {"dilate",            PGM, _check_dilate},
+    {"grad",              PGM, _check_grad},
+    {"convert",           PPM, _check_convert},
+    {"point",             PGM, _check_point},
+    {"profiles",          PGM, _check_profiles},
+    {"geom",              PPM, _check_geom},
+    {"scale",             PPM, _check_scale},
+    {"warp",              PPM, _check_warp},
+    {"stream",            PGM, _check_stream},
+    {"split",             PPM, _check_split},
+    {"frames",            PPM, _check_frames},
+    {"bad_frames",        PGM, _check_bad_frames},
+    {"async",             PPM, _check_async},
+    {"pipeline",          PPM, _check_pipeline},
+    {"graph",             PGM, _check_graph},
+    {"banded",            PGM, _check_banded},
+    {"pad",               PGM, _check_pad},
+    {"view",              PPM, _check_view},
+    {"roi",               PPM, _check_roi},
+};
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc > 4) {
+        printf("Expected usage: %s [ncases] [seed] [check name]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int ncases = (argc > 1) ? atoi(argv[1]) : DIFF_DEFAULT_CASES;
+    unsigned int x = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10) : DIFF_DEFAULT_SEED;
+    char* only = (argc > 3) ? argv[3] : NULL;
+    if (x == 0) x = 1;
+    unsigned int seed = x;
+
+    int nchecks = 0;
+
+    for (int i = 0; i < ncases; i++) {
+        DIFFCASE dc;
+
+        // mostly small images with every shape of border (1xN, Nx1, smaller than the radius...),
+        // and from time to time one big enough to be split into tiles
+        if (i % DIFF_BIG_EVERY == DIFF_BIG_EVERY-1) {
+            dc.width = 256 + _next_rand(&x) % 200;
+            dc.height = 256 + _next_rand(&x) % 200;
+        } else {
+            dc.width = 1 + _next_rand(&x) % 40;
+            dc.height = 1 + _next_rand(&x) % 40;
+        }
+        dc.radius = _next_rand(&x) % (DIFF_MAX_RADIUS+1);
+        dc.content = _next_rand(&x) % _CONTENTEND;
+        dc.seed = _next_rand(&x);
+
+        IMAGE src = {.width = dc.width, .height = dc.height};
+        src.mat = pxalloc(dc.width, dc.height);
+        if (src.mat == NULL) {
+            printf("Error allocating a %ux%u image\n", dc.width, dc.height);
+            exit(EXIT_FAILURE);
+        }
+        _fill_image(&src, dc.content, dc.seed);
+
+        for (int k = 0; k < sizeof(_checks)/sizeof(DIFFCHECK); k++) {
+            if (only != NULL && strcmp(only, _checks[k].name) != 0) continue;
+
+            src.img_type = _checks[k].type;
+            if (_checks[k].check(&src, &dc) != 0) {
+                printf("FAILED after %d checks (rerun with: %s %d %u %s)\n", nchecks, argv[0], ncases, seed, _checks[k].name);
+                free_img_pxmat(&src);
+                return EXIT_FAILURE;
+            }
+            nchecks++;
+        }
+
+        free_img_pxmat(&src);
+    }
+
+    printf("%d checks over %d randomized cases matched their reference\n", nchecks, ncases);
+
+    return 0;
+}